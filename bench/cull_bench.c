@@ -0,0 +1,125 @@
+// Microbenchmark of the CPU frustum culling kernels.
+//
+// Culls 1M random bounding spheres, of which about one in sixteen is visible,
+// with every kernel the CPU supports on one thread and then with the
+// widest kernel spread over an increasing number of job workers.
+//
+// Build and run with `make bench`.
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../debug/print.h"
+#include "../utils/cpu_culling.h"
+
+#define OBJECT_COUNT (1u << 20)
+#define REPETITIONS 50
+
+static double now_ms()
+{
+        struct timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return time.tv_sec * 1000.0 + time.tv_nsec / 1000000.0;
+}
+
+static float random_float(float min, float max)
+{
+        return min + (max - min) * ((float) rand() / (float) RAND_MAX);
+}
+
+static void report(const char *name, uint32_t workers, double ms,
+                uint32_t visible)
+{
+        printf("%-8s %3u worker(s) %8.3f ms %8.1f Mobjects/s %u visible\n",
+                        name, workers, ms,
+                        OBJECT_COUNT / ms / 1000.0, visible);
+}
+
+int main()
+{
+        // Same clip space box as the culling shader, open near and far
+        const vec4 planes[CULL_PLANE_COUNT] = {
+                { 1.0f,  0.0f, 0.0f, 1.0f},
+                {-1.0f,  0.0f, 0.0f, 1.0f},
+                { 0.0f,  1.0f, 0.0f, 1.0f},
+                { 0.0f, -1.0f, 0.0f, 1.0f},
+                { 0.0f,  0.0f, 0.0f, 1.0f},
+                { 0.0f,  0.0f, 0.0f, 1.0f},
+        };
+
+        struct CullBounds bounds;
+        create_cull_bounds(OBJECT_COUNT, &bounds);
+        srand(1);
+        for (uint32_t i = 0; i < OBJECT_COUNT; i++)
+                set_cull_bound(&bounds, i,
+                                random_float(-4.0f, 4.0f),
+                                random_float(-4.0f, 4.0f),
+                                random_float(-1.0f, 1.0f),
+                                random_float(0.0f, 0.05f));
+
+        uint32_t *expected = malloc(OBJECT_COUNT * sizeof(uint32_t));
+        uint32_t *visible = malloc(OBJECT_COUNT * sizeof(uint32_t));
+        uint32_t expectedCount = cull_bounds(&bounds, planes,
+                        CULL_KERNEL_SCALAR, expected);
+
+        const enum CullKernel kernels[] = {
+                CULL_KERNEL_SCALAR,
+                CULL_KERNEL_SSE,
+                CULL_KERNEL_AVX2,
+                CULL_KERNEL_NEON
+        };
+        for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+                if (!is_cull_kernel_supported(kernels[k]))
+                        continue;
+
+                uint32_t count = 0;
+                double start = now_ms();
+                for (size_t r = 0; r < REPETITIONS; r++)
+                        count = cull_bounds(&bounds, planes, kernels[k],
+                                        visible);
+                double ms = (now_ms() - start) / REPETITIONS;
+
+                if (count != expectedCount ||
+                                memcmp(visible, expected,
+                                        count * sizeof(uint32_t)) != 0) {
+                        fprintf(stderr, "%s kernel disagrees with scalar!\n",
+                                        cull_kernel_name(kernels[k]));
+                        return EXIT_FAILURE;
+                }
+                report(cull_kernel_name(kernels[k]), 1, ms, count);
+        }
+
+        enum CullKernel kernel = detect_cull_kernel();
+        long coreCount = sysconf(_SC_NPROCESSORS_ONLN);
+        for (long workers = 2; workers <= coreCount; workers *= 2) {
+                struct JobSystem jobSystem;
+                create_job_system(workers - 1, &jobSystem);
+
+                uint32_t count = 0;
+                double start = now_ms();
+                for (size_t r = 0; r < REPETITIONS; r++)
+                        count = cull_bounds_parallel(&jobSystem, &bounds,
+                                        planes, kernel, visible);
+                double ms = (now_ms() - start) / REPETITIONS;
+
+                if (count != expectedCount ||
+                                memcmp(visible, expected,
+                                        count * sizeof(uint32_t)) != 0) {
+                        fprintf(stderr, "Parallel culling disagrees with scalar!\n");
+                        return EXIT_FAILURE;
+                }
+                report(cull_kernel_name(kernel), workers, ms, count);
+
+                destroy_job_system(&jobSystem);
+        }
+
+        free(visible);
+        free(expected);
+        destroy_cull_bounds(&bounds);
+        log_flush();
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,139 @@
+// Scaling benchmark of the job system.
+//
+// Runs a batch of small jobs, each of which starts child jobs and waits
+// on them, with 1 to all cores as workers. Reports throughput per worker
+// count and checks that every job ran exactly once.
+//
+// Build and run with `make bench`.
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../debug/print.h"
+#include "../utils/job_system.h"
+
+#define PARENT_JOB_COUNT 4096
+#define CHILD_JOB_COUNT 16
+// Iterations of busy work per job, a few microseconds
+#define JOB_WORK 1000
+#define REPETITIONS 5
+
+struct ParentJob {
+        struct JobSystem *p_job_system;
+        atomic_uint *p_completed;
+};
+
+static double now_ms()
+{
+        struct timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return time.tv_sec * 1000.0 + time.tv_nsec / 1000000.0;
+}
+
+static void busy_work()
+{
+        volatile uint32_t value = 1;
+        for (uint32_t i = 0; i < JOB_WORK; i++)
+                value = value * 1664525u + 1013904223u;
+}
+
+static void child_job(void *p_data)
+{
+        busy_work();
+        atomic_fetch_add_explicit((atomic_uint *) p_data, 1,
+                        memory_order_relaxed);
+}
+
+// Depends on its children, which other workers may steal while this
+// one waits
+static void parent_job(void *p_data)
+{
+        struct ParentJob *p_parent = p_data;
+        busy_work();
+
+        struct Job children[CHILD_JOB_COUNT];
+        for (size_t i = 0; i < CHILD_JOB_COUNT; i++) {
+                children[i].function = child_job;
+                children[i].p_data = p_parent->p_completed;
+        }
+
+        struct JobCounter counter = {};
+        run_jobs(p_parent->p_job_system, children, CHILD_JOB_COUNT,
+                        &counter);
+        wait_for_counter(p_parent->p_job_system, &counter);
+
+        atomic_fetch_add_explicit(p_parent->p_completed, 1,
+                        memory_order_relaxed);
+}
+
+static double run_batch(struct JobSystem *p_job_system)
+{
+        static struct ParentJob parents[PARENT_JOB_COUNT];
+        static struct Job jobs[PARENT_JOB_COUNT];
+        atomic_uint completed = 0;
+
+        for (size_t i = 0; i < PARENT_JOB_COUNT; i++) {
+                parents[i].p_job_system = p_job_system;
+                parents[i].p_completed = &completed;
+                jobs[i].function = parent_job;
+                jobs[i].p_data = &parents[i];
+        }
+
+        double start = now_ms();
+        struct JobCounter counter = {};
+        run_jobs(p_job_system, jobs, PARENT_JOB_COUNT, &counter);
+        wait_for_counter(p_job_system, &counter);
+        double ms = now_ms() - start;
+
+        uint32_t expected = PARENT_JOB_COUNT * (CHILD_JOB_COUNT + 1);
+        if (atomic_load(&completed) != expected) {
+                fprintf(stderr, "Ran %u jobs instead of %u!\n",
+                                atomic_load(&completed), expected);
+                exit(EXIT_FAILURE);
+        }
+
+        return ms;
+}
+
+// Doubles the workers, ending on all cores even when their count is not
+// a power of two
+static long next_worker_count(long workers, long core_count)
+{
+        if (workers < core_count && workers * 2 > core_count)
+                return core_count;
+        return workers * 2;
+}
+
+int main()
+{
+        uint32_t jobCount = PARENT_JOB_COUNT * (CHILD_JOB_COUNT + 1);
+        long coreCount = sysconf(_SC_NPROCESSORS_ONLN);
+        double singleWorkerMs = 0.0;
+
+        for (long workers = 1; workers <= coreCount;
+                        workers = next_worker_count(workers, coreCount)) {
+                struct JobSystem jobSystem;
+                create_job_system(workers - 1, &jobSystem);
+
+                // The first batch warms up the threads and caches
+                run_batch(&jobSystem);
+                double ms = 0.0;
+                for (size_t r = 0; r < REPETITIONS; r++)
+                        ms += run_batch(&jobSystem);
+                ms /= REPETITIONS;
+
+                if (workers == 1)
+                        singleWorkerMs = ms;
+                printf("%3ld worker(s) %8.3f ms %8.2f Mjobs/s %5.2fx\n",
+                                workers, ms, jobCount / ms / 1000.0,
+                                singleWorkerMs / ms);
+
+                destroy_job_system(&jobSystem);
+        }
+
+        log_flush();
+        return EXIT_SUCCESS;
+}
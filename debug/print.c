@@ -1,11 +1,362 @@
-#include <stdio.h>
+#include <pthread.h>
+#include <semaphore.h>
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#include "print.h"
+
+// Number of queued messages, must be a power of two
+#define LOG_RING_SIZE 512
+#define LOG_RECORD_SIZE 512
+
+// Each call site may log this many messages per second,
+// repeats beyond that are counted and summarized instead.
+#define RATE_LIMIT_BURST 10
+#define RATE_LIMIT_SLOTS 64
+#define RATE_LIMIT_PROBES 8
+
+// How long log_flush() sleeps between checks on the writer
+#define FLUSH_INTERVAL_NS 2000000
+
+
+// A slot in the ring. The sequence number tells producers and the
+// consumer whose turn it is, so no locks are needed (bounded MPMC queue
+// after Dmitry Vyukov, with a single consumer).
+struct LogRecord {
+        atomic_size_t sequence;
+        FILE *p_out;
+        char message[LOG_RECORD_SIZE];
+};
+
+// Call sites are told apart by their format string, which the macros in
+// print.h make unique per message. A slot whose call site has been quiet
+// for the current second is handed to another one when its probes are
+// all taken, so the table never fills up for good.
+struct RateLimit {
+        _Atomic(const char *) site;
+        atomic_uint window;
+        atomic_uint count;
+        atomic_uint suppressed;
+};
+
+static struct LogRecord ring[LOG_RING_SIZE];
+static atomic_size_t enqueuePosition;
+// Only touched by the writer thread
+static size_t dequeuePosition;
+
+static struct RateLimit rateLimits[RATE_LIMIT_SLOTS];
+static atomic_uint droppedCount;
+
+static pthread_once_t startOnce = PTHREAD_ONCE_INIT;
+static pthread_t writerThread;
+// Posted for every queued or dropped message and to stop the writer
+static sem_t writerWakeup;
+static atomic_bool writerRunning;
+static atomic_bool writerStarted;
+
+
+static bool drain_one()
+{
+        struct LogRecord *p_record =
+                &ring[dequeuePosition & (LOG_RING_SIZE - 1)];
+        size_t sequence = atomic_load_explicit(&p_record->sequence,
+                        memory_order_acquire);
+        if (sequence != dequeuePosition + 1)
+                return false;
+
+        fputs(p_record->message, p_record->p_out);
+
+        atomic_store_explicit(&p_record->sequence,
+                        dequeuePosition + LOG_RING_SIZE,
+                        memory_order_release);
+        dequeuePosition++;
+        return true;
+}
+
+static void drain()
+{
+        bool wrote = false;
+        while (drain_one())
+                wrote = true;
+
+        unsigned int dropped = atomic_exchange(&droppedCount, 0);
+        if (dropped > 0) {
+                fprintf(stderr, YELLOW "[WARNING] Log queue full, "
+                                "dropped %u messages\n" NORMAL, dropped);
+                wrote = true;
+        }
+
+        if (wrote) {
+                fflush(stdout);
+                fflush(stderr);
+        }
+}
+
+static void *writer_main(void *p_unused)
+{
+        (void) p_unused;
+
+        // Several posts may be handled by one drain, the leftover ones
+        // only cost a look at an empty ring
+        while (atomic_load(&writerRunning)) {
+                while (sem_wait(&writerWakeup) != 0)
+                        ;
+                drain();
+        }
+
+        // Whatever was queued before the stop request
+        drain();
+        return NULL;
+}
+
+// The part of a call site's format string that identifies it in the
+// suppression summary, without the color and the trailing newline
+static const char *site_name(const char *fmt, int *p_length)
+{
+        if (fmt[0] == '\x1B' && strchr(fmt, 'm') != NULL)
+                fmt = strchr(fmt, 'm') + 1;
+
+        size_t length = strcspn(fmt, "\n\x1B");
+        *p_length = length < 60 ? (int) length : 60;
+        return fmt;
+}
+
+static void report_suppressed()
+{
+        for (size_t i = 0; i < RATE_LIMIT_SLOTS; i++) {
+                const char *site = atomic_load(&rateLimits[i].site);
+                unsigned int suppressed =
+                        atomic_exchange(&rateLimits[i].suppressed, 0);
+                if (site == NULL || suppressed == 0)
+                        continue;
+
+                int length;
+                const char *name = site_name(site, &length);
+                fprintf(stderr, YELLOW "[WARNING] Suppressed %u repeats "
+                                "of: %.*s\n" NORMAL, suppressed, length, name);
+        }
+}
+
+static void stop_writer()
+{
+        if (!atomic_load(&writerStarted))
+                return;
+
+        atomic_store(&writerRunning, false);
+        sem_post(&writerWakeup);
+        pthread_join(writerThread, NULL);
+        atomic_store(&writerStarted, false);
+
+        report_suppressed();
+        fflush(stderr);
+}
+
+static void start_writer()
+{
+        for (size_t i = 0; i < LOG_RING_SIZE; i++)
+                atomic_init(&ring[i].sequence, i);
+
+        if (sem_init(&writerWakeup, 0, 0) != 0)
+                return;
+
+        atomic_store(&writerRunning, true);
+        if (pthread_create(&writerThread, NULL, writer_main, NULL) != 0) {
+                sem_destroy(&writerWakeup);
+                return;
+        }
+
+        atomic_store(&writerStarted, true);
+        // error() is usually followed by exit(), flush on the way out
+        atexit(stop_writer);
+}
+
+static unsigned int current_second()
+{
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+        return (unsigned int) now.tv_sec;
+}
+
+// Formats into a buffer of LOG_RECORD_SIZE
+static void format_message(char *message, const char *fmt, va_list ap)
+{
+        int length = vsnprintf(message, LOG_RECORD_SIZE, fmt, ap);
+
+        // Keep truncated messages terminated and the color reset
+        static const char truncated[] = NORMAL "...\n";
+        if (length >= LOG_RECORD_SIZE)
+                memcpy(&message[LOG_RECORD_SIZE - sizeof(truncated)],
+                                truncated, sizeof(truncated));
+}
+
+static void enqueue(FILE *p_out, const char *message)
+{
+        size_t position = atomic_load_explicit(&enqueuePosition,
+                        memory_order_relaxed);
+        struct LogRecord *p_record;
+
+        for (;;) {
+                p_record = &ring[position & (LOG_RING_SIZE - 1)];
+                size_t sequence = atomic_load_explicit(&p_record->sequence,
+                                memory_order_acquire);
+                intptr_t difference = (intptr_t) sequence - (intptr_t) position;
+
+                if (difference == 0) {
+                        if (atomic_compare_exchange_weak_explicit(
+                                                &enqueuePosition, &position,
+                                                position + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed))
+                                break;
+                } else if (difference < 0) {
+                        // Full, the writer has fallen behind
+                        atomic_fetch_add(&droppedCount, 1);
+                        sem_post(&writerWakeup);
+                        return;
+                } else {
+                        position = atomic_load_explicit(&enqueuePosition,
+                                        memory_order_relaxed);
+                }
+        }
+
+        p_record->p_out = p_out;
+        strcpy(p_record->message, message);
+
+        atomic_store_explicit(&p_record->sequence, position + 1,
+                        memory_order_release);
+        sem_post(&writerWakeup);
+}
+
+// FNV-1a over the format string, so that the slot does not depend on
+// where the linker put it
+static size_t hash_site(const char *fmt)
+{
+        uint_least64_t hash = 14695981039346656037u;
+        for (const char *c = fmt; *c != '\0'; c++) {
+                hash ^= (unsigned char) *c;
+                hash *= 1099511628211u;
+        }
+        return (size_t) hash;
+}
+
+// Summarizes what was held back from the call site since the last summary
+static void enqueue_suppressed(struct RateLimit *p_limit, const char *site)
+{
+        unsigned int suppressed = atomic_exchange(&p_limit->suppressed, 0);
+        if (suppressed == 0)
+                return;
+
+        int length;
+        const char *name = site_name(site, &length);
+        char summary[LOG_RECORD_SIZE];
+        snprintf(summary, sizeof(summary), YELLOW "[WARNING] Suppressed "
+                        "%u repeats of: %.*s\n" NORMAL,
+                        suppressed, length, name);
+        enqueue(stderr, summary);
+}
+
+// Finds the slot of the call site, claiming a free one or one that has
+// not been used this second if it has none yet
+static struct RateLimit *find_rate_limit(const char *fmt, unsigned int now)
+{
+        size_t first = hash_site(fmt) % RATE_LIMIT_SLOTS;
+
+        for (size_t i = 0; i < RATE_LIMIT_PROBES; i++) {
+                struct RateLimit *p_slot =
+                        &rateLimits[(first + i) % RATE_LIMIT_SLOTS];
+                const char *site = atomic_load(&p_slot->site);
+                if (site == NULL &&
+                                atomic_compare_exchange_strong(&p_slot->site,
+                                        &site, fmt))
+                        site = fmt;
+                if (site == fmt)
+                        return p_slot;
+        }
+
+        for (size_t i = 0; i < RATE_LIMIT_PROBES; i++) {
+                struct RateLimit *p_slot =
+                        &rateLimits[(first + i) % RATE_LIMIT_SLOTS];
+                const char *site = atomic_load(&p_slot->site);
+                if (atomic_load(&p_slot->window) == now)
+                        continue;
+
+                // The new call site starts with a window of its own
+                enqueue_suppressed(p_slot, site);
+                if (atomic_compare_exchange_strong(&p_slot->site, &site,
+                                        fmt)) {
+                        atomic_store(&p_slot->window, now);
+                        atomic_store(&p_slot->count, 0);
+                        return p_slot;
+                }
+        }
+
+        return NULL;
+}
+
+static bool is_rate_limited(const char *fmt)
+{
+        unsigned int now = current_second();
+        struct RateLimit *p_limit = find_rate_limit(fmt, now);
+
+        // Every nearby slot is busy this second, do not limit rather than
+        // lose messages
+        if (p_limit == NULL)
+                return false;
+
+        unsigned int window = atomic_load(&p_limit->window);
+        if (window != now &&
+                        atomic_compare_exchange_strong(&p_limit->window,
+                                &window, now)) {
+                atomic_store(&p_limit->count, 0);
+                enqueue_suppressed(p_limit, fmt);
+        }
+
+        if (atomic_fetch_add(&p_limit->count, 1) < RATE_LIMIT_BURST)
+                return false;
+
+        atomic_fetch_add(&p_limit->suppressed, 1);
+        return true;
+}
 
 void debug(FILE *p_out, const char *fmt, ...) {
+        pthread_once(&startOnce, start_writer);
+
         va_list ap;
         va_start(ap, fmt);
-        vfprintf(p_out, fmt, ap);
+
+        if (!atomic_load(&writerStarted)) {
+                // No writer thread, or already shut down
+                vfprintf(p_out, fmt, ap);
+        } else if (!is_rate_limited(fmt)) {
+                char message[LOG_RECORD_SIZE];
+                format_message(message, fmt, ap);
+                enqueue(p_out, message);
+        }
+
         va_end(ap);
 }
 
+void log_flush(void)
+{
+        if (!atomic_load(&writerStarted))
+                return;
+
+        // Wait until the writer has caught up with everything queued so far
+        size_t target = atomic_load(&enqueuePosition);
+        struct timespec interval = {0, FLUSH_INTERVAL_NS};
+        for (;;) {
+                struct LogRecord *p_record =
+                        &ring[(target - 1) & (LOG_RING_SIZE - 1)];
+                if (target == 0 || atomic_load_explicit(&p_record->sequence,
+                                        memory_order_acquire)
+                                >= target - 1 + LOG_RING_SIZE)
+                        return;
+                nanosleep(&interval, NULL);
+        }
+}
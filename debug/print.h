@@ -7,20 +7,48 @@
 
 #include <stdio.h>
 
+// Messages above LOG_LEVEL are compiled out entirely, their arguments
+// are not evaluated. Override with e.g. -DLOG_LEVEL=LOG_LEVEL_WARNING
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_INFO 3
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
 
+// Formats the message on the calling thread and queues it for a
+// background thread to write out. Never blocks: when the queue is full
+// or the call site is being rate limited the message is dropped.
 void debug(FILE *out, const char *fmt, ...);
 
+// Blocks until every queued message has been written
+void log_flush(void);
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
 #define error(err_msg, ...) debug(stderr, \
                 RED "[ERROR] %s: %s: %d: " err_msg NORMAL, \
                 __FILE__, __func__, __LINE__, ##__VA_ARGS__)
+#else
+#define error(err_msg, ...) ((void) 0)
+#endif
 
+#if LOG_LEVEL >= LOG_LEVEL_WARNING
 #define warning(warn_msg, ...) debug(stderr, \
                 YELLOW "[WARNING] %s: %s: %d: " warn_msg NORMAL, \
                 __FILE__, __func__, __LINE__, ##__VA_ARGS__)
+#else
+#define warning(warn_msg, ...) ((void) 0)
+#endif
 
+#if LOG_LEVEL >= LOG_LEVEL_INFO
 #define info(info_msg, ...) debug(stderr, \
                 "[INFO] %s: %s: %d: " info_msg NORMAL, \
                 __FILE__, __func__, __LINE__, ##__VA_ARGS__)
-
+#else
+#define info(info_msg, ...) ((void) 0)
 #endif
 
+#endif
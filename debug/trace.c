@@ -0,0 +1,212 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "print.h"
+#include "trace.h"
+
+// Upper bound on the events kept per thread, later events are dropped
+#define TRACE_MAX_EVENTS_PER_THREAD (1 << 20)
+#define TRACE_INITIAL_CAPACITY 4096
+
+struct TraceEvent {
+        const char *name;
+        uint32_t track;
+        uint64_t begin_ns;
+        uint64_t duration_ns;
+};
+
+struct TraceBuffer {
+        uint32_t thread_id;
+        const char *thread_name;
+        struct TraceEvent *events;
+        size_t count;
+        size_t capacity;
+        size_t dropped;
+        struct TraceBuffer *p_next;
+};
+
+static _Thread_local struct TraceBuffer *tp_buffer;
+
+// Every thread's buffer, only locked when a thread records its first
+// event and when the session is written out.
+static pthread_mutex_t buffersMutex = PTHREAD_MUTEX_INITIALIZER;
+static struct TraceBuffer *p_buffers;
+static atomic_uint nextThreadId = 1;
+
+static atomic_bool sessionActive;
+static const char *sessionPath;
+static uint64_t sessionStart;
+
+
+uint64_t trace_now_ns(void)
+{
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (uint64_t) now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static struct TraceBuffer *get_thread_buffer()
+{
+        if (tp_buffer != NULL)
+                return tp_buffer;
+
+        struct TraceBuffer *p_buffer = calloc(1, sizeof(struct TraceBuffer));
+        if (p_buffer == NULL)
+                return NULL;
+        p_buffer->thread_id = atomic_fetch_add(&nextThreadId, 1);
+
+        pthread_mutex_lock(&buffersMutex);
+        p_buffer->p_next = p_buffers;
+        p_buffers = p_buffer;
+        pthread_mutex_unlock(&buffersMutex);
+
+        tp_buffer = p_buffer;
+        return p_buffer;
+}
+
+void trace_complete_event(
+                const char *name,
+                uint32_t track,
+                uint64_t begin_ns,
+                uint64_t end_ns)
+{
+        if (!atomic_load_explicit(&sessionActive, memory_order_relaxed))
+                return;
+
+        struct TraceBuffer *p_buffer = get_thread_buffer();
+        if (p_buffer == NULL)
+                return;
+
+        if (p_buffer->count == p_buffer->capacity) {
+                size_t capacity = p_buffer->capacity == 0 ?
+                        TRACE_INITIAL_CAPACITY : p_buffer->capacity * 2;
+                struct TraceEvent *events = NULL;
+                if (capacity <= TRACE_MAX_EVENTS_PER_THREAD)
+                        events = realloc(p_buffer->events,
+                                        capacity * sizeof(struct TraceEvent));
+                if (events == NULL) {
+                        p_buffer->dropped++;
+                        return;
+                }
+                p_buffer->events = events;
+                p_buffer->capacity = capacity;
+        }
+
+        struct TraceEvent *p_event = &p_buffer->events[p_buffer->count++];
+        p_event->name = name;
+        p_event->track = track == 0 ? p_buffer->thread_id : track;
+        p_event->begin_ns = begin_ns;
+        p_event->duration_ns = end_ns > begin_ns ? end_ns - begin_ns : 0;
+}
+
+struct TraceZone trace_zone_begin(const char *name)
+{
+        struct TraceZone zone = { name, trace_now_ns() };
+        return zone;
+}
+
+void trace_zone_end(struct TraceZone *p_zone)
+{
+        trace_complete_event(p_zone->name, 0, p_zone->begin_ns,
+                        trace_now_ns());
+}
+
+void trace_set_thread_name(const char *name)
+{
+        struct TraceBuffer *p_buffer = get_thread_buffer();
+        if (p_buffer != NULL)
+                p_buffer->thread_name = name;
+}
+
+void trace_begin_session(const char *path)
+{
+        sessionPath = path;
+        sessionStart = trace_now_ns();
+        atomic_store(&sessionActive, true);
+}
+
+// Names are string literals from the zones, but escape them anyway
+static void write_json_string(FILE *p_file, const char *string)
+{
+        fputc('"', p_file);
+        for (const char *c = string; *c != '\0'; c++) {
+                if (*c == '"' || *c == '\\')
+                        fputc('\\', p_file);
+                if ((unsigned char) *c >= 0x20)
+                        fputc(*c, p_file);
+        }
+        fputc('"', p_file);
+}
+
+static void write_thread_name(
+                FILE *p_file,
+                bool *p_first,
+                uint32_t thread_id,
+                const char *name)
+{
+        fprintf(p_file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\","
+                        "\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+                        *p_first ? "" : ",", thread_id);
+        write_json_string(p_file, name);
+        fprintf(p_file, "}}");
+        *p_first = false;
+}
+
+void trace_end_session(void)
+{
+        if (!atomic_exchange(&sessionActive, false))
+                return;
+
+        FILE *p_file = fopen(sessionPath, "w");
+        if (p_file == NULL) {
+                warning("Failed to open trace file %s!\n", sessionPath);
+                return;
+        }
+
+        fprintf(p_file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+        bool first = true;
+        write_thread_name(p_file, &first, TRACE_GPU_TRACK, "GPU");
+
+        size_t eventCount = 0, droppedCount = 0;
+        pthread_mutex_lock(&buffersMutex);
+        for (struct TraceBuffer *p_buffer = p_buffers; p_buffer != NULL;
+                        p_buffer = p_buffer->p_next) {
+                if (p_buffer->thread_name != NULL)
+                        write_thread_name(p_file, &first,
+                                        p_buffer->thread_id,
+                                        p_buffer->thread_name);
+
+                for (size_t i = 0; i < p_buffer->count; i++) {
+                        const struct TraceEvent *p_event =
+                                &p_buffer->events[i];
+                        // Events from before the session are clamped to it
+                        uint64_t begin = p_event->begin_ns > sessionStart ?
+                                p_event->begin_ns - sessionStart : 0;
+
+                        fprintf(p_file, ",\n{\"name\":");
+                        write_json_string(p_file, p_event->name);
+                        fprintf(p_file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                                        "\"ts\":%.3f,\"dur\":%.3f}",
+                                        p_event->track, begin / 1000.0,
+                                        p_event->duration_ns / 1000.0);
+                }
+
+                eventCount += p_buffer->count;
+                droppedCount += p_buffer->dropped;
+                p_buffer->count = 0;
+                p_buffer->dropped = 0;
+        }
+        pthread_mutex_unlock(&buffersMutex);
+
+        fprintf(p_file, "\n]}\n");
+        fclose(p_file);
+
+        info("Wrote %zu trace events to %s\n", eventCount, sessionPath);
+        if (droppedCount > 0)
+                warning("Dropped %zu trace events\n", droppedCount);
+}
@@ -0,0 +1,67 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// CPU and GPU trace zones written as Chrome trace-event JSON, which
+// chrome://tracing and ui.perfetto.dev can open.
+//
+// Tracing is compiled in with -DENABLE_TRACING (make TRACE=1). Without
+// it every TRACE_* macro compiles to nothing.
+//
+// Events are recorded into a buffer owned by the recording thread, so
+// zones never contend with each other. The buffers are written out by
+// TRACE_END_SESSION(), which has to run once the other threads are idle.
+
+// Track the GPU timestamp ranges are put on
+#define TRACE_GPU_TRACK 1000
+
+struct TraceZone {
+        const char *name;
+        uint64_t begin_ns;
+};
+
+uint64_t trace_now_ns(void);
+
+void trace_begin_session(const char *path);
+void trace_end_session(void);
+void trace_set_thread_name(const char *name);
+
+void trace_complete_event(
+                const char *name,
+                uint32_t track,
+                uint64_t begin_ns,
+                uint64_t end_ns);
+
+struct TraceZone trace_zone_begin(const char *name);
+void trace_zone_end(struct TraceZone *p_zone);
+
+#ifdef ENABLE_TRACING
+
+#define TRACE_ENABLED 1
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+// Records a zone from here to the end of the enclosing scope
+#define TRACE_ZONE(name) \
+        struct TraceZone TRACE_CONCAT(traceZone, __LINE__) \
+                __attribute__((cleanup(trace_zone_end))) = \
+                trace_zone_begin(name)
+
+#define TRACE_BEGIN_SESSION(path) trace_begin_session(path)
+#define TRACE_END_SESSION() trace_end_session()
+#define TRACE_THREAD_NAME(name) trace_set_thread_name(name)
+
+#else
+
+#define TRACE_ENABLED 0
+
+#define TRACE_ZONE(name) ((void) 0)
+#define TRACE_BEGIN_SESSION(path) ((void) (path))
+#define TRACE_END_SESSION() ((void) 0)
+#define TRACE_THREAD_NAME(name) ((void) (name))
+
+#endif
+
+#endif
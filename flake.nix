@@ -42,10 +42,7 @@
           buildPhase = ''
             runHook preBuild
 
-            # Compile the shaders to SPIR-V.
-            glslc shaders/triangle_shader.vert -o shaders/vert.spv
-            glslc shaders/gradient_shader.frag -o shaders/frag.spv
-
+            # Also compiles the shaders to SPIR-V.
             make CC=clang
 
             runHook postBuild
@@ -58,7 +55,7 @@
             # alongside the binary and run from that directory.
             mkdir -p $out/bin $out/share/hello-triangle/shaders
             cp VulkanTest $out/share/hello-triangle/
-            cp shaders/vert.spv shaders/frag.spv $out/share/hello-triangle/shaders/
+            cp shaders/*.spv $out/share/hello-triangle/shaders/
 
             makeWrapper $out/share/hello-triangle/VulkanTest $out/bin/hello-triangle \
               --chdir $out/share/hello-triangle \
@@ -1,6 +1,5 @@
 #include "vulkan/vk_command_buffer.h"
 #include "vulkan/vk_command_pool.h"
-#include "vulkan/vk_frame_buffer.h"
 #include "vulkan/vk_render_pass.h"
 #include <stddef.h>
 #include <stdint.h>
@@ -14,8 +13,11 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "debug/print.h"
+#include "debug/trace.h"
 #include "option.h"
 
 #include "vulkan/vk_validation_layer.h"
@@ -29,9 +31,30 @@
 #include "vulkan/vk_graphics_pipeline.h"
 #include "vulkan/vk_swap_chain.h"
 #include "vulkan/vk_vertex_data.h"
+#include "vulkan/vk_buffer.h"
+#include "vulkan/vk_particle_system.h"
+#include "vulkan/vk_gpu_culling.h"
+#include "vulkan/vk_mesh_registry.h"
+#include "vulkan/vk_frame_sync.h"
+#include "vulkan/vk_frame_pacer.h"
+#include "vulkan/vk_frame_capture.h"
+#include "vulkan/vk_gpu_timer.h"
+#include "vulkan/vk_shader_cache.h"
+#include "vulkan/vk_pipeline_cache.h"
+#include "vulkan/vk_resolution_scaler.h"
+#include "vulkan/vk_depth_buffer.h"
+#include "vulkan/vk_asset_streamer.h"
+#include "vulkan/vk_texture.h"
+#include "vulkan/vk_descriptors.h"
+#include "vulkan/vk_host_allocator.h"
+#include "vulkan/vk_memory_budget.h"
+#include "vulkan/vk_render_graph.h"
+#include "vulkan/vk_output.h"
+#include "vulkan/vk_offscreen_target.h"
 
 #include "utils/array.h"
-#include "datastructures/list.h"
+#include "utils/job_system.h"
+#include "utils/texture_codec.h"
 
 #define foreach(item, list) \
         for(typeof(list[0]) *item = list; item < (&list)[1]; item++)
@@ -44,11 +67,42 @@ const bool ENABLE_VALIDATION_LAYERS = true;
 const bool ENABLE_VALIDATION_LAYERS = false;
 #endif
 
+// Print frame time statistics periodically in Debug Mode
+#ifdef DEBUG
+static const bool ENABLE_FRAME_TIME_REPORT = true;
+#else
+static const bool ENABLE_FRAME_TIME_REPORT = false;
+#endif
+
+// Count the host memory the driver allocates through our allocation
+// callbacks, per allocation scope, in Debug Mode. Reported at startup,
+// once the allocations have settled and after the swap chain changes.
+#ifdef DEBUG
+static const bool ENABLE_HOST_ALLOCATION_TRACKING = true;
+#else
+static const bool ENABLE_HOST_ALLOCATION_TRACKING = false;
+#endif
+// Serve the driver's small allocations from fixed size pools
+static const bool POOL_SMALL_HOST_ALLOCATIONS = true;
+// Frames drawn before the steady state report
+static const uint32_t HOST_ALLOCATION_STEADY_FRAMES = 600;
+
+// Read the per heap budgets from the driver with VK_EXT_memory_budget.
+// Once an allocation would take a heap past this share of its budget,
+// idle capture buffers and the streaming staging ring are released
+// first, before the driver starts paging.
+static const bool ENABLE_MEMORY_BUDGET = true;
+static const float MEMORY_PRESSURE_THRESHOLD = 0.9f;
+
 // Window Size
 static const uint32_t WIDTH = 800;
 static const uint32_t HEIGHT = 600;
 
-static GLFWwindow *p_window;
+// Windows showing the scene, at most MAX_FRAME_OUTPUTS. They share the
+// device and everything rendered, and are drawn with one submit and one
+// present. Resolution scaling, captures and frame pacing follow the
+// first window.
+static const uint32_t WINDOW_COUNT = 1;
 
 // Validation Layers to request/enable
 static const char *VALIDATION_LAYERS[] = {
@@ -63,9 +117,135 @@ static const char *DEVICE_EXTENSIONS[] = {
 
 static const int MAX_FRAMES_IN_FLIGHT = 2;
 
+// Track frame completion with a single Vulkan 1.2 timeline semaphore
+// instead of per-frame fences when the device supports it.
+static const bool ENABLE_TIMELINE_SEMAPHORES = true;
+
+// Render straight into the swap chain images with Vulkan 1.3 dynamic
+// rendering when the device supports it. Otherwise the render graph
+// creates a render pass and framebuffer for every pass it renders.
+static const bool ENABLE_DYNAMIC_RENDERING = true;
+
+// Frame rate cap, 0 renders as fast as the present mode allows
+static const double TARGET_FPS = 60.0;
+// Wait for the previous present to reach the display before starting a
+// frame when VK_KHR_present_wait is supported
+static const bool ENABLE_PRESENT_WAIT = true;
+// Seconds between two frame time reports
+static const double FRAME_TIME_REPORT_INTERVAL = 5.0;
+
+// Only render when something changed. While the scene is unchanged the
+// main loop blocks on window events instead of drawing the same frame.
+static const bool ENABLE_IDLE_RENDERING = true;
+// Upper bound on how long the idle loop blocks, so that periodic work
+// like the frame time report still runs
+static const double IDLE_WAIT_TIMEOUT = 0.5;
+// Running particles change every frame and keep the loop from ever
+// going idle, so they start paused. Space starts them.
+static const bool START_PARTICLES_PAUSED = true;
+
+// F12 saves the next frame as <SCREENSHOT_PREFIX>_<n>.ppm,
+// F11 starts and stops streaming every frame to CAPTURE_STREAM_PATH
+static const char *SCREENSHOT_PREFIX = "screenshot";
+static const char *CAPTURE_STREAM_PATH = "capture.rgba";
+
+// Render BATCH_FRAME_COUNT frames offscreen as fast as possible instead
+// of opening a window, and stream them to BATCH_OUTPUT_PATH, "-" for
+// stdout. Nothing is presented. The particles advance by a fixed step of
+// 1 / BATCH_FRAME_RATE every frame, so every run renders the same
+// sequence. Frames are read back and written out on the capture writer
+// thread while the next ones render.
+static const bool ENABLE_BATCH_MODE = false;
+static const uint32_t BATCH_FRAME_COUNT = 600;
+static const uint32_t BATCH_WIDTH = 1280;
+static const uint32_t BATCH_HEIGHT = 720;
+static const uint32_t BATCH_FRAME_RATE = 60;
+static const enum CaptureFormat BATCH_CAPTURE_FORMAT = CAPTURE_FORMAT_Y4M;
+static const char *BATCH_OUTPUT_PATH = "batch.y4m";
+// sRGB like the swap chain, so the frames match a capture of the window
+static const VkFormat BATCH_COLOR_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+
+// Chrome trace written when built with tracing (make TRACE=1). Open it
+// in chrome://tracing or ui.perfetto.dev.
+static const char *TRACE_PATH = "trace.json";
+
+// Pipeline cache kept between runs, so unchanged pipelines are not
+// compiled again
+static const char *PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+
+// Render at a reduced resolution when the GPU takes longer than the budget
+// to draw a frame, and upscale to the window. The budget leaves headroom
+// under the 16.7 ms a frame gets at TARGET_FPS.
+static const bool ENABLE_DYNAMIC_RESOLUTION = true;
+static const double GPU_FRAME_TIME_BUDGET_MS = 14.0;
+static const float MIN_RESOLUTION_SCALE = 0.5f;
+
+// List every available instance extension during startup
+static const bool ENABLE_VERBOSE_STARTUP = false;
+
+// Read on a background thread while the instance and device are created
+static const char *SHADER_FILES[] = {
+        "shaders/vert.spv",
+        "shaders/frag.spv",
+        "shaders/textured_frag.spv",
+        "shaders/bindless_frag.spv",
+        "shaders/particle_vert.spv",
+        "shaders/particle_comp.spv",
+        "shaders/cull_comp.spv"
+};
+
+// Number of particles simulated by the compute shader
+static const uint32_t PARTICLE_COUNT = 1 << 20;
+
+// Cull the objects on the GPU and draw the survivors of every mesh with a
+// single multi-draw indirect call. Needs the multiDrawIndirect and
+// drawIndirectFirstInstance features. When disabled or unsupported the
+// objects are culled on the CPU and drawn with one draw per mesh.
+static const bool ENABLE_GPU_DRIVEN_RENDERING = true;
+
+// Vertex formats the meshes are quantized into at load time. Vertex
+// fetch bandwidth dominates on large meshes, snorm16 positions and unorm8
+// colors take 8 bytes per vertex instead of 20.
+static const enum VertexPositionFormat VERTEX_POSITION_FORMAT =
+        VERTEX_POSITION_SNORM16;
+static const enum VertexColorFormat VERTEX_COLOR_FORMAT =
+        VERTEX_COLOR_UNORM8;
+
+// The objects are laid out in a grid that extends past the screen
+// so that the culling pass has something to reject.
+static const uint32_t OBJECT_GRID_SIZE = 128;
+static const float OBJECT_GRID_EXTENT = 2.0f;
+
+// The objects are streamed in after startup, a batch of grid rows at a
+// time, and show up as their uploads finish. The budget caps the bytes
+// uploaded per frame so streaming never causes a hitch, the staging ring
+// must hold a few frames worth of uploads. The objects are decoded by up
+// to STREAMING_LOADER_COUNT background jobs, which leaves the other
+// workers free for the culling jobs of the frame.
+static const uint32_t OBJECT_ROWS_PER_BATCH = 8;
+static const VkDeviceSize STREAMING_BYTES_PER_FRAME = 32 * 1024;
+static const VkDeviceSize STREAMING_STAGING_SIZE = 256 * 1024;
+static const uint32_t STREAMING_LOADER_COUNT = 2;
+
+// Store the object texture block compressed, BC1 takes 4 bits per texel
+// instead of 32. Devices without BC support get it decoded to RGBA8.
+static const bool ENABLE_TEXTURE_COMPRESSION = true;
+static const uint32_t OBJECT_TEXTURE_SIZE = 256;
+
+// Put every texture and storage buffer into one set that is bound once
+// per frame and indexed by the shaders, instead of writing and binding a
+// set per draw. Needs descriptor indexing, without it the texture set is
+// allocated every frame from pools that are reset in one go.
+static const bool ENABLE_BINDLESS_DESCRIPTORS = true;
+static const uint32_t BINDLESS_TEXTURE_CAPACITY = 1024;
+static const uint32_t BINDLESS_BUFFER_CAPACITY = 1024;
+static const uint32_t FRAME_DESCRIPTOR_SET_COUNT = 64;
+
 
 // Handle to the Vulkan library instance
 static VkInstance instance;
+// Vulkan version the instance was created with
+static uint32_t instanceApiVersion = VK_API_VERSION_1_0;
 
 // Handle to the physical device(gpu) to use
 // This object will be implicitly destroyed when the VkInstance is destroyed
@@ -80,68 +260,240 @@ static VkDevice device;
 static VkQueue graphicsQueue;
 // Handle to the present queue
 static VkQueue presentQueue;
+// Handle to the compute queue
+// This is a separate async compute queue when the device has one,
+// otherwise it is the graphics queue.
+static VkQueue computeQueue;
+// Handle to the transfer queue used for streaming
+// This is a dedicated transfer queue when the device has one,
+// otherwise it is the graphics queue.
+static VkQueue transferQueue;
 
 
-static struct SwapChainDetails swapChainDetails;
-
-
-// Handle to the swap chain image views
-static VkImageView *swapChainImageViews;
+// The window, surface and swap chain of every window
+static struct Output outputs[MAX_FRAME_OUTPUTS];
+// Windows that were opened, none in batch mode
+static uint32_t windowCount = 0;
 
 // Handle to the Debug callback
 static VkDebugUtilsMessengerEXT debugMessenger;
 
-// Handle to the window surface
-static VkSurfaceKHR surface;
-
-static VkRenderPass renderPass;
+// Only used to create the pipelines, VK_NULL_HANDLE when dynamic
+// rendering is used
+static VkRenderPass renderPass = VK_NULL_HANDLE;
+static bool useDynamicRendering = false;
 static struct GraphicsPipelineDetails graphicsPipelineDetails;
 
-static VkBuffer vertexBuffer;
-static VkDeviceMemory vertexBufferMemory;
-static VkFramebuffer *swapChainFramebuffers;
+static struct VertexLayout vertexLayout;
+static struct MeshRegistry meshRegistry;
+// The meshes the grid cycles through
+static uint32_t meshIds[3];
+// The quad again, as a mesh of its own so that it is drawn after the
+// nearer grid meshes instead of along with the grid quads
+static uint32_t backgroundMeshId;
+static VkFormat depthFormat;
+static struct RenderGraph renderGraph;
 
 static VkCommandPool commandPool;
 static VkCommandBuffer *commandBuffers;
 
+static VkCommandPool computeCommandPool;
+static VkCommandBuffer *computeCommandBuffers;
 
-static VkSemaphore *imageAvailableSemaphores;
-static VkSemaphore *renderFinishedSemaphores;
-static VkFence *inFlightFences;
+static struct ParticleSystem particleSystem;
+
+static struct GpuCulling gpuCulling;
+static bool useGpuDrivenRendering = false;
+
+// A range of the objects that is loaded and uploaded as one asset
+struct ObjectBatch {
+        uint32_t first_object;
+        uint32_t object_count;
+        uint32_t first_row;
+        // The background quad instead of grid rows
+        bool background;
+};
+
+static struct AssetStreamer assetStreamer;
+static struct ObjectBatch *objectBatches;
+static bool sceneStreamed = false;
+
+static struct TextureDescriptors textureDescriptors;
+static struct Texture objectTexture;
+
+static struct DescriptorAllocator descriptorAllocator;
+static struct BindlessTable bindlessTable;
+static bool useBindless = false;
+static uint32_t objectTextureIndex = 0;
+
+// Shared by every engine task that runs in parallel. The main thread is
+// worker 0 and runs jobs while it waits on them.
+static struct JobSystem jobSystem;
+
+
+static struct FrameSync frameSync;
 
 static uint32_t currentFrame = 0;
 
-static bool frameBufferResized = false;
+// Timers count from the start of run(). They do not use GLFW's timer,
+// batch mode runs without GLFW.
+static double startTime;
+static double lastFrameTime = 0.0;
+
+// Set whenever the next frame would differ from the last one presented
+static bool sceneDirty = true;
+// The particle simulation animates the scene every frame while it runs.
+// Space toggles it.
+static bool particlesPaused;
 
-static List *vertices;
+static struct FrameCapture frameCapture;
+static bool screenshotRequested = false;
+static bool streamingCapture = false;
+
+static struct FramePacer framePacer;
+
+static struct GpuTimer gpuTimer;
+static bool useGpuTimer = false;
+
+static bool firstFramePresented = false;
+
+static struct ResolutionScaler resolutionScaler;
+static bool useResolutionScaling = false;
+
+// Rendered to instead of the windows in batch mode
+static struct OffscreenTarget offscreenTarget;
+
+static const Vertex QUAD_VERTICES[] = {
+        {{-0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}},
+        {{0.5f, 0.5f}, {1.0f, 1.0f, 0.0f}},
+        {{-0.5f, 0.5f}, {1.0f, 0.0f, 1.0f}},
+        {{0.5f, 0.0f}, {1.0f, 0.0f, 1.0f}}
+};
+static const uint16_t QUAD_INDICES[] = {
+        0, 1, 2, 0, 3, 1
+};
+
+static const Vertex TRIANGLE_VERTICES[] = {
+        {{-0.5f, 0.0f}, {0.0f, 1.0f, 0.0f}},
+        {{0.5f, 0.0f}, {0.0f, 1.0f, 1.0f}},
+        {{0.0f, 0.5f}, {0.0f, 0.0f, 1.0f}}
+};
+static const uint16_t TRIANGLE_INDICES[] = {
+        0, 1, 2
+};
+
+static const Vertex DIAMOND_VERTICES[] = {
+        {{0.0f, 0.0f}, {1.0f, 1.0f, 1.0f}},
+        {{0.5f, 0.25f}, {0.0f, 1.0f, 1.0f}},
+        {{0.0f, 0.5f}, {1.0f, 1.0f, 0.0f}},
+        {{-0.5f, 0.25f}, {1.0f, 0.0f, 1.0f}}
+};
+static const uint16_t DIAMOND_INDICES[] = {
+        0, 1, 2, 0, 2, 3
+};
 
 
 
 // Prototypes
-static void create_vertex_buffer();
+static void create_meshes();
+static void create_objects(const struct QueueFamilyIndices *p_indices);
+static void create_object_texture(
+                const struct OptionalDeviceFeatures *p_features);
 
 
 static void framebuffer_resize_callback(GLFWwindow *window, int width, int height)
 {
-        frameBufferResized = true;
+        struct Output *p_output = glfwGetWindowUserPointer(window);
+        p_output->resized = true;
+        sceneDirty = true;
 }
 
+// The window contents were damaged, e.g. after being uncovered
+static void window_refresh_callback(GLFWwindow *window)
+{
+        sceneDirty = true;
+}
 
-void init_window()
+static void key_callback(GLFWwindow *window, int key, int scancode,
+                int action, int mods)
+{
+        if (key == GLFW_KEY_SPACE && action == GLFW_PRESS)
+                particlesPaused = !particlesPaused;
+        if (key == GLFW_KEY_F12 && action == GLFW_PRESS)
+                screenshotRequested = true;
+        if (key == GLFW_KEY_F11 && action == GLFW_PRESS)
+                streamingCapture = !streamingCapture;
+        sceneDirty = true;
+}
+
+static void cursor_pos_callback(GLFWwindow *window, double x, double y)
+{
+        sceneDirty = true;
+}
+
+static void mouse_button_callback(GLFWwindow *window, int button,
+                int action, int mods)
+{
+        sceneDirty = true;
+}
+
+static void scroll_callback(GLFWwindow *window, double x, double y)
 {
-        glfwInit();
+        sceneDirty = true;
+}
+
 
+void init_window()
+{
+        TRACE_ZONE("init_window");
         // Tell glfw to not use OpenGL since we use Vulkan
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 
-        p_window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", NULL, NULL);
-        glfwSetFramebufferSizeCallback(p_window, framebuffer_resize_callback);
-        glfwSetWindowSizeLimits(p_window, 200, 200, GLFW_DONT_CARE, GLFW_DONT_CARE); // TODO: Doesn't work on wayfire (crashes when width or height is zero)
+        if (WINDOW_COUNT == 0 || WINDOW_COUNT > MAX_FRAME_OUTPUTS) {
+                error("Between 1 and %u windows are supported!\n",
+                                MAX_FRAME_OUTPUTS);
+                exit(EXIT_FAILURE);
+        }
+
+        for (uint32_t i = 0; i < WINDOW_COUNT; i++) {
+                GLFWwindow *p_window = glfwCreateWindow(WIDTH, HEIGHT,
+                                "Vulkan", NULL, NULL);
+                outputs[i].p_window = p_window;
+                // The resize callback flags the output of its window
+                glfwSetWindowUserPointer(p_window, &outputs[i]);
+                glfwSetFramebufferSizeCallback(p_window, framebuffer_resize_callback);
+                glfwSetWindowRefreshCallback(p_window, window_refresh_callback);
+                glfwSetKeyCallback(p_window, key_callback);
+                glfwSetCursorPosCallback(p_window, cursor_pos_callback);
+                glfwSetMouseButtonCallback(p_window, mouse_button_callback);
+                glfwSetScrollCallback(p_window, scroll_callback);
+                glfwSetWindowSizeLimits(p_window, 200, 200, GLFW_DONT_CARE, GLFW_DONT_CARE); // TODO: Doesn't work on wayfire (crashes when width or height is zero)
+        }
+        windowCount = WINDOW_COUNT;
 }
 
 
+// Returns the highest instance version supported by the loader,
+// capped at the version this application is written against.
+static uint32_t get_instance_api_version()
+{
+        // vkEnumerateInstanceVersion does not exist in Vulkan 1.0 loaders
+        PFN_vkEnumerateInstanceVersion enumerateInstanceVersion =
+                (PFN_vkEnumerateInstanceVersion) vkGetInstanceProcAddr(
+                                NULL, "vkEnumerateInstanceVersion");
+
+        uint32_t version = VK_API_VERSION_1_0;
+        if (enumerateInstanceVersion != NULL)
+                enumerateInstanceVersion(&version);
+
+        return version < VK_API_VERSION_1_3 ? version : VK_API_VERSION_1_3;
+}
+
 void create_instance()
 {
+        TRACE_ZONE("create_instance");
+        instanceApiVersion = get_instance_api_version();
+
         // We specify some information about our application so that
         // it can be used for optimizations. (Optional)
         VkApplicationInfo appInfo = {};
@@ -151,7 +503,7 @@ void create_instance()
         appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
         appInfo.pEngineName = "No Engine";
         appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.apiVersion = VK_API_VERSION_1_0;
+        appInfo.apiVersion = instanceApiVersion;
 
 
         // Here we tell the Vulkan Driver which Global Extensions and
@@ -162,11 +514,11 @@ void create_instance()
         createInfo.pApplicationInfo = &appInfo;
 
         // Get the extensions required to interface with the
-        // window system from GLFW.
+        // window system from GLFW, unless there is no window.
         // We also get additional extensions when
         // validation layers are enabled.
         struct RequiredExtensions requiredExtensions =
-                get_required_extensions();
+                get_required_extensions(!ENABLE_BATCH_MODE);
 
         createInfo.enabledExtensionCount = requiredExtensions.extension_count;
         createInfo.ppEnabledExtensionNames = requiredExtensions.extensions;
@@ -190,12 +542,24 @@ void create_instance()
         }
 
         // Create the Vulkan instance
-        VkResult result = vkCreateInstance(&createInfo, NULL, &instance);
+        VkResult result = vkCreateInstance(&createInfo, get_host_allocator(),
+                        &instance);
         if (result != VK_SUCCESS) {
                 error("Failed to create Vulkan instance!\n");
                 exit(EXIT_FAILURE);
         }
 
+        // Check that the requested validation layers are available
+        if (ENABLE_VALIDATION_LAYERS &&
+                        !check_validation_layer_support(VALIDATION_LAYERS,
+                                ARRAY_SIZE(VALIDATION_LAYERS))) {
+                error("Validation layers requested, but not available!\n");
+                exit(EXIT_FAILURE);
+        }
+}
+
+static void print_instance_extensions()
+{
         // Get the number of available extensions
         uint32_t extension_count = 0;
         vkEnumerateInstanceExtensionProperties(NULL, &extension_count, NULL);
@@ -211,79 +575,132 @@ void create_instance()
         for (size_t i = 0; i < extension_count; i++) {
                 printf("\t %s\n", extensions[i].extensionName);
         }
+}
 
-        // Check that the requested validation layers are available
-        if (ENABLE_VALIDATION_LAYERS &&
-                        !check_validation_layer_support(VALIDATION_LAYERS,
-                                ARRAY_SIZE(VALIDATION_LAYERS))) {
-                error("Validation layers requested, but not available!\n");
-                exit(EXIT_FAILURE);
-        }
+// Startup is split into tasks that do not depend on each other and run
+// as background jobs. Each task only touches state that nothing else
+// reads until its counter has been waited on.
+static void start_startup_task(JobFunction task, void *p_arg,
+                struct JobCounter *p_counter)
+{
+        struct Job job = {task, p_arg};
+        run_background_job(&jobSystem, &job, p_counter);
 }
 
-void create_surface()
+static void create_instance_task(void *p_unused)
 {
-        if (glfwCreateWindowSurface(instance, p_window, NULL, &surface)
-                        != VK_SUCCESS) {
-                error("Failed to create window surface!\n");
-                exit(EXIT_FAILURE);
-        }
+        create_instance();
+}
+
+static void print_instance_extensions_task(void *p_unused)
+{
+        print_instance_extensions();
 }
 
-static void create_sync_objects()
+// Only needs the device, the render pass and the color format, so the
+// pipeline is compiled while the swap chain and buffers are created.
+static void create_graphics_pipeline_task(void *p_color_format)
 {
-        imageAvailableSemaphores = malloc(MAX_FRAMES_IN_FLIGHT);
-        renderFinishedSemaphores = malloc(MAX_FRAMES_IN_FLIGHT);
-        inFlightFences = malloc(MAX_FRAMES_IN_FLIGHT);
+        graphicsPipelineDetails = create_graphics_pipeline(&device,
+                        &renderPass, *(VkFormat *) p_color_format,
+                        depthFormat, &vertexLayout,
+                        useBindless ? bindlessTable.set_layout :
+                        textureDescriptors.set_layout, useBindless);
+}
 
-        VkSemaphoreCreateInfo semaphoreInfo = {};
-        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+void create_surface()
+{
+        TRACE_ZONE("create_surface");
+        for (uint32_t i = 0; i < windowCount; i++)
+                create_output_surface(instance, outputs[i].p_window,
+                                &outputs[i]);
+}
 
-        VkFenceCreateInfo fenceInfo = {};
-        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+// Memory pressure handlers, they run on the render thread which makes
+// every device memory allocation
+static VkDeviceSize release_capture_memory(void *p_unused,
+                uint32_t heap_index, VkDeviceSize size)
+{
+        return release_idle_capture_slots(&frameCapture);
+}
 
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-                if (vkCreateSemaphore(device, &semaphoreInfo, NULL,
-                                        &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-                                vkCreateSemaphore(device, &semaphoreInfo, NULL,
-                                        &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-                                vkCreateFence(device, &fenceInfo, NULL,
-                                        &inFlightFences[i]) != VK_SUCCESS) {
-                        error("Failed to create synchronization objects for a frame!");
-                        exit(EXIT_FAILURE);
-                }
-        }
+static VkDeviceSize release_streaming_memory(void *p_unused,
+                uint32_t heap_index, VkDeviceSize size)
+{
+        return release_asset_streamer_staging(&assetStreamer);
 }
 
 static void init_vulkan()
 {
-        create_instance();
+        TRACE_ZONE("init_vulkan");
         if (ENABLE_VALIDATION_LAYERS) {
                 setup_debug_messenger(instance, &debugMessenger);
         }
 
         create_surface();
 
+        // Batch mode has no surface, and needs no swap chain extension
+        VkSurfaceKHR surface = windowCount > 0 ?
+                outputs[0].surface : VK_NULL_HANDLE;
+        uint32_t deviceExtensionCount = windowCount > 0 ?
+                ARRAY_SIZE(DEVICE_EXTENSIONS) : 0;
+
         pick_physical_device(
                         &instance,
                         &surface,
                         DEVICE_EXTENSIONS,
-                        ARRAY_SIZE(DEVICE_EXTENSIONS),
+                        deviceExtensionCount,
                         &physicalDevice
                         );
 
+        struct OptionalDeviceFeatures optionalFeatures = {};
+        optionalFeatures.timeline_semaphores = ENABLE_TIMELINE_SEMAPHORES &&
+                supports_timeline_semaphores(physicalDevice,
+                                instanceApiVersion);
+        optionalFeatures.dynamic_rendering = ENABLE_DYNAMIC_RENDERING &&
+                supports_dynamic_rendering(physicalDevice,
+                                instanceApiVersion);
+        optionalFeatures.present_wait = ENABLE_PRESENT_WAIT &&
+                windowCount > 0 &&
+                supports_present_wait(physicalDevice, instanceApiVersion);
+        optionalFeatures.multi_draw_indirect = ENABLE_GPU_DRIVEN_RENDERING &&
+                supports_multi_draw_indirect(physicalDevice);
+        optionalFeatures.texture_compression_bc = ENABLE_TEXTURE_COMPRESSION &&
+                supports_texture_compression_bc(physicalDevice);
+        optionalFeatures.texture_compression_etc2 =
+                ENABLE_TEXTURE_COMPRESSION &&
+                supports_texture_compression_etc2(physicalDevice);
+        optionalFeatures.descriptor_indexing = ENABLE_BINDLESS_DESCRIPTORS &&
+                supports_descriptor_indexing(physicalDevice,
+                                instanceApiVersion);
+        optionalFeatures.memory_budget = ENABLE_MEMORY_BUDGET &&
+                supports_memory_budget(physicalDevice, instanceApiVersion);
+        // Only the GPU timer of tracing builds reads the clocks
+        optionalFeatures.calibrated_timestamps = TRACE_ENABLED &&
+                supports_calibrated_timestamps(instance, physicalDevice);
+        useDynamicRendering = optionalFeatures.dynamic_rendering;
+        useGpuDrivenRendering = optionalFeatures.multi_draw_indirect;
+        useBindless = optionalFeatures.descriptor_indexing;
+
         if (create_logical_device(&physicalDevice, &surface,
                                 DEVICE_EXTENSIONS,
-                                ARRAY_SIZE(DEVICE_EXTENSIONS),
+                                deviceExtensionCount,
                                 VALIDATION_LAYERS,
                                 ARRAY_SIZE(VALIDATION_LAYERS),
+                                &optionalFeatures,
                                 &device)
                         != VK_SUCCESS) {
                 error("Failed to create logical device!\n");
                 exit(EXIT_FAILURE);
         }
 
+        // Before anything allocates device memory
+        init_memory_budget(physicalDevice, optionalFeatures.memory_budget,
+                        MEMORY_PRESSURE_THRESHOLD);
+
+        // Before any pipeline is created, they all share it
+        create_pipeline_cache(device, physicalDevice, PIPELINE_CACHE_PATH);
+
         struct QueueFamilyIndices queueFamilyIndices =
                 find_queue_families(physicalDevice, surface);
 
@@ -291,253 +708,920 @@ static void init_vulkan()
                         &graphicsQueue);
         create_queue(&device,queueFamilyIndices.present_family.value,
                         &presentQueue);
-        
-        if(create_swap_chain(p_window, device, physicalDevice,
-                                surface, &swapChainDetails)
-                        != VK_SUCCESS) {
-                error("Failed to create swap chain!\n");
+        create_queue(&device,queueFamilyIndices.compute_family.value,
+                        &computeQueue);
+        create_queue(&device,queueFamilyIndices.transfer_family.value,
+                        &transferQueue);
+
+        VkFormat swapChainFormat = BATCH_COLOR_FORMAT;
+        if (windowCount > 0)
+                swapChainFormat = choose_swap_chain_format(physicalDevice,
+                                surface);
+        else if (!supports_offscreen_target(physicalDevice, swapChainFormat)) {
+                error("Batch color format can not be rendered to!\n");
                 exit(EXIT_FAILURE);
         }
 
-        if (create_image_views(device,
-                                swapChainDetails.images,
-                                swapChainDetails.image_count,
-                                &swapChainDetails.image_format,
-                                &swapChainImageViews)
-                        != VK_SUCCESS) {
-                error("Failed to create image views!\n");
-                exit(EXIT_FAILURE);
+        // The device and pipelines were chosen for the first window, the
+        // others have to work with them as they are
+        for (uint32_t i = 1; i < windowCount; i++) {
+                if (!supports_output_present(physicalDevice,
+                                        queueFamilyIndices.present_family.value,
+                                        &outputs[i]) ||
+                                choose_swap_chain_format(physicalDevice,
+                                        outputs[i].surface)
+                                != swapChainFormat) {
+                        error("Window %u can not be presented like the first one!\n",
+                                        i);
+                        exit(EXIT_FAILURE);
+                }
         }
+        depthFormat = find_depth_format(physicalDevice);
+        vertexLayout = create_vertex_layout(VERTEX_POSITION_FORMAT,
+                        VERTEX_COLOR_FORMAT);
+        if (!useDynamicRendering)
+                renderPass = create_render_pass(&device, &swapChainFormat,
+                                depthFormat);
+        create_texture_descriptors(device, &textureDescriptors);
+        if (useBindless)
+                create_bindless_table(device, physicalDevice,
+                                BINDLESS_TEXTURE_CAPACITY,
+                                BINDLESS_BUFFER_CAPACITY, &bindlessTable);
+
+        VkDescriptorPoolSize framePoolSizes[] = {
+                {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                        FRAME_DESCRIPTOR_SET_COUNT},
+                {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, FRAME_DESCRIPTOR_SET_COUNT},
+                {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, FRAME_DESCRIPTOR_SET_COUNT}
+        };
+        create_descriptor_allocator(device, MAX_FRAMES_IN_FLIGHT,
+                        FRAME_DESCRIPTOR_SET_COUNT, framePoolSizes,
+                        ARRAY_SIZE(framePoolSizes), &descriptorAllocator);
 
-        renderPass =
-                create_render_pass(&device, &swapChainDetails.image_format);
+        struct JobCounter pipelineTask = {};
+        start_startup_task(create_graphics_pipeline_task, &swapChainFormat,
+                        &pipelineTask);
 
-        graphicsPipelineDetails = create_graphics_pipeline(
-                        &device, &swapChainDetails.extent, &renderPass);
+        for (uint32_t i = 0; i < windowCount; i++) {
+                create_output_swap_chain(device, physicalDevice,
+                                MAX_FRAMES_IN_FLIGHT, &outputs[i]);
 
-        if (create_frame_buffers(device,
-                                &swapChainDetails,
-                                swapChainImageViews,
-                                &renderPass,
-                                &swapChainFramebuffers) != VK_SUCCESS) {
-                error("Failed to create framebuffer!");
-                exit(EXIT_FAILURE);
+                if (outputs[i].swap_chain_details.image_format
+                                != swapChainFormat) {
+                        error("Swap chain format changed during startup!\n");
+                        exit(EXIT_FAILURE);
+                }
         }
 
-        commandPool = create_command_pool(&device, &physicalDevice, &surface);
-        create_vertex_buffer();
+        if (windowCount == 0)
+                create_offscreen_target(device, physicalDevice,
+                                swapChainFormat,
+                                (VkExtent2D) {BATCH_WIDTH, BATCH_HEIGHT},
+                                MAX_FRAMES_IN_FLIGHT, &offscreenTarget);
+
+        create_render_graph(device, physicalDevice, useDynamicRendering,
+                        &renderGraph);
+
+        commandPool = create_command_pool(&device,
+                        queueFamilyIndices.graphics_family.value);
+        create_meshes();
+        create_object_texture(&optionalFeatures);
+        create_asset_streamer(device, physicalDevice,
+                        queueFamilyIndices.transfer_family.value,
+                        transferQueue, STREAMING_STAGING_SIZE,
+                        STREAMING_BYTES_PER_FRAME, &jobSystem,
+                        STREAMING_LOADER_COUNT, &assetStreamer);
+        create_objects(&queueFamilyIndices);
         commandBuffers = create_command_buffer(&device, &commandPool, MAX_FRAMES_IN_FLIGHT);
 
-        create_sync_objects();
+        computeCommandPool = create_command_pool(&device,
+                        queueFamilyIndices.compute_family.value);
+        computeCommandBuffers = create_command_buffer(&device,
+                        &computeCommandPool, MAX_FRAMES_IN_FLIGHT);
+
+        uint32_t particleQueueFamilies[] = {
+                queueFamilyIndices.graphics_family.value,
+                queueFamilyIndices.compute_family.value
+        };
+        create_particle_system(device, physicalDevice, commandPool,
+                        graphicsQueue, particleQueueFamilies,
+                        ARRAY_SIZE(particleQueueFamilies), &renderPass,
+                        swapChainFormat, depthFormat,
+                        PARTICLE_COUNT, MAX_FRAMES_IN_FLIGHT,
+                        &particleSystem);
+        particlesPaused = START_PARTICLES_PAUSED;
+
+        create_frame_sync(device, MAX_FRAMES_IN_FLIGHT,
+                        optionalFeatures.timeline_semaphores, &frameSync);
+
+        init_frame_pacer(device, TARGET_FPS, optionalFeatures.present_wait,
+                        &framePacer);
+
+        if (windowCount > 0)
+                create_frame_capture(device, physicalDevice,
+                                SCREENSHOT_PREFIX, CAPTURE_STREAM_PATH,
+                                (uint32_t) TARGET_FPS, &frameCapture);
+        else
+                create_frame_capture(device, physicalDevice,
+                                SCREENSHOT_PREFIX, BATCH_OUTPUT_PATH,
+                                BATCH_FRAME_RATE, &frameCapture);
+
+        // Capture buffers are only needed again on the next capture, so
+        // they go before the staging ring that streaming still uses
+        add_memory_pressure_handler(release_capture_memory, NULL);
+        add_memory_pressure_handler(release_streaming_memory, NULL);
+
+        useGpuTimer = TRACE_ENABLED && supports_gpu_timing(physicalDevice,
+                        queueFamilyIndices.graphics_family.value);
+        if (useGpuTimer)
+                create_gpu_timer(device, physicalDevice, commandPool,
+                                graphicsQueue,
+                                queueFamilyIndices.graphics_family.value,
+                                MAX_FRAMES_IN_FLIGHT,
+                                optionalFeatures.calibrated_timestamps,
+                                &gpuTimer);
+
+        const struct SwapChainDetails *p_details =
+                &outputs[0].swap_chain_details;
+        useResolutionScaling = ENABLE_DYNAMIC_RESOLUTION &&
+                windowCount > 0 &&
+                supports_resolution_scaling(physicalDevice,
+                                queueFamilyIndices.graphics_family.value,
+                                p_details->image_format,
+                                p_details->image_usage);
+        if (useResolutionScaling)
+                create_resolution_scaler(device, physicalDevice,
+                                p_details->image_format,
+                                p_details->extent,
+                                queueFamilyIndices.graphics_family.value,
+                                MAX_FRAMES_IN_FLIGHT, GPU_FRAME_TIME_BUDGET_MS,
+                                MIN_RESOLUTION_SCALE, &resolutionScaler);
+
+        wait_for_counter(&jobSystem, &pipelineTask);
+        release_shader_files();
 }
 
-static uint32_t find_memory_type(
-                uint32_t type_filter,
-                VkMemoryPropertyFlags properties)
+// Every mesh lives in the shared buffers of the mesh registry. Meshes are
+// drawn nearest first, by the depth of their nearest object, so the
+// background gets a mesh of its own that only holds far objects.
+static void create_meshes()
 {
-        VkPhysicalDeviceMemoryProperties memProperties;
-        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+        TRACE_ZONE("create_meshes");
+        init_mesh_registry(&vertexLayout, &meshRegistry);
+
+        meshIds[0] = register_mesh(&meshRegistry,
+                        QUAD_VERTICES, ARRAY_SIZE(QUAD_VERTICES),
+                        QUAD_INDICES, ARRAY_SIZE(QUAD_INDICES));
+        meshIds[1] = register_mesh(&meshRegistry,
+                        TRIANGLE_VERTICES, ARRAY_SIZE(TRIANGLE_VERTICES),
+                        TRIANGLE_INDICES, ARRAY_SIZE(TRIANGLE_INDICES));
+        meshIds[2] = register_mesh(&meshRegistry,
+                        DIAMOND_VERTICES, ARRAY_SIZE(DIAMOND_VERTICES),
+                        DIAMOND_INDICES, ARRAY_SIZE(DIAMOND_INDICES));
+        backgroundMeshId = register_mesh(&meshRegistry,
+                        QUAD_VERTICES, ARRAY_SIZE(QUAD_VERTICES),
+                        QUAD_INDICES, ARRAY_SIZE(QUAD_INDICES));
+
+        upload_mesh_registry(device, physicalDevice, commandPool,
+                        graphicsQueue, &meshRegistry);
+}
 
-        for (size_t i = 0; i < memProperties.memoryTypeCount; i++) {
-                if (type_filter & (1 << i) &&
-                                (memProperties.memoryTypes[i].propertyFlags &
-                                 properties) == properties) {
-                        return i;
+// A checker pattern with a soft radial falloff, generated since there are
+// no asset files. An offline tool would bake the compressed mips, here
+// every level is encoded to BC1 at load time instead.
+static void create_object_texture(
+                const struct OptionalDeviceFeatures *p_features)
+{
+        TRACE_ZONE("create_object_texture");
+        uint32_t size = OBJECT_TEXTURE_SIZE;
+        uint8_t *texels = malloc((size_t) size * size * 4);
+        for (uint32_t y = 0; y < size; y++) {
+                for (uint32_t x = 0; x < size; x++) {
+                        float u = (x + 0.5f) / size - 0.5f;
+                        float v = (y + 0.5f) / size - 0.5f;
+                        float falloff = 1.0f - (u * u + v * v) * 1.5f;
+                        bool checker = ((x / 32) + (y / 32)) % 2 == 0;
+                        uint8_t value = (checker ? 255 : 160) * falloff;
+                        uint8_t *p_texel = &texels[(y * size + x) * 4];
+                        p_texel[0] = value;
+                        p_texel[1] = value;
+                        p_texel[2] = checker ? 255 : value;
+                        p_texel[3] = 255;
                 }
         }
 
-        error("Failed to find suitable memory type!");
-        exit(EXIT_FAILURE);
+        struct TextureSource source = {};
+        source.extent = (VkExtent2D) {size, size};
+        if (!ENABLE_TEXTURE_COMPRESSION) {
+                source.format = VK_FORMAT_R8G8B8A8_UNORM;
+                source.mip_levels = 1;
+                source.p_data = texels;
+                create_texture(device, physicalDevice, commandPool,
+                                graphicsQueue, p_features, &source,
+                                &objectTexture);
+                free(texels);
+        } else {
+                source.format = VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+                source.mip_levels = get_mip_level_count(size, size);
+
+                size_t blockSize = 0;
+                for (uint32_t level = 0; level < source.mip_levels; level++)
+                        blockSize += get_compressed_size(
+                                        get_mip_extent(size, level),
+                                        get_mip_extent(size, level),
+                                        BC1_BLOCK_BYTES);
+
+                uint8_t *blocks = malloc(blockSize);
+                uint8_t *p_level = blocks;
+                for (uint32_t level = 0; level < source.mip_levels; level++) {
+                        uint32_t extent = get_mip_extent(size, level);
+                        if (level > 0) {
+                                uint32_t parent =
+                                        get_mip_extent(size, level - 1);
+                                uint8_t *smaller = malloc(
+                                                (size_t) extent * extent * 4);
+                                downsample_rgba8(texels, parent, parent,
+                                                smaller);
+                                free(texels);
+                                texels = smaller;
+                        }
+                        encode_bc1(texels, extent, extent, p_level);
+                        p_level += get_compressed_size(extent, extent,
+                                        BC1_BLOCK_BYTES);
+                }
+                free(texels);
+
+                source.p_data = blocks;
+                create_texture(device, physicalDevice, commandPool,
+                                graphicsQueue, p_features, &source,
+                                &objectTexture);
+                free(blocks);
+        }
+
+        if (useBindless)
+                objectTextureIndex = add_bindless_texture(device,
+                                &bindlessTable, textureDescriptors.sampler,
+                                objectTexture.image_view);
+        info("Object texture: format %d, %u mips, %lu bytes\n",
+                        objectTexture.format, objectTexture.mip_levels,
+                        (unsigned long) objectTexture.size);
+}
+
+static uint32_t get_grid_object_mesh(uint32_t x, uint32_t y)
+{
+        return meshIds[(x + y) % ARRAY_SIZE(meshIds)];
+}
+
+// Runs as a loader job. The scene is generated rather than read from
+// disk, a file backed loader would read and decode the batch here.
+static void *load_object_batch(void *p_asset, VkDeviceSize *p_size)
+{
+        const struct ObjectBatch *p_batch = p_asset;
+        Instance *objects = malloc(p_batch->object_count * sizeof(Instance));
+        if (objects == NULL)
+                return NULL;
+
+        if (p_batch->background) {
+                // The original quad, centered and at full size.
+                // The radius bounds the quad corners around the origin.
+                // It sits behind the grid, which covers most of it.
+                objects[0] = (Instance) {{0.0f, 0.0f}, 0.71f, 1.0f, 0.5f,
+                        backgroundMeshId};
+                *p_size = sizeof(Instance);
+                return objects;
+        }
+
+        float spacing = 2.0f * OBJECT_GRID_EXTENT / OBJECT_GRID_SIZE;
+        float scale = spacing * 0.4f;
+        for (size_t i = 0; i < p_batch->object_count; i++) {
+                uint32_t x = i % OBJECT_GRID_SIZE;
+                uint32_t y = p_batch->first_row + i / OBJECT_GRID_SIZE;
+                Instance *p_object = &objects[i];
+                p_object->center[0] =
+                        -OBJECT_GRID_EXTENT + (x + 0.5f) * spacing;
+                p_object->center[1] =
+                        -OBJECT_GRID_EXTENT + (y + 0.5f) * spacing;
+                p_object->radius = 0.71f * scale;
+                p_object->scale = scale;
+                p_object->depth = 0.25f;
+                p_object->mesh = get_grid_object_mesh(x, y);
+        }
+
+        *p_size = p_batch->object_count * sizeof(Instance);
+        return objects;
+}
+
+// Runs on the render thread once the batch is in the object buffer
+static void object_batch_ready(void *p_asset, const void *p_data,
+                VkDeviceSize size)
+{
+        const struct ObjectBatch *p_batch = p_asset;
+        add_culled_objects(&gpuCulling, p_batch->first_object, p_data,
+                        p_batch->object_count);
+        sceneDirty = true;
 }
 
-static void create_vertex_buffer()
+// Sizes the culling buffers for the whole scene and requests its objects
+// from the asset streamer, which uploads them over the next frames.
+static void create_objects(const struct QueueFamilyIndices *p_indices)
 {
-        Vertex vertex_data[] = {
-            {{-0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}},
-            {{0.5f, 0.5f}, {1.0f, 1.0f, 0.0f}},
-            {{-0.5f, 0.5f}, {1.0f, 0.0f, 1.0f}},
-            {{-0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}},
-            {{0.5f, 0.0f}, {1.0f, 0.0f, 1.0f}},
-            {{0.5f, 0.5f}, {1.0f, 1.0f, 0.0f}}
+        TRACE_ZONE("create_objects");
+        // Counted up front so every mesh's region of the instance buffers
+        // can hold all of its objects once they are streamed in
+        uint32_t meshCapacities[ARRAY_SIZE(meshIds) + 1] = {};
+        meshCapacities[backgroundMeshId]++;
+        for (size_t y = 0; y < OBJECT_GRID_SIZE; y++)
+                for (size_t x = 0; x < OBJECT_GRID_SIZE; x++)
+                        meshCapacities[get_grid_object_mesh(x, y)]++;
+
+        uint32_t queueFamilies[] = {
+                p_indices->graphics_family.value,
+                p_indices->transfer_family.value
         };
+        create_gpu_culling(device, physicalDevice, commandPool,
+                        graphicsQueue, queueFamilies,
+                        ARRAY_SIZE(queueFamilies), &meshRegistry,
+                        meshCapacities, MAX_FRAMES_IN_FLIGHT,
+                        useGpuDrivenRendering, &gpuCulling);
+
+        uint32_t rowBatchCount = (OBJECT_GRID_SIZE + OBJECT_ROWS_PER_BATCH - 1)
+                / OBJECT_ROWS_PER_BATCH;
+        uint32_t batchCount = rowBatchCount + 1;
+        objectBatches = calloc(batchCount, sizeof(struct ObjectBatch));
+
+        // The background comes last, the grid is what shows up first
+        uint32_t firstObject = 0;
+        for (size_t i = 0; i < batchCount; i++) {
+                struct ObjectBatch *p_batch = &objectBatches[i];
+                p_batch->first_object = firstObject;
+                if (i < rowBatchCount) {
+                        p_batch->first_row = i * OBJECT_ROWS_PER_BATCH;
+                        uint32_t rows = OBJECT_GRID_SIZE - p_batch->first_row;
+                        if (rows > OBJECT_ROWS_PER_BATCH)
+                                rows = OBJECT_ROWS_PER_BATCH;
+                        p_batch->object_count = rows * OBJECT_GRID_SIZE;
+                } else {
+                        p_batch->background = true;
+                        p_batch->object_count = 1;
+                }
 
-        vertices = list_create(10);
-        for (size_t i = 0; i < ARRAY_SIZE(vertex_data); i++)
-                list_add(vertices, (void*)&vertex_data[i]);
+                struct AssetRequest request = {};
+                request.load = load_object_batch;
+                request.ready = object_batch_ready;
+                request.p_asset = p_batch;
+                request.dst_buffer = gpuCulling.object_buffer;
+                request.dst_offset = (VkDeviceSize) firstObject *
+                        sizeof(Instance);
+                request_asset(&assetStreamer, &request);
+
+                firstObject += p_batch->object_count;
+        }
+}
 
-        VkBufferCreateInfo bufferInfo = {};
-        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        bufferInfo.size = sizeof(Vertex) * list_size(vertices);
-        bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+// Seconds since run() started
+static double get_time()
+{
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (double) now.tv_sec + (double) now.tv_nsec * 1e-9 - startTime;
+}
 
-        if (vkCreateBuffer(device, &bufferInfo, NULL, &vertexBuffer) 
-                        != VK_SUCCESS) {
-                error("Failed to create vertex buffer!");
+// Simulates the particles for the current frame on the compute queue.
+// The graphics submission of this frame waits on the signalled semaphore,
+// while the graphics work of the previous frame may still be running.
+static void submit_particle_update()
+{
+        TRACE_ZONE("submit_particle_update");
+        double now = get_time();
+        // A paused simulation still runs to carry the particles
+        // over into this frame's buffer, it just does not move them.
+        float deltaTime = particlesPaused ?
+                0.0f : (float) ((now - lastFrameTime) * 1000.0);
+        lastFrameTime = now;
+        // Batch frames take however long they take, the sequence does not
+        if (windowCount == 0)
+                deltaTime = 1000.0f / BATCH_FRAME_RATE;
+
+        VkCommandBuffer commandBuffer = computeCommandBuffers[currentFrame];
+        vkResetCommandBuffer(commandBuffer, 0);
+
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+                error("Failed to begin recording compute command buffer!");
                 exit(EXIT_FAILURE);
         }
 
-        VkMemoryRequirements memRequirements;
-        vkGetBufferMemoryRequirements(device, vertexBuffer, &memRequirements);
-
-        VkMemoryAllocateInfo allocInfo = {};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex =
-                find_memory_type(memRequirements.memoryTypeBits,
-                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        record_particle_update(&particleSystem, commandBuffer,
+                        currentFrame, deltaTime);
 
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+                error("Failed to record compute command buffer!");
+                exit(EXIT_FAILURE);
+        }
 
-        if (vkAllocateMemory(device, &allocInfo, NULL, &vertexBufferMemory)
-                        != VK_SUCCESS) {
-                error("Failed to allocate vertex buffer memory!");
+        if (submit_compute_work(&frameSync, computeQueue, commandBuffer,
+                                currentFrame) != VK_SUCCESS) {
+                error("Failed to submit compute command buffer!");
                 exit(EXIT_FAILURE);
         }
+}
+
+static void handle_swap_chain_change(
+                struct Output *p_output)
+{
+        bool primary = p_output == &outputs[0];
+        if (primary)
+                reset_present_wait(&framePacer);
+        recreate_output_swap_chain(device, physicalDevice, p_output);
+
+        // The device is idle after recreating the swap chain. The graph
+        // still holds framebuffers of the old image views, and the
+        // transient images of the old size.
+        report_render_graph_memory(&renderGraph);
+        reset_render_graph(&renderGraph);
+        if (useResolutionScaling && primary)
+                resize_resolution_scaler(&resolutionScaler,
+                                p_output->swap_chain_details.extent);
+
+        report_host_allocations("swap chain recreated");
+}
+
+// Recreates the swap chains that are out of date or whose window was
+// resized. Minimized windows keep theirs until they are restored.
+static void update_swap_chains(
+                const VkResult *a_results)
+{
+        for (uint32_t i = 0; i < windowCount; i++) {
+                struct Output *p_output = &outputs[i];
+                if (a_results[i] == VK_ERROR_OUT_OF_DATE_KHR ||
+                                a_results[i] == VK_SUBOPTIMAL_KHR)
+                        p_output->resized = true;
+
+                if (p_output->resized && !is_output_minimized(p_output))
+                        handle_swap_chain_change(p_output);
+        }
+}
 
-        vkBindBufferMemory(device, vertexBuffer, vertexBufferMemory, 0);
+// Records and submits the frame for every output. The submission waits on
+// the acquire semaphores and signals the present semaphores, batch frames
+// have none.
+static void submit_frame(
+                const struct FrameOutputInfo *a_outputs,
+                uint32_t output_count,
+                const VkSemaphore *a_image_available,
+                const VkSemaphore *a_render_finished,
+                uint32_t semaphore_count)
+{
+        // Only start a new frame if we are submitting work
+        begin_frame_submission(device, &frameSync, currentFrame);
+
+        submit_particle_update();
+
+        // The slot's previous frame has finished, so its sets are free
+        begin_descriptor_frame(&descriptorAllocator, currentFrame);
+        VkDescriptorSet textureSet = bindlessTable.set;
+        if (!useBindless) {
+                textureSet = allocate_frame_descriptor_set(
+                                &descriptorAllocator,
+                                textureDescriptors.set_layout);
+                write_texture_descriptor(device, &textureDescriptors,
+                                textureSet, &objectTexture);
+        }
 
-        void *data;
-        vkMapMemory(device, vertexBufferMemory, 0, bufferInfo.size, 0, &data);
-        memcpy(data, *list_get_elements(vertices), (size_t) bufferInfo.size);
-        vkUnmapMemory(device, vertexBufferMemory);
+        if (!useGpuDrivenRendering)
+                cull_objects_on_cpu(&gpuCulling, &jobSystem, currentFrame);
+
+        vkResetCommandBuffer(commandBuffers[currentFrame], 0);
+        struct FrameRecordInfo recordInfo = {};
+        recordInfo.p_render_graph = &renderGraph;
+        recordInfo.a_outputs = a_outputs;
+        recordInfo.output_count = output_count;
+        recordInfo.depth_format = depthFormat;
+        recordInfo.graphics_pipeline =
+                graphicsPipelineDetails.graphics_pipeline;
+        recordInfo.graphics_pipeline_layout =
+                graphicsPipelineDetails.pipeline_layout;
+        recordInfo.texture_set = textureSet;
+        recordInfo.bindless = useBindless;
+        recordInfo.texture_index = objectTextureIndex;
+        recordInfo.p_mesh_registry = &meshRegistry;
+        recordInfo.p_particle_system = &particleSystem;
+        recordInfo.p_gpu_culling = &gpuCulling;
+        recordInfo.gpu_driven = useGpuDrivenRendering;
+        recordInfo.current_frame = currentFrame;
+        recordInfo.frame_number = frameSync.frame_number;
+        recordInfo.p_frame_capture = &frameCapture;
+        recordInfo.capture_format = streamingCapture ?
+                CAPTURE_FORMAT_RAW : CAPTURE_FORMAT_PPM;
+        if (windowCount == 0)
+                recordInfo.capture_format = BATCH_CAPTURE_FORMAT;
+        recordInfo.p_gpu_timer = useGpuTimer ? &gpuTimer : NULL;
+        {
+                TRACE_ZONE("record");
+                record_command_buffer(commandBuffers[currentFrame],
+                                &recordInfo);
+        }
+
+        {
+                TRACE_ZONE("submit");
+                if (submit_graphics_work(&frameSync, graphicsQueue,
+                                        commandBuffers[currentFrame],
+                                        currentFrame, a_image_available,
+                                        a_render_finished, semaphore_count)
+                                != VK_SUCCESS) {
+                        error("Failed to submit draw command buffer!");
+                        exit(EXIT_FAILURE);
+                }
+        }
 }
 
 void draw_frame()
 {
-        vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+        TRACE_ZONE("draw_frame");
+        wait_for_frame_slot(device, &frameSync, currentFrame);
+
+        // Write out the captures of every frame that has finished since
+        collect_frame_captures(&frameCapture,
+                        get_completed_frame(device, &frameSync));
+
+        // Objects whose upload has finished are drawn from this frame on
+        if (update_asset_streamer(&assetStreamer) > 0 && !sceneStreamed &&
+                        !is_asset_streaming(&assetStreamer)) {
+                info("Scene streamed in: %.1f ms\n", get_time() * 1000.0);
+                sceneStreamed = true;
+        }
 
-        uint32_t imageIndex;
-        VkResult result = vkAcquireNextImageKHR(device, swapChainDetails.swap_chain, UINT64_MAX,
-                        imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+        VkResult results[MAX_FRAME_OUTPUTS];
+        bool acquired = false;
+        for (uint32_t i = 0; i < windowCount; i++) {
+                results[i] = VK_SUCCESS;
+                if (is_output_minimized(&outputs[i]))
+                        continue;
+
+                VkResult result = acquire_output_image(device, &outputs[i],
+                                currentFrame);
+                if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+                        outputs[i].resized = true;
+                } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+                        error("Failed to acquire swap chain image!");
+                        exit(EXIT_FAILURE);
+                }
+                acquired |= outputs[i].acquired;
+        }
 
-        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-                recreate_swap_chain(p_window, device,
-                                &swapChainImageViews, physicalDevice, surface, 
-                                &swapChainDetails, &renderPass, 
-                                &swapChainFramebuffers);
+        if (!acquired) {
+                update_swap_chains(results);
                 return;
-        } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
-                error("Failed to acquire swap chain image!");
-                exit(EXIT_FAILURE);
         }
 
-        // Only reset the fence if we are submitting work
-        vkResetFences(device, 1, &inFlightFences[currentFrame]);
+        // Every window with an image takes part in the frame
+        struct FrameOutputInfo frameOutputs[MAX_FRAME_OUTPUTS] = {};
+        VkSemaphore imageAvailable[MAX_FRAME_OUTPUTS];
+        VkSemaphore renderFinished[MAX_FRAME_OUTPUTS];
+        uint32_t outputCount = 0;
+        for (uint32_t i = 0; i < windowCount; i++) {
+                const struct Output *p_output = &outputs[i];
+                if (!p_output->acquired)
+                        continue;
+
+                const struct SwapChainDetails *p_details =
+                        &p_output->swap_chain_details;
+                struct FrameOutputInfo *p_frameOutput =
+                        &frameOutputs[outputCount];
+                p_frameOutput->swap_chain_image =
+                        p_details->images[p_output->image_index];
+                p_frameOutput->swap_chain_image_view =
+                        p_output->image_views[p_output->image_index];
+                p_frameOutput->swap_chain_format = p_details->image_format;
+                p_frameOutput->extent = p_details->extent;
+                if (i == 0) {
+                        p_frameOutput->capture =
+                                (screenshotRequested || streamingCapture) &&
+                                (p_details->image_usage &
+                                 VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+                        p_frameOutput->p_resolution_scaler =
+                                useResolutionScaling ?
+                                &resolutionScaler : NULL;
+                        screenshotRequested = false;
+                }
 
-        vkResetCommandBuffer(commandBuffers[currentFrame], 0);
-        record_command_buffer(&renderPass, swapChainFramebuffers,
-                        &swapChainDetails.extent,
-                        &graphicsPipelineDetails.graphics_pipeline,
-                        commandBuffers[currentFrame], imageIndex,
-                        list_size(vertices), vertexBuffer);
-
-        VkSubmitInfo submitInfo = {};
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-        VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
-        VkPipelineStageFlags waitStages[] = {
-                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
-        };
-        submitInfo.waitSemaphoreCount = 1;
-        submitInfo.pWaitSemaphores = waitSemaphores;
-        submitInfo.pWaitDstStageMask = waitStages;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+                imageAvailable[outputCount] =
+                        p_output->image_available_semaphores[currentFrame];
+                renderFinished[outputCount] =
+                        p_output->render_finished_semaphores[currentFrame];
+                outputCount++;
+        }
 
-        VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
-        submitInfo.signalSemaphoreCount = 1;
-        submitInfo.pSignalSemaphores = signalSemaphores;
+        submit_frame(frameOutputs, outputCount, imageAvailable,
+                        renderFinished, outputCount);
 
-        if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame])
-                        != VK_SUCCESS) {
-                error("Failed to submit draw command buffer!");
-                exit(EXIT_FAILURE);
+        // The frame pacer follows the first window
+        uint64_t presentId = 0;
+        if (framePacer.wait_for_present != NULL && outputs[0].acquired)
+                presentId = next_present_id(&framePacer);
+
+        VkResult result = present_outputs(presentQueue, outputs,
+                        windowCount, currentFrame, presentId, results);
+
+        for (uint32_t i = 0; i < windowCount; i++) {
+                if (results[i] != VK_SUCCESS &&
+                                results[i] != VK_SUBOPTIMAL_KHR &&
+                                results[i] != VK_ERROR_OUT_OF_DATE_KHR) {
+                        error("Failed to present swap chain image!");
+                        exit(EXIT_FAILURE);
+                }
         }
 
-        VkPresentInfoKHR presentInfo = {};
-        presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-        presentInfo.waitSemaphoreCount = 1;
-        presentInfo.pWaitSemaphores = signalSemaphores;
-
-        VkSwapchainKHR swapChains[] = { swapChainDetails.swap_chain };
-        presentInfo.swapchainCount = 1;
-        presentInfo.pSwapchains = swapChains;
-        presentInfo.pImageIndices = &imageIndex;
-        presentInfo.pResults = NULL;
-
-        result = vkQueuePresentKHR(presentQueue, &presentInfo);
-
-        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR
-                        || frameBufferResized) {
-                frameBufferResized = false;
-                recreate_swap_chain(p_window, device,
-                                &swapChainImageViews, physicalDevice, surface, 
-                                &swapChainDetails, &renderPass, 
-                                &swapChainFramebuffers);
-        } else if (result != VK_SUCCESS) {
-                error("Failed to present swap chain image!");
-                exit(EXIT_FAILURE);
+        if (presentId != 0 && results[0] == VK_SUCCESS &&
+                        !outputs[0].resized)
+                on_frame_presented(&framePacer, presentId);
+        update_swap_chains(results);
+
+        if (!firstFramePresented && (result == VK_SUCCESS ||
+                                result == VK_SUBOPTIMAL_KHR)) {
+                info("Time to first frame: %.1f ms\n", get_time() * 1000.0);
+                firstFramePresented = true;
         }
 
         currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
 }
 
+static void report_frame_times()
+{
+        struct FrameTimeStats stats = get_frame_time_stats(&framePacer);
+        info("Frame time over %u frames: avg %.2f ms, min %.2f ms, "
+                        "max %.2f ms, jitter %.2f ms\n",
+                        stats.sample_count, stats.average_ms, stats.min_ms,
+                        stats.max_ms, stats.jitter_ms);
+
+        if (useResolutionScaling)
+                info("GPU frame time %.2f ms, render scale %.2f\n",
+                                resolutionScaler.gpu_time_ms,
+                                resolutionScaler.scale);
+
+        report_memory_budget();
+}
+
+// Closing any of the windows quits
+static bool should_close()
+{
+        for (uint32_t i = 0; i < windowCount; i++)
+                if (glfwWindowShouldClose(outputs[i].p_window))
+                        return true;
+        return false;
+}
+
+static bool are_windows_minimized()
+{
+        for (uint32_t i = 0; i < windowCount; i++)
+                if (!is_output_minimized(&outputs[i]))
+                        return false;
+        return true;
+}
+
+// Blocks until a window is restored. Nothing is rendered or simulated
+// while every window is minimized, so the loop suspends entirely instead
+// of spinning in recreate_swap_chain() waiting for a non-zero size.
+static void wait_while_minimized()
+{
+        while (are_windows_minimized() && !should_close())
+                glfwWaitEvents();
+
+        // Do not let the time spent minimized count as one huge frame
+        lastFrameTime = get_time();
+        reset_frame_pacing(&framePacer);
+        sceneDirty = true;
+}
+
+static bool needs_redraw()
+{
+        return !ENABLE_IDLE_RENDERING || sceneDirty || !particlesPaused ||
+                streamingCapture || is_asset_streaming(&assetStreamer);
+}
+
 static void main_loop()
 {
-        while(!glfwWindowShouldClose(p_window)) {
-                glfwPollEvents();
+        lastFrameTime = get_time();
+        double lastReportTime = lastFrameTime;
+        bool idle = false;
+        uint32_t framesDrawn = 0;
+
+        while(!should_close()) {
+                if (needs_redraw())
+                        glfwPollEvents();
+                else
+                        glfwWaitEventsTimeout(IDLE_WAIT_TIMEOUT);
+
+                if (ENABLE_FRAME_TIME_REPORT && get_time() - lastReportTime
+                                >= FRAME_TIME_REPORT_INTERVAL) {
+                        report_frame_times();
+                        lastReportTime = get_time();
+                }
+
+                if (are_windows_minimized()) {
+                        wait_while_minimized();
+                        continue;
+                }
+
+                if (!needs_redraw()) {
+                        idle = true;
+                        continue;
+                }
+
+                // The gap since the last frame drawn before going idle
+                // is not a late frame, keep it out of the pacing and
+                // the particle simulation.
+                if (idle) {
+                        reset_frame_pacing(&framePacer);
+                        lastFrameTime = get_time();
+                        idle = false;
+                }
+
+                // Cleared before drawing so that changes made while the
+                // frame is being drawn still cause another one.
+                sceneDirty = false;
+                pace_frame(device, outputs[0].swap_chain_details.swap_chain,
+                                &framePacer);
                 draw_frame();
+
+                if (++framesDrawn == HOST_ALLOCATION_STEADY_FRAMES)
+                        report_host_allocations("steady state");
         }
 
         vkDeviceWaitIdle(device);
 }
 
-static void cleanup()
+// Renders one frame of the batch sequence into the offscreen target and
+// reads it back. When the writer thread has fallen behind this waits for
+// it, a batch must not drop frames.
+static void draw_batch_frame()
+{
+        TRACE_ZONE("draw_batch_frame");
+        wait_for_frame_slot(device, &frameSync, currentFrame);
+
+        collect_frame_captures(&frameCapture,
+                        get_completed_frame(device, &frameSync));
+        wait_for_capture_slot(&frameCapture);
+
+        struct FrameOutputInfo frameOutput = {};
+        frameOutput.swap_chain_image = offscreenTarget.images[currentFrame];
+        frameOutput.swap_chain_image_view =
+                offscreenTarget.image_views[currentFrame];
+        frameOutput.swap_chain_format = offscreenTarget.format;
+        frameOutput.extent = offscreenTarget.extent;
+        frameOutput.offscreen = true;
+        frameOutput.capture = true;
+        submit_frame(&frameOutput, 1, NULL, NULL, 0);
+
+        currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+}
+
+// Renders the batch sequence as fast as the GPU and the writer thread
+// allow. The frame rate covers everything from the first frame until the
+// last one is written out.
+static void render_batch()
 {
-        cleanup_swap_chain(device, swapChainDetails.swap_chain,
-                        swapChainFramebuffers, swapChainImageViews,
-                        swapChainDetails.image_count,
-                        swapChainDetails.image_count);
+        // Every frame shows the whole scene, stream it in first
+        while (is_asset_streaming(&assetStreamer)) {
+                update_asset_streamer(&assetStreamer);
+                usleep(1000);
+        }
 
-        vkDestroyBuffer(device, vertexBuffer, NULL);
-        vkFreeMemory(device, vertexBufferMemory, NULL);
+        double start = get_time();
+        for (uint32_t i = 0; i < BATCH_FRAME_COUNT; i++)
+                draw_batch_frame();
+
+        vkDeviceWaitIdle(device);
+        finish_frame_captures(&frameCapture);
+        double seconds = get_time() - start;
+
+        info("Rendered %u frames of %ux%u in %.2f s: %.1f FPS end to end\n",
+                        BATCH_FRAME_COUNT, BATCH_WIDTH, BATCH_HEIGHT,
+                        seconds, BATCH_FRAME_COUNT / seconds);
+}
+
+static void cleanup()
+{
+        for (uint32_t i = 0; i < windowCount; i++)
+                destroy_output(instance, device, &outputs[i]);
+        report_render_graph_memory(&renderGraph);
+        destroy_render_graph(&renderGraph);
+
+        destroy_mesh_registry(device, &meshRegistry);
+        destroy_texture(device, &objectTexture);
+        destroy_texture_descriptors(device, &textureDescriptors);
+        destroy_descriptor_allocator(&descriptorAllocator);
+        if (useBindless)
+                destroy_bindless_table(device, &bindlessTable);
+
+        destroy_asset_streamer(&assetStreamer);
+        free(objectBatches);
+        destroy_gpu_culling(device, &gpuCulling);
+        destroy_particle_system(device, &particleSystem);
 
         vkDestroyPipeline(device,
-                        graphicsPipelineDetails.graphics_pipeline, NULL);
+                        graphicsPipelineDetails.graphics_pipeline,
+                        get_host_allocator());
 
         vkDestroyPipelineLayout(device,
-                        graphicsPipelineDetails.pipeline_layout, NULL);
+                        graphicsPipelineDetails.pipeline_layout,
+                        get_host_allocator());
 
-        vkDestroyRenderPass(device, renderPass, NULL);
+        vkDestroyRenderPass(device, renderPass, get_host_allocator());
 
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-                vkDestroySemaphore(device, renderFinishedSemaphores[i], NULL);
-                vkDestroySemaphore(device, imageAvailableSemaphores[i], NULL);
-                vkDestroyFence(device, inFlightFences[i], NULL);
-        }
+        destroy_frame_sync(device, &frameSync);
+
+        destroy_frame_capture(&frameCapture);
+
+        if (useGpuTimer)
+                destroy_gpu_timer(&gpuTimer);
+
+        if (useResolutionScaling)
+                destroy_resolution_scaler(&resolutionScaler);
 
-        vkDestroyCommandPool(device, commandPool, NULL);
+        if (windowCount == 0)
+                destroy_offscreen_target(&offscreenTarget);
 
-        vkDestroyDevice(device, NULL);
+        vkDestroyCommandPool(device, commandPool, get_host_allocator());
+        vkDestroyCommandPool(device, computeCommandPool, get_host_allocator());
+
+        destroy_pipeline_cache(device);
+
+        vkDestroyDevice(device, get_host_allocator());
+        destroy_memory_budget();
 
         if (ENABLE_VALIDATION_LAYERS) {
-                destroy_debug_messenger(instance, debugMessenger, NULL);
+                destroy_debug_messenger(instance, debugMessenger,
+                                get_host_allocator());
         }
 
-        vkDestroySurfaceKHR(instance, surface, NULL);
-        vkDestroyInstance(instance, NULL);
+        vkDestroyInstance(instance, get_host_allocator());
+        destroy_host_allocator();
+
+        for (uint32_t i = 0; i < windowCount; i++)
+                glfwDestroyWindow(outputs[i].p_window);
+
+        if (!ENABLE_BATCH_MODE)
+                glfwTerminate();
 
-        glfwDestroyWindow(p_window);
+        destroy_job_system(&jobSystem);
 
-        glfwTerminate();
+        TRACE_END_SESSION();
 }
 
 static void run()
 {
-        init_window();
+        TRACE_BEGIN_SESSION(TRACE_PATH);
+        TRACE_THREAD_NAME("Main");
+        startTime = get_time();
+
+        long coreCount = sysconf(_SC_NPROCESSORS_ONLN);
+        create_job_system(coreCount > 1 ? coreCount - 1 : 0, &jobSystem);
+
+        // Start the file IO first, nothing needs the shaders until the
+        // device exists.
+        preload_shader_files(SHADER_FILES, ARRAY_SIZE(SHADER_FILES));
+
+        // Loads GLFW's Vulkan state here, before the instance thread
+        // asks it for the required extensions. Batch mode does not need
+        // GLFW, which may not even start without a display.
+        if (!ENABLE_BATCH_MODE) {
+                if (!glfwInit()) {
+                        error("Failed to initialize GLFW!\n");
+                        exit(EXIT_FAILURE);
+                }
+                if (!glfwVulkanSupported()) {
+                        error("Vulkan is not supported!\n");
+                        exit(EXIT_FAILURE);
+                }
+        }
+
+        // The callbacks have to be in place before the instance exists
+        if (ENABLE_HOST_ALLOCATION_TRACKING)
+                init_host_allocator(POOL_SMALL_HOST_ALLOCATIONS);
+
+        // The instance does not need the window, create both at once
+        struct JobCounter instanceTask = {};
+        start_startup_task(create_instance_task, NULL, &instanceTask);
+        struct JobCounter extensionsTask = {};
+        if (ENABLE_VERBOSE_STARTUP)
+                start_startup_task(print_instance_extensions_task, NULL,
+                                &extensionsTask);
+
+        if (!ENABLE_BATCH_MODE)
+                init_window();
+        wait_for_counter(&jobSystem, &instanceTask);
+
         init_vulkan();
-        main_loop();
+        report_host_allocations("startup");
+
+        wait_for_counter(&jobSystem, &extensionsTask);
+
+        if (ENABLE_BATCH_MODE)
+                render_batch();
+        else
+                main_loop();
         cleanup();
 }
 
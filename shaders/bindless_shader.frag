@@ -0,0 +1,18 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Every texture of the bindless table
+layout(set = 0, binding = 0) uniform sampler2D textures[];
+
+layout(push_constant) uniform DrawConstants {
+        uint textureIndex;
+} draw;
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+layout(location = 0) out vec4 outColor;
+
+void main() {
+        vec3 texel = texture(textures[draw.textureIndex], fragTexCoord).rgb;
+        outColor = vec4(fragColor * texel, 1.0);
+}
@@ -1,4 +1,4 @@
 #!/bin/bash
 
-glslc triangle_shader.vert -o vert.spv
-glslc gradient_shader.frag -o frag.spv
+# The Makefile knows which source every .spv is compiled from
+make -C "$(dirname "$0")/.." shaders
@@ -0,0 +1,11 @@
+#version 450
+
+layout(binding = 0) uniform sampler2D objectTexture;
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+layout(location = 0) out vec4 outColor;
+
+void main() {
+        outColor = vec4(fragColor * texture(objectTexture, fragTexCoord).rgb, 1.0);
+}
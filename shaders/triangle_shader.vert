@@ -2,10 +2,16 @@
 
 layout(location = 0) in vec2 inPosition;
 layout(location = 1) in vec3 inColor;
+// xy: object center, z: bounding radius, w: scale
+layout(location = 2) in vec4 inInstance;
+layout(location = 3) in float inDepth;
 
 layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
 
 void main() {
-        gl_Position = vec4(inPosition, 0.0, 1.0);
+        gl_Position = vec4(inPosition * inInstance.w + inInstance.xy, inDepth, 1.0);
         fragColor = inColor;
+        // The meshes span -0.5 to 0.5 in model space
+        fragTexCoord = inPosition + 0.5;
 }
@@ -0,0 +1,425 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cglm/cglm.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CULL_X86 1
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "../debug/print.h"
+#include "../debug/trace.h"
+#include "cpu_culling.h"
+
+// More chunks than workers, so a worker that finishes early steals
+// the work of a slower one
+#define CULL_CHUNKS_PER_WORKER 4
+
+typedef uint32_t (*CullRangeFunction)(
+                const struct CullBounds *p_bounds,
+                const vec4 *a_planes,
+                uint32_t begin,
+                uint32_t end,
+                uint32_t *a_visible);
+
+
+static float *alloc_component(uint32_t count)
+{
+        size_t padded = (count + CULL_BLOCK_SIZE - 1) /
+                CULL_BLOCK_SIZE * CULL_BLOCK_SIZE;
+        if (padded == 0)
+                padded = CULL_BLOCK_SIZE;
+
+        float *component = aligned_alloc(CULL_ALIGNMENT,
+                        padded * sizeof(float));
+        if (component == NULL) {
+                error("Failed to allocate cull bounds!");
+                exit(EXIT_FAILURE);
+        }
+
+        memset(component, 0, padded * sizeof(float));
+        return component;
+}
+
+void create_cull_bounds(
+                uint32_t count,
+                struct CullBounds *p_bounds)
+{
+        p_bounds->center_x = alloc_component(count);
+        p_bounds->center_y = alloc_component(count);
+        p_bounds->center_z = alloc_component(count);
+        p_bounds->radius = alloc_component(count);
+        p_bounds->count = count;
+}
+
+void set_cull_bound(
+                struct CullBounds *p_bounds,
+                uint32_t index,
+                float x,
+                float y,
+                float z,
+                float radius)
+{
+        p_bounds->center_x[index] = x;
+        p_bounds->center_y[index] = y;
+        p_bounds->center_z[index] = z;
+        p_bounds->radius[index] = radius;
+}
+
+void destroy_cull_bounds(
+                struct CullBounds *p_bounds)
+{
+        free(p_bounds->center_x);
+        free(p_bounds->center_y);
+        free(p_bounds->center_z);
+        free(p_bounds->radius);
+        memset(p_bounds, 0, sizeof(*p_bounds));
+}
+
+// A sphere is visible unless it lies entirely behind one of the planes.
+// Writes the indices of the visible spheres in ascending order.
+static uint32_t cull_range_scalar(
+                const struct CullBounds *p_bounds,
+                const vec4 *a_planes,
+                uint32_t begin,
+                uint32_t end,
+                uint32_t *a_visible)
+{
+        uint32_t count = 0;
+        for (uint32_t i = begin; i < end; i++) {
+                float x = p_bounds->center_x[i];
+                float y = p_bounds->center_y[i];
+                float z = p_bounds->center_z[i];
+                float negRadius = -p_bounds->radius[i];
+
+                bool inside = true;
+                for (size_t p = 0; p < CULL_PLANE_COUNT; p++) {
+                        float distance = a_planes[p][0] * x +
+                                a_planes[p][1] * y +
+                                a_planes[p][2] * z +
+                                a_planes[p][3];
+                        inside &= distance >= negRadius;
+                }
+
+                // Branchless append, the slot is overwritten when culled
+                a_visible[count] = i;
+                count += inside;
+        }
+        return count;
+}
+
+static uint32_t append_mask(uint32_t mask, uint32_t first,
+                uint32_t *a_visible)
+{
+        uint32_t count = 0;
+        while (mask) {
+                a_visible[count++] = first + __builtin_ctz(mask);
+                mask &= mask - 1;
+        }
+        return count;
+}
+
+#if defined(__SSE2__)
+static uint32_t cull_range_sse(
+                const struct CullBounds *p_bounds,
+                const vec4 *a_planes,
+                uint32_t begin,
+                uint32_t end,
+                uint32_t *a_visible)
+{
+        __m128 planes[CULL_PLANE_COUNT][4];
+        for (size_t p = 0; p < CULL_PLANE_COUNT; p++)
+                for (size_t c = 0; c < 4; c++)
+                        planes[p][c] = _mm_set1_ps(a_planes[p][c]);
+
+        uint32_t count = 0;
+        uint32_t i = begin;
+        for (; i + 4 <= end; i += 4) {
+                __m128 x = _mm_load_ps(&p_bounds->center_x[i]);
+                __m128 y = _mm_load_ps(&p_bounds->center_y[i]);
+                __m128 z = _mm_load_ps(&p_bounds->center_z[i]);
+                __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(),
+                                _mm_load_ps(&p_bounds->radius[i]));
+
+                __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                for (size_t p = 0; p < CULL_PLANE_COUNT; p++) {
+                        __m128 distance = _mm_add_ps(
+                                _mm_add_ps(_mm_mul_ps(planes[p][0], x),
+                                        _mm_mul_ps(planes[p][1], y)),
+                                _mm_add_ps(_mm_mul_ps(planes[p][2], z),
+                                        planes[p][3]));
+                        inside = _mm_and_ps(inside,
+                                        _mm_cmpge_ps(distance, negRadius));
+                }
+
+                count += append_mask(_mm_movemask_ps(inside), i,
+                                &a_visible[count]);
+        }
+
+        return count + cull_range_scalar(p_bounds, a_planes, i, end,
+                        &a_visible[count]);
+}
+#endif
+
+#if defined(CULL_X86)
+__attribute__((target("avx2")))
+static uint32_t cull_range_avx2(
+                const struct CullBounds *p_bounds,
+                const vec4 *a_planes,
+                uint32_t begin,
+                uint32_t end,
+                uint32_t *a_visible)
+{
+        __m256 planes[CULL_PLANE_COUNT][4];
+        for (size_t p = 0; p < CULL_PLANE_COUNT; p++)
+                for (size_t c = 0; c < 4; c++)
+                        planes[p][c] = _mm256_set1_ps(a_planes[p][c]);
+
+        uint32_t count = 0;
+        uint32_t i = begin;
+        for (; i + 8 <= end; i += 8) {
+                __m256 x = _mm256_load_ps(&p_bounds->center_x[i]);
+                __m256 y = _mm256_load_ps(&p_bounds->center_y[i]);
+                __m256 z = _mm256_load_ps(&p_bounds->center_z[i]);
+                __m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(),
+                                _mm256_load_ps(&p_bounds->radius[i]));
+
+                __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+                for (size_t p = 0; p < CULL_PLANE_COUNT; p++) {
+                        __m256 distance = _mm256_add_ps(
+                                _mm256_add_ps(_mm256_mul_ps(planes[p][0], x),
+                                        _mm256_mul_ps(planes[p][1], y)),
+                                _mm256_add_ps(_mm256_mul_ps(planes[p][2], z),
+                                        planes[p][3]));
+                        inside = _mm256_and_ps(inside,
+                                        _mm256_cmp_ps(distance, negRadius,
+                                                _CMP_GE_OQ));
+                }
+
+                count += append_mask(_mm256_movemask_ps(inside), i,
+                                &a_visible[count]);
+        }
+
+        return count + cull_range_scalar(p_bounds, a_planes, i, end,
+                        &a_visible[count]);
+}
+#endif
+
+#if defined(__ARM_NEON)
+static uint32_t cull_range_neon(
+                const struct CullBounds *p_bounds,
+                const vec4 *a_planes,
+                uint32_t begin,
+                uint32_t end,
+                uint32_t *a_visible)
+{
+        float32x4_t planes[CULL_PLANE_COUNT][4];
+        for (size_t p = 0; p < CULL_PLANE_COUNT; p++)
+                for (size_t c = 0; c < 4; c++)
+                        planes[p][c] = vdupq_n_f32(a_planes[p][c]);
+
+        // Lane weights to gather the comparison into a bit mask
+        static const uint32_t LANE_BITS[4] = {1, 2, 4, 8};
+        uint32x4_t laneBits = vld1q_u32(LANE_BITS);
+
+        uint32_t count = 0;
+        uint32_t i = begin;
+        for (; i + 4 <= end; i += 4) {
+                float32x4_t x = vld1q_f32(&p_bounds->center_x[i]);
+                float32x4_t y = vld1q_f32(&p_bounds->center_y[i]);
+                float32x4_t z = vld1q_f32(&p_bounds->center_z[i]);
+                float32x4_t negRadius =
+                        vnegq_f32(vld1q_f32(&p_bounds->radius[i]));
+
+                uint32x4_t inside = vdupq_n_u32(UINT32_MAX);
+                for (size_t p = 0; p < CULL_PLANE_COUNT; p++) {
+                        float32x4_t distance = vaddq_f32(
+                                vaddq_f32(vmulq_f32(planes[p][0], x),
+                                        vmulq_f32(planes[p][1], y)),
+                                vaddq_f32(vmulq_f32(planes[p][2], z),
+                                        planes[p][3]));
+                        inside = vandq_u32(inside,
+                                        vcgeq_f32(distance, negRadius));
+                }
+
+                uint32x4_t bits = vandq_u32(inside, laneBits);
+                uint32x2_t pairs = vadd_u32(vget_low_u32(bits),
+                                vget_high_u32(bits));
+                uint32_t mask = vget_lane_u32(vpadd_u32(pairs, pairs), 0);
+
+                count += append_mask(mask, i, &a_visible[count]);
+        }
+
+        return count + cull_range_scalar(p_bounds, a_planes, i, end,
+                        &a_visible[count]);
+}
+#endif
+
+bool is_cull_kernel_supported(
+                enum CullKernel kernel)
+{
+        switch (kernel) {
+        case CULL_KERNEL_SCALAR:
+                return true;
+#if defined(__SSE2__)
+        case CULL_KERNEL_SSE:
+                return true;
+#endif
+#if defined(CULL_X86)
+        case CULL_KERNEL_AVX2:
+                __builtin_cpu_init();
+                return __builtin_cpu_supports("avx2");
+#endif
+#if defined(__ARM_NEON)
+        case CULL_KERNEL_NEON:
+                return true;
+#endif
+        default:
+                return false;
+        }
+}
+
+// The widest kernel the CPU runs
+enum CullKernel detect_cull_kernel()
+{
+        const enum CullKernel preferred[] = {
+                CULL_KERNEL_AVX2,
+                CULL_KERNEL_NEON,
+                CULL_KERNEL_SSE
+        };
+        for (size_t i = 0; i < sizeof(preferred) / sizeof(preferred[0]); i++)
+                if (is_cull_kernel_supported(preferred[i]))
+                        return preferred[i];
+
+        return CULL_KERNEL_SCALAR;
+}
+
+const char *cull_kernel_name(
+                enum CullKernel kernel)
+{
+        switch (kernel) {
+        case CULL_KERNEL_SSE:
+                return "SSE";
+        case CULL_KERNEL_AVX2:
+                return "AVX2";
+        case CULL_KERNEL_NEON:
+                return "NEON";
+        default:
+                return "scalar";
+        }
+}
+
+static CullRangeFunction get_cull_range_function(
+                enum CullKernel kernel)
+{
+        if (!is_cull_kernel_supported(kernel))
+                return cull_range_scalar;
+
+        switch (kernel) {
+#if defined(__SSE2__)
+        case CULL_KERNEL_SSE:
+                return cull_range_sse;
+#endif
+#if defined(CULL_X86)
+        case CULL_KERNEL_AVX2:
+                return cull_range_avx2;
+#endif
+#if defined(__ARM_NEON)
+        case CULL_KERNEL_NEON:
+                return cull_range_neon;
+#endif
+        default:
+                return cull_range_scalar;
+        }
+}
+
+// Tests every bound on the calling thread. a_visible must have room for
+// p_bounds->count indices, the visible ones are written in ascending order
+// and their number is returned.
+uint32_t cull_bounds(
+                const struct CullBounds *p_bounds,
+                const vec4 *a_planes,
+                enum CullKernel kernel,
+                uint32_t *a_visible)
+{
+        return get_cull_range_function(kernel)(p_bounds, a_planes, 0,
+                        p_bounds->count, a_visible);
+}
+
+// Chunks start on a block boundary so the kernels only do aligned loads
+static void get_chunk_range(uint32_t count, uint32_t chunk,
+                uint32_t chunks, uint32_t *p_begin, uint32_t *p_end)
+{
+        uint64_t blocks = (count + CULL_BLOCK_SIZE - 1) / CULL_BLOCK_SIZE;
+        uint64_t begin = blocks * chunk / chunks * CULL_BLOCK_SIZE;
+        uint64_t end = blocks * (chunk + 1) / chunks * CULL_BLOCK_SIZE;
+        *p_begin = begin < count ? begin : count;
+        *p_end = end < count ? end : count;
+}
+
+struct CullChunk {
+        CullRangeFunction cull_range;
+        const struct CullBounds *p_bounds;
+        const vec4 *a_planes;
+        uint32_t begin;
+        uint32_t end;
+        uint32_t *a_visible;
+        uint32_t visible_count;
+};
+
+static void cull_chunk_job(void *p_data)
+{
+        struct CullChunk *p_chunk = p_data;
+        p_chunk->visible_count = p_chunk->cull_range(p_chunk->p_bounds,
+                        p_chunk->a_planes, p_chunk->begin, p_chunk->end,
+                        &p_chunk->a_visible[p_chunk->begin]);
+}
+
+// Same as cull_bounds(), with the bounds split into chunks that are
+// tested as jobs. The calling thread runs chunks too while it waits.
+uint32_t cull_bounds_parallel(
+                struct JobSystem *p_job_system,
+                const struct CullBounds *p_bounds,
+                const vec4 *a_planes,
+                enum CullKernel kernel,
+                uint32_t *a_visible)
+{
+        TRACE_ZONE("cull_bounds_parallel");
+        uint32_t chunkCount =
+                p_job_system->worker_count * CULL_CHUNKS_PER_WORKER;
+        CullRangeFunction cullRange = get_cull_range_function(kernel);
+
+        struct CullChunk chunks[chunkCount];
+        struct Job jobs[chunkCount];
+        for (size_t i = 0; i < chunkCount; i++) {
+                chunks[i].cull_range = cullRange;
+                chunks[i].p_bounds = p_bounds;
+                chunks[i].a_planes = a_planes;
+                chunks[i].a_visible = a_visible;
+                get_chunk_range(p_bounds->count, i, chunkCount,
+                                &chunks[i].begin, &chunks[i].end);
+                jobs[i].function = cull_chunk_job;
+                jobs[i].p_data = &chunks[i];
+        }
+
+        struct JobCounter counter = {};
+        run_jobs(p_job_system, jobs, chunkCount, &counter);
+        wait_for_counter(p_job_system, &counter);
+
+        // Every chunk wrote its indices at the start of its own range,
+        // close the gaps between them
+        uint32_t visibleCount = 0;
+        for (size_t i = 0; i < chunkCount; i++) {
+                memmove(&a_visible[visibleCount],
+                                &a_visible[chunks[i].begin],
+                                chunks[i].visible_count * sizeof(uint32_t));
+                visibleCount += chunks[i].visible_count;
+        }
+
+        return visibleCount;
+}
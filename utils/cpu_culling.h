@@ -0,0 +1,69 @@
+#ifndef CPU_CULLING_H
+#define CPU_CULLING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <cglm/cglm.h>
+
+#include "job_system.h"
+
+#define CULL_PLANE_COUNT 6
+// Arrays are aligned and padded for the widest kernel
+#define CULL_ALIGNMENT 32
+#define CULL_BLOCK_SIZE 8
+
+// Bounding spheres in structure of arrays layout, so a SIMD kernel loads
+// the same component of several objects with a single aligned load.
+struct CullBounds {
+        float *center_x;
+        float *center_y;
+        float *center_z;
+        float *radius;
+        // Bounds that are culled, at most the count they were created with
+        uint32_t count;
+};
+
+enum CullKernel {
+        CULL_KERNEL_SCALAR,
+        CULL_KERNEL_SSE,
+        CULL_KERNEL_AVX2,
+        CULL_KERNEL_NEON
+};
+
+void create_cull_bounds(
+                uint32_t count,
+                struct CullBounds *p_bounds);
+
+void set_cull_bound(
+                struct CullBounds *p_bounds,
+                uint32_t index,
+                float x,
+                float y,
+                float z,
+                float radius);
+
+void destroy_cull_bounds(
+                struct CullBounds *p_bounds);
+
+enum CullKernel detect_cull_kernel();
+
+bool is_cull_kernel_supported(
+                enum CullKernel kernel);
+
+const char *cull_kernel_name(
+                enum CullKernel kernel);
+
+uint32_t cull_bounds(
+                const struct CullBounds *p_bounds,
+                const vec4 *a_planes,
+                enum CullKernel kernel,
+                uint32_t *a_visible);
+
+uint32_t cull_bounds_parallel(
+                struct JobSystem *p_job_system,
+                const struct CullBounds *p_bounds,
+                const vec4 *a_planes,
+                enum CullKernel kernel,
+                uint32_t *a_visible);
+
+#endif
@@ -1,4 +1,5 @@
 #include "file.h"
+#include "../debug/trace.h"
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -19,6 +20,7 @@ void free_filebytes(struct FileBytes *fileBytes)
 
 struct FileBytes *read_file(const char *filename)
 {
+        TRACE_ZONE("read_file");
         FILE *fileptr;
         struct FileBytes *buffer = new_filebytes();
 
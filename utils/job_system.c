@@ -0,0 +1,385 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../debug/print.h"
+#include "../debug/trace.h"
+#include "job_system.h"
+
+// Failed steal rounds before an idle worker goes to sleep
+#define IDLE_SPIN_COUNT 64
+
+struct WorkerStart {
+        struct JobSystem *p_job_system;
+        uint32_t index;
+};
+
+// The job system and worker the calling thread belongs to, if any
+static _Thread_local struct JobSystem *p_currentJobSystem = NULL;
+static _Thread_local uint32_t currentWorker = 0;
+
+
+static bool find_worker(const struct JobSystem *p_job_system,
+                uint32_t *p_worker)
+{
+        if (p_currentJobSystem != p_job_system)
+                return false;
+        *p_worker = currentWorker;
+        return true;
+}
+
+static void write_slot(struct JobSlot *p_slot, const struct Job *p_job,
+                struct JobCounter *p_counter)
+{
+        atomic_store_explicit(&p_slot->function, p_job->function,
+                        memory_order_relaxed);
+        atomic_store_explicit(&p_slot->p_data, p_job->p_data,
+                        memory_order_relaxed);
+        atomic_store_explicit(&p_slot->p_counter, p_counter,
+                        memory_order_relaxed);
+}
+
+static void read_slot(struct JobSlot *p_slot, struct Job *p_job,
+                struct JobCounter **pp_counter)
+{
+        p_job->function = atomic_load_explicit(&p_slot->function,
+                        memory_order_relaxed);
+        p_job->p_data = atomic_load_explicit(&p_slot->p_data,
+                        memory_order_relaxed);
+        *pp_counter = atomic_load_explicit(&p_slot->p_counter,
+                        memory_order_relaxed);
+}
+
+// Owner only. Returns false when the deque is full.
+static bool push_job(struct JobDeque *p_deque, const struct Job *p_job,
+                struct JobCounter *p_counter)
+{
+        int_fast64_t bottom = atomic_load_explicit(&p_deque->bottom,
+                        memory_order_relaxed);
+        int_fast64_t top = atomic_load_explicit(&p_deque->top,
+                        memory_order_acquire);
+        if (bottom - top >= JOB_DEQUE_CAPACITY)
+                return false;
+
+        write_slot(&p_deque->slots[bottom % JOB_DEQUE_CAPACITY], p_job,
+                        p_counter);
+        atomic_thread_fence(memory_order_release);
+        atomic_store_explicit(&p_deque->bottom, bottom + 1,
+                        memory_order_relaxed);
+        return true;
+}
+
+// Owner only, takes the most recently pushed job
+static bool take_job(struct JobDeque *p_deque, struct Job *p_job,
+                struct JobCounter **pp_counter)
+{
+        int_fast64_t bottom = atomic_load_explicit(&p_deque->bottom,
+                        memory_order_relaxed) - 1;
+        atomic_store_explicit(&p_deque->bottom, bottom, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        int_fast64_t top = atomic_load_explicit(&p_deque->top,
+                        memory_order_relaxed);
+
+        if (top > bottom) {
+                atomic_store_explicit(&p_deque->bottom, bottom + 1,
+                                memory_order_relaxed);
+                return false;
+        }
+
+        read_slot(&p_deque->slots[bottom % JOB_DEQUE_CAPACITY], p_job,
+                        pp_counter);
+        if (top < bottom)
+                return true;
+
+        // Last job, race the thieves for it
+        bool won = atomic_compare_exchange_strong_explicit(&p_deque->top,
+                        &top, top + 1, memory_order_seq_cst,
+                        memory_order_relaxed);
+        atomic_store_explicit(&p_deque->bottom, bottom + 1,
+                        memory_order_relaxed);
+        return won;
+}
+
+// Any thread, takes the oldest job
+static bool steal_job(struct JobDeque *p_deque, struct Job *p_job,
+                struct JobCounter **pp_counter)
+{
+        int_fast64_t top = atomic_load_explicit(&p_deque->top,
+                        memory_order_acquire);
+        atomic_thread_fence(memory_order_seq_cst);
+        int_fast64_t bottom = atomic_load_explicit(&p_deque->bottom,
+                        memory_order_acquire);
+        if (top >= bottom)
+                return false;
+
+        read_slot(&p_deque->slots[top % JOB_DEQUE_CAPACITY], p_job,
+                        pp_counter);
+        return atomic_compare_exchange_strong_explicit(&p_deque->top,
+                        &top, top + 1, memory_order_seq_cst,
+                        memory_order_relaxed);
+}
+
+static void execute_job(const struct Job *p_job,
+                struct JobCounter *p_counter)
+{
+        p_job->function(p_job->p_data);
+        atomic_fetch_sub_explicit(&p_counter->remaining, 1,
+                        memory_order_release);
+}
+
+// Runs one job from the worker's own deque, or else one stolen from
+// another worker. Returns false when no job was found.
+static bool run_one_job(struct JobSystem *p_job_system, uint32_t worker)
+{
+        struct Job job;
+        struct JobCounter *p_counter;
+
+        bool found = take_job(&p_job_system->deques[worker], &job,
+                        &p_counter);
+        for (uint32_t i = 1; !found && i < p_job_system->worker_count; i++) {
+                uint32_t victim = (worker + i) % p_job_system->worker_count;
+                found = steal_job(&p_job_system->deques[victim], &job,
+                                &p_counter);
+        }
+        if (!found)
+                return false;
+
+        atomic_fetch_sub(&p_job_system->queued, 1);
+        execute_job(&job, p_counter);
+        return true;
+}
+
+// Runs the oldest background job. Background threads only, returns false
+// when there is none.
+static bool run_background_job_from_queue(struct JobSystem *p_job_system)
+{
+        pthread_mutex_lock(&p_job_system->mutex);
+        if (p_job_system->background_count == 0) {
+                pthread_mutex_unlock(&p_job_system->mutex);
+                return false;
+        }
+
+        struct BackgroundJob job = p_job_system->background_jobs[
+                p_job_system->background_first];
+        p_job_system->background_first = (p_job_system->background_first
+                        + 1) % p_job_system->background_capacity;
+        p_job_system->background_count--;
+        atomic_fetch_sub(&p_job_system->queued, 1);
+        pthread_mutex_unlock(&p_job_system->mutex);
+
+        execute_job(&job.job, job.p_counter);
+        return true;
+}
+
+static void *worker_main(void *p_arg)
+{
+        struct WorkerStart start = *(struct WorkerStart *) p_arg;
+        free(p_arg);
+        TRACE_THREAD_NAME("Job worker");
+
+        struct JobSystem *p_job_system = start.p_job_system;
+        p_currentJobSystem = p_job_system;
+        currentWorker = start.index;
+
+        uint32_t idleRounds = 0;
+        while (!atomic_load(&p_job_system->quit)) {
+                if (run_one_job(p_job_system, start.index) ||
+                                run_background_job_from_queue(p_job_system)) {
+                        idleRounds = 0;
+                        continue;
+                }
+                if (++idleRounds < IDLE_SPIN_COUNT) {
+                        sched_yield();
+                        continue;
+                }
+
+                // Announce the sleep before checking for work, so a
+                // concurrent run_jobs() either sees the sleeper or this
+                // check sees its job
+                pthread_mutex_lock(&p_job_system->mutex);
+                atomic_fetch_add(&p_job_system->sleeping, 1);
+                while (atomic_load(&p_job_system->queued) == 0 &&
+                                !atomic_load(&p_job_system->quit))
+                        pthread_cond_wait(&p_job_system->work_ready,
+                                        &p_job_system->mutex);
+                atomic_fetch_sub(&p_job_system->sleeping, 1);
+                pthread_mutex_unlock(&p_job_system->mutex);
+                idleRounds = 0;
+        }
+
+        return NULL;
+}
+
+// Starts thread_count background workers. The calling thread becomes
+// worker 0 and has to be the one destroying the job system.
+void create_job_system(
+                uint32_t thread_count,
+                struct JobSystem *p_job_system)
+{
+        memset(p_job_system, 0, sizeof(*p_job_system));
+        p_job_system->worker_count = thread_count + 1;
+
+        p_job_system->deques = aligned_alloc(_Alignof(struct JobDeque),
+                        p_job_system->worker_count * sizeof(struct JobDeque));
+        p_job_system->threads = malloc(thread_count * sizeof(pthread_t));
+        if (p_job_system->deques == NULL) {
+                error("Failed to allocate job deques!");
+                exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < p_job_system->worker_count; i++) {
+                atomic_init(&p_job_system->deques[i].top, 0);
+                atomic_init(&p_job_system->deques[i].bottom, 0);
+        }
+
+        atomic_init(&p_job_system->queued, 0);
+        atomic_init(&p_job_system->sleeping, 0);
+        atomic_init(&p_job_system->quit, false);
+        pthread_mutex_init(&p_job_system->mutex, NULL);
+        pthread_cond_init(&p_job_system->work_ready, NULL);
+
+        p_currentJobSystem = p_job_system;
+        currentWorker = 0;
+
+        for (size_t i = 0; i < thread_count; i++) {
+                struct WorkerStart *p_start = malloc(sizeof(*p_start));
+                p_start->p_job_system = p_job_system;
+                p_start->index = i + 1;
+
+                if (pthread_create(&p_job_system->threads[i], NULL,
+                                        worker_main, p_start) != 0) {
+                        error("Failed to start job worker!");
+                        exit(EXIT_FAILURE);
+                }
+        }
+}
+
+// Queues the jobs on the calling worker and adds them to the counter.
+// Jobs run from a thread outside of the job system run right away.
+void run_jobs(
+                struct JobSystem *p_job_system,
+                const struct Job *a_jobs,
+                uint32_t job_count,
+                struct JobCounter *p_counter)
+{
+        atomic_fetch_add_explicit(&p_counter->remaining, job_count,
+                        memory_order_relaxed);
+
+        uint32_t worker;
+        if (!find_worker(p_job_system, &worker)) {
+                for (size_t i = 0; i < job_count; i++)
+                        execute_job(&a_jobs[i], p_counter);
+                return;
+        }
+
+        for (size_t i = 0; i < job_count; i++) {
+                // Counted before the push, so a thief never sees a job
+                // that is not counted yet
+                atomic_fetch_add(&p_job_system->queued, 1);
+                if (!push_job(&p_job_system->deques[worker], &a_jobs[i],
+                                        p_counter)) {
+                        atomic_fetch_sub(&p_job_system->queued, 1);
+                        execute_job(&a_jobs[i], p_counter);
+                }
+        }
+
+        if (atomic_load(&p_job_system->sleeping) > 0) {
+                pthread_mutex_lock(&p_job_system->mutex);
+                pthread_cond_broadcast(&p_job_system->work_ready);
+                pthread_mutex_unlock(&p_job_system->mutex);
+        }
+}
+
+// Queues a job for the background threads and adds it to the counter.
+// Any thread may queue one. Without background threads the job runs
+// right away.
+void run_background_job(
+                struct JobSystem *p_job_system,
+                const struct Job *p_job,
+                struct JobCounter *p_counter)
+{
+        atomic_fetch_add_explicit(&p_counter->remaining, 1,
+                        memory_order_relaxed);
+
+        if (p_job_system->worker_count == 1) {
+                execute_job(p_job, p_counter);
+                return;
+        }
+
+        pthread_mutex_lock(&p_job_system->mutex);
+        if (p_job_system->background_count ==
+                        p_job_system->background_capacity) {
+                uint32_t capacity = p_job_system->background_capacity > 0 ?
+                        p_job_system->background_capacity * 2 : 16;
+                struct BackgroundJob *jobs = malloc(capacity *
+                                sizeof(struct BackgroundJob));
+                if (jobs == NULL) {
+                        error("Failed to grow the background job queue!");
+                        exit(EXIT_FAILURE);
+                }
+
+                // Unwrap the ring into the new array
+                for (size_t i = 0; i < p_job_system->background_count; i++)
+                        jobs[i] = p_job_system->background_jobs[
+                                (p_job_system->background_first + i) %
+                                p_job_system->background_capacity];
+                free(p_job_system->background_jobs);
+                p_job_system->background_jobs = jobs;
+                p_job_system->background_first = 0;
+                p_job_system->background_capacity = capacity;
+        }
+
+        uint32_t last = (p_job_system->background_first +
+                        p_job_system->background_count) %
+                p_job_system->background_capacity;
+        p_job_system->background_jobs[last] = (struct BackgroundJob) {
+                *p_job, p_counter
+        };
+        p_job_system->background_count++;
+        atomic_fetch_add(&p_job_system->queued, 1);
+
+        pthread_cond_broadcast(&p_job_system->work_ready);
+        pthread_mutex_unlock(&p_job_system->mutex);
+}
+
+// Returns once every job of the counter has finished. A worker runs
+// other jobs while it waits, so waiting inside a job does not block a
+// thread and jobs can depend on jobs they start.
+void wait_for_counter(
+                struct JobSystem *p_job_system,
+                struct JobCounter *p_counter)
+{
+        TRACE_ZONE("wait_for_counter");
+        uint32_t worker;
+        bool isWorker = find_worker(p_job_system, &worker);
+
+        while (atomic_load_explicit(&p_counter->remaining,
+                                memory_order_acquire) > 0) {
+                if (!isWorker || !run_one_job(p_job_system, worker))
+                        sched_yield();
+        }
+}
+
+void destroy_job_system(
+                struct JobSystem *p_job_system)
+{
+        pthread_mutex_lock(&p_job_system->mutex);
+        atomic_store(&p_job_system->quit, true);
+        pthread_cond_broadcast(&p_job_system->work_ready);
+        pthread_mutex_unlock(&p_job_system->mutex);
+
+        for (size_t i = 0; i + 1 < p_job_system->worker_count; i++)
+                pthread_join(p_job_system->threads[i], NULL);
+
+        pthread_mutex_destroy(&p_job_system->mutex);
+        pthread_cond_destroy(&p_job_system->work_ready);
+        free(p_job_system->deques);
+        free(p_job_system->threads);
+        free(p_job_system->background_jobs);
+
+        if (p_currentJobSystem == p_job_system)
+                p_currentJobSystem = NULL;
+}
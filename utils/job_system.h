@@ -0,0 +1,94 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Jobs a single worker can have queued at once. Pushing onto a full
+// deque runs the job right away instead.
+#define JOB_DEQUE_CAPACITY 4096
+
+typedef void (*JobFunction)(void *p_data);
+
+struct Job {
+        JobFunction function;
+        void *p_data;
+};
+
+// Number of unfinished jobs started with it. A job that depends on
+// others waits on their counter, which runs other jobs in the meantime.
+struct JobCounter {
+        atomic_uint remaining;
+};
+
+// A queued job. The fields are atomic because a thief may read a slot
+// while its owner overwrites it, the thief then discards what it read.
+struct JobSlot {
+        _Atomic(JobFunction) function;
+        _Atomic(void *) p_data;
+        _Atomic(struct JobCounter *) p_counter;
+};
+
+// Chase-Lev work stealing deque. The owning worker pushes and takes at
+// the bottom, other workers steal from the top.
+struct JobDeque {
+        _Alignas(64) atomic_int_fast64_t top;
+        _Alignas(64) atomic_int_fast64_t bottom;
+        struct JobSlot slots[JOB_DEQUE_CAPACITY];
+};
+
+// A job that may run for a long time, like decoding an asset. Kept
+// apart from the deques so that it never delays jobs someone waits on.
+struct BackgroundJob {
+        struct Job job;
+        struct JobCounter *p_counter;
+};
+
+// Worker 0 is the thread that created the job system, it runs jobs
+// whenever it waits on a counter. Every other worker is a background
+// thread that sleeps while there is nothing to steal.
+//
+// Background jobs are only run by the background threads, in the order
+// they were queued, and only while no other job is left to steal.
+struct JobSystem {
+        uint32_t worker_count;
+        struct JobDeque *deques;
+        pthread_t *threads;
+        // FIFO ring of background jobs, guarded by the mutex
+        struct BackgroundJob *background_jobs;
+        uint32_t background_first;
+        uint32_t background_count;
+        uint32_t background_capacity;
+        // Deque and background jobs not taken yet
+        atomic_uint queued;
+        atomic_uint sleeping;
+        atomic_bool quit;
+        pthread_mutex_t mutex;
+        pthread_cond_t work_ready;
+};
+
+void create_job_system(
+                uint32_t thread_count,
+                struct JobSystem *p_job_system);
+
+void run_jobs(
+                struct JobSystem *p_job_system,
+                const struct Job *a_jobs,
+                uint32_t job_count,
+                struct JobCounter *p_counter);
+
+void run_background_job(
+                struct JobSystem *p_job_system,
+                const struct Job *p_job,
+                struct JobCounter *p_counter);
+
+void wait_for_counter(
+                struct JobSystem *p_job_system,
+                struct JobCounter *p_counter);
+
+void destroy_job_system(
+                struct JobSystem *p_job_system);
+
+#endif
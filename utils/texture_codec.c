@@ -0,0 +1,506 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "texture_codec.h"
+
+#define BLOCK_TEXELS (TEXTURE_BLOCK_SIZE * TEXTURE_BLOCK_SIZE)
+
+// ETC1 intensity modifiers, indexed by the table codeword
+static const int ETC_MODIFIERS[8][2] = {
+        {2, 8}, {5, 17}, {9, 29}, {13, 42},
+        {18, 60}, {24, 80}, {33, 106}, {47, 183}
+};
+
+// Distances of the ETC2 T and H modes
+static const int ETC2_DISTANCES[8] = {3, 6, 11, 16, 23, 32, 41, 64};
+
+
+uint32_t get_mip_level_count(
+                uint32_t width,
+                uint32_t height)
+{
+        uint32_t size = width > height ? width : height;
+        uint32_t levels = 1;
+        while (size > 1) {
+                size >>= 1;
+                levels++;
+        }
+        return levels;
+}
+
+uint32_t get_mip_extent(
+                uint32_t extent,
+                uint32_t level)
+{
+        extent >>= level;
+        return extent > 0 ? extent : 1;
+}
+
+size_t get_compressed_size(
+                uint32_t width,
+                uint32_t height,
+                size_t block_bytes)
+{
+        size_t blocksX = (width + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE;
+        size_t blocksY = (height + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE;
+        return blocksX * blocksY * block_bytes;
+}
+
+// Box filters the image to the next mip level. Odd edges repeat their
+// last texel.
+void downsample_rgba8(
+                const uint8_t *a_src,
+                uint32_t src_width,
+                uint32_t src_height,
+                uint8_t *a_dst)
+{
+        uint32_t width = get_mip_extent(src_width, 1);
+        uint32_t height = get_mip_extent(src_height, 1);
+
+        for (size_t y = 0; y < height; y++) {
+                size_t y0 = y * 2;
+                size_t y1 = y0 + 1 < src_height ? y0 + 1 : y0;
+                for (size_t x = 0; x < width; x++) {
+                        size_t x0 = x * 2;
+                        size_t x1 = x0 + 1 < src_width ? x0 + 1 : x0;
+                        for (size_t c = 0; c < 4; c++) {
+                                uint32_t sum =
+                                        a_src[(y0 * src_width + x0) * 4 + c] +
+                                        a_src[(y0 * src_width + x1) * 4 + c] +
+                                        a_src[(y1 * src_width + x0) * 4 + c] +
+                                        a_src[(y1 * src_width + x1) * 4 + c];
+                                a_dst[(y * width + x) * 4 + c] = (sum + 2) / 4;
+                        }
+                }
+        }
+}
+
+static uint8_t clamp_channel(int value)
+{
+        return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+static uint16_t pack_rgb565(const int *a_rgb)
+{
+        return (uint16_t) ((a_rgb[0] * 31 + 127) / 255 << 11 |
+                        (a_rgb[1] * 63 + 127) / 255 << 5 |
+                        (a_rgb[2] * 31 + 127) / 255);
+}
+
+static void unpack_rgb565(uint16_t color, int *a_rgb)
+{
+        int r = color >> 11 & 0x1f;
+        int g = color >> 5 & 0x3f;
+        int b = color & 0x1f;
+        a_rgb[0] = r << 3 | r >> 2;
+        a_rgb[1] = g << 2 | g >> 4;
+        a_rgb[2] = b << 3 | b >> 2;
+}
+
+// The four colors a BC1 block interpolates between. Alpha is zero for
+// the transparent fourth color of the three color mode.
+static void get_bc1_palette(uint16_t color0, uint16_t color1,
+                int a_palette[4][4])
+{
+        unpack_rgb565(color0, a_palette[0]);
+        unpack_rgb565(color1, a_palette[1]);
+        a_palette[0][3] = 255;
+        a_palette[1][3] = 255;
+
+        for (size_t c = 0; c < 3; c++) {
+                int c0 = a_palette[0][c];
+                int c1 = a_palette[1][c];
+                if (color0 > color1) {
+                        a_palette[2][c] = (2 * c0 + c1) / 3;
+                        a_palette[3][c] = (c0 + 2 * c1) / 3;
+                } else {
+                        a_palette[2][c] = (c0 + c1) / 2;
+                        a_palette[3][c] = 0;
+                }
+        }
+        a_palette[2][3] = 255;
+        a_palette[3][3] = color0 > color1 ? 255 : 0;
+}
+
+// Reads a block of texels, repeating the last row and column for blocks
+// that hang over the edge of the image
+static void read_block(const uint8_t *a_rgba, uint32_t width, uint32_t height,
+                uint32_t block_x, uint32_t block_y,
+                uint8_t a_texels[BLOCK_TEXELS][4])
+{
+        for (size_t y = 0; y < TEXTURE_BLOCK_SIZE; y++) {
+                size_t py = block_y * TEXTURE_BLOCK_SIZE + y;
+                if (py >= height)
+                        py = height - 1;
+                for (size_t x = 0; x < TEXTURE_BLOCK_SIZE; x++) {
+                        size_t px = block_x * TEXTURE_BLOCK_SIZE + x;
+                        if (px >= width)
+                                px = width - 1;
+                        memcpy(a_texels[y * TEXTURE_BLOCK_SIZE + x],
+                                        &a_rgba[(py * width + px) * 4], 4);
+                }
+        }
+}
+
+static void write_block(uint8_t *a_rgba, uint32_t width, uint32_t height,
+                uint32_t block_x, uint32_t block_y,
+                const uint8_t a_texels[BLOCK_TEXELS][4])
+{
+        for (size_t y = 0; y < TEXTURE_BLOCK_SIZE; y++) {
+                size_t py = block_y * TEXTURE_BLOCK_SIZE + y;
+                for (size_t x = 0; x < TEXTURE_BLOCK_SIZE; x++) {
+                        size_t px = block_x * TEXTURE_BLOCK_SIZE + x;
+                        if (px < width && py < height)
+                                memcpy(&a_rgba[(py * width + px) * 4],
+                                                a_texels[y * TEXTURE_BLOCK_SIZE + x],
+                                                4);
+                }
+        }
+}
+
+// Fits the endpoints to the inset bounding box of the block's colors,
+// which is fast and good enough for load time compression. Alpha is
+// dropped, the four color mode is always used.
+static void encode_bc1_block(const uint8_t a_texels[BLOCK_TEXELS][4],
+                uint8_t *p_block)
+{
+        int min[3] = {255, 255, 255};
+        int max[3] = {0, 0, 0};
+        for (size_t i = 0; i < BLOCK_TEXELS; i++) {
+                for (size_t c = 0; c < 3; c++) {
+                        if (a_texels[i][c] < min[c])
+                                min[c] = a_texels[i][c];
+                        if (a_texels[i][c] > max[c])
+                                max[c] = a_texels[i][c];
+                }
+        }
+        for (size_t c = 0; c < 3; c++) {
+                int inset = (max[c] - min[c]) / 16;
+                min[c] += inset;
+                max[c] -= inset;
+        }
+
+        uint16_t color0 = pack_rgb565(max);
+        uint16_t color1 = pack_rgb565(min);
+        if (color0 < color1) {
+                uint16_t swap = color0;
+                color0 = color1;
+                color1 = swap;
+        }
+
+        uint32_t indices = 0;
+        if (color0 != color1) {
+                int palette[4][4];
+                get_bc1_palette(color0, color1, palette);
+
+                for (size_t i = 0; i < BLOCK_TEXELS; i++) {
+                        uint32_t best = 0;
+                        int bestError = -1;
+                        for (size_t p = 0; p < 4; p++) {
+                                int error = 0;
+                                for (size_t c = 0; c < 3; c++) {
+                                        int d = a_texels[i][c] - palette[p][c];
+                                        error += d * d;
+                                }
+                                if (bestError < 0 || error < bestError) {
+                                        bestError = error;
+                                        best = p;
+                                }
+                        }
+                        indices |= best << (2 * i);
+                }
+        }
+
+        p_block[0] = color0 & 0xff;
+        p_block[1] = color0 >> 8;
+        p_block[2] = color1 & 0xff;
+        p_block[3] = color1 >> 8;
+        for (size_t i = 0; i < 4; i++)
+                p_block[4 + i] = indices >> (8 * i) & 0xff;
+}
+
+// Compresses an RGBA8 image into BC1 blocks, row by row
+void encode_bc1(
+                const uint8_t *a_rgba,
+                uint32_t width,
+                uint32_t height,
+                uint8_t *a_blocks)
+{
+        uint32_t blocksX = (width + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE;
+        uint32_t blocksY = (height + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE;
+
+        for (size_t by = 0; by < blocksY; by++) {
+                for (size_t bx = 0; bx < blocksX; bx++) {
+                        uint8_t texels[BLOCK_TEXELS][4];
+                        read_block(a_rgba, width, height, bx, by, texels);
+                        encode_bc1_block(texels,
+                                        &a_blocks[(by * blocksX + bx) *
+                                        BC1_BLOCK_BYTES]);
+                }
+        }
+}
+
+void decode_bc1(
+                const uint8_t *a_blocks,
+                uint32_t width,
+                uint32_t height,
+                uint8_t *a_rgba)
+{
+        uint32_t blocksX = (width + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE;
+        uint32_t blocksY = (height + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE;
+
+        for (size_t by = 0; by < blocksY; by++) {
+                for (size_t bx = 0; bx < blocksX; bx++) {
+                        const uint8_t *p_block = &a_blocks[
+                                (by * blocksX + bx) * BC1_BLOCK_BYTES];
+                        uint16_t color0 = p_block[0] | p_block[1] << 8;
+                        uint16_t color1 = p_block[2] | p_block[3] << 8;
+                        uint32_t indices = p_block[4] | p_block[5] << 8 |
+                                p_block[6] << 16 | (uint32_t) p_block[7] << 24;
+
+                        int palette[4][4];
+                        get_bc1_palette(color0, color1, palette);
+
+                        uint8_t texels[BLOCK_TEXELS][4];
+                        for (size_t i = 0; i < BLOCK_TEXELS; i++) {
+                                const int *p_color =
+                                        palette[indices >> (2 * i) & 3];
+                                for (size_t c = 0; c < 4; c++)
+                                        texels[i][c] = p_color[c];
+                        }
+                        write_block(a_rgba, width, height, bx, by, texels);
+                }
+        }
+}
+
+static uint32_t get_bits(uint64_t block, uint32_t high, uint32_t count)
+{
+        return block >> (high + 1 - count) & ((1u << count) - 1);
+}
+
+static int extend_4(uint32_t value)
+{
+        return value << 4 | value;
+}
+
+static int extend_5(uint32_t value)
+{
+        return value << 3 | value >> 2;
+}
+
+static int extend_6(uint32_t value)
+{
+        return value << 2 | value >> 4;
+}
+
+static int extend_7(uint32_t value)
+{
+        return value << 1 | value >> 6;
+}
+
+static void set_texel(uint8_t *p_texel, int r, int g, int b)
+{
+        p_texel[0] = clamp_channel(r);
+        p_texel[1] = clamp_channel(g);
+        p_texel[2] = clamp_channel(b);
+        p_texel[3] = 255;
+}
+
+// Two bit texel index of the ETC layout. Texels are numbered column by
+// column, the most significant bits are in the upper half of the word.
+static uint32_t get_etc_index(uint64_t block, uint32_t x, uint32_t y)
+{
+        uint32_t bit = x * TEXTURE_BLOCK_SIZE + y;
+        return (block >> (bit + 16) & 1) << 1 | (block >> bit & 1);
+}
+
+// Individual and differential modes, which ETC2 shares with ETC1
+static void decode_etc1_block(uint64_t block, const int a_base[2][3],
+                uint8_t a_texels[BLOCK_TEXELS][4])
+{
+        bool flip = block >> 32 & 1;
+        uint32_t tables[2] = {get_bits(block, 39, 3), get_bits(block, 36, 3)};
+
+        for (size_t y = 0; y < TEXTURE_BLOCK_SIZE; y++) {
+                for (size_t x = 0; x < TEXTURE_BLOCK_SIZE; x++) {
+                        uint32_t subBlock = flip ? y >= 2 : x >= 2;
+                        const int *p_modifiers =
+                                ETC_MODIFIERS[tables[subBlock]];
+                        uint32_t index = get_etc_index(block, x, y);
+                        int modifier = p_modifiers[index & 1];
+                        if (index & 2)
+                                modifier = -modifier;
+
+                        const int *p_base = a_base[subBlock];
+                        set_texel(a_texels[y * TEXTURE_BLOCK_SIZE + x],
+                                        p_base[0] + modifier,
+                                        p_base[1] + modifier,
+                                        p_base[2] + modifier);
+                }
+        }
+}
+
+// T and H modes pick every texel from four paint colors
+static void decode_paint_block(uint64_t block, const int a_paint[4][3],
+                uint8_t a_texels[BLOCK_TEXELS][4])
+{
+        for (size_t y = 0; y < TEXTURE_BLOCK_SIZE; y++) {
+                for (size_t x = 0; x < TEXTURE_BLOCK_SIZE; x++) {
+                        const int *p_paint =
+                                a_paint[get_etc_index(block, x, y)];
+                        set_texel(a_texels[y * TEXTURE_BLOCK_SIZE + x],
+                                        p_paint[0], p_paint[1], p_paint[2]);
+                }
+        }
+}
+
+static void decode_t_block(uint64_t block, uint8_t a_texels[BLOCK_TEXELS][4])
+{
+        int color0[3] = {
+                extend_4(get_bits(block, 60, 2) << 2 | get_bits(block, 57, 2)),
+                extend_4(get_bits(block, 55, 4)),
+                extend_4(get_bits(block, 51, 4))
+        };
+        int color1[3] = {
+                extend_4(get_bits(block, 47, 4)),
+                extend_4(get_bits(block, 43, 4)),
+                extend_4(get_bits(block, 39, 4))
+        };
+        int distance = ETC2_DISTANCES[get_bits(block, 35, 2) << 1 |
+                get_bits(block, 32, 1)];
+
+        int paint[4][3];
+        for (size_t c = 0; c < 3; c++) {
+                paint[0][c] = color0[c];
+                paint[1][c] = color1[c] + distance;
+                paint[2][c] = color1[c];
+                paint[3][c] = color1[c] - distance;
+        }
+        decode_paint_block(block, paint, a_texels);
+}
+
+static void decode_h_block(uint64_t block, uint8_t a_texels[BLOCK_TEXELS][4])
+{
+        uint32_t packed0[3] = {
+                get_bits(block, 62, 4),
+                get_bits(block, 58, 3) << 1 | get_bits(block, 52, 1),
+                get_bits(block, 51, 1) << 3 | get_bits(block, 49, 3)
+        };
+        uint32_t packed1[3] = {
+                get_bits(block, 46, 4),
+                get_bits(block, 42, 4),
+                get_bits(block, 38, 4)
+        };
+
+        // The order of the two colors stores the lowest distance bit
+        uint32_t value0 = packed0[0] << 8 | packed0[1] << 4 | packed0[2];
+        uint32_t value1 = packed1[0] << 8 | packed1[1] << 4 | packed1[2];
+        int distance = ETC2_DISTANCES[get_bits(block, 34, 1) << 2 |
+                get_bits(block, 32, 1) << 1 | (value0 >= value1)];
+
+        int paint[4][3];
+        for (size_t c = 0; c < 3; c++) {
+                paint[0][c] = extend_4(packed0[c]) + distance;
+                paint[1][c] = extend_4(packed0[c]) - distance;
+                paint[2][c] = extend_4(packed1[c]) + distance;
+                paint[3][c] = extend_4(packed1[c]) - distance;
+        }
+        decode_paint_block(block, paint, a_texels);
+}
+
+// Planar mode interpolates between an origin, horizontal and vertical color
+static void decode_planar_block(uint64_t block,
+                uint8_t a_texels[BLOCK_TEXELS][4])
+{
+        int origin[3] = {
+                extend_6(get_bits(block, 62, 6)),
+                extend_7(get_bits(block, 56, 1) << 6 | get_bits(block, 54, 6)),
+                extend_6(get_bits(block, 48, 1) << 5 |
+                                get_bits(block, 44, 2) << 3 |
+                                get_bits(block, 41, 3))
+        };
+        int horizontal[3] = {
+                extend_6(get_bits(block, 38, 5) << 1 | get_bits(block, 32, 1)),
+                extend_7(get_bits(block, 31, 7)),
+                extend_6(get_bits(block, 24, 6))
+        };
+        int vertical[3] = {
+                extend_6(get_bits(block, 18, 6)),
+                extend_7(get_bits(block, 12, 7)),
+                extend_6(get_bits(block, 5, 6))
+        };
+
+        for (size_t y = 0; y < TEXTURE_BLOCK_SIZE; y++) {
+                for (size_t x = 0; x < TEXTURE_BLOCK_SIZE; x++) {
+                        int color[3];
+                        for (size_t c = 0; c < 3; c++)
+                                color[c] = ((int) x * (horizontal[c] - origin[c]) +
+                                                (int) y * (vertical[c] - origin[c]) +
+                                                4 * origin[c] + 2) >> 2;
+                        set_texel(a_texels[y * TEXTURE_BLOCK_SIZE + x],
+                                        color[0], color[1], color[2]);
+                }
+        }
+}
+
+static void decode_etc2_rgb_block(const uint8_t *p_bytes,
+                uint8_t a_texels[BLOCK_TEXELS][4])
+{
+        uint64_t block = 0;
+        for (size_t i = 0; i < ETC2_RGB_BLOCK_BYTES; i++)
+                block = block << 8 | p_bytes[i];
+
+        int base[2][3];
+        if (!(block >> 33 & 1)) {
+                for (size_t c = 0; c < 3; c++) {
+                        base[0][c] = extend_4(get_bits(block, 63 - 8 * c, 4));
+                        base[1][c] = extend_4(get_bits(block, 59 - 8 * c, 4));
+                }
+                decode_etc1_block(block, base, a_texels);
+                return;
+        }
+
+        // A differential color that overflows selects one of the modes
+        // ETC2 added, red for T, green for H and blue for planar
+        int colors[3];
+        for (size_t c = 0; c < 3; c++) {
+                int color = get_bits(block, 63 - 8 * c, 5);
+                int delta = get_bits(block, 58 - 8 * c, 3);
+                if (delta >= 4)
+                        delta -= 8;
+                colors[c] = color + delta;
+                base[0][c] = extend_5(color);
+                base[1][c] = extend_5(colors[c] & 0x1f);
+        }
+
+        if (colors[0] < 0 || colors[0] > 31)
+                decode_t_block(block, a_texels);
+        else if (colors[1] < 0 || colors[1] > 31)
+                decode_h_block(block, a_texels);
+        else if (colors[2] < 0 || colors[2] > 31)
+                decode_planar_block(block, a_texels);
+        else
+                decode_etc1_block(block, base, a_texels);
+}
+
+// Decodes ETC2 RGB8 blocks, ETC1 data included, into opaque RGBA8
+void decode_etc2_rgb(
+                const uint8_t *a_blocks,
+                uint32_t width,
+                uint32_t height,
+                uint8_t *a_rgba)
+{
+        uint32_t blocksX = (width + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE;
+        uint32_t blocksY = (height + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE;
+
+        for (size_t by = 0; by < blocksY; by++) {
+                for (size_t bx = 0; bx < blocksX; bx++) {
+                        uint8_t texels[BLOCK_TEXELS][4];
+                        decode_etc2_rgb_block(&a_blocks[(by * blocksX + bx) *
+                                        ETC2_RGB_BLOCK_BYTES], texels);
+                        write_block(a_rgba, width, height, bx, by, texels);
+                }
+        }
+}
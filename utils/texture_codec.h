@@ -0,0 +1,49 @@
+#ifndef TEXTURE_CODEC_H
+#define TEXTURE_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Block compressed formats pack 4x4 texels into one block
+#define TEXTURE_BLOCK_SIZE 4
+#define BC1_BLOCK_BYTES 8
+#define ETC2_RGB_BLOCK_BYTES 8
+
+uint32_t get_mip_level_count(
+                uint32_t width,
+                uint32_t height);
+
+uint32_t get_mip_extent(
+                uint32_t extent,
+                uint32_t level);
+
+size_t get_compressed_size(
+                uint32_t width,
+                uint32_t height,
+                size_t block_bytes);
+
+void downsample_rgba8(
+                const uint8_t *a_src,
+                uint32_t src_width,
+                uint32_t src_height,
+                uint8_t *a_dst);
+
+void encode_bc1(
+                const uint8_t *a_rgba,
+                uint32_t width,
+                uint32_t height,
+                uint8_t *a_blocks);
+
+void decode_bc1(
+                const uint8_t *a_blocks,
+                uint32_t width,
+                uint32_t height,
+                uint8_t *a_rgba);
+
+void decode_etc2_rgb(
+                const uint8_t *a_blocks,
+                uint32_t width,
+                uint32_t height,
+                uint8_t *a_rgba);
+
+#endif
@@ -0,0 +1,459 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+
+#include "../debug/print.h"
+#include "../debug/trace.h"
+#include "vk_asset_streamer.h"
+#include "vk_buffer.h"
+#include "vk_command_pool.h"
+#include "vk_host_allocator.h"
+#include "vk_memory_budget.h"
+
+// Alignment of every asset in the staging ring
+#define STAGING_ALIGNMENT 16
+
+
+// Decodes queued assets in request order until none are left. Several
+// loaders may work on neighbouring assets at once, the uploads are put
+// back in order later.
+static void loader_job(void *p_data)
+{
+        struct AssetStreamer *p_asset_streamer = p_data;
+
+        for (;;) {
+                pthread_mutex_lock(&p_asset_streamer->mutex);
+                if (p_asset_streamer->next_load ==
+                                p_asset_streamer->asset_count ||
+                                p_asset_streamer->stop_loaders) {
+                        // Checked and given up under the lock, so
+                        // request_asset() sees the loader as gone
+                        p_asset_streamer->running_loaders--;
+                        pthread_mutex_unlock(&p_asset_streamer->mutex);
+                        break;
+                }
+
+                // The array may be resized by the render thread, so only
+                // touch it with the lock held
+                uint32_t index = p_asset_streamer->next_load++;
+                struct AssetRequest request =
+                        p_asset_streamer->assets[index].request;
+                p_asset_streamer->assets[index].state = ASSET_LOADING;
+                pthread_mutex_unlock(&p_asset_streamer->mutex);
+
+                VkDeviceSize size = 0;
+                void *p_data;
+                {
+                        TRACE_ZONE("load_asset");
+                        p_data = request.load(request.p_asset, &size);
+                }
+                if (p_data == NULL) {
+                        error("Failed to load asset %u!", index);
+                        exit(EXIT_FAILURE);
+                }
+
+                pthread_mutex_lock(&p_asset_streamer->mutex);
+                struct StreamedAsset *p_streamed =
+                        &p_asset_streamer->assets[index];
+                p_streamed->p_data = p_data;
+                p_streamed->size = size;
+                p_streamed->state = ASSET_LOADED;
+                pthread_mutex_unlock(&p_asset_streamer->mutex);
+        }
+}
+
+// The handles are only stored once the ring is complete, a memory
+// pressure handler may look at them while the memory is allocated.
+static VkResult create_staging_ring(
+                struct AssetStreamer *p_asset_streamer)
+{
+        VkDevice device = p_asset_streamer->device;
+        VkBuffer buffer;
+        VkDeviceMemory memory;
+        VkResult result = create_buffer(device,
+                        p_asset_streamer->physical_device,
+                        p_asset_streamer->ring_size,
+                        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                        &buffer, &memory);
+        if (result != VK_SUCCESS)
+                return result;
+
+        void *data;
+        vkMapMemory(device, memory, 0, p_asset_streamer->ring_size, 0, &data);
+        p_asset_streamer->staging_buffer = buffer;
+        p_asset_streamer->staging_memory = memory;
+        p_asset_streamer->p_staging = data;
+
+        return VK_SUCCESS;
+}
+
+static void destroy_staging_ring(
+                struct AssetStreamer *p_asset_streamer)
+{
+        if (p_asset_streamer->staging_memory == VK_NULL_HANDLE)
+                return;
+
+        VkDevice device = p_asset_streamer->device;
+        vkUnmapMemory(device, p_asset_streamer->staging_memory);
+        vkDestroyBuffer(device, p_asset_streamer->staging_buffer,
+                        get_host_allocator());
+        free_device_memory(device, p_asset_streamer->staging_memory);
+        p_asset_streamer->staging_buffer = VK_NULL_HANDLE;
+        p_asset_streamer->staging_memory = VK_NULL_HANDLE;
+        p_asset_streamer->p_staging = NULL;
+}
+
+void create_asset_streamer(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                uint32_t transfer_queue_family,
+                VkQueue transfer_queue,
+                VkDeviceSize staging_size,
+                VkDeviceSize bytes_per_frame,
+                struct JobSystem *p_job_system,
+                uint32_t loader_count,
+                struct AssetStreamer *p_asset_streamer)
+{
+        TRACE_ZONE("create_asset_streamer");
+        *p_asset_streamer = (struct AssetStreamer) {};
+        p_asset_streamer->device = device;
+        p_asset_streamer->queue = transfer_queue;
+        p_asset_streamer->bytes_per_frame = bytes_per_frame;
+        p_asset_streamer->physical_device = physical_device;
+        p_asset_streamer->ring_size = staging_size;
+
+        if (create_staging_ring(p_asset_streamer) != VK_SUCCESS) {
+                error("Failed to create streaming staging ring!");
+                exit(EXIT_FAILURE);
+        }
+
+        p_asset_streamer->command_pool = create_command_pool(&device,
+                        transfer_queue_family);
+
+        VkCommandBuffer commandBuffers[STREAM_UPLOAD_SLOT_COUNT];
+        VkCommandBufferAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = p_asset_streamer->command_pool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = STREAM_UPLOAD_SLOT_COUNT;
+
+        if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers)
+                        != VK_SUCCESS) {
+                error("Failed to allocate streaming command buffers!");
+                exit(EXIT_FAILURE);
+        }
+
+        VkFenceCreateInfo fenceInfo = {};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+        for (size_t i = 0; i < STREAM_UPLOAD_SLOT_COUNT; i++) {
+                struct StreamUploadSlot *p_slot = &p_asset_streamer->slots[i];
+                p_slot->command_buffer = commandBuffers[i];
+                if (vkCreateFence(device, &fenceInfo, get_host_allocator(),
+                                        &p_slot->fence)
+                                != VK_SUCCESS) {
+                        error("Failed to create streaming fence!");
+                        exit(EXIT_FAILURE);
+                }
+        }
+
+        pthread_mutex_init(&p_asset_streamer->mutex, NULL);
+
+        p_asset_streamer->p_job_system = p_job_system;
+        p_asset_streamer->loader_count = loader_count;
+}
+
+// Queues the asset for loading and returns right away, starting another
+// loader job if fewer than loader_count are running. Render thread only.
+void request_asset(
+                struct AssetStreamer *p_asset_streamer,
+                const struct AssetRequest *p_request)
+{
+        pthread_mutex_lock(&p_asset_streamer->mutex);
+        if (p_asset_streamer->asset_count == p_asset_streamer->asset_capacity) {
+                uint32_t capacity = p_asset_streamer->asset_capacity > 0 ?
+                        p_asset_streamer->asset_capacity * 2 : 16;
+                struct StreamedAsset *assets = realloc(p_asset_streamer->assets,
+                                capacity * sizeof(struct StreamedAsset));
+                if (assets == NULL) {
+                        error("Failed to grow the asset queue!");
+                        exit(EXIT_FAILURE);
+                }
+                p_asset_streamer->assets = assets;
+                p_asset_streamer->asset_capacity = capacity;
+        }
+
+        struct StreamedAsset *p_streamed =
+                &p_asset_streamer->assets[p_asset_streamer->asset_count++];
+        *p_streamed = (struct StreamedAsset) {};
+        p_streamed->request = *p_request;
+        p_streamed->state = ASSET_QUEUED;
+
+        bool startLoader = p_asset_streamer->running_loaders <
+                p_asset_streamer->loader_count;
+        if (startLoader)
+                p_asset_streamer->running_loaders++;
+        pthread_mutex_unlock(&p_asset_streamer->mutex);
+
+        // Queued outside the lock, without background threads the job
+        // runs right here
+        if (startLoader) {
+                struct Job job = {loader_job, p_asset_streamer};
+                run_background_job(p_asset_streamer->p_job_system, &job,
+                                &p_asset_streamer->loader_counter);
+        }
+}
+
+// Places size bytes in the staging ring. Fails when the ring is too full,
+// the data of uploads still in flight is never overwritten.
+static bool allocate_staging(
+                struct AssetStreamer *p_asset_streamer,
+                VkDeviceSize size,
+                VkDeviceSize *p_offset)
+{
+        VkDeviceSize head = (p_asset_streamer->ring_head +
+                        STAGING_ALIGNMENT - 1) & ~(VkDeviceSize)
+                (STAGING_ALIGNMENT - 1);
+        VkDeviceSize tail = p_asset_streamer->ring_tail;
+        VkDeviceSize ringSize = p_asset_streamer->ring_size;
+
+        // The head only meets the tail when the ring is empty
+        if (p_asset_streamer->ring_head >= tail) {
+                if (head + size <= ringSize)
+                        *p_offset = head;
+                else if (size < tail)
+                        *p_offset = 0;
+                else
+                        return false;
+        } else if (head + size < tail) {
+                *p_offset = head;
+        } else {
+                return false;
+        }
+
+        p_asset_streamer->ring_head = *p_offset + size;
+        return true;
+}
+
+// Hands the assets of finished uploads to their ready callbacks, oldest
+// upload first. Returns the number of assets made ready.
+static uint32_t retire_uploads(
+                struct AssetStreamer *p_asset_streamer)
+{
+        uint32_t readyCount = 0;
+
+        while (p_asset_streamer->busy_slot_count > 0) {
+                struct StreamUploadSlot *p_slot =
+                        &p_asset_streamer->slots[p_asset_streamer->oldest_slot];
+                if (vkGetFenceStatus(p_asset_streamer->device, p_slot->fence)
+                                != VK_SUCCESS)
+                        break;
+
+                for (size_t i = 0; i < p_slot->asset_count; i++) {
+                        struct StreamedAsset *p_streamed =
+                                &p_asset_streamer->assets[
+                                        p_slot->first_asset + i];
+                        const struct AssetRequest *p_request =
+                                &p_streamed->request;
+                        if (p_request->ready != NULL)
+                                p_request->ready(p_request->p_asset,
+                                                p_streamed->p_data,
+                                                p_streamed->size);
+
+                        free(p_streamed->p_data);
+                        p_streamed->p_data = NULL;
+                        p_streamed->state = ASSET_READY;
+                }
+                readyCount += p_slot->asset_count;
+
+                p_asset_streamer->ring_tail = p_slot->ring_end;
+                p_slot->busy = false;
+                p_asset_streamer->oldest_slot = (p_asset_streamer->oldest_slot
+                                + 1) % STREAM_UPLOAD_SLOT_COUNT;
+                p_asset_streamer->busy_slot_count--;
+        }
+
+        if (p_asset_streamer->busy_slot_count == 0) {
+                p_asset_streamer->ring_head = 0;
+                p_asset_streamer->ring_tail = 0;
+        }
+
+        p_asset_streamer->ready_count += readyCount;
+        return readyCount;
+}
+
+// Takes the decoded assets next in request order that fit the frame's
+// budget and the staging ring. At least one asset is taken when possible,
+// so an asset larger than the budget still gets uploaded.
+static uint32_t take_uploads(
+                struct AssetStreamer *p_asset_streamer)
+{
+        VkDeviceSize frameBytes = 0;
+        uint32_t count = 0;
+
+        pthread_mutex_lock(&p_asset_streamer->mutex);
+        while (p_asset_streamer->next_upload < p_asset_streamer->asset_count) {
+                struct StreamedAsset *p_streamed =
+                        &p_asset_streamer->assets[p_asset_streamer->next_upload];
+                if (p_streamed->state != ASSET_LOADED)
+                        break;
+
+                if (p_streamed->size > p_asset_streamer->ring_size) {
+                        error("Asset %u does not fit the staging ring!",
+                                        p_asset_streamer->next_upload);
+                        exit(EXIT_FAILURE);
+                }
+                if (count > 0 && frameBytes + p_streamed->size >
+                                p_asset_streamer->bytes_per_frame)
+                        break;
+                if (!allocate_staging(p_asset_streamer, p_streamed->size,
+                                        &p_streamed->staging_offset))
+                        break;
+
+                p_streamed->state = ASSET_UPLOADING;
+                frameBytes += p_streamed->size;
+                p_asset_streamer->next_upload++;
+                count++;
+        }
+        pthread_mutex_unlock(&p_asset_streamer->mutex);
+
+        return count;
+}
+
+// Retires finished uploads and starts the next one. Call once per frame
+// on the render thread, the ready callbacks run from here. Returns the
+// number of assets that became ready.
+uint32_t update_asset_streamer(
+                struct AssetStreamer *p_asset_streamer)
+{
+        TRACE_ZONE("update_asset_streamer");
+        uint32_t readyCount = retire_uploads(p_asset_streamer);
+
+        if (p_asset_streamer->busy_slot_count == STREAM_UPLOAD_SLOT_COUNT)
+                return readyCount;
+
+        // The ring may have been released under memory pressure. Bring it
+        // back once there is something to upload, or try again next frame.
+        if (p_asset_streamer->staging_memory == VK_NULL_HANDLE) {
+                if (p_asset_streamer->next_upload ==
+                                p_asset_streamer->asset_count ||
+                                create_staging_ring(p_asset_streamer)
+                                != VK_SUCCESS)
+                        return readyCount;
+        }
+
+        uint32_t firstAsset = p_asset_streamer->next_upload;
+        uint32_t assetCount = take_uploads(p_asset_streamer);
+        if (assetCount == 0)
+                return readyCount;
+
+        uint32_t slotIndex = (p_asset_streamer->oldest_slot +
+                        p_asset_streamer->busy_slot_count) %
+                STREAM_UPLOAD_SLOT_COUNT;
+        struct StreamUploadSlot *p_slot = &p_asset_streamer->slots[slotIndex];
+
+        vkResetCommandBuffer(p_slot->command_buffer, 0);
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(p_slot->command_buffer, &beginInfo);
+
+        // Loaders are done with these entries and only this thread
+        // resizes the array, so they are read without the lock
+        for (size_t i = 0; i < assetCount; i++) {
+                const struct StreamedAsset *p_streamed =
+                        &p_asset_streamer->assets[firstAsset + i];
+                memcpy(&p_asset_streamer->p_staging[p_streamed->staging_offset],
+                                p_streamed->p_data, p_streamed->size);
+
+                VkBufferCopy region = {};
+                region.srcOffset = p_streamed->staging_offset;
+                region.dstOffset = p_streamed->request.dst_offset;
+                region.size = p_streamed->size;
+                vkCmdCopyBuffer(p_slot->command_buffer,
+                                p_asset_streamer->staging_buffer,
+                                p_streamed->request.dst_buffer, 1, &region);
+
+                p_asset_streamer->uploaded_bytes += p_streamed->size;
+        }
+
+        if (vkEndCommandBuffer(p_slot->command_buffer) != VK_SUCCESS) {
+                error("Failed to record streaming upload!");
+                exit(EXIT_FAILURE);
+        }
+
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &p_slot->command_buffer;
+
+        vkResetFences(p_asset_streamer->device, 1, &p_slot->fence);
+        if (vkQueueSubmit(p_asset_streamer->queue, 1, &submitInfo,
+                                p_slot->fence) != VK_SUCCESS) {
+                error("Failed to submit streaming upload!");
+                exit(EXIT_FAILURE);
+        }
+
+        p_slot->busy = true;
+        p_slot->first_asset = firstAsset;
+        p_slot->asset_count = assetCount;
+        p_slot->ring_end = p_asset_streamer->ring_head;
+        p_asset_streamer->busy_slot_count++;
+
+        return readyCount;
+}
+
+// Frees the staging ring if no upload is using it, it is created again
+// when the next asset is uploaded. Render thread only, returns the bytes
+// freed.
+VkDeviceSize release_asset_streamer_staging(
+                struct AssetStreamer *p_asset_streamer)
+{
+        if (p_asset_streamer->busy_slot_count > 0 ||
+                        p_asset_streamer->staging_memory == VK_NULL_HANDLE)
+                return 0;
+
+        destroy_staging_ring(p_asset_streamer);
+        return p_asset_streamer->ring_size;
+}
+
+// Whether any requested asset is not ready yet. Render thread only.
+bool is_asset_streaming(
+                const struct AssetStreamer *p_asset_streamer)
+{
+        return p_asset_streamer->ready_count < p_asset_streamer->asset_count;
+}
+
+// The transfer queue must be idle and the job system still running.
+// Assets that are not ready yet are dropped without calling their ready
+// callback, loaders finish the asset they are decoding.
+void destroy_asset_streamer(
+                struct AssetStreamer *p_asset_streamer)
+{
+        pthread_mutex_lock(&p_asset_streamer->mutex);
+        p_asset_streamer->stop_loaders = true;
+        pthread_mutex_unlock(&p_asset_streamer->mutex);
+
+        wait_for_counter(p_asset_streamer->p_job_system,
+                        &p_asset_streamer->loader_counter);
+
+        for (size_t i = 0; i < p_asset_streamer->asset_count; i++)
+                free(p_asset_streamer->assets[i].p_data);
+        free(p_asset_streamer->assets);
+
+        VkDevice device = p_asset_streamer->device;
+        for (size_t i = 0; i < STREAM_UPLOAD_SLOT_COUNT; i++)
+                vkDestroyFence(device, p_asset_streamer->slots[i].fence,
+                                get_host_allocator());
+        vkDestroyCommandPool(device, p_asset_streamer->command_pool,
+                        get_host_allocator());
+
+        destroy_staging_ring(p_asset_streamer);
+
+        pthread_mutex_destroy(&p_asset_streamer->mutex);
+}
@@ -0,0 +1,135 @@
+#ifndef VK_ASSET_STREAMER_H
+#define VK_ASSET_STREAMER_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+#include "../utils/job_system.h"
+
+// Uploads that can be in flight on the transfer queue at once
+#define STREAM_UPLOAD_SLOT_COUNT 4
+
+// Reads and decodes an asset, runs as a background job. Returns the bytes
+// to upload allocated with malloc, and their size in p_size.
+typedef void *(*AssetLoadFunction)(void *p_asset, VkDeviceSize *p_size);
+
+// Runs on the render thread once the bytes are in the destination buffer.
+// p_data are the decoded bytes, they are freed after the call.
+typedef void (*AssetReadyFunction)(void *p_asset, const void *p_data,
+                VkDeviceSize size);
+
+struct AssetRequest {
+        AssetLoadFunction load;
+        AssetReadyFunction ready;
+        void *p_asset;
+        // Must be usable by the transfer queue family and have the
+        // transfer destination usage
+        VkBuffer dst_buffer;
+        VkDeviceSize dst_offset;
+};
+
+enum AssetState {
+        ASSET_QUEUED,
+        ASSET_LOADING,
+        // Decoded, waiting for its turn to be uploaded
+        ASSET_LOADED,
+        ASSET_UPLOADING,
+        ASSET_READY
+};
+
+struct StreamedAsset {
+        struct AssetRequest request;
+        enum AssetState state;
+        void *p_data;
+        VkDeviceSize size;
+        VkDeviceSize staging_offset;
+};
+
+struct StreamUploadSlot {
+        VkCommandBuffer command_buffer;
+        VkFence fence;
+        bool busy;
+        // The slot uploads a contiguous range of the assets
+        uint32_t first_asset;
+        uint32_t asset_count;
+        // Ring offset just past the slot's staging data
+        VkDeviceSize ring_end;
+};
+
+// Streams assets in the background instead of uploading them at startup.
+//
+// Loader jobs on the background threads of the job system read and
+// decode requested assets in parallel. Once per
+// frame update_asset_streamer() copies decoded assets into a persistently
+// mapped staging ring and submits their copies to the transfer queue, up
+// to a byte budget so a burst of assets cannot stall the frame. Uploads
+// whose fence has signalled are handed back through their ready callback
+// on the render thread.
+//
+// Assets are uploaded and made ready in the order they were requested,
+// whatever order the loaders finish them in.
+struct AssetStreamer {
+        VkDevice device;
+        VkPhysicalDevice physical_device;
+        VkQueue queue;
+        VkCommandPool command_pool;
+        VkDeviceSize bytes_per_frame;
+        // Released under memory pressure while no upload is in flight
+        VkBuffer staging_buffer;
+        VkDeviceMemory staging_memory;
+        uint8_t *p_staging;
+        VkDeviceSize ring_size;
+        // The data of in-flight uploads lies between tail and head,
+        // wrapping around at the end of the ring
+        VkDeviceSize ring_head;
+        VkDeviceSize ring_tail;
+        struct StreamUploadSlot slots[STREAM_UPLOAD_SLOT_COUNT];
+        uint32_t oldest_slot;
+        uint32_t busy_slot_count;
+        // Every request made so far, in request order. Only the render
+        // thread resizes the array.
+        struct StreamedAsset *assets;
+        uint32_t asset_count;
+        uint32_t asset_capacity;
+        uint32_t next_load;
+        uint32_t next_upload;
+        uint32_t ready_count;
+        VkDeviceSize uploaded_bytes;
+        struct JobSystem *p_job_system;
+        // Each loader job decodes queued assets until none are left
+        uint32_t loader_count;
+        uint32_t running_loaders;
+        struct JobCounter loader_counter;
+        bool stop_loaders;
+        pthread_mutex_t mutex;
+};
+
+void create_asset_streamer(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                uint32_t transfer_queue_family,
+                VkQueue transfer_queue,
+                VkDeviceSize staging_size,
+                VkDeviceSize bytes_per_frame,
+                struct JobSystem *p_job_system,
+                uint32_t loader_count,
+                struct AssetStreamer *p_asset_streamer);
+
+void request_asset(
+                struct AssetStreamer *p_asset_streamer,
+                const struct AssetRequest *p_request);
+
+uint32_t update_asset_streamer(
+                struct AssetStreamer *p_asset_streamer);
+
+VkDeviceSize release_asset_streamer_staging(
+                struct AssetStreamer *p_asset_streamer);
+
+bool is_asset_streaming(
+                const struct AssetStreamer *p_asset_streamer);
+
+void destroy_asset_streamer(
+                struct AssetStreamer *p_asset_streamer);
+
+#endif
@@ -0,0 +1,224 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+
+#include "../debug/print.h"
+#include "vk_buffer.h"
+#include "vk_host_allocator.h"
+#include "vk_memory_budget.h"
+
+
+bool try_find_memory_type(
+                VkPhysicalDevice physical_device,
+                uint32_t type_filter,
+                VkMemoryPropertyFlags properties,
+                uint32_t *p_type_index)
+{
+        VkPhysicalDeviceMemoryProperties memProperties;
+        vkGetPhysicalDeviceMemoryProperties(physical_device, &memProperties);
+
+        for (size_t i = 0; i < memProperties.memoryTypeCount; i++) {
+                if (type_filter & (1 << i) &&
+                                (memProperties.memoryTypes[i].propertyFlags &
+                                 properties) == properties) {
+                        *p_type_index = i;
+                        return true;
+                }
+        }
+
+        return false;
+}
+
+uint32_t find_memory_type(
+                VkPhysicalDevice physical_device,
+                uint32_t type_filter,
+                VkMemoryPropertyFlags properties)
+{
+        uint32_t typeIndex;
+        if (try_find_memory_type(physical_device, type_filter, properties,
+                                &typeIndex))
+                return typeIndex;
+
+        error("Failed to find suitable memory type!");
+        exit(EXIT_FAILURE);
+}
+
+VkResult create_buffer_concurrent(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                VkDeviceSize size,
+                VkBufferUsageFlags usage,
+                VkMemoryPropertyFlags properties,
+                const uint32_t *a_queue_families,
+                uint32_t queue_family_count,
+                VkBuffer *p_buffer,
+                VkDeviceMemory *p_buffer_memory)
+{
+        // Concurrent sharing requires every family index to be unique,
+        // so drop duplicates before deciding on the sharing mode.
+        uint32_t uniqueFamilies[queue_family_count + 1];
+        uint32_t uniqueCount = 0;
+        for (size_t i = 0; i < queue_family_count; i++) {
+                bool seen = false;
+                for (size_t j = 0; j < uniqueCount; j++)
+                        seen |= uniqueFamilies[j] == a_queue_families[i];
+                if (!seen)
+                        uniqueFamilies[uniqueCount++] = a_queue_families[i];
+        }
+
+        VkBufferCreateInfo bufferInfo = {};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+
+        if (uniqueCount > 1) {
+                bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+                bufferInfo.queueFamilyIndexCount = uniqueCount;
+                bufferInfo.pQueueFamilyIndices = uniqueFamilies;
+        } else {
+                bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        }
+
+        VkResult result = vkCreateBuffer(device, &bufferInfo,
+                        get_host_allocator(), p_buffer);
+        if (result != VK_SUCCESS)
+                return result;
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(device, *p_buffer, &memRequirements);
+
+        VkMemoryAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memRequirements.size;
+        allocInfo.memoryTypeIndex =
+                find_memory_type(physical_device,
+                                memRequirements.memoryTypeBits, properties);
+
+        result = allocate_device_memory(device, &allocInfo, p_buffer_memory);
+        if (result != VK_SUCCESS) {
+                vkDestroyBuffer(device, *p_buffer, get_host_allocator());
+                return result;
+        }
+
+        return vkBindBufferMemory(device, *p_buffer, *p_buffer_memory, 0);
+}
+
+VkResult create_buffer(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                VkDeviceSize size,
+                VkBufferUsageFlags usage,
+                VkMemoryPropertyFlags properties,
+                VkBuffer *p_buffer,
+                VkDeviceMemory *p_buffer_memory)
+{
+        return create_buffer_concurrent(device, physical_device, size, usage,
+                        properties, NULL, 0, p_buffer, p_buffer_memory);
+}
+
+VkCommandBuffer begin_single_time_commands(
+                VkDevice device,
+                VkCommandPool command_pool)
+{
+        VkCommandBufferAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = command_pool;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer)
+                        != VK_SUCCESS) {
+                error("Failed to allocate transfer command buffer!");
+                exit(EXIT_FAILURE);
+        }
+
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+        return commandBuffer;
+}
+
+void end_single_time_commands(
+                VkDevice device,
+                VkCommandPool command_pool,
+                VkQueue queue,
+                VkCommandBuffer command_buffer)
+{
+        vkEndCommandBuffer(command_buffer);
+
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &command_buffer;
+
+        if (vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE)
+                        != VK_SUCCESS) {
+                error("Failed to submit transfer command buffer!");
+                exit(EXIT_FAILURE);
+        }
+        vkQueueWaitIdle(queue);
+
+        vkFreeCommandBuffers(device, command_pool, 1, &command_buffer);
+}
+
+void copy_buffer(
+                VkDevice device,
+                VkCommandPool command_pool,
+                VkQueue queue,
+                VkBuffer src_buffer,
+                VkBuffer dst_buffer,
+                VkDeviceSize size)
+{
+        VkCommandBuffer commandBuffer =
+                begin_single_time_commands(device, command_pool);
+
+        VkBufferCopy copyRegion = {};
+        copyRegion.srcOffset = 0;
+        copyRegion.dstOffset = 0;
+        copyRegion.size = size;
+        vkCmdCopyBuffer(commandBuffer, src_buffer, dst_buffer, 1, &copyRegion);
+
+        end_single_time_commands(device, command_pool, queue, commandBuffer);
+}
+
+// Copies host data into a device local buffer through a temporary
+// host visible staging buffer.
+void upload_buffer(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                VkCommandPool command_pool,
+                VkQueue queue,
+                VkBuffer dst_buffer,
+                const void *p_data,
+                VkDeviceSize size)
+{
+        VkBuffer stagingBuffer;
+        VkDeviceMemory stagingBufferMemory;
+
+        if (create_buffer(device, physical_device, size,
+                                VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                &stagingBuffer, &stagingBufferMemory)
+                        != VK_SUCCESS) {
+                error("Failed to create staging buffer!");
+                exit(EXIT_FAILURE);
+        }
+
+        void *data;
+        vkMapMemory(device, stagingBufferMemory, 0, size, 0, &data);
+        memcpy(data, p_data, (size_t) size);
+        vkUnmapMemory(device, stagingBufferMemory);
+
+        copy_buffer(device, command_pool, queue,
+                        stagingBuffer, dst_buffer, size);
+
+        vkDestroyBuffer(device, stagingBuffer, get_host_allocator());
+        free_device_memory(device, stagingBufferMemory);
+}
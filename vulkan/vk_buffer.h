@@ -0,0 +1,66 @@
+#ifndef VK_BUFFER_H
+#define VK_BUFFER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+bool try_find_memory_type(
+                VkPhysicalDevice physical_device,
+                uint32_t type_filter,
+                VkMemoryPropertyFlags properties,
+                uint32_t *p_type_index);
+
+uint32_t find_memory_type(
+                VkPhysicalDevice physical_device,
+                uint32_t type_filter,
+                VkMemoryPropertyFlags properties);
+
+VkResult create_buffer(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                VkDeviceSize size,
+                VkBufferUsageFlags usage,
+                VkMemoryPropertyFlags properties,
+                VkBuffer *p_buffer,
+                VkDeviceMemory *p_buffer_memory);
+
+VkResult create_buffer_concurrent(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                VkDeviceSize size,
+                VkBufferUsageFlags usage,
+                VkMemoryPropertyFlags properties,
+                const uint32_t *a_queue_families,
+                uint32_t queue_family_count,
+                VkBuffer *p_buffer,
+                VkDeviceMemory *p_buffer_memory);
+
+VkCommandBuffer begin_single_time_commands(
+                VkDevice device,
+                VkCommandPool command_pool);
+
+void end_single_time_commands(
+                VkDevice device,
+                VkCommandPool command_pool,
+                VkQueue queue,
+                VkCommandBuffer command_buffer);
+
+void copy_buffer(
+                VkDevice device,
+                VkCommandPool command_pool,
+                VkQueue queue,
+                VkBuffer src_buffer,
+                VkBuffer dst_buffer,
+                VkDeviceSize size);
+
+void upload_buffer(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                VkCommandPool command_pool,
+                VkQueue queue,
+                VkBuffer dst_buffer,
+                const void *p_data,
+                VkDeviceSize size);
+
+#endif
@@ -4,7 +4,14 @@
 
 #include "../debug/print.h"
 #include "vk_vertex_data.h"
-#include "../datastructures/list.h"
+#include "vk_particle_system.h"
+#include "vk_gpu_culling.h"
+#include "vk_mesh_registry.h"
+#include "vk_command_buffer.h"
+#include "vk_render_graph.h"
+#include "vk_frame_capture.h"
+#include "vk_gpu_timer.h"
+#include "vk_resolution_scaler.h"
 
 VkCommandBuffer *create_command_buffer(
                 VkDevice *p_device,
@@ -28,15 +35,192 @@ VkCommandBuffer *create_command_buffer(
         return commandBuffers;
 }
 
+// What the passes of one output are recorded from
+struct FramePasses {
+        const struct FrameRecordInfo *p_info;
+        const struct FrameOutputInfo *p_output;
+        // Extent of the scene, below the swap chain extent when scaling
+        VkExtent2D render_extent;
+};
+
+static void record_cull_pass(
+                VkCommandBuffer command_buffer,
+                void *p_user_data)
+{
+        const struct FrameRecordInfo *p_info = p_user_data;
+
+        record_gpu_culling(p_info->p_gpu_culling, command_buffer,
+                        p_info->current_frame);
+}
+
+static void record_scene_pass(
+                VkCommandBuffer command_buffer,
+                void *p_user_data)
+{
+        const struct FramePasses *p_passes = p_user_data;
+        const struct FrameRecordInfo *p_info = p_passes->p_info;
+        // The scale follows the cost of the scene alone
+        const struct ResolutionScaler *p_scaler =
+                p_passes->p_output->p_resolution_scaler;
+        if (p_scaler != NULL)
+                begin_resolution_scaler_timing(p_scaler, command_buffer,
+                                p_info->current_frame);
+
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                        p_info->graphics_pipeline);
+        vkCmdBindDescriptorSets(command_buffer,
+                        VK_PIPELINE_BIND_POINT_GRAPHICS,
+                        p_info->graphics_pipeline_layout, 0, 1,
+                        &p_info->texture_set, 0, NULL);
+        if (p_info->bindless)
+                vkCmdPushConstants(command_buffer,
+                                p_info->graphics_pipeline_layout,
+                                VK_SHADER_STAGE_VERTEX_BIT |
+                                VK_SHADER_STAGE_FRAGMENT_BIT,
+                                0, sizeof(uint32_t), &p_info->texture_index);
+
+        // Dynamic state, shared by every graphics pipeline bound below
+        VkViewport viewport = {};
+        viewport.width = (float) p_passes->render_extent.width;
+        viewport.height = (float) p_passes->render_extent.height;
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+
+        VkRect2D scissor = {};
+        scissor.extent = p_passes->render_extent;
+        vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+        bind_mesh_registry(p_info->p_mesh_registry, command_buffer);
+
+        // Opaque objects first so the particles are tested against them
+        record_object_draw(p_info->p_gpu_culling, command_buffer,
+                        p_info->current_frame, p_info->gpu_driven);
+
+        record_particle_draw(p_info->p_particle_system, command_buffer,
+                        p_info->current_frame);
+
+        if (p_scaler != NULL)
+                end_resolution_scaler_timing(p_scaler, command_buffer,
+                                p_info->current_frame);
+}
+
+static void record_upscale_pass(
+                VkCommandBuffer command_buffer,
+                void *p_user_data)
+{
+        const struct FramePasses *p_passes = p_user_data;
+        const struct FrameOutputInfo *p_output = p_passes->p_output;
+
+        record_resolution_upscale(p_output->p_resolution_scaler,
+                        command_buffer, p_passes->p_info->current_frame,
+                        p_output->swap_chain_image, p_output->extent);
+}
+
+static void record_capture_pass(
+                VkCommandBuffer command_buffer,
+                void *p_user_data)
+{
+        const struct FramePasses *p_passes = p_user_data;
+        const struct FrameRecordInfo *p_info = p_passes->p_info;
+        const struct FrameOutputInfo *p_output = p_passes->p_output;
+
+        record_frame_capture(p_info->p_frame_capture, command_buffer,
+                        p_output->swap_chain_image,
+                        p_output->swap_chain_format, p_output->extent,
+                        p_info->frame_number, p_info->capture_format);
+}
+
+// Declares the scene of one output in the graph, rendered after the
+// culling pass and followed by the upscale and capture when enabled
+static void add_output_passes(
+                struct RenderGraph *p_graph,
+                VkCommandBuffer command_buffer,
+                struct FramePasses *p_passes,
+                uint32_t indirect_buffer,
+                uint32_t visible_buffer)
+{
+        const struct FrameRecordInfo *p_info = p_passes->p_info;
+        const struct FrameOutputInfo *p_output = p_passes->p_output;
+        p_passes->render_extent = p_output->extent;
+
+        // The acquire semaphore is waited on at the color output stage
+        uint32_t swapChainImage = import_render_graph_image(p_graph,
+                        p_output->swap_chain_image,
+                        p_output->swap_chain_image_view,
+                        p_output->swap_chain_format, p_output->extent,
+                        VK_IMAGE_LAYOUT_UNDEFINED,
+                        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                        p_output->offscreen ? VK_IMAGE_LAYOUT_UNDEFINED :
+                        VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+        // The scene is rendered into the offscreen image when scaling.
+        // Its previous frame has finished by the time the slot is reused.
+        struct ResolutionScaler *p_scaler = p_output->p_resolution_scaler;
+        uint32_t target = swapChainImage;
+        if (p_scaler != NULL) {
+                uint32_t frame = p_info->current_frame;
+                p_passes->render_extent = begin_resolution_scaler_frame(
+                                p_scaler, command_buffer, frame);
+                target = import_render_graph_image(p_graph,
+                                p_scaler->images[frame],
+                                p_scaler->image_views[frame],
+                                p_scaler->format, p_scaler->max_extent,
+                                VK_IMAGE_LAYOUT_UNDEFINED,
+                                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                                VK_IMAGE_LAYOUT_UNDEFINED);
+        }
+
+        // Only used by this output's render pass, so the depth images of
+        // all outputs share memory. An output that is skipped for a while
+        // leaves its image to the graph until it is back.
+        uint32_t depth = add_render_graph_transient(p_graph,
+                        p_info->depth_format, p_output->extent);
+
+        VkClearValue clearColor = {};
+        clearColor.color = (VkClearColorValue) {{0.0f, 0.0f, 0.0f, 1.0f}};
+        VkClearValue clearDepth = {};
+        clearDepth.depthStencil = (VkClearDepthStencilValue) {1.0f, 0};
+
+        uint32_t render = add_render_graph_pass(p_graph, "render",
+                        p_passes->render_extent, false, record_scene_pass,
+                        p_passes);
+        clear_render_graph_attachment(p_graph, render, target, clearColor);
+        clear_render_graph_attachment(p_graph, render, depth, clearDepth);
+        if (p_info->gpu_driven) {
+                use_render_graph_resource(p_graph, render, indirect_buffer,
+                                RENDER_GRAPH_INDIRECT_READ);
+                use_render_graph_resource(p_graph, render, visible_buffer,
+                                RENDER_GRAPH_VERTEX_READ);
+        }
+
+        if (p_scaler != NULL) {
+                uint32_t upscale = add_render_graph_pass(p_graph, "upscale",
+                                p_output->extent, false, record_upscale_pass,
+                                p_passes);
+                use_render_graph_resource(p_graph, upscale, target,
+                                RENDER_GRAPH_TRANSFER_SRC);
+                use_render_graph_resource(p_graph, upscale, swapChainImage,
+                                RENDER_GRAPH_TRANSFER_DST);
+        }
+
+        // The readback is used by the host, which the graph cannot see
+        if (p_output->capture) {
+                uint32_t capture = add_render_graph_pass(p_graph, "capture",
+                                p_output->extent, true, record_capture_pass,
+                                p_passes);
+                use_render_graph_resource(p_graph, capture, swapChainImage,
+                                RENDER_GRAPH_TRANSFER_SRC);
+        }
+}
+
+// Declares the frame as a render graph: culling once, then the scene of
+// every output with its upscale and capture readback, each one only when
+// enabled. The graph takes care of the barriers between them and of the
+// depth images.
 void record_command_buffer(
-                VkRenderPass *p_render_pass,
-                VkFramebuffer *frame_buffers,
-                VkExtent2D *p_extent,
-                VkPipeline *p_graphics_pipeline,
                 VkCommandBuffer command_buffer,
-                uint32_t image_index,
-                const uint32_t vertices_size,
-                VkBuffer p_vertex_buffer)
+                const struct FrameRecordInfo *p_info)
 {
         VkCommandBufferBeginInfo beginInfo = {};
         beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -48,33 +232,47 @@ void record_command_buffer(
                 exit(EXIT_FAILURE);
         }
 
-        VkRenderPassBeginInfo renderPassInfo = {};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = *p_render_pass;
-        renderPassInfo.framebuffer = frame_buffers[image_index];
-        VkOffset2D offset = {0, 0};
-        renderPassInfo.renderArea.offset = offset;
-        renderPassInfo.renderArea.extent = *p_extent;
-        VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-        renderPassInfo.clearValueCount = 1;
-        renderPassInfo.pClearValues = &clearColor;
+        begin_gpu_timer_frame(p_info->p_gpu_timer, command_buffer,
+                        p_info->current_frame);
 
-        vkCmdBeginRenderPass(command_buffer, &renderPassInfo,
-                        VK_SUBPASS_CONTENTS_INLINE);
+        struct RenderGraph *p_graph = p_info->p_render_graph;
+        begin_render_graph(p_graph);
 
-        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, *p_graphics_pipeline);
+        uint32_t indirectBuffer = 0;
+        uint32_t visibleBuffer = 0;
+        if (p_info->gpu_driven) {
+                const struct GpuCulling *p_culling = p_info->p_gpu_culling;
+                indirectBuffer = import_render_graph_buffer(p_graph,
+                                p_culling->indirect_buffers[
+                                p_info->current_frame]);
+                visibleBuffer = import_render_graph_buffer(p_graph,
+                                p_culling->visible_buffers[
+                                p_info->current_frame]);
 
-        VkBuffer vertexBuffers[] = {p_vertex_buffer};
-        VkDeviceSize offsets[] = {0};
-        vkCmdBindVertexBuffers(command_buffer, 0, 1, vertexBuffers, offsets);
+                // Every output shows the same view, so one pass culls for
+                // all of them
+                uint32_t cull = add_render_graph_pass(p_graph, "cull",
+                                p_info->a_outputs[0].extent, false,
+                                record_cull_pass, (void *) p_info);
+                use_render_graph_resource(p_graph, cull, indirectBuffer,
+                                RENDER_GRAPH_COMPUTE_WRITE);
+                use_render_graph_resource(p_graph, cull, visibleBuffer,
+                                RENDER_GRAPH_COMPUTE_WRITE);
+        }
 
-        vkCmdDraw(command_buffer, vertices_size, 1, 0, 0);
+        struct FramePasses passes[MAX_FRAME_OUTPUTS] = {};
+        for (uint32_t i = 0; i < p_info->output_count; i++) {
+                passes[i].p_info = p_info;
+                passes[i].p_output = &p_info->a_outputs[i];
+                add_output_passes(p_graph, command_buffer, &passes[i],
+                                indirectBuffer, visibleBuffer);
+        }
 
-        vkCmdEndRenderPass(command_buffer);
+        execute_render_graph(p_graph, command_buffer, p_info->p_gpu_timer,
+                        p_info->current_frame);
 
         if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
                 error("Failed to record command buffer!");
                 exit(EXIT_FAILURE);
         }
 }
-
@@ -1,8 +1,63 @@
 #ifndef VK_COMMAND_BUFFER_H
 #define VK_COMMAND_BUFFER_H
 
+#include <stdbool.h>
 #include <vulkan/vulkan_core.h>
 #include "vk_vertex_data.h"
+#include "vk_particle_system.h"
+#include "vk_gpu_culling.h"
+#include "vk_mesh_registry.h"
+#include "vk_frame_capture.h"
+#include "vk_gpu_timer.h"
+#include "vk_resolution_scaler.h"
+#include "vk_render_graph.h"
+
+// Outputs a single frame is recorded for
+#define MAX_FRAME_OUTPUTS 4
+
+// A swap chain image the frame is rendered to
+struct FrameOutputInfo {
+        VkImage swap_chain_image;
+        VkImageView swap_chain_image_view;
+        VkFormat swap_chain_format;
+        VkExtent2D extent;
+        // An image of an OffscreenTarget that is never presented, left in
+        // the layout of the last pass that used it
+        bool offscreen;
+        // Copy the finished frame into p_frame_capture
+        bool capture;
+        // Render at a reduced resolution and upscale into the swap chain
+        // image, NULL to render at the swap chain extent directly
+        struct ResolutionScaler *p_resolution_scaler;
+};
+
+// Everything record_command_buffer() needs to record one frame
+struct FrameRecordInfo {
+        // Declared again for every frame, and owns the depth images
+        struct RenderGraph *p_render_graph;
+        const struct FrameOutputInfo *a_outputs;
+        uint32_t output_count;
+        VkFormat depth_format;
+        VkPipeline graphics_pipeline;
+        VkPipelineLayout graphics_pipeline_layout;
+        // Set 0 of the graphics pipeline. Either this frame's set with the
+        // texture of the objects, or the bindless table and the index of
+        // the texture in it.
+        VkDescriptorSet texture_set;
+        bool bindless;
+        uint32_t texture_index;
+        const struct MeshRegistry *p_mesh_registry;
+        const struct ParticleSystem *p_particle_system;
+        const struct GpuCulling *p_gpu_culling;
+        bool gpu_driven;
+        uint32_t current_frame;
+        // Frame number from FrameSync, tags the capture readback
+        uint64_t frame_number;
+        enum CaptureFormat capture_format;
+        struct FrameCapture *p_frame_capture;
+        // Times the culling and render passes, NULL when not profiling
+        struct GpuTimer *p_gpu_timer;
+};
 
 VkCommandBuffer *create_command_buffer(
                 VkDevice *p_device,
@@ -10,13 +65,7 @@ VkCommandBuffer *create_command_buffer(
                 uint32_t max_frames_in_flight);
 
 void record_command_buffer(
-                VkRenderPass *p_render_pass,
-                VkFramebuffer *frame_buffers,
-                VkExtent2D *p_extent,
-                VkPipeline *p_graphics_pipeline,
                 VkCommandBuffer command_buffer,
-                uint32_t image_index,
-                const uint32_t vertices_size,
-                VkBuffer p_vertex_buffer);
+                const struct FrameRecordInfo *p_info);
 
 #endif
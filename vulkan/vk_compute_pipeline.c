@@ -0,0 +1,92 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <vulkan/vulkan_core.h>
+
+#include "../debug/print.h"
+#include "../debug/trace.h"
+#include "../utils/file.h"
+#include "vk_compute_pipeline.h"
+#include "vk_graphics_pipeline.h"
+#include "vk_host_allocator.h"
+#include "vk_pipeline_cache.h"
+#include "vk_shader_cache.h"
+
+
+struct ComputePipelineDetails create_compute_pipeline(
+                VkDevice *p_device,
+                const char *shader_path,
+                VkDescriptorSetLayout *p_descriptor_set_layout,
+                uint32_t push_constant_size)
+{
+        TRACE_ZONE("create_compute_pipeline");
+        struct FileBytes *computeShaderCode = load_shader_file(shader_path);
+        if (computeShaderCode == NULL) {
+                error("Failed to load compute shader!");
+                exit(EXIT_FAILURE);
+        }
+
+        VkShaderModule computeShaderModule =
+                create_shader_module(p_device, computeShaderCode);
+
+        VkPipelineShaderStageCreateInfo computeShaderStageInfo = {};
+        computeShaderStageInfo.sType =
+                VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        computeShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        computeShaderStageInfo.module = computeShaderModule;
+        computeShaderStageInfo.pName = "main";
+
+        VkPushConstantRange pushConstantRange = {};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = push_constant_size;
+
+        VkPipelineLayout pipelineLayout;
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+        pipelineLayoutInfo.sType =
+              VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = p_descriptor_set_layout;
+        pipelineLayoutInfo.pushConstantRangeCount =
+                push_constant_size > 0 ? 1 : 0;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+        if (vkCreatePipelineLayout(*p_device, &pipelineLayoutInfo,
+                                get_host_allocator(),
+                                &pipelineLayout) != VK_SUCCESS) {
+                error("Failed to create compute pipeline layout!");
+                exit(EXIT_FAILURE);
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo = {};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage = computeShaderStageInfo;
+        pipelineInfo.layout = pipelineLayout;
+
+        VkPipeline computePipeline;
+        if (vkCreateComputePipelines(*p_device, get_pipeline_cache(), 1,
+                                &pipelineInfo, get_host_allocator(),
+                                &computePipeline) != VK_SUCCESS) {
+                error("Failed to create compute pipeline!");
+                exit(EXIT_FAILURE);
+        }
+
+        vkDestroyShaderModule(*p_device, computeShaderModule,
+                        get_host_allocator());
+
+        struct ComputePipelineDetails pipelineDetails = {};
+        pipelineDetails.compute_pipeline = computePipeline;
+        pipelineDetails.pipeline_layout = pipelineLayout;
+
+        return pipelineDetails;
+}
+
+void destroy_compute_pipeline(
+                VkDevice *p_device,
+                struct ComputePipelineDetails *p_pipeline_details)
+{
+        vkDestroyPipeline(*p_device, p_pipeline_details->compute_pipeline,
+                        get_host_allocator());
+        vkDestroyPipelineLayout(*p_device,
+                        p_pipeline_details->pipeline_layout,
+                        get_host_allocator());
+}
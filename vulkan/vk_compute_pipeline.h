@@ -0,0 +1,22 @@
+#ifndef VK_COMPUTE_PIPELINE_H
+#define VK_COMPUTE_PIPELINE_H
+
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+struct ComputePipelineDetails {
+        VkPipeline compute_pipeline;
+        VkPipelineLayout pipeline_layout;
+};
+
+struct ComputePipelineDetails create_compute_pipeline(
+                VkDevice *p_device,
+                const char *shader_path,
+                VkDescriptorSetLayout *p_descriptor_set_layout,
+                uint32_t push_constant_size);
+
+void destroy_compute_pipeline(
+                VkDevice *p_device,
+                struct ComputePipelineDetails *p_pipeline_details);
+
+#endif
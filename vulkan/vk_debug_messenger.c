@@ -6,12 +6,13 @@
 #include <stdlib.h>
 
 #include "../debug/print.h"
+#include "vk_host_allocator.h"
 
 
 // Loads the vkCreateDebugUtilsMessengerEXT extension function
 static VkResult create_debug_messenger(VkInstance instance,
                 const VkDebugUtilsMessengerCreateInfoEXT *p_create_info,
-                VkAllocationCallbacks *p_allocator,
+                const VkAllocationCallbacks *p_allocator,
                 VkDebugUtilsMessengerEXT *p_debug_messenger)
 {
         VkResult (*functionPtr)(VkInstance,
@@ -80,7 +81,8 @@ void setup_debug_messenger(VkInstance instance,
         populate_debug_messenger_createinfo(&createInfo);
 
         if (create_debug_messenger(instance, &createInfo,
-                                NULL, p_debug_messenger) != VK_SUCCESS) {
+                                get_host_allocator(), p_debug_messenger)
+                        != VK_SUCCESS) {
                 error("Failed to set up debug messenger!\n");
                 exit(EXIT_FAILURE);
         }
@@ -0,0 +1,31 @@
+#include <stdlib.h>
+#include <vulkan/vulkan_core.h>
+
+#include "../debug/print.h"
+#include "../utils/array.h"
+#include "vk_depth_buffer.h"
+
+
+// Depth only formats in order of preference. D16 is always supported.
+static const VkFormat DEPTH_FORMATS[] = {
+        VK_FORMAT_D32_SFLOAT,
+        VK_FORMAT_X8_D24_UNORM_PACK32,
+        VK_FORMAT_D16_UNORM
+};
+
+VkFormat find_depth_format(
+                VkPhysicalDevice physical_device)
+{
+        for (size_t i = 0; i < ARRAY_SIZE(DEPTH_FORMATS); i++) {
+                VkFormatProperties properties;
+                vkGetPhysicalDeviceFormatProperties(physical_device,
+                                DEPTH_FORMATS[i], &properties);
+
+                if (properties.optimalTilingFeatures &
+                                VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+                        return DEPTH_FORMATS[i];
+        }
+
+        error("Failed to find a supported depth format!");
+        exit(EXIT_FAILURE);
+}
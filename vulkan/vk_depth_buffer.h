@@ -0,0 +1,11 @@
+#ifndef VK_DEPTH_BUFFER_H
+#define VK_DEPTH_BUFFER_H
+
+#include <vulkan/vulkan_core.h>
+
+// The depth attachment itself is a transient image of the render graph,
+// created at the size of the swap chain.
+VkFormat find_depth_format(
+                VkPhysicalDevice physical_device);
+
+#endif
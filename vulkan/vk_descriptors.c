@@ -0,0 +1,315 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+
+#include "../debug/print.h"
+#include "../debug/trace.h"
+#include "../utils/array.h"
+#include "vk_descriptors.h"
+#include "vk_host_allocator.h"
+
+
+static VkDescriptorPool create_frame_pool(
+                const struct DescriptorAllocator *p_allocator)
+{
+        VkDescriptorPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = p_allocator->pool_size_count;
+        poolInfo.pPoolSizes = p_allocator->pool_sizes;
+        poolInfo.maxSets = p_allocator->max_sets;
+
+        VkDescriptorPool pool;
+        if (vkCreateDescriptorPool(p_allocator->device, &poolInfo,
+                                get_host_allocator(),
+                                &pool) != VK_SUCCESS) {
+                error("Failed to create frame descriptor pool!");
+                exit(EXIT_FAILURE);
+        }
+
+        return pool;
+}
+
+// The pool sizes describe the descriptors of max_sets typical sets. A
+// frame that needs more gets another pool of the same size.
+void create_descriptor_allocator(
+                VkDevice device,
+                uint32_t frame_count,
+                uint32_t max_sets,
+                const VkDescriptorPoolSize *a_pool_sizes,
+                uint32_t pool_size_count,
+                struct DescriptorAllocator *p_allocator)
+{
+        TRACE_ZONE("create_descriptor_allocator");
+        *p_allocator = (struct DescriptorAllocator) {};
+        p_allocator->device = device;
+        p_allocator->frame_count = frame_count;
+        p_allocator->max_sets = max_sets;
+        p_allocator->pool_size_count = pool_size_count;
+        p_allocator->pool_sizes =
+                malloc(pool_size_count * sizeof(VkDescriptorPoolSize));
+        memcpy(p_allocator->pool_sizes, a_pool_sizes,
+                        pool_size_count * sizeof(VkDescriptorPoolSize));
+
+        p_allocator->frames =
+                calloc(frame_count, sizeof(struct FrameDescriptorPools));
+        for (size_t i = 0; i < frame_count; i++) {
+                struct FrameDescriptorPools *p_frame = &p_allocator->frames[i];
+                p_frame->pools = malloc(sizeof(VkDescriptorPool));
+                p_frame->pools[0] = create_frame_pool(p_allocator);
+                p_frame->pool_count = 1;
+        }
+}
+
+// Must be called once the GPU has finished the last frame that used the
+// slot. Resetting a pool frees all of its sets at once, which is far
+// cheaper than freeing them individually.
+void begin_descriptor_frame(
+                struct DescriptorAllocator *p_allocator,
+                uint32_t frame)
+{
+        TRACE_ZONE("begin_descriptor_frame");
+        struct FrameDescriptorPools *p_frame = &p_allocator->frames[frame];
+        for (size_t i = 0; i <= p_frame->current_pool; i++)
+                vkResetDescriptorPool(p_allocator->device,
+                                p_frame->pools[i], 0);
+
+        p_frame->current_pool = 0;
+        p_allocator->current_frame = frame;
+}
+
+// The set is valid until the same frame slot begins again
+VkDescriptorSet allocate_frame_descriptor_set(
+                struct DescriptorAllocator *p_allocator,
+                VkDescriptorSetLayout set_layout)
+{
+        struct FrameDescriptorPools *p_frame =
+                &p_allocator->frames[p_allocator->current_frame];
+
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &set_layout;
+
+        VkDescriptorSet set;
+        while (true) {
+                allocInfo.descriptorPool =
+                        p_frame->pools[p_frame->current_pool];
+                VkResult result = vkAllocateDescriptorSets(
+                                p_allocator->device, &allocInfo, &set);
+                if (result == VK_SUCCESS)
+                        return set;
+
+                if (result != VK_ERROR_OUT_OF_POOL_MEMORY &&
+                                result != VK_ERROR_FRAGMENTED_POOL) {
+                        error("Failed to allocate frame descriptor set!");
+                        exit(EXIT_FAILURE);
+                }
+
+                // Move on to the next pool, creating it if this frame
+                // has never needed that many
+                p_frame->current_pool++;
+                if (p_frame->current_pool == p_frame->pool_count) {
+                        p_frame->pools = realloc(p_frame->pools,
+                                        (p_frame->pool_count + 1) *
+                                        sizeof(VkDescriptorPool));
+                        p_frame->pools[p_frame->pool_count++] =
+                                create_frame_pool(p_allocator);
+                }
+        }
+}
+
+void destroy_descriptor_allocator(
+                struct DescriptorAllocator *p_allocator)
+{
+        for (size_t i = 0; i < p_allocator->frame_count; i++) {
+                struct FrameDescriptorPools *p_frame = &p_allocator->frames[i];
+                for (size_t j = 0; j < p_frame->pool_count; j++)
+                        vkDestroyDescriptorPool(p_allocator->device,
+                                        p_frame->pools[j],
+                                        get_host_allocator());
+                free(p_frame->pools);
+        }
+
+        free(p_allocator->frames);
+        free(p_allocator->pool_sizes);
+}
+
+// The table is sized once, the device limits for update after bind
+// descriptors are usually far above what is requested here.
+void create_bindless_table(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                uint32_t texture_capacity,
+                uint32_t buffer_capacity,
+                struct BindlessTable *p_table)
+{
+        TRACE_ZONE("create_bindless_table");
+        *p_table = (struct BindlessTable) {};
+
+        VkPhysicalDeviceVulkan12Properties properties12 = {};
+        properties12.sType =
+                VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+
+        VkPhysicalDeviceProperties2 properties = {};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &properties12;
+
+        vkGetPhysicalDeviceProperties2(physical_device, &properties);
+
+        uint32_t maxTextures =
+                properties12.maxPerStageDescriptorUpdateAfterBindSampledImages;
+        uint32_t maxBuffers =
+                properties12.maxPerStageDescriptorUpdateAfterBindStorageBuffers;
+        p_table->texture_capacity = texture_capacity < maxTextures ?
+                texture_capacity : maxTextures;
+        p_table->buffer_capacity = buffer_capacity < maxBuffers ?
+                buffer_capacity : maxBuffers;
+
+        VkDescriptorSetLayoutBinding bindings[2] = {};
+        bindings[0].binding = BINDLESS_TEXTURE_BINDING;
+        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        bindings[0].descriptorCount = p_table->texture_capacity;
+        bindings[0].stageFlags = VK_SHADER_STAGE_ALL;
+
+        bindings[1].binding = BINDLESS_BUFFER_BINDING;
+        bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[1].descriptorCount = p_table->buffer_capacity;
+        bindings[1].stageFlags = VK_SHADER_STAGE_ALL;
+
+        // Unused slots may stay empty, and slots may be filled in while
+        // frames that use the set are still in flight
+        VkDescriptorBindingFlags bindingFlags[2] = {
+                VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+                        VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT,
+                VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+                        VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT
+        };
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo = {};
+        bindingFlagsInfo.sType =
+                VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+        bindingFlagsInfo.bindingCount = ARRAY_SIZE(bindingFlags);
+        bindingFlagsInfo.pBindingFlags = bindingFlags;
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.pNext = &bindingFlagsInfo;
+        layoutInfo.flags =
+                VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+        layoutInfo.bindingCount = ARRAY_SIZE(bindings);
+        layoutInfo.pBindings = bindings;
+
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo,
+                                get_host_allocator(),
+                                &p_table->set_layout) != VK_SUCCESS) {
+                error("Failed to create bindless descriptor set layout!");
+                exit(EXIT_FAILURE);
+        }
+
+        VkDescriptorPoolSize poolSizes[2] = {};
+        poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        poolSizes[0].descriptorCount = p_table->texture_capacity;
+        poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSizes[1].descriptorCount = p_table->buffer_capacity;
+
+        VkDescriptorPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+        poolInfo.poolSizeCount = ARRAY_SIZE(poolSizes);
+        poolInfo.pPoolSizes = poolSizes;
+        poolInfo.maxSets = 1;
+
+        if (vkCreateDescriptorPool(device, &poolInfo, get_host_allocator(),
+                                &p_table->pool)
+                        != VK_SUCCESS) {
+                error("Failed to create bindless descriptor pool!");
+                exit(EXIT_FAILURE);
+        }
+
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = p_table->pool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &p_table->set_layout;
+
+        if (vkAllocateDescriptorSets(device, &allocInfo, &p_table->set)
+                        != VK_SUCCESS) {
+                error("Failed to allocate bindless descriptor set!");
+                exit(EXIT_FAILURE);
+        }
+}
+
+// Returns the index shaders use to sample the texture. The image must be
+// in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL whenever it is sampled.
+uint32_t add_bindless_texture(
+                VkDevice device,
+                struct BindlessTable *p_table,
+                VkSampler sampler,
+                VkImageView image_view)
+{
+        if (p_table->texture_count == p_table->texture_capacity) {
+                error("Bindless texture table is full!");
+                exit(EXIT_FAILURE);
+        }
+
+        VkDescriptorImageInfo imageInfo = {};
+        imageInfo.sampler = sampler;
+        imageInfo.imageView = image_view;
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        VkWriteDescriptorSet write = {};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = p_table->set;
+        write.dstBinding = BINDLESS_TEXTURE_BINDING;
+        write.dstArrayElement = p_table->texture_count;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write.descriptorCount = 1;
+        write.pImageInfo = &imageInfo;
+
+        vkUpdateDescriptorSets(device, 1, &write, 0, NULL);
+
+        return p_table->texture_count++;
+}
+
+// Returns the index shaders use to access the buffer range
+uint32_t add_bindless_buffer(
+                VkDevice device,
+                struct BindlessTable *p_table,
+                VkBuffer buffer,
+                VkDeviceSize offset,
+                VkDeviceSize range)
+{
+        if (p_table->buffer_count == p_table->buffer_capacity) {
+                error("Bindless buffer table is full!");
+                exit(EXIT_FAILURE);
+        }
+
+        VkDescriptorBufferInfo bufferInfo = {};
+        bufferInfo.buffer = buffer;
+        bufferInfo.offset = offset;
+        bufferInfo.range = range;
+
+        VkWriteDescriptorSet write = {};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = p_table->set;
+        write.dstBinding = BINDLESS_BUFFER_BINDING;
+        write.dstArrayElement = p_table->buffer_count;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write.descriptorCount = 1;
+        write.pBufferInfo = &bufferInfo;
+
+        vkUpdateDescriptorSets(device, 1, &write, 0, NULL);
+
+        return p_table->buffer_count++;
+}
+
+void destroy_bindless_table(
+                VkDevice device,
+                struct BindlessTable *p_table)
+{
+        vkDestroyDescriptorPool(device, p_table->pool, get_host_allocator());
+        vkDestroyDescriptorSetLayout(device, p_table->set_layout,
+                        get_host_allocator());
+}
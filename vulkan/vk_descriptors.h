@@ -0,0 +1,90 @@
+#ifndef VK_DESCRIPTORS_H
+#define VK_DESCRIPTORS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+// Bindings of the bindless set
+#define BINDLESS_TEXTURE_BINDING 0
+#define BINDLESS_BUFFER_BINDING 1
+
+// The pools one frame in flight allocates its sets from. More pools are
+// added when the existing ones run out and kept for the following frames.
+struct FrameDescriptorPools {
+        VkDescriptorPool *pools;
+        uint32_t pool_count;
+        // Pools before this one ran out during the current frame
+        uint32_t current_pool;
+};
+
+// Hands out descriptor sets that live for one frame. Sets are never
+// freed one by one, a frame's pools are reset together once the GPU is
+// done with the frame.
+struct DescriptorAllocator {
+        VkDevice device;
+        struct FrameDescriptorPools *frames;
+        uint32_t frame_count;
+        uint32_t current_frame;
+        VkDescriptorPoolSize *pool_sizes;
+        uint32_t pool_size_count;
+        uint32_t max_sets;
+};
+
+// One global set with an array of every texture and storage buffer.
+// Shaders index it with the numbers handed out when adding resources, so
+// it is bound once and never rewritten for a draw.
+struct BindlessTable {
+        VkDescriptorSetLayout set_layout;
+        VkDescriptorPool pool;
+        VkDescriptorSet set;
+        uint32_t texture_capacity;
+        uint32_t texture_count;
+        uint32_t buffer_capacity;
+        uint32_t buffer_count;
+};
+
+void create_descriptor_allocator(
+                VkDevice device,
+                uint32_t frame_count,
+                uint32_t max_sets,
+                const VkDescriptorPoolSize *a_pool_sizes,
+                uint32_t pool_size_count,
+                struct DescriptorAllocator *p_allocator);
+
+void begin_descriptor_frame(
+                struct DescriptorAllocator *p_allocator,
+                uint32_t frame);
+
+VkDescriptorSet allocate_frame_descriptor_set(
+                struct DescriptorAllocator *p_allocator,
+                VkDescriptorSetLayout set_layout);
+
+void destroy_descriptor_allocator(
+                struct DescriptorAllocator *p_allocator);
+
+void create_bindless_table(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                uint32_t texture_capacity,
+                uint32_t buffer_capacity,
+                struct BindlessTable *p_table);
+
+uint32_t add_bindless_texture(
+                VkDevice device,
+                struct BindlessTable *p_table,
+                VkSampler sampler,
+                VkImageView image_view);
+
+uint32_t add_bindless_buffer(
+                VkDevice device,
+                struct BindlessTable *p_table,
+                VkBuffer buffer,
+                VkDeviceSize offset,
+                VkDeviceSize range);
+
+void destroy_bindless_table(
+                VkDevice device,
+                struct BindlessTable *p_table);
+
+#endif
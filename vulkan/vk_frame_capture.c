@@ -0,0 +1,555 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+
+#include "../debug/print.h"
+#include "../debug/trace.h"
+#include "vk_buffer.h"
+#include "vk_frame_capture.h"
+#include "vk_host_allocator.h"
+#include "vk_memory_budget.h"
+
+#define CAPTURE_BYTES_PER_PIXEL 4
+
+
+static bool is_capture_format_supported(
+                VkFormat format,
+                bool *p_bgra)
+{
+        switch (format) {
+        case VK_FORMAT_B8G8R8A8_SRGB:
+        case VK_FORMAT_B8G8R8A8_UNORM:
+                *p_bgra = true;
+                return true;
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_R8G8B8A8_UNORM:
+                *p_bgra = false;
+                return true;
+        default:
+                return false;
+        }
+}
+
+static void destroy_slot_buffer(
+                VkDevice device,
+                struct CaptureSlot *p_slot)
+{
+        if (p_slot->buffer == VK_NULL_HANDLE)
+                return;
+
+        vkUnmapMemory(device, p_slot->memory);
+        vkDestroyBuffer(device, p_slot->buffer, get_host_allocator());
+        free_device_memory(device, p_slot->memory);
+        p_slot->buffer = VK_NULL_HANDLE;
+        p_slot->memory = VK_NULL_HANDLE;
+        p_slot->p_mapped = NULL;
+        p_slot->capacity = 0;
+}
+
+// Makes sure a free slot can hold size bytes. The buffer only grows, so
+// after the first capture at a given size no further allocations happen.
+static bool reserve_slot_buffer(
+                struct FrameCapture *p_frame_capture,
+                struct CaptureSlot *p_slot,
+                VkDeviceSize size)
+{
+        if (p_slot->capacity >= size)
+                return true;
+
+        VkDevice device = p_frame_capture->device;
+        destroy_slot_buffer(device, p_slot);
+
+        VkBufferCreateInfo bufferInfo = {};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(device, &bufferInfo, get_host_allocator(),
+                                &p_slot->buffer)
+                        != VK_SUCCESS) {
+                p_slot->buffer = VK_NULL_HANDLE;
+                return false;
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(device, p_slot->buffer,
+                        &memRequirements);
+
+        // The host reads every byte, which is slow from uncached memory.
+        // Cached memory is not always coherent though.
+        uint32_t typeIndex;
+        p_slot->coherent = false;
+        if (!try_find_memory_type(p_frame_capture->physical_device,
+                                memRequirements.memoryTypeBits,
+                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+                                &typeIndex)) {
+                typeIndex = find_memory_type(p_frame_capture->physical_device,
+                                memRequirements.memoryTypeBits,
+                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+                p_slot->coherent = true;
+        }
+
+        VkMemoryAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memRequirements.size;
+        allocInfo.memoryTypeIndex = typeIndex;
+
+        if (allocate_device_memory(device, &allocInfo, &p_slot->memory)
+                        != VK_SUCCESS) {
+                vkDestroyBuffer(device, p_slot->buffer, get_host_allocator());
+                p_slot->buffer = VK_NULL_HANDLE;
+                return false;
+        }
+
+        vkBindBufferMemory(device, p_slot->buffer, p_slot->memory, 0);
+        vkMapMemory(device, p_slot->memory, 0, VK_WHOLE_SIZE, 0,
+                        &p_slot->p_mapped);
+        p_slot->capacity = size;
+
+        return true;
+}
+
+// Converts one row of captured pixels to RGB or RGBA byte order
+static void convert_row(
+                const uint8_t *a_src,
+                uint8_t *a_dst,
+                uint32_t width,
+                bool bgra,
+                uint32_t dst_channels)
+{
+        for (size_t x = 0; x < width; x++) {
+                const uint8_t *p_pixel = &a_src[x * CAPTURE_BYTES_PER_PIXEL];
+                uint8_t *p_out = &a_dst[x * dst_channels];
+                p_out[0] = bgra ? p_pixel[2] : p_pixel[0];
+                p_out[1] = p_pixel[1];
+                p_out[2] = bgra ? p_pixel[0] : p_pixel[2];
+                if (dst_channels == 4)
+                        p_out[3] = p_pixel[3];
+        }
+}
+
+static void write_ppm(
+                const struct FrameCapture *p_frame_capture,
+                const struct CaptureSlot *p_slot)
+{
+        char path[512];
+        snprintf(path, sizeof(path), "%s_%05u.ppm",
+                        p_frame_capture->screenshot_prefix, p_slot->sequence);
+
+        FILE *p_file = fopen(path, "wb");
+        if (p_file == NULL) {
+                warning("Failed to open %s for writing!\n", path);
+                return;
+        }
+
+        fprintf(p_file, "P6\n%u %u\n255\n", p_slot->width, p_slot->height);
+
+        uint8_t row[p_slot->width * 3];
+        const uint8_t *p_pixels = p_slot->p_mapped;
+        size_t rowPitch = (size_t) p_slot->width * CAPTURE_BYTES_PER_PIXEL;
+        for (size_t y = 0; y < p_slot->height; y++) {
+                convert_row(&p_pixels[y * rowPitch], row, p_slot->width,
+                                p_slot->bgra, 3);
+                fwrite(row, 1, sizeof(row), p_file);
+        }
+
+        fclose(p_file);
+        info("Captured frame %lu to %s\n",
+                        (unsigned long) p_slot->frame_number, path);
+}
+
+// Converts one row of captured pixels to a plane of 4:4:4 YCbCr, with the
+// BT.601 limited range coefficients Y4M players assume
+static void convert_row_ycbcr(
+                const uint8_t *a_src,
+                uint8_t *a_dst,
+                uint32_t width,
+                bool bgra,
+                uint32_t plane)
+{
+        for (size_t x = 0; x < width; x++) {
+                const uint8_t *p_pixel = &a_src[x * CAPTURE_BYTES_PER_PIXEL];
+                int r = bgra ? p_pixel[2] : p_pixel[0];
+                int g = p_pixel[1];
+                int b = bgra ? p_pixel[0] : p_pixel[2];
+
+                int value;
+                if (plane == 0)
+                        value = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+                else if (plane == 1)
+                        value = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+                else
+                        value = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+                a_dst[x] = (uint8_t) value;
+        }
+}
+
+// Opens the stream on its first frame. Every frame of a stream has to
+// have the size and format of the first one.
+static bool open_stream(
+                struct FrameCapture *p_frame_capture,
+                const struct CaptureSlot *p_slot)
+{
+        if (p_frame_capture->p_stream != NULL)
+                return true;
+
+        const char *path = p_frame_capture->stream_path;
+        if (strcmp(path, "-") == 0) {
+                p_frame_capture->p_stream = stdout;
+                path = "stdout";
+        } else {
+                p_frame_capture->p_stream = fopen(path, "wb");
+        }
+        if (p_frame_capture->p_stream == NULL) {
+                warning("Failed to open %s for writing!\n", path);
+                return false;
+        }
+
+        if (p_slot->format == CAPTURE_FORMAT_Y4M) {
+                fprintf(p_frame_capture->p_stream,
+                                "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C444\n",
+                                p_slot->width, p_slot->height,
+                                p_frame_capture->stream_frame_rate);
+                info("Streaming %ux%u Y4M frames to %s\n",
+                                p_slot->width, p_slot->height, path);
+        } else {
+                info("Streaming %ux%u RGBA frames to %s\n",
+                                p_slot->width, p_slot->height, path);
+        }
+
+        return true;
+}
+
+static void write_y4m(
+                struct FrameCapture *p_frame_capture,
+                const struct CaptureSlot *p_slot)
+{
+        if (!open_stream(p_frame_capture, p_slot))
+                return;
+
+        fputs("FRAME\n", p_frame_capture->p_stream);
+
+        // The planes follow each other, so the frame is read once per plane
+        uint8_t row[p_slot->width];
+        const uint8_t *p_pixels = p_slot->p_mapped;
+        size_t rowPitch = (size_t) p_slot->width * CAPTURE_BYTES_PER_PIXEL;
+        for (uint32_t plane = 0; plane < 3; plane++) {
+                for (size_t y = 0; y < p_slot->height; y++) {
+                        convert_row_ycbcr(&p_pixels[y * rowPitch], row,
+                                        p_slot->width, p_slot->bgra, plane);
+                        fwrite(row, 1, sizeof(row), p_frame_capture->p_stream);
+                }
+        }
+}
+
+static void write_raw(
+                struct FrameCapture *p_frame_capture,
+                const struct CaptureSlot *p_slot)
+{
+        if (!open_stream(p_frame_capture, p_slot))
+                return;
+
+        uint8_t row[p_slot->width * CAPTURE_BYTES_PER_PIXEL];
+        const uint8_t *p_pixels = p_slot->p_mapped;
+        for (size_t y = 0; y < p_slot->height; y++) {
+                convert_row(&p_pixels[y * sizeof(row)], row, p_slot->width,
+                                p_slot->bgra, CAPTURE_BYTES_PER_PIXEL);
+                fwrite(row, 1, sizeof(row), p_frame_capture->p_stream);
+        }
+}
+
+// Writes out the slots handed over by collect_frame_captures(), so file
+// IO never runs on the render thread.
+static void *writer_thread_main(void *p_arg)
+{
+        struct FrameCapture *p_frame_capture = p_arg;
+        TRACE_THREAD_NAME("Capture writer");
+
+        for (;;) {
+                pthread_mutex_lock(&p_frame_capture->mutex);
+                while (p_frame_capture->write_queue_count == 0 &&
+                                !p_frame_capture->stop_writer)
+                        pthread_cond_wait(&p_frame_capture->condition,
+                                        &p_frame_capture->mutex);
+
+                if (p_frame_capture->write_queue_count == 0) {
+                        pthread_mutex_unlock(&p_frame_capture->mutex);
+                        break;
+                }
+
+                uint32_t slotIndex = p_frame_capture->write_queue[
+                        p_frame_capture->write_queue_head];
+                p_frame_capture->write_queue_head =
+                        (p_frame_capture->write_queue_head + 1) %
+                        CAPTURE_SLOT_COUNT;
+                p_frame_capture->write_queue_count--;
+                pthread_mutex_unlock(&p_frame_capture->mutex);
+
+                struct CaptureSlot *p_slot =
+                        &p_frame_capture->slots[slotIndex];
+                TRACE_ZONE("write_capture");
+                if (p_slot->format == CAPTURE_FORMAT_PPM)
+                        write_ppm(p_frame_capture, p_slot);
+                else if (p_slot->format == CAPTURE_FORMAT_Y4M)
+                        write_y4m(p_frame_capture, p_slot);
+                else
+                        write_raw(p_frame_capture, p_slot);
+
+                pthread_mutex_lock(&p_frame_capture->mutex);
+                p_slot->state = CAPTURE_SLOT_FREE;
+                pthread_cond_broadcast(&p_frame_capture->slot_condition);
+                pthread_mutex_unlock(&p_frame_capture->mutex);
+        }
+
+        return NULL;
+}
+
+void create_frame_capture(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                const char *screenshot_prefix,
+                const char *stream_path,
+                uint32_t stream_frame_rate,
+                struct FrameCapture *p_frame_capture)
+{
+        *p_frame_capture = (struct FrameCapture) {};
+        p_frame_capture->device = device;
+        p_frame_capture->physical_device = physical_device;
+        p_frame_capture->screenshot_prefix = screenshot_prefix;
+        p_frame_capture->stream_path = stream_path;
+        p_frame_capture->stream_frame_rate = stream_frame_rate;
+
+        pthread_mutex_init(&p_frame_capture->mutex, NULL);
+        pthread_cond_init(&p_frame_capture->condition, NULL);
+        pthread_cond_init(&p_frame_capture->slot_condition, NULL);
+
+        if (pthread_create(&p_frame_capture->writer_thread, NULL,
+                                writer_thread_main, p_frame_capture) != 0) {
+                error("Failed to create capture writer thread!");
+                exit(EXIT_FAILURE);
+        }
+}
+
+// Blocks until a slot is free, for when captures must not be dropped.
+// Captures whose frame has completed have to be collected first, and
+// there have to be more slots than frames in flight: only the writer
+// thread is waited on.
+void wait_for_capture_slot(
+                struct FrameCapture *p_frame_capture)
+{
+        TRACE_ZONE("wait_for_capture_slot");
+        pthread_mutex_lock(&p_frame_capture->mutex);
+        for (;;) {
+                bool slotFree = false;
+                for (size_t i = 0; i < CAPTURE_SLOT_COUNT; i++)
+                        slotFree |= p_frame_capture->slots[i].state ==
+                                CAPTURE_SLOT_FREE;
+                if (slotFree)
+                        break;
+
+                pthread_cond_wait(&p_frame_capture->slot_condition,
+                                &p_frame_capture->mutex);
+        }
+        pthread_mutex_unlock(&p_frame_capture->mutex);
+}
+
+// Records a copy of the image into a free readback slot. The image must
+// be in the transfer source layout. Returns false if the capture had to be
+// dropped.
+bool record_frame_capture(
+                struct FrameCapture *p_frame_capture,
+                VkCommandBuffer command_buffer,
+                VkImage image,
+                VkFormat image_format,
+                VkExtent2D extent,
+                uint64_t frame_number,
+                enum CaptureFormat format)
+{
+        bool bgra;
+        if (!is_capture_format_supported(image_format, &bgra)) {
+                p_frame_capture->dropped_count++;
+                return false;
+        }
+
+        struct CaptureSlot *p_slot = NULL;
+        pthread_mutex_lock(&p_frame_capture->mutex);
+        for (size_t i = 0; i < CAPTURE_SLOT_COUNT; i++) {
+                if (p_frame_capture->slots[i].state == CAPTURE_SLOT_FREE) {
+                        p_slot = &p_frame_capture->slots[i];
+                        break;
+                }
+        }
+        pthread_mutex_unlock(&p_frame_capture->mutex);
+
+        VkDeviceSize size = (VkDeviceSize) extent.width * extent.height *
+                CAPTURE_BYTES_PER_PIXEL;
+        if (p_slot == NULL ||
+                        !reserve_slot_buffer(p_frame_capture, p_slot, size)) {
+                p_frame_capture->dropped_count++;
+                return false;
+        }
+
+        VkBufferImageCopy region = {};
+        region.bufferOffset = 0;
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent.width = extent.width;
+        region.imageExtent.height = extent.height;
+        region.imageExtent.depth = 1;
+
+        vkCmdCopyImageToBuffer(command_buffer, image,
+                        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                        p_slot->buffer, 1, &region);
+
+        VkBufferMemoryBarrier hostBarrier = {};
+        hostBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        hostBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        hostBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        hostBarrier.buffer = p_slot->buffer;
+        hostBarrier.offset = 0;
+        hostBarrier.size = VK_WHOLE_SIZE;
+
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_PIPELINE_STAGE_HOST_BIT, 0, 0, NULL,
+                        1, &hostBarrier, 0, NULL);
+
+        p_slot->format = format;
+        p_slot->frame_number = frame_number;
+        p_slot->width = extent.width;
+        p_slot->height = extent.height;
+        p_slot->bgra = bgra;
+        p_slot->sequence = p_frame_capture->capture_count++;
+        p_slot->state = CAPTURE_SLOT_PENDING;
+
+        return true;
+}
+
+// Hands every capture whose frame has completed on the GPU to the writer
+// thread, in the order they were captured.
+void collect_frame_captures(
+                struct FrameCapture *p_frame_capture,
+                uint64_t completed_frame)
+{
+        for (;;) {
+                struct CaptureSlot *p_oldest = NULL;
+                uint32_t oldestIndex = 0;
+                for (size_t i = 0; i < CAPTURE_SLOT_COUNT; i++) {
+                        struct CaptureSlot *p_slot = &p_frame_capture->slots[i];
+                        if (p_slot->state != CAPTURE_SLOT_PENDING ||
+                                        p_slot->frame_number > completed_frame)
+                                continue;
+                        if (p_oldest == NULL ||
+                                        p_slot->sequence < p_oldest->sequence) {
+                                p_oldest = p_slot;
+                                oldestIndex = i;
+                        }
+                }
+
+                if (p_oldest == NULL)
+                        return;
+
+                if (!p_oldest->coherent) {
+                        VkMappedMemoryRange range = {};
+                        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+                        range.memory = p_oldest->memory;
+                        range.offset = 0;
+                        range.size = VK_WHOLE_SIZE;
+                        vkInvalidateMappedMemoryRanges(
+                                        p_frame_capture->device, 1, &range);
+                }
+
+                pthread_mutex_lock(&p_frame_capture->mutex);
+                p_oldest->state = CAPTURE_SLOT_WRITING;
+                uint32_t tail = (p_frame_capture->write_queue_head +
+                                p_frame_capture->write_queue_count) %
+                        CAPTURE_SLOT_COUNT;
+                p_frame_capture->write_queue[tail] = oldestIndex;
+                p_frame_capture->write_queue_count++;
+                pthread_cond_signal(&p_frame_capture->condition);
+                pthread_mutex_unlock(&p_frame_capture->mutex);
+        }
+}
+
+// The device must be idle. Returns once every capture has been written
+// out and the stream flushed, e.g. to time a whole capture.
+void finish_frame_captures(
+                struct FrameCapture *p_frame_capture)
+{
+        collect_frame_captures(p_frame_capture, UINT64_MAX);
+
+        pthread_mutex_lock(&p_frame_capture->mutex);
+        for (size_t i = 0; i < CAPTURE_SLOT_COUNT; i++)
+                while (p_frame_capture->slots[i].state != CAPTURE_SLOT_FREE)
+                        pthread_cond_wait(&p_frame_capture->slot_condition,
+                                        &p_frame_capture->mutex);
+        pthread_mutex_unlock(&p_frame_capture->mutex);
+
+        if (p_frame_capture->p_stream != NULL)
+                fflush(p_frame_capture->p_stream);
+}
+
+// Frees the readback buffers of slots that are not in use, they are
+// allocated again by the next capture. Returns the bytes freed.
+VkDeviceSize release_idle_capture_slots(
+                struct FrameCapture *p_frame_capture)
+{
+        VkDeviceSize freed = 0;
+        pthread_mutex_lock(&p_frame_capture->mutex);
+        for (size_t i = 0; i < CAPTURE_SLOT_COUNT; i++) {
+                struct CaptureSlot *p_slot = &p_frame_capture->slots[i];
+                // A slot without memory may be in the middle of reserving
+                // its buffer
+                if (p_slot->state != CAPTURE_SLOT_FREE ||
+                                p_slot->memory == VK_NULL_HANDLE)
+                        continue;
+
+                freed += p_slot->capacity;
+                destroy_slot_buffer(p_frame_capture->device, p_slot);
+        }
+        pthread_mutex_unlock(&p_frame_capture->mutex);
+
+        return freed;
+}
+
+// The device must be idle, every pending capture is written out first.
+void destroy_frame_capture(
+                struct FrameCapture *p_frame_capture)
+{
+        collect_frame_captures(p_frame_capture, UINT64_MAX);
+
+        pthread_mutex_lock(&p_frame_capture->mutex);
+        p_frame_capture->stop_writer = true;
+        pthread_cond_signal(&p_frame_capture->condition);
+        pthread_mutex_unlock(&p_frame_capture->mutex);
+        pthread_join(p_frame_capture->writer_thread, NULL);
+
+        if (p_frame_capture->p_stream == stdout)
+                fflush(stdout);
+        else if (p_frame_capture->p_stream != NULL)
+                fclose(p_frame_capture->p_stream);
+
+        for (size_t i = 0; i < CAPTURE_SLOT_COUNT; i++)
+                destroy_slot_buffer(p_frame_capture->device,
+                                &p_frame_capture->slots[i]);
+
+        if (p_frame_capture->dropped_count > 0)
+                warning("Dropped %u frame captures\n",
+                                p_frame_capture->dropped_count);
+
+        pthread_cond_destroy(&p_frame_capture->condition);
+        pthread_cond_destroy(&p_frame_capture->slot_condition);
+        pthread_mutex_destroy(&p_frame_capture->mutex);
+}
@@ -0,0 +1,115 @@
+#ifndef VK_FRAME_CAPTURE_H
+#define VK_FRAME_CAPTURE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vulkan/vulkan_core.h>
+
+// Number of frames that can be read back at the same time
+#define CAPTURE_SLOT_COUNT 4
+
+enum CaptureFormat {
+        // One binary PPM file per frame, for screenshots and golden images
+        CAPTURE_FORMAT_PPM,
+        // Tightly packed RGBA8 frames appended to a single file. Play it
+        // back with e.g. ffmpeg -f rawvideo -pix_fmt rgba -s WxH -i FILE
+        CAPTURE_FORMAT_RAW,
+        // A YUV4MPEG2 stream of 4:4:4 BT.601 frames, which carries its
+        // size and frame rate so players and encoders take it as is
+        CAPTURE_FORMAT_Y4M
+};
+
+enum CaptureSlotState {
+        CAPTURE_SLOT_FREE,
+        // The copy is recorded, waiting for the frame to finish on the GPU
+        CAPTURE_SLOT_PENDING,
+        // Owned by the writer thread until the frame is written out
+        CAPTURE_SLOT_WRITING
+};
+
+struct CaptureSlot {
+        enum CaptureSlotState state;
+        enum CaptureFormat format;
+        VkBuffer buffer;
+        VkDeviceMemory memory;
+        VkDeviceSize capacity;
+        // Persistently mapped for the lifetime of the buffer
+        void *p_mapped;
+        bool coherent;
+        uint64_t frame_number;
+        uint32_t width;
+        uint32_t height;
+        // The swap chain stores BGRA, which is swizzled when written
+        bool bgra;
+        uint32_t sequence;
+};
+
+// Reads frames back to the host without stalling the GPU.
+//
+// A capture records a copy of the swap chain image into one of a ring of
+// host visible buffers at the end of the frame's command buffer. Nothing
+// waits for it: the slot is handed to a writer thread only once the frame
+// number it was recorded in has completed, a few frames later. If every
+// slot is still in use the capture is dropped rather than blocking, unless
+// the caller waits for a slot with wait_for_capture_slot() first.
+struct FrameCapture {
+        VkDevice device;
+        VkPhysicalDevice physical_device;
+        struct CaptureSlot slots[CAPTURE_SLOT_COUNT];
+        // Screenshots are written to <screenshot_prefix>_<n>.ppm
+        const char *screenshot_prefix;
+        // Streams go to <stream_path>, or to stdout when it is "-"
+        const char *stream_path;
+        FILE *p_stream;
+        // Written to the Y4M header
+        uint32_t stream_frame_rate;
+        uint32_t capture_count;
+        uint32_t dropped_count;
+        // Slots waiting for the writer thread, oldest first
+        uint32_t write_queue[CAPTURE_SLOT_COUNT];
+        uint32_t write_queue_head;
+        uint32_t write_queue_count;
+        bool stop_writer;
+        pthread_t writer_thread;
+        pthread_mutex_t mutex;
+        pthread_cond_t condition;
+        // Signalled by the writer thread whenever it frees a slot
+        pthread_cond_t slot_condition;
+};
+
+void create_frame_capture(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                const char *screenshot_prefix,
+                const char *stream_path,
+                uint32_t stream_frame_rate,
+                struct FrameCapture *p_frame_capture);
+
+void wait_for_capture_slot(
+                struct FrameCapture *p_frame_capture);
+
+bool record_frame_capture(
+                struct FrameCapture *p_frame_capture,
+                VkCommandBuffer command_buffer,
+                VkImage image,
+                VkFormat image_format,
+                VkExtent2D extent,
+                uint64_t frame_number,
+                enum CaptureFormat format);
+
+void collect_frame_captures(
+                struct FrameCapture *p_frame_capture,
+                uint64_t completed_frame);
+
+void finish_frame_captures(
+                struct FrameCapture *p_frame_capture);
+
+VkDeviceSize release_idle_capture_slots(
+                struct FrameCapture *p_frame_capture);
+
+void destroy_frame_capture(
+                struct FrameCapture *p_frame_capture);
+
+#endif
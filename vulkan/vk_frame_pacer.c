@@ -0,0 +1,170 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <vulkan/vulkan_core.h>
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "../debug/trace.h"
+#include "vk_frame_pacer.h"
+
+// Sleeps are ended this early and the rest of the wait is spent spinning
+#define SPIN_THRESHOLD 0.0015
+
+// Upper bound on a present wait so a lost present cannot hang the loop
+#define PRESENT_WAIT_TIMEOUT_NS 100000000ull
+
+
+static void sleep_until(double deadline)
+{
+        double remaining = deadline - glfwGetTime();
+
+        if (remaining > SPIN_THRESHOLD) {
+                double sleepTime = remaining - SPIN_THRESHOLD;
+                struct timespec duration = {};
+                duration.tv_sec = (time_t) sleepTime;
+                duration.tv_nsec =
+                        (long) ((sleepTime - duration.tv_sec) * 1e9);
+                nanosleep(&duration, NULL);
+        }
+
+        while (glfwGetTime() < deadline)
+                ;
+}
+
+static void record_frame_time(
+                struct FramePacer *p_frame_pacer,
+                double frame_start)
+{
+        if (p_frame_pacer->last_frame_start > 0.0) {
+                p_frame_pacer->frame_times[p_frame_pacer->frame_time_index] =
+                        frame_start - p_frame_pacer->last_frame_start;
+                p_frame_pacer->frame_time_index =
+                        (p_frame_pacer->frame_time_index + 1) %
+                        FRAME_TIME_HISTORY;
+                if (p_frame_pacer->frame_time_count < FRAME_TIME_HISTORY)
+                        p_frame_pacer->frame_time_count++;
+        }
+
+        p_frame_pacer->last_frame_start = frame_start;
+}
+
+void init_frame_pacer(
+                VkDevice device,
+                double target_fps,
+                bool use_present_wait,
+                struct FramePacer *p_frame_pacer)
+{
+        *p_frame_pacer = (struct FramePacer) {};
+
+        if (target_fps > 0.0)
+                p_frame_pacer->target_frame_time = 1.0 / target_fps;
+
+        // Extension commands are not exported by the loader
+        if (use_present_wait)
+                p_frame_pacer->wait_for_present = (PFN_vkWaitForPresentKHR)
+                        vkGetDeviceProcAddr(device, "vkWaitForPresentKHR");
+}
+
+// Blocks until the next frame may start. Call once per frame, right
+// before the frame is drawn.
+void pace_frame(
+                VkDevice device,
+                VkSwapchainKHR swap_chain,
+                struct FramePacer *p_frame_pacer)
+{
+        TRACE_ZONE("pace_frame");
+        if (p_frame_pacer->wait_for_present != NULL &&
+                        p_frame_pacer->waitable_present_id != 0) {
+                // A timeout only costs us pacing for one frame
+                p_frame_pacer->wait_for_present(device, swap_chain,
+                                p_frame_pacer->waitable_present_id,
+                                PRESENT_WAIT_TIMEOUT_NS);
+                p_frame_pacer->waitable_present_id = 0;
+        }
+
+        double targetFrameTime = p_frame_pacer->target_frame_time;
+        if (targetFrameTime > 0.0) {
+                double now = glfwGetTime();
+
+                // After a stall, start over from now instead of rendering
+                // a burst of frames to catch up with the missed deadlines.
+                if (p_frame_pacer->next_deadline == 0.0 ||
+                                now - p_frame_pacer->next_deadline >
+                                targetFrameTime)
+                        p_frame_pacer->next_deadline = now;
+
+                sleep_until(p_frame_pacer->next_deadline);
+                p_frame_pacer->next_deadline += targetFrameTime;
+        }
+
+        record_frame_time(p_frame_pacer, glfwGetTime());
+}
+
+// Returns the id to chain into the present through VkPresentIdKHR
+uint64_t next_present_id(
+                struct FramePacer *p_frame_pacer)
+{
+        return ++p_frame_pacer->present_id;
+}
+
+void on_frame_presented(
+                struct FramePacer *p_frame_pacer,
+                uint64_t present_id)
+{
+        p_frame_pacer->waitable_present_id = present_id;
+}
+
+// Present ids belong to a swap chain, so waiting on one from before the
+// swap chain was recreated would only run into the timeout.
+void reset_present_wait(
+                struct FramePacer *p_frame_pacer)
+{
+        p_frame_pacer->waitable_present_id = 0;
+}
+
+// Forgets the last frame start and deadline, for when rendering resumes
+// after a deliberate pause such as idling or being minimized.
+void reset_frame_pacing(
+                struct FramePacer *p_frame_pacer)
+{
+        p_frame_pacer->last_frame_start = 0.0;
+        p_frame_pacer->next_deadline = 0.0;
+}
+
+struct FrameTimeStats get_frame_time_stats(
+                const struct FramePacer *p_frame_pacer)
+{
+        struct FrameTimeStats stats = {};
+        uint32_t count = p_frame_pacer->frame_time_count;
+        if (count == 0)
+                return stats;
+
+        double sum = 0.0;
+        stats.min_ms = p_frame_pacer->frame_times[0];
+        stats.max_ms = p_frame_pacer->frame_times[0];
+        for (size_t i = 0; i < count; i++) {
+                double frameTime = p_frame_pacer->frame_times[i];
+                sum += frameTime;
+                if (frameTime < stats.min_ms)
+                        stats.min_ms = frameTime;
+                if (frameTime > stats.max_ms)
+                        stats.max_ms = frameTime;
+        }
+        double average = sum / count;
+
+        double deviation = 0.0;
+        for (size_t i = 0; i < count; i++) {
+                double difference = p_frame_pacer->frame_times[i] - average;
+                deviation += difference < 0.0 ? -difference : difference;
+        }
+
+        stats.sample_count = count;
+        stats.average_ms = average * 1000.0;
+        stats.min_ms *= 1000.0;
+        stats.max_ms *= 1000.0;
+        stats.jitter_ms = deviation / count * 1000.0;
+
+        return stats;
+}
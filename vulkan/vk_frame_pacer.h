@@ -0,0 +1,71 @@
+#ifndef VK_FRAME_PACER_H
+#define VK_FRAME_PACER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+// Number of frames the frame time statistics are taken over
+#define FRAME_TIME_HISTORY 240
+
+struct FrameTimeStats {
+        uint32_t sample_count;
+        double average_ms;
+        double min_ms;
+        double max_ms;
+        // Mean absolute deviation from the average frame time
+        double jitter_ms;
+};
+
+// Limits the frame rate to a target and keeps the frame cadence steady.
+//
+// When VK_KHR_present_wait is enabled, a frame is not started before the
+// previous present has reached the display, so at most one frame is ever
+// queued for presentation. On top of that, or on its own without present
+// wait, a timer holds every frame until its deadline. The timer sleeps for
+// most of the wait and spins for the last part, since sleeps tend to
+// overshoot by around a millisecond.
+struct FramePacer {
+        // Seconds per frame, 0 leaves the rate to the present mode
+        double target_frame_time;
+        double next_deadline;
+        double last_frame_start;
+        // NULL when present wait is not enabled on the device
+        PFN_vkWaitForPresentKHR wait_for_present;
+        // Last id handed out by next_present_id()
+        uint64_t present_id;
+        // Present to wait on before the next frame, 0 if there is none
+        uint64_t waitable_present_id;
+        double frame_times[FRAME_TIME_HISTORY];
+        uint32_t frame_time_index;
+        uint32_t frame_time_count;
+};
+
+void init_frame_pacer(
+                VkDevice device,
+                double target_fps,
+                bool use_present_wait,
+                struct FramePacer *p_frame_pacer);
+
+void pace_frame(
+                VkDevice device,
+                VkSwapchainKHR swap_chain,
+                struct FramePacer *p_frame_pacer);
+
+uint64_t next_present_id(
+                struct FramePacer *p_frame_pacer);
+
+void on_frame_presented(
+                struct FramePacer *p_frame_pacer,
+                uint64_t present_id);
+
+void reset_present_wait(
+                struct FramePacer *p_frame_pacer);
+
+void reset_frame_pacing(
+                struct FramePacer *p_frame_pacer);
+
+struct FrameTimeStats get_frame_time_stats(
+                const struct FramePacer *p_frame_pacer);
+
+#endif
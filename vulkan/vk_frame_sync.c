@@ -0,0 +1,289 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <vulkan/vulkan_core.h>
+
+#include "../debug/print.h"
+#include "../debug/trace.h"
+#include "vk_frame_sync.h"
+#include "vk_host_allocator.h"
+
+
+static VkSemaphore create_semaphore(
+                VkDevice device,
+                VkSemaphoreType type)
+{
+        VkSemaphoreTypeCreateInfo typeInfo = {};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeInfo.semaphoreType = type;
+        typeInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphoreInfo = {};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        // Leave the chain empty for binary semaphores so that this
+        // also works on Vulkan 1.0 devices.
+        if (type == VK_SEMAPHORE_TYPE_TIMELINE)
+                semaphoreInfo.pNext = &typeInfo;
+
+        VkSemaphore semaphore;
+        if (vkCreateSemaphore(device, &semaphoreInfo, get_host_allocator(),
+                                &semaphore)
+                        != VK_SUCCESS) {
+                error("Failed to create synchronization objects for a frame!");
+                exit(EXIT_FAILURE);
+        }
+
+        return semaphore;
+}
+
+void create_frame_sync(
+                VkDevice device,
+                uint32_t frame_count,
+                bool use_timeline,
+                struct FrameSync *p_frame_sync)
+{
+        p_frame_sync->use_timeline = use_timeline;
+        p_frame_sync->frame_count = frame_count;
+        p_frame_sync->frame_number = 0;
+        p_frame_sync->completed_frame = 0;
+
+        if (use_timeline) {
+                p_frame_sync->timeline_semaphore =
+                        create_semaphore(device, VK_SEMAPHORE_TYPE_TIMELINE);
+                p_frame_sync->compute_timeline_semaphore =
+                        create_semaphore(device, VK_SEMAPHORE_TYPE_TIMELINE);
+                p_frame_sync->compute_finished_semaphores = NULL;
+                p_frame_sync->in_flight_fences = NULL;
+                return;
+        }
+
+        p_frame_sync->timeline_semaphore = VK_NULL_HANDLE;
+        p_frame_sync->compute_timeline_semaphore = VK_NULL_HANDLE;
+        p_frame_sync->compute_finished_semaphores =
+                malloc(frame_count * sizeof(VkSemaphore));
+        p_frame_sync->in_flight_fences = malloc(frame_count * sizeof(VkFence));
+
+        VkFenceCreateInfo fenceInfo = {};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+        for (size_t i = 0; i < frame_count; i++) {
+                p_frame_sync->compute_finished_semaphores[i] =
+                        create_semaphore(device, VK_SEMAPHORE_TYPE_BINARY);
+                if (vkCreateFence(device, &fenceInfo, get_host_allocator(),
+                                        &p_frame_sync->in_flight_fences[i])
+                                != VK_SUCCESS) {
+                        error("Failed to create synchronization objects for a frame!");
+                        exit(EXIT_FAILURE);
+                }
+        }
+}
+
+// Blocks until the frame that last used this slot has finished on the GPU,
+// so its command buffers and per-frame resources can be reused.
+void wait_for_frame_slot(
+                VkDevice device,
+                struct FrameSync *p_frame_sync,
+                uint32_t current_frame)
+{
+        TRACE_ZONE("wait_for_frame_slot");
+        uint64_t nextFrame = p_frame_sync->frame_number + 1;
+        if (nextFrame <= p_frame_sync->frame_count)
+                return;
+
+        uint64_t previousFrame = nextFrame - p_frame_sync->frame_count;
+        if (previousFrame <= p_frame_sync->completed_frame)
+                return;
+
+        if (p_frame_sync->use_timeline) {
+                uint64_t value = previousFrame;
+
+                VkSemaphoreWaitInfo waitInfo = {};
+                waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+                waitInfo.semaphoreCount = 1;
+                waitInfo.pSemaphores = &p_frame_sync->timeline_semaphore;
+                waitInfo.pValues = &value;
+
+                vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+        } else {
+                vkWaitForFences(device, 1,
+                                &p_frame_sync->in_flight_fences[current_frame],
+                                VK_TRUE, UINT64_MAX);
+        }
+
+        p_frame_sync->completed_frame = previousFrame;
+}
+
+// Starts a new frame number. Only call this once the frame is certain to
+// be submitted, an unsignalled fence would otherwise never be waited on.
+void begin_frame_submission(
+                VkDevice device,
+                struct FrameSync *p_frame_sync,
+                uint32_t current_frame)
+{
+        p_frame_sync->frame_number++;
+
+        if (!p_frame_sync->use_timeline)
+                vkResetFences(device, 1,
+                                &p_frame_sync->in_flight_fences[current_frame]);
+}
+
+// Returns the last frame number whose graphics work has finished.
+// Per-frame allocations tagged with a frame number can be recycled
+// once this has passed it.
+uint64_t get_completed_frame(
+                VkDevice device,
+                struct FrameSync *p_frame_sync)
+{
+        if (p_frame_sync->use_timeline) {
+                uint64_t value;
+                if (vkGetSemaphoreCounterValue(device,
+                                        p_frame_sync->timeline_semaphore,
+                                        &value) == VK_SUCCESS &&
+                                value > p_frame_sync->completed_frame)
+                        p_frame_sync->completed_frame = value;
+                return p_frame_sync->completed_frame;
+        }
+
+        // Poll the fences of the frames still in flight, oldest first
+        uint64_t frameCount = p_frame_sync->frame_count;
+        uint64_t frame = p_frame_sync->completed_frame + 1;
+        for (; frame <= p_frame_sync->frame_number; frame++) {
+                VkFence fence =
+                        p_frame_sync->in_flight_fences[(frame - 1) % frameCount];
+                if (vkGetFenceStatus(device, fence) != VK_SUCCESS)
+                        break;
+                p_frame_sync->completed_frame = frame;
+        }
+
+        return p_frame_sync->completed_frame;
+}
+
+VkResult submit_compute_work(
+                const struct FrameSync *p_frame_sync,
+                VkQueue queue,
+                VkCommandBuffer command_buffer,
+                uint32_t current_frame)
+{
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &command_buffer;
+        submitInfo.signalSemaphoreCount = 1;
+
+        if (!p_frame_sync->use_timeline) {
+                submitInfo.pSignalSemaphores =
+                        &p_frame_sync->compute_finished_semaphores[current_frame];
+                return vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+        }
+
+        uint64_t signalValue = p_frame_sync->frame_number;
+
+        VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.signalSemaphoreValueCount = 1;
+        timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.pSignalSemaphores =
+                &p_frame_sync->compute_timeline_semaphore;
+
+        return vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+}
+
+// Submits the graphics work of the current frame. It waits on the compute
+// work of the same frame and the swap chain images acquired for it, one
+// per output, and signals a render_finished semaphore for each of their
+// presents.
+VkResult submit_graphics_work(
+                const struct FrameSync *p_frame_sync,
+                VkQueue queue,
+                VkCommandBuffer command_buffer,
+                uint32_t current_frame,
+                const VkSemaphore *a_image_available,
+                const VkSemaphore *a_render_finished,
+                uint32_t image_count)
+{
+        VkSemaphore computeSemaphore = p_frame_sync->use_timeline ?
+                p_frame_sync->compute_timeline_semaphore :
+                p_frame_sync->compute_finished_semaphores[current_frame];
+
+        // The particles are only consumed as vertex input, so the
+        // graphics work before that stage can overlap the simulation.
+        VkSemaphore waitSemaphores[image_count + 1];
+        VkPipelineStageFlags waitStages[image_count + 1];
+        waitSemaphores[0] = computeSemaphore;
+        waitStages[0] = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+        for (size_t i = 0; i < image_count; i++) {
+                waitSemaphores[i + 1] = a_image_available[i];
+                waitStages[i + 1] =
+                        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        }
+
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.waitSemaphoreCount = image_count + 1;
+        submitInfo.pWaitSemaphores = waitSemaphores;
+        submitInfo.pWaitDstStageMask = waitStages;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &command_buffer;
+
+        if (!p_frame_sync->use_timeline) {
+                submitInfo.signalSemaphoreCount = image_count;
+                submitInfo.pSignalSemaphores = a_render_finished;
+                return vkQueueSubmit(queue, 1, &submitInfo,
+                                p_frame_sync->in_flight_fences[current_frame]);
+        }
+
+        VkSemaphore signalSemaphores[image_count + 1];
+        signalSemaphores[0] = p_frame_sync->timeline_semaphore;
+        for (size_t i = 0; i < image_count; i++)
+                signalSemaphores[i + 1] = a_render_finished[i];
+
+        // Values for binary semaphores are ignored
+        uint64_t waitValues[image_count + 1];
+        uint64_t signalValues[image_count + 1];
+        for (size_t i = 0; i < image_count + 1; i++) {
+                waitValues[i] = 0;
+                signalValues[i] = 0;
+        }
+        waitValues[0] = p_frame_sync->frame_number;
+        signalValues[0] = p_frame_sync->frame_number;
+
+        VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.waitSemaphoreValueCount = image_count + 1;
+        timelineInfo.pWaitSemaphoreValues = waitValues;
+        timelineInfo.signalSemaphoreValueCount = image_count + 1;
+        timelineInfo.pSignalSemaphoreValues = signalValues;
+
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.signalSemaphoreCount = image_count + 1;
+        submitInfo.pSignalSemaphores = signalSemaphores;
+
+        return vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+}
+
+void destroy_frame_sync(
+                VkDevice device,
+                struct FrameSync *p_frame_sync)
+{
+        if (p_frame_sync->use_timeline) {
+                vkDestroySemaphore(device, p_frame_sync->timeline_semaphore,
+                                get_host_allocator());
+                vkDestroySemaphore(device,
+                                p_frame_sync->compute_timeline_semaphore,
+                                get_host_allocator());
+                return;
+        }
+
+        for (size_t i = 0; i < p_frame_sync->frame_count; i++) {
+                vkDestroySemaphore(device,
+                                p_frame_sync->compute_finished_semaphores[i],
+                                get_host_allocator());
+                vkDestroyFence(device, p_frame_sync->in_flight_fences[i],
+                                get_host_allocator());
+        }
+        free(p_frame_sync->compute_finished_semaphores);
+        free(p_frame_sync->in_flight_fences);
+}
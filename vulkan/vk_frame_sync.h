@@ -0,0 +1,74 @@
+#ifndef VK_FRAME_SYNC_H
+#define VK_FRAME_SYNC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+// Synchronization between the host and the frames in flight.
+//
+// With use_timeline a timeline semaphore tracks the progress of every
+// frame: the graphics work of frame n signals n, so its counter is the
+// number of completed frames. The compute work runs on its own queue and
+// may start on frame n + 1 while frame n still renders, so it signals n
+// on a timeline of its own, which the graphics work of frame n waits on.
+// A single timeline shared by both would be signalled out of order. This
+// replaces the per-frame fences and compute semaphores. Without it the
+// Vulkan 1.0 fences and binary semaphores are used.
+//
+// The binary semaphores the swap chains need belong to the outputs.
+struct FrameSync {
+        bool use_timeline;
+        uint32_t frame_count;
+        // Number of frames submitted so far, frame numbers start at 1
+        uint64_t frame_number;
+        // Last frame known to be finished on the GPU
+        uint64_t completed_frame;
+        // Timeline mode, signalled by the graphics and the compute work
+        VkSemaphore timeline_semaphore;
+        VkSemaphore compute_timeline_semaphore;
+        // Binary mode
+        VkSemaphore *compute_finished_semaphores;
+        VkFence *in_flight_fences;
+};
+
+void create_frame_sync(
+                VkDevice device,
+                uint32_t frame_count,
+                bool use_timeline,
+                struct FrameSync *p_frame_sync);
+
+void wait_for_frame_slot(
+                VkDevice device,
+                struct FrameSync *p_frame_sync,
+                uint32_t current_frame);
+
+void begin_frame_submission(
+                VkDevice device,
+                struct FrameSync *p_frame_sync,
+                uint32_t current_frame);
+
+uint64_t get_completed_frame(
+                VkDevice device,
+                struct FrameSync *p_frame_sync);
+
+VkResult submit_compute_work(
+                const struct FrameSync *p_frame_sync,
+                VkQueue queue,
+                VkCommandBuffer command_buffer,
+                uint32_t current_frame);
+
+VkResult submit_graphics_work(
+                const struct FrameSync *p_frame_sync,
+                VkQueue queue,
+                VkCommandBuffer command_buffer,
+                uint32_t current_frame,
+                const VkSemaphore *a_image_available,
+                const VkSemaphore *a_render_finished,
+                uint32_t image_count);
+
+void destroy_frame_sync(
+                VkDevice device,
+                struct FrameSync *p_frame_sync);
+
+#endif
@@ -0,0 +1,670 @@
+#include <float.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+
+#include "../debug/print.h"
+#include "../debug/trace.h"
+#include "../utils/array.h"
+#include "vk_buffer.h"
+#include "vk_compute_pipeline.h"
+#include "vk_gpu_culling.h"
+#include "vk_host_allocator.h"
+#include "vk_memory_budget.h"
+#include "vk_mesh_registry.h"
+#include "vk_vertex_data.h"
+
+// Must match local_size_x in cull_shader.comp
+#define CULL_WORKGROUP_SIZE 64
+
+struct CullPushConstants {
+        vec4 frustum_planes[FRUSTUM_PLANE_COUNT];
+        uint32_t object_count;
+};
+
+
+static void create_cull_descriptors(
+                VkDevice device,
+                struct GpuCulling *p_gpu_culling)
+{
+        // 0: all objects, 1: visible objects, 2: indirect draw commands
+        VkDescriptorSetLayoutBinding bindings[3] = {};
+        for (size_t i = 0; i < ARRAY_SIZE(bindings); i++) {
+                bindings[i].binding = i;
+                bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                bindings[i].descriptorCount = 1;
+                bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = ARRAY_SIZE(bindings);
+        layoutInfo.pBindings = bindings;
+
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo,
+                                get_host_allocator(),
+                                &p_gpu_culling->descriptor_set_layout)
+                        != VK_SUCCESS) {
+                error("Failed to create culling descriptor set layout!");
+                exit(EXIT_FAILURE);
+        }
+
+        uint32_t frameCount = p_gpu_culling->frame_count;
+
+        VkDescriptorPoolSize poolSize = {};
+        poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSize.descriptorCount = frameCount * ARRAY_SIZE(bindings);
+
+        VkDescriptorPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = frameCount;
+
+        if (vkCreateDescriptorPool(device, &poolInfo, get_host_allocator(),
+                                &p_gpu_culling->descriptor_pool)
+                        != VK_SUCCESS) {
+                error("Failed to create culling descriptor pool!");
+                exit(EXIT_FAILURE);
+        }
+
+        VkDescriptorSetLayout layouts[frameCount];
+        for (size_t i = 0; i < frameCount; i++)
+                layouts[i] = p_gpu_culling->descriptor_set_layout;
+
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = p_gpu_culling->descriptor_pool;
+        allocInfo.descriptorSetCount = frameCount;
+        allocInfo.pSetLayouts = layouts;
+
+        p_gpu_culling->descriptor_sets =
+                malloc(frameCount * sizeof(VkDescriptorSet));
+        if (vkAllocateDescriptorSets(device, &allocInfo,
+                                p_gpu_culling->descriptor_sets)
+                        != VK_SUCCESS) {
+                error("Failed to allocate culling descriptor sets!");
+                exit(EXIT_FAILURE);
+        }
+
+        for (size_t i = 0; i < frameCount; i++) {
+                VkDescriptorBufferInfo bufferInfos[3] = {};
+                bufferInfos[0].buffer = p_gpu_culling->object_buffer;
+                bufferInfos[0].range = VK_WHOLE_SIZE;
+                bufferInfos[1].buffer = p_gpu_culling->visible_buffers[i];
+                bufferInfos[1].range = VK_WHOLE_SIZE;
+                bufferInfos[2].buffer = p_gpu_culling->indirect_buffers[i];
+                bufferInfos[2].range = VK_WHOLE_SIZE;
+
+                VkWriteDescriptorSet writes[3] = {};
+                for (size_t j = 0; j < ARRAY_SIZE(writes); j++) {
+                        writes[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                        writes[j].dstSet = p_gpu_culling->descriptor_sets[i];
+                        writes[j].dstBinding = j;
+                        writes[j].descriptorType =
+                                VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                        writes[j].descriptorCount = 1;
+                        writes[j].pBufferInfo = &bufferInfos[j];
+                }
+
+                vkUpdateDescriptorSets(device, ARRAY_SIZE(writes), writes,
+                                0, NULL);
+        }
+}
+
+// Builds one draw command per mesh, whose instances are a region of the
+// instance buffers with room for every object the mesh will have. The
+// commands follow the registration order of the meshes, mesh_order says
+// which order they are drawn in.
+static void create_draw_commands(
+                const struct MeshRegistry *p_mesh_registry,
+                const uint32_t *a_mesh_capacities,
+                struct GpuCulling *p_gpu_culling)
+{
+        uint32_t meshCount = p_mesh_registry->mesh_count;
+        VkDrawIndexedIndirectCommand *commands =
+                calloc(meshCount, sizeof(VkDrawIndexedIndirectCommand));
+
+        uint32_t firstInstance = 0;
+        for (size_t i = 0; i < meshCount; i++) {
+                const struct Mesh *p_mesh = &p_mesh_registry->meshes[i];
+                commands[i].indexCount = p_mesh->index_count;
+                commands[i].instanceCount = a_mesh_capacities[i];
+                commands[i].firstIndex = p_mesh->first_index;
+                commands[i].vertexOffset = p_mesh->vertex_offset;
+                commands[i].firstInstance = firstInstance;
+                firstInstance += commands[i].instanceCount;
+        }
+
+        p_gpu_culling->mesh_count = meshCount;
+        p_gpu_culling->object_capacity = firstInstance;
+        p_gpu_culling->draw_commands = commands;
+        p_gpu_culling->mesh_object_counts = calloc(meshCount, sizeof(uint32_t));
+
+        // Meshes without objects sort last
+        p_gpu_culling->mesh_depths = malloc(meshCount * sizeof(float));
+        p_gpu_culling->mesh_order = malloc(meshCount * sizeof(uint32_t));
+        for (uint32_t i = 0; i < meshCount; i++) {
+                p_gpu_culling->mesh_depths[i] = FLT_MAX;
+                p_gpu_culling->mesh_order[i] = i;
+        }
+}
+
+// Sorts the meshes by the depth of their nearest object. Insertion sort,
+// there are few meshes and they are already mostly in order.
+static void sort_meshes(
+                struct GpuCulling *p_gpu_culling)
+{
+        uint32_t *order = p_gpu_culling->mesh_order;
+        const float *depths = p_gpu_culling->mesh_depths;
+
+        for (uint32_t i = 1; i < p_gpu_culling->mesh_count; i++) {
+                uint32_t mesh = order[i];
+                uint32_t j = i;
+                for (; j > 0 && depths[order[j - 1]] > depths[mesh]; j--)
+                        order[j] = order[j - 1];
+                order[j] = mesh;
+        }
+}
+
+static int compare_instance_depth(const void *p_a, const void *p_b)
+{
+        float a = ((const Instance *) p_a)->depth;
+        float b = ((const Instance *) p_b)->depth;
+        return (a > b) - (a < b);
+}
+
+// Host side of the CPU culling path. The instance buffers are written
+// every frame, so they stay mapped.
+static void create_cpu_culling(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                struct GpuCulling *p_gpu_culling)
+{
+        uint32_t objectCapacity = p_gpu_culling->object_capacity;
+        uint32_t frameCount = p_gpu_culling->frame_count;
+        VkDeviceSize objectBufferSize = sizeof(Instance) * objectCapacity;
+
+        p_gpu_culling->cpu_culling = true;
+        p_gpu_culling->cull_kernel = detect_cull_kernel();
+        p_gpu_culling->objects = malloc(objectBufferSize);
+        p_gpu_culling->sorted_objects = malloc(objectBufferSize);
+        p_gpu_culling->visible_indices =
+                malloc(objectCapacity * sizeof(uint32_t));
+
+        // Only the resident objects are culled
+        create_cull_bounds(objectCapacity, &p_gpu_culling->bounds);
+        p_gpu_culling->bounds.count = 0;
+
+        p_gpu_culling->cpu_visible_buffers =
+                malloc(frameCount * sizeof(VkBuffer));
+        p_gpu_culling->cpu_visible_buffer_memory =
+                malloc(frameCount * sizeof(VkDeviceMemory));
+        p_gpu_culling->cpu_visible_objects =
+                malloc(frameCount * sizeof(Instance *));
+        p_gpu_culling->cpu_draw_commands = calloc(
+                        frameCount * p_gpu_culling->mesh_count,
+                        sizeof(VkDrawIndexedIndirectCommand));
+
+        for (size_t i = 0; i < frameCount; i++) {
+                if (create_buffer(device, physical_device, objectBufferSize,
+                                        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                        &p_gpu_culling->cpu_visible_buffers[i],
+                                        &p_gpu_culling->cpu_visible_buffer_memory[i])
+                                != VK_SUCCESS) {
+                        error("Failed to create CPU culling buffers!");
+                        exit(EXIT_FAILURE);
+                }
+
+                void *data;
+                vkMapMemory(device, p_gpu_culling->cpu_visible_buffer_memory[i],
+                                0, objectBufferSize, 0, &data);
+                p_gpu_culling->cpu_visible_objects[i] = data;
+        }
+}
+
+// Device side of the GPU driven path: the culling shader and the
+// buffers it compacts the objects into every frame
+static void create_gpu_driven_culling(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                VkCommandPool command_pool,
+                VkQueue queue,
+                struct GpuCulling *p_gpu_culling)
+{
+        uint32_t frameCount = p_gpu_culling->frame_count;
+        VkDeviceSize objectBufferSize =
+                sizeof(Instance) * p_gpu_culling->object_capacity;
+        uint32_t meshCount = p_gpu_culling->mesh_count;
+        VkDeviceSize commandBufferSize =
+                sizeof(VkDrawIndexedIndirectCommand) * meshCount;
+
+        // The instance counts are reset on the GPU every frame, the other
+        // fields of the commands never change.
+        VkDrawIndexedIndirectCommand resetCommands[meshCount];
+        memcpy(resetCommands, p_gpu_culling->draw_commands,
+                        sizeof(resetCommands));
+        for (size_t i = 0; i < meshCount; i++)
+                resetCommands[i].instanceCount = 0;
+
+        if (create_buffer(device, physical_device, commandBufferSize,
+                                VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                &p_gpu_culling->command_reset_buffer,
+                                &p_gpu_culling->command_reset_buffer_memory)
+                        != VK_SUCCESS) {
+                error("Failed to create draw command reset buffer!");
+                exit(EXIT_FAILURE);
+        }
+        upload_buffer(device, physical_device, command_pool, queue,
+                        p_gpu_culling->command_reset_buffer, resetCommands,
+                        commandBufferSize);
+
+        p_gpu_culling->visible_buffers = malloc(frameCount * sizeof(VkBuffer));
+        p_gpu_culling->visible_buffer_memory =
+                malloc(frameCount * sizeof(VkDeviceMemory));
+        p_gpu_culling->indirect_buffers = malloc(frameCount * sizeof(VkBuffer));
+        p_gpu_culling->indirect_buffer_memory =
+                malloc(frameCount * sizeof(VkDeviceMemory));
+
+        for (size_t i = 0; i < frameCount; i++) {
+                if (create_buffer(device, physical_device, objectBufferSize,
+                                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                        &p_gpu_culling->visible_buffers[i],
+                                        &p_gpu_culling->visible_buffer_memory[i])
+                                != VK_SUCCESS ||
+                                create_buffer(device, physical_device,
+                                        commandBufferSize,
+                                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                        VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                        &p_gpu_culling->indirect_buffers[i],
+                                        &p_gpu_culling->indirect_buffer_memory[i])
+                                != VK_SUCCESS) {
+                        error("Failed to create culling buffers!");
+                        exit(EXIT_FAILURE);
+                }
+        }
+
+        create_cull_descriptors(device, p_gpu_culling);
+
+        p_gpu_culling->compute_pipeline_details =
+                create_compute_pipeline(&device, "shaders/cull_comp.spv",
+                                &p_gpu_culling->descriptor_set_layout,
+                                sizeof(struct CullPushConstants));
+}
+
+void create_gpu_culling(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                VkCommandPool command_pool,
+                VkQueue queue,
+                const uint32_t *a_queue_families,
+                uint32_t queue_family_count,
+                const struct MeshRegistry *p_mesh_registry,
+                const uint32_t *a_mesh_capacities,
+                uint32_t frame_count,
+                bool gpu_driven,
+                struct GpuCulling *p_gpu_culling)
+{
+        TRACE_ZONE("create_gpu_culling");
+        p_gpu_culling->object_count = 0;
+        p_gpu_culling->frame_count = frame_count;
+        p_gpu_culling->cpu_culling = false;
+
+        create_draw_commands(p_mesh_registry, a_mesh_capacities,
+                        p_gpu_culling);
+
+        VkDeviceSize objectBufferSize =
+                sizeof(Instance) * p_gpu_culling->object_capacity;
+
+        // Written by streamed uploads, which may run on another family.
+        // Both paths stream the objects in.
+        if (create_buffer_concurrent(device, physical_device,
+                                objectBufferSize,
+                                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                a_queue_families, queue_family_count,
+                                &p_gpu_culling->object_buffer,
+                                &p_gpu_culling->object_buffer_memory)
+                        != VK_SUCCESS) {
+                error("Failed to create object buffer!");
+                exit(EXIT_FAILURE);
+        }
+
+        // Default to the clip space box, leaving near and far open
+        const vec4 planes[FRUSTUM_PLANE_COUNT] = {
+                { 1.0f,  0.0f, 0.0f, 1.0f},
+                {-1.0f,  0.0f, 0.0f, 1.0f},
+                { 0.0f,  1.0f, 0.0f, 1.0f},
+                { 0.0f, -1.0f, 0.0f, 1.0f},
+                { 0.0f,  0.0f, 0.0f, 1.0f},
+                { 0.0f,  0.0f, 0.0f, 1.0f},
+        };
+        set_frustum_planes(p_gpu_culling, planes);
+
+        if (gpu_driven)
+                create_gpu_driven_culling(device, physical_device,
+                                command_pool, queue, p_gpu_culling);
+        else
+                create_cpu_culling(device, physical_device, p_gpu_culling);
+}
+
+// Makes the objects uploaded to the object buffer at first_object part of
+// the culling, from the next recorded frame on. Objects have to be added
+// in order and each mesh's objects must fit its capacity.
+void add_culled_objects(
+                struct GpuCulling *p_gpu_culling,
+                uint32_t first_object,
+                const Instance *a_objects,
+                uint32_t object_count)
+{
+        if (first_object != p_gpu_culling->object_count ||
+                        object_count > p_gpu_culling->object_capacity -
+                        first_object) {
+                error("Objects must be added in order and within capacity!");
+                exit(EXIT_FAILURE);
+        }
+
+        bool depthsChanged = false;
+        for (size_t i = 0; i < object_count; i++) {
+                uint32_t mesh = a_objects[i].mesh;
+                if (mesh >= p_gpu_culling->mesh_count ||
+                                p_gpu_culling->mesh_object_counts[mesh] ==
+                                p_gpu_culling->draw_commands[mesh].instanceCount) {
+                        error("Object does not fit the capacity of its mesh!");
+                        exit(EXIT_FAILURE);
+                }
+                p_gpu_culling->mesh_object_counts[mesh]++;
+
+                if (a_objects[i].depth < p_gpu_culling->mesh_depths[mesh]) {
+                        p_gpu_culling->mesh_depths[mesh] = a_objects[i].depth;
+                        depthsChanged = true;
+                }
+        }
+        if (depthsChanged)
+                sort_meshes(p_gpu_culling);
+
+        if (p_gpu_culling->cpu_culling) {
+                memcpy(&p_gpu_culling->objects[first_object], a_objects,
+                                object_count * sizeof(Instance));
+
+                // Flat scene, the culling shader also tests at z = 0
+                for (size_t i = 0; i < object_count; i++)
+                        set_cull_bound(&p_gpu_culling->bounds,
+                                        first_object + i,
+                                        a_objects[i].center[0],
+                                        a_objects[i].center[1],
+                                        0.0f, a_objects[i].radius);
+                p_gpu_culling->bounds.count = first_object + object_count;
+        }
+
+        p_gpu_culling->object_count = first_object + object_count;
+}
+
+void set_frustum_planes(
+                struct GpuCulling *p_gpu_culling,
+                const vec4 *a_planes)
+{
+        memcpy(p_gpu_culling->frustum_planes, a_planes,
+                        sizeof(p_gpu_culling->frustum_planes));
+}
+
+// Culls the objects on the CPU and fills the instance buffer and draw
+// commands of the frame for record_object_draw(). The frame's previous
+// submission must have finished.
+void cull_objects_on_cpu(
+                struct GpuCulling *p_gpu_culling,
+                struct JobSystem *p_job_system,
+                uint32_t current_frame)
+{
+        TRACE_ZONE("cull_objects_on_cpu");
+        uint32_t visibleCount = cull_bounds_parallel(p_job_system,
+                        &p_gpu_culling->bounds,
+                        (const vec4 *) p_gpu_culling->frustum_planes,
+                        p_gpu_culling->cull_kernel,
+                        p_gpu_culling->visible_indices);
+
+        uint32_t meshCount = p_gpu_culling->mesh_count;
+        VkDrawIndexedIndirectCommand *commands =
+                &p_gpu_culling->cpu_draw_commands[current_frame * meshCount];
+        for (size_t i = 0; i < meshCount; i++) {
+                commands[i] = p_gpu_culling->draw_commands[i];
+                commands[i].instanceCount = 0;
+        }
+
+        // Objects are resident in the order they were streamed in, not
+        // grouped by mesh, so count every mesh's survivors before copying
+        // them into their ranges
+        for (size_t i = 0; i < visibleCount; i++) {
+                uint32_t index = p_gpu_culling->visible_indices[i];
+                commands[p_gpu_culling->objects[index].mesh].instanceCount++;
+        }
+
+        uint32_t nextInstance[meshCount];
+        uint32_t firstInstance = 0;
+        for (size_t i = 0; i < meshCount; i++) {
+                commands[i].firstInstance = firstInstance;
+                nextInstance[i] = firstInstance;
+                firstInstance += commands[i].instanceCount;
+        }
+
+        // Sorted front to back in host memory, the instance buffer is
+        // write combined and too slow to read back from
+        Instance *sortedObjects = p_gpu_culling->sorted_objects;
+        for (size_t i = 0; i < visibleCount; i++) {
+                uint32_t index = p_gpu_culling->visible_indices[i];
+                const Instance *p_object = &p_gpu_culling->objects[index];
+                sortedObjects[nextInstance[p_object->mesh]++] = *p_object;
+        }
+        for (size_t i = 0; i < meshCount; i++)
+                qsort(&sortedObjects[commands[i].firstInstance],
+                                commands[i].instanceCount, sizeof(Instance),
+                                compare_instance_depth);
+
+        memcpy(p_gpu_culling->cpu_visible_objects[current_frame],
+                        sortedObjects, visibleCount * sizeof(Instance));
+}
+
+// Records the culling pass. Must be recorded outside of a render pass and
+// before record_object_draw() for the same frame. The indirect and visible
+// buffers of the frame are written by the compute shader, whoever records
+// the draw has to make them visible to it.
+void record_gpu_culling(
+                const struct GpuCulling *p_gpu_culling,
+                VkCommandBuffer command_buffer,
+                uint32_t current_frame)
+{
+        VkBuffer indirectBuffer = p_gpu_culling->indirect_buffers[current_frame];
+
+        // Reset the instance counts of the draw commands. They are
+        // strided, so copy the whole array instead of filling them.
+        VkBufferCopy resetRegion = {};
+        resetRegion.size = sizeof(VkDrawIndexedIndirectCommand) *
+                p_gpu_culling->mesh_count;
+        vkCmdCopyBuffer(command_buffer, p_gpu_culling->command_reset_buffer,
+                        indirectBuffer, 1, &resetRegion);
+
+        // The second barrier makes objects streamed in on the transfer
+        // queue visible. Their upload's fence was waited on before they
+        // were added, so only the visibility is missing.
+        VkBufferMemoryBarrier transferBarriers[2] = {};
+        for (size_t i = 0; i < ARRAY_SIZE(transferBarriers); i++) {
+                transferBarriers[i].sType =
+                        VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+                transferBarriers[i].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                transferBarriers[i].srcQueueFamilyIndex =
+                        VK_QUEUE_FAMILY_IGNORED;
+                transferBarriers[i].dstQueueFamilyIndex =
+                        VK_QUEUE_FAMILY_IGNORED;
+                transferBarriers[i].offset = 0;
+                transferBarriers[i].size = VK_WHOLE_SIZE;
+        }
+        transferBarriers[0].dstAccessMask =
+                VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        transferBarriers[0].buffer = indirectBuffer;
+        transferBarriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        transferBarriers[1].buffer = p_gpu_culling->object_buffer;
+
+        vkCmdPipelineBarrier(command_buffer,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                        0, 0, NULL, ARRAY_SIZE(transferBarriers),
+                        transferBarriers, 0, NULL);
+
+        const struct ComputePipelineDetails *p_compute =
+                &p_gpu_culling->compute_pipeline_details;
+
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                        p_compute->compute_pipeline);
+
+        vkCmdBindDescriptorSets(command_buffer,
+                        VK_PIPELINE_BIND_POINT_COMPUTE,
+                        p_compute->pipeline_layout, 0, 1,
+                        &p_gpu_culling->descriptor_sets[current_frame],
+                        0, NULL);
+
+        struct CullPushConstants pushConstants = {};
+        memcpy(pushConstants.frustum_planes, p_gpu_culling->frustum_planes,
+                        sizeof(pushConstants.frustum_planes));
+        pushConstants.object_count = p_gpu_culling->object_count;
+        vkCmdPushConstants(command_buffer, p_compute->pipeline_layout,
+                        VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                        sizeof(pushConstants), &pushConstants);
+
+        uint32_t groupCount = (p_gpu_culling->object_count +
+                        CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE;
+        vkCmdDispatch(command_buffer, groupCount, 1, 1);
+}
+
+// Records the object draw inside an active render pass. The mesh registry
+// must already be bound. The meshes are drawn nearest first. With
+// gpu_driven, meshes whose commands follow each other in that order are
+// drawn by a single multi-draw indirect call, which needs the
+// multiDrawIndirect and drawIndirectFirstInstance features. Otherwise
+// the objects left by cull_objects_on_cpu() are drawn with one instanced
+// draw per mesh.
+void record_object_draw(
+                const struct GpuCulling *p_gpu_culling,
+                VkCommandBuffer command_buffer,
+                uint32_t current_frame,
+                bool gpu_driven)
+{
+        VkDeviceSize offsets[] = {0};
+
+        if (gpu_driven) {
+                vkCmdBindVertexBuffers(command_buffer, 1, 1,
+                                &p_gpu_culling->visible_buffers[current_frame],
+                                offsets);
+                const uint32_t *order = p_gpu_culling->mesh_order;
+                uint32_t first = 0;
+                for (uint32_t i = 1; i <= p_gpu_culling->mesh_count; i++) {
+                        if (i < p_gpu_culling->mesh_count &&
+                                        order[i] == order[i - 1] + 1)
+                                continue;
+
+                        vkCmdDrawIndexedIndirect(command_buffer,
+                                        p_gpu_culling->indirect_buffers[
+                                        current_frame],
+                                        order[first] *
+                                        sizeof(VkDrawIndexedIndirectCommand),
+                                        i - first,
+                                        sizeof(VkDrawIndexedIndirectCommand));
+                        first = i;
+                }
+                return;
+        }
+
+        uint32_t meshCount = p_gpu_culling->mesh_count;
+        vkCmdBindVertexBuffers(command_buffer, 1, 1,
+                        &p_gpu_culling->cpu_visible_buffers[current_frame],
+                        offsets);
+        for (size_t i = 0; i < meshCount; i++) {
+                const VkDrawIndexedIndirectCommand *p_command =
+                        &p_gpu_culling->cpu_draw_commands[
+                                current_frame * meshCount +
+                                p_gpu_culling->mesh_order[i]];
+                if (p_command->instanceCount == 0)
+                        continue;
+
+                vkCmdDrawIndexed(command_buffer, p_command->indexCount,
+                                p_command->instanceCount,
+                                p_command->firstIndex,
+                                p_command->vertexOffset,
+                                p_command->firstInstance);
+        }
+}
+
+void destroy_gpu_culling(
+                VkDevice device,
+                struct GpuCulling *p_gpu_culling)
+{
+        if (p_gpu_culling->cpu_culling) {
+                for (size_t i = 0; i < p_gpu_culling->frame_count; i++) {
+                        vkDestroyBuffer(device,
+                                        p_gpu_culling->cpu_visible_buffers[i],
+                                        get_host_allocator());
+                        free_device_memory(device,
+                                        p_gpu_culling->cpu_visible_buffer_memory[i]);
+                }
+                free(p_gpu_culling->cpu_visible_buffers);
+                free(p_gpu_culling->cpu_visible_buffer_memory);
+                free(p_gpu_culling->cpu_visible_objects);
+                free(p_gpu_culling->cpu_draw_commands);
+                free(p_gpu_culling->visible_indices);
+                free(p_gpu_culling->objects);
+                free(p_gpu_culling->sorted_objects);
+                destroy_cull_bounds(&p_gpu_culling->bounds);
+        } else {
+                destroy_compute_pipeline(&device,
+                                &p_gpu_culling->compute_pipeline_details);
+
+                vkDestroyDescriptorPool(device, p_gpu_culling->descriptor_pool,
+                                get_host_allocator());
+                vkDestroyDescriptorSetLayout(device,
+                                p_gpu_culling->descriptor_set_layout,
+                                get_host_allocator());
+                free(p_gpu_culling->descriptor_sets);
+
+                for (size_t i = 0; i < p_gpu_culling->frame_count; i++) {
+                        vkDestroyBuffer(device,
+                                        p_gpu_culling->visible_buffers[i],
+                                        get_host_allocator());
+                        free_device_memory(device,
+                                        p_gpu_culling->visible_buffer_memory[i]);
+                        vkDestroyBuffer(device,
+                                        p_gpu_culling->indirect_buffers[i],
+                                        get_host_allocator());
+                        free_device_memory(device,
+                                        p_gpu_culling->indirect_buffer_memory[i]);
+                }
+                free(p_gpu_culling->visible_buffers);
+                free(p_gpu_culling->visible_buffer_memory);
+                free(p_gpu_culling->indirect_buffers);
+                free(p_gpu_culling->indirect_buffer_memory);
+
+                vkDestroyBuffer(device, p_gpu_culling->command_reset_buffer,
+                                get_host_allocator());
+                free_device_memory(device,
+                                p_gpu_culling->command_reset_buffer_memory);
+        }
+
+        free(p_gpu_culling->draw_commands);
+        free(p_gpu_culling->mesh_object_counts);
+        free(p_gpu_culling->mesh_depths);
+        free(p_gpu_culling->mesh_order);
+
+        vkDestroyBuffer(device, p_gpu_culling->object_buffer,
+                        get_host_allocator());
+        free_device_memory(device, p_gpu_culling->object_buffer_memory);
+}
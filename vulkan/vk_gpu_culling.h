@@ -0,0 +1,130 @@
+#ifndef VK_GPU_CULLING_H
+#define VK_GPU_CULLING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+#include <cglm/cglm.h>
+
+#include "../utils/cpu_culling.h"
+#include "vk_compute_pipeline.h"
+#include "vk_mesh_registry.h"
+#include "vk_vertex_data.h"
+
+#define FRUSTUM_PLANE_COUNT 6
+
+// GPU driven object rendering.
+//
+// All object bounds live in a single storage buffer. Every frame a
+// compute pass tests them against the frustum and appends the survivors
+// to their mesh's region of a per-frame instance buffer while counting
+// them in the instanceCount of that mesh's indirect draw command. Every
+// mesh shares the buffers of the mesh registry, so the draw itself is a
+// single multi-draw vkCmdDrawIndexedIndirect and the CPU cost of a frame
+// depends on neither the number of objects nor meshes.
+//
+// Without GPU driven rendering the same bounds are culled on the CPU by
+// SIMD kernels spread over worker threads, and the survivors are written
+// to a host visible instance buffer drawn with one draw per mesh.
+//
+// Either way the meshes are drawn nearest first, ordered by the depth of
+// their nearest resident object, so the depth test rejects fragments
+// hidden by earlier meshes before they are shaded. The CPU path also
+// sorts the objects of every mesh front to back; the GPU compaction
+// leaves them in no particular order.
+//
+// The object buffer starts out empty and is filled in by streamed
+// uploads, each mesh's region is sized for the objects it will have
+// once everything is resident. add_culled_objects() makes objects part
+// of the culling once their upload has finished.
+struct GpuCulling {
+        // Resident objects, the first object_count of the object buffer
+        uint32_t object_count;
+        uint32_t object_capacity;
+        uint32_t mesh_count;
+        uint32_t frame_count;
+        VkBuffer object_buffer;
+        VkDeviceMemory object_buffer_memory;
+        // Draw commands with the mesh's region of the instance buffers,
+        // instanceCount is the capacity of the region
+        VkDrawIndexedIndirectCommand *draw_commands;
+        // Resident objects of every mesh
+        uint32_t *mesh_object_counts;
+        // Depth of the nearest resident object of every mesh, and the
+        // meshes sorted by it
+        float *mesh_depths;
+        uint32_t *mesh_order;
+        // GPU culling, only created when GPU driven.
+        // The same commands with no instances, copied over the indirect
+        // buffer to reset it every frame
+        VkBuffer command_reset_buffer;
+        VkDeviceMemory command_reset_buffer_memory;
+        // One compacted instance buffer and one command array per frame
+        VkBuffer *visible_buffers;
+        VkDeviceMemory *visible_buffer_memory;
+        VkBuffer *indirect_buffers;
+        VkDeviceMemory *indirect_buffer_memory;
+        VkDescriptorSetLayout descriptor_set_layout;
+        VkDescriptorPool descriptor_pool;
+        VkDescriptorSet *descriptor_sets;
+        struct ComputePipelineDetails compute_pipeline_details;
+        vec4 frustum_planes[FRUSTUM_PLANE_COUNT];
+        // CPU culling, only created when not GPU driven
+        bool cpu_culling;
+        enum CullKernel cull_kernel;
+        Instance *objects;
+        // The visible objects of a frame, grouped by mesh and sorted
+        Instance *sorted_objects;
+        struct CullBounds bounds;
+        uint32_t *visible_indices;
+        VkBuffer *cpu_visible_buffers;
+        VkDeviceMemory *cpu_visible_buffer_memory;
+        Instance **cpu_visible_objects;
+        // mesh_count commands per frame
+        VkDrawIndexedIndirectCommand *cpu_draw_commands;
+};
+
+void create_gpu_culling(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                VkCommandPool command_pool,
+                VkQueue queue,
+                const uint32_t *a_queue_families,
+                uint32_t queue_family_count,
+                const struct MeshRegistry *p_mesh_registry,
+                const uint32_t *a_mesh_capacities,
+                uint32_t frame_count,
+                bool gpu_driven,
+                struct GpuCulling *p_gpu_culling);
+
+void add_culled_objects(
+                struct GpuCulling *p_gpu_culling,
+                uint32_t first_object,
+                const Instance *a_objects,
+                uint32_t object_count);
+
+void set_frustum_planes(
+                struct GpuCulling *p_gpu_culling,
+                const vec4 *a_planes);
+
+void cull_objects_on_cpu(
+                struct GpuCulling *p_gpu_culling,
+                struct JobSystem *p_job_system,
+                uint32_t current_frame);
+
+void record_gpu_culling(
+                const struct GpuCulling *p_gpu_culling,
+                VkCommandBuffer command_buffer,
+                uint32_t current_frame);
+
+void record_object_draw(
+                const struct GpuCulling *p_gpu_culling,
+                VkCommandBuffer command_buffer,
+                uint32_t current_frame,
+                bool gpu_driven);
+
+void destroy_gpu_culling(
+                VkDevice device,
+                struct GpuCulling *p_gpu_culling);
+
+#endif
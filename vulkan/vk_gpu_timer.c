@@ -0,0 +1,293 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <vulkan/vulkan_core.h>
+
+#include "../debug/print.h"
+#include "../debug/trace.h"
+#include "vk_buffer.h"
+#include "vk_gpu_timer.h"
+#include "vk_host_allocator.h"
+
+
+bool supports_gpu_timing(
+                VkPhysicalDevice physical_device,
+                uint32_t queue_family_index)
+{
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physical_device, &properties);
+        if (properties.limits.timestampPeriod == 0.0f)
+                return false;
+
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physical_device,
+                        &queueFamilyCount, NULL);
+        VkQueueFamilyProperties queueFamilies[queueFamilyCount];
+        vkGetPhysicalDeviceQueueFamilyProperties(physical_device,
+                        &queueFamilyCount, queueFamilies);
+
+        return queue_family_index < queueFamilyCount &&
+                queueFamilies[queue_family_index].timestampValidBits > 0;
+}
+
+// The bits of a timestamp of the queue family that hold its value
+uint64_t get_timestamp_mask(
+                VkPhysicalDevice physical_device,
+                uint32_t queue_family_index)
+{
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physical_device,
+                        &queueFamilyCount, NULL);
+        VkQueueFamilyProperties queueFamilies[queueFamilyCount];
+        vkGetPhysicalDeviceQueueFamilyProperties(physical_device,
+                        &queueFamilyCount, queueFamilies);
+
+        uint32_t validBits = queueFamilies[queue_family_index].timestampValidBits;
+        return validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
+}
+
+// Samples both clocks at once. The trace runs on CLOCK_MONOTONIC.
+static bool read_calibrated_timestamps(
+                struct GpuTimer *p_gpu_timer,
+                uint64_t *p_timestamp,
+                uint64_t *p_cpu_ns)
+{
+        VkCalibratedTimestampInfoEXT infos[2] = {};
+        infos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+        infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+        infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+        infos[1].timeDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+
+        uint64_t timestamps[2];
+        uint64_t maxDeviation;
+        if (p_gpu_timer->get_calibrated_timestamps(p_gpu_timer->device, 2,
+                                infos, timestamps, &maxDeviation)
+                        != VK_SUCCESS)
+                return false;
+
+        *p_timestamp = timestamps[0];
+        *p_cpu_ns = timestamps[1];
+        return true;
+}
+
+// Writes a single timestamp and takes the midpoint of the CPU time
+// around the submission as the moment it was taken. The queue is drained
+// first so that the timestamp does not wait behind earlier work.
+static bool submit_calibration_timestamp(
+                struct GpuTimer *p_gpu_timer,
+                uint64_t *p_timestamp,
+                uint64_t *p_cpu_ns)
+{
+        VkQueryPool queryPool = p_gpu_timer->calibration_query_pool;
+
+        VkCommandBuffer commandBuffer = begin_single_time_commands(
+                        p_gpu_timer->device, p_gpu_timer->command_pool);
+        vkCmdResetQueryPool(commandBuffer, queryPool, 0, 1);
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                        queryPool, 0);
+
+        vkQueueWaitIdle(p_gpu_timer->queue);
+        uint64_t cpuBegin = trace_now_ns();
+        end_single_time_commands(p_gpu_timer->device,
+                        p_gpu_timer->command_pool, p_gpu_timer->queue,
+                        commandBuffer);
+        uint64_t cpuEnd = trace_now_ns();
+
+        if (vkGetQueryPoolResults(p_gpu_timer->device, queryPool, 0, 1,
+                                sizeof(*p_timestamp), p_timestamp,
+                                sizeof(*p_timestamp),
+                                VK_QUERY_RESULT_64_BIT |
+                                VK_QUERY_RESULT_WAIT_BIT) != VK_SUCCESS)
+                return false;
+
+        *p_cpu_ns = cpuBegin + (cpuEnd - cpuBegin) / 2;
+        return true;
+}
+
+// Measures the offset from GPU to trace time again. A failed measurement
+// keeps the previous offset.
+static void calibrate_gpu_clock(
+                struct GpuTimer *p_gpu_timer)
+{
+        TRACE_ZONE("calibrate_gpu_clock");
+        uint64_t timestamp = 0;
+        uint64_t cpuNs = 0;
+        bool calibrated = p_gpu_timer->get_calibrated_timestamps != NULL ?
+                read_calibrated_timestamps(p_gpu_timer, &timestamp, &cpuNs) :
+                submit_calibration_timestamp(p_gpu_timer, &timestamp,
+                                &cpuNs);
+        p_gpu_timer->frames_since_calibration = 0;
+        if (!calibrated) {
+                warning("Failed to calibrate the GPU clock\n");
+                return;
+        }
+
+        uint64_t gpuNs = (uint64_t) ((timestamp & p_gpu_timer->timestamp_mask)
+                        * p_gpu_timer->timestamp_period);
+        p_gpu_timer->offset_ns = (int64_t) (cpuNs - gpuNs);
+}
+
+void create_gpu_timer(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                VkCommandPool command_pool,
+                VkQueue queue,
+                uint32_t queue_family_index,
+                uint32_t frame_count,
+                bool use_calibrated_timestamps,
+                struct GpuTimer *p_gpu_timer)
+{
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+        *p_gpu_timer = (struct GpuTimer) {};
+        p_gpu_timer->device = device;
+        p_gpu_timer->command_pool = command_pool;
+        p_gpu_timer->queue = queue;
+        p_gpu_timer->frame_count = frame_count;
+        p_gpu_timer->timestamp_period = properties.limits.timestampPeriod;
+        p_gpu_timer->timestamp_mask =
+                get_timestamp_mask(physical_device, queue_family_index);
+        p_gpu_timer->frames = calloc(frame_count, sizeof(struct GpuTimerFrame));
+
+        VkQueryPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        poolInfo.queryCount = GPU_TIMER_MAX_ZONES * 2;
+
+        for (size_t i = 0; i < frame_count; i++) {
+                if (vkCreateQueryPool(device, &poolInfo, get_host_allocator(),
+                                        &p_gpu_timer->frames[i].query_pool)
+                                != VK_SUCCESS) {
+                        error("Failed to create timestamp query pool!");
+                        exit(EXIT_FAILURE);
+                }
+        }
+
+        // Extension commands are not exported by the loader
+        if (use_calibrated_timestamps)
+                p_gpu_timer->get_calibrated_timestamps =
+                        (PFN_vkGetCalibratedTimestampsEXT)
+                        vkGetDeviceProcAddr(device,
+                                        "vkGetCalibratedTimestampsEXT");
+
+        if (p_gpu_timer->get_calibrated_timestamps == NULL) {
+                poolInfo.queryCount = 1;
+                if (vkCreateQueryPool(device, &poolInfo, get_host_allocator(),
+                                        &p_gpu_timer->calibration_query_pool)
+                                != VK_SUCCESS) {
+                        error("Failed to create timestamp query pool!");
+                        exit(EXIT_FAILURE);
+                }
+        }
+
+        calibrate_gpu_clock(p_gpu_timer);
+}
+
+static void read_gpu_zones(
+                struct GpuTimer *p_gpu_timer,
+                struct GpuTimerFrame *p_frame)
+{
+        uint32_t queryCount = p_frame->zone_count * 2;
+        uint64_t timestamps[GPU_TIMER_MAX_ZONES * 2];
+
+        // The frame is known to be finished, so results are not waited for
+        if (vkGetQueryPoolResults(p_gpu_timer->device, p_frame->query_pool,
+                                0, queryCount, sizeof(timestamps), timestamps,
+                                sizeof(uint64_t), VK_QUERY_RESULT_64_BIT)
+                        != VK_SUCCESS)
+                return;
+
+        for (size_t i = 0; i < p_frame->zone_count; i++) {
+                uint64_t begin = timestamps[i * 2] &
+                        p_gpu_timer->timestamp_mask;
+                uint64_t end = timestamps[i * 2 + 1] &
+                        p_gpu_timer->timestamp_mask;
+
+                trace_complete_event(p_frame->zone_names[i], TRACE_GPU_TRACK,
+                                (uint64_t) (begin * p_gpu_timer->timestamp_period)
+                                + p_gpu_timer->offset_ns,
+                                (uint64_t) (end * p_gpu_timer->timestamp_period)
+                                + p_gpu_timer->offset_ns);
+        }
+}
+
+void begin_gpu_timer_frame(
+                struct GpuTimer *p_gpu_timer,
+                VkCommandBuffer command_buffer,
+                uint32_t frame)
+{
+        if (p_gpu_timer == NULL)
+                return;
+
+        // Before the zones are read, so they use the fresh offset
+        uint32_t interval = p_gpu_timer->get_calibrated_timestamps != NULL ?
+                GPU_TIMER_CALIBRATION_INTERVAL :
+                GPU_TIMER_SUBMIT_CALIBRATION_INTERVAL;
+        if (++p_gpu_timer->frames_since_calibration >= interval)
+                calibrate_gpu_clock(p_gpu_timer);
+
+        struct GpuTimerFrame *p_frame = &p_gpu_timer->frames[frame];
+        if (p_frame->pending)
+                read_gpu_zones(p_gpu_timer, p_frame);
+
+        vkCmdResetQueryPool(command_buffer, p_frame->query_pool, 0,
+                        GPU_TIMER_MAX_ZONES * 2);
+        p_frame->zone_count = 0;
+        p_frame->pending = false;
+}
+
+void begin_gpu_zone(
+                struct GpuTimer *p_gpu_timer,
+                VkCommandBuffer command_buffer,
+                uint32_t frame,
+                const char *name)
+{
+        if (p_gpu_timer == NULL)
+                return;
+
+        struct GpuTimerFrame *p_frame = &p_gpu_timer->frames[frame];
+        if (p_frame->zone_count == GPU_TIMER_MAX_ZONES)
+                return;
+
+        p_frame->zone_names[p_frame->zone_count] = name;
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                        p_frame->query_pool, p_frame->zone_count * 2);
+}
+
+void end_gpu_zone(
+                struct GpuTimer *p_gpu_timer,
+                VkCommandBuffer command_buffer,
+                uint32_t frame)
+{
+        if (p_gpu_timer == NULL)
+                return;
+
+        struct GpuTimerFrame *p_frame = &p_gpu_timer->frames[frame];
+        if (p_frame->zone_count == GPU_TIMER_MAX_ZONES)
+                return;
+
+        vkCmdWriteTimestamp(command_buffer,
+                        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        p_frame->query_pool, p_frame->zone_count * 2 + 1);
+        p_frame->zone_count++;
+        p_frame->pending = true;
+}
+
+void destroy_gpu_timer(
+                struct GpuTimer *p_gpu_timer)
+{
+        if (p_gpu_timer->frames == NULL)
+                return;
+
+        for (size_t i = 0; i < p_gpu_timer->frame_count; i++)
+                vkDestroyQueryPool(p_gpu_timer->device,
+                                p_gpu_timer->frames[i].query_pool,
+                                get_host_allocator());
+        if (p_gpu_timer->calibration_query_pool != VK_NULL_HANDLE)
+                vkDestroyQueryPool(p_gpu_timer->device,
+                                p_gpu_timer->calibration_query_pool,
+                                get_host_allocator());
+        free(p_gpu_timer->frames);
+        p_gpu_timer->frames = NULL;
+}
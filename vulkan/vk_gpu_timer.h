@@ -0,0 +1,92 @@
+#ifndef VK_GPU_TIMER_H
+#define VK_GPU_TIMER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+// Number of timed ranges a single frame can record
+#define GPU_TIMER_MAX_ZONES 16
+
+// Frames between two measurements of the GPU clock offset. Without
+// calibrated timestamps a measurement waits for the queue to go idle,
+// so it is taken less often.
+#define GPU_TIMER_CALIBRATION_INTERVAL 60
+#define GPU_TIMER_SUBMIT_CALIBRATION_INTERVAL 600
+
+struct GpuTimerFrame {
+        VkQueryPool query_pool;
+        const char *zone_names[GPU_TIMER_MAX_ZONES];
+        uint32_t zone_count;
+        // Set once timestamps were recorded and not yet read back
+        bool pending;
+};
+
+// Measures ranges of a command buffer with timestamp queries and puts
+// them on the trace timeline next to the CPU zones.
+//
+// Every frame in flight has its own query pool. Its results are read
+// when the slot is recorded again, by which point the frame that wrote
+// them has finished, so reading them never waits on the GPU.
+//
+// GPU ticks are mapped to the CPU clock with an offset that is measured
+// again every few frames, since the two clocks drift apart. The offset
+// comes from VK_EXT_calibrated_timestamps where available. Otherwise a
+// timestamp is submitted on an idle queue and taken to be written
+// halfway through the submission.
+struct GpuTimer {
+        VkDevice device;
+        VkCommandPool command_pool;
+        VkQueue queue;
+        uint32_t frame_count;
+        struct GpuTimerFrame *frames;
+        // Nanoseconds per timestamp tick
+        double timestamp_period;
+        uint64_t timestamp_mask;
+        // Added to a GPU timestamp in nanoseconds to get trace time
+        int64_t offset_ns;
+        uint32_t frames_since_calibration;
+        // Loaded when VK_EXT_calibrated_timestamps is enabled
+        PFN_vkGetCalibratedTimestampsEXT get_calibrated_timestamps;
+        // Only used without calibrated timestamps
+        VkQueryPool calibration_query_pool;
+};
+
+bool supports_gpu_timing(
+                VkPhysicalDevice physical_device,
+                uint32_t queue_family_index);
+
+uint64_t get_timestamp_mask(
+                VkPhysicalDevice physical_device,
+                uint32_t queue_family_index);
+
+void create_gpu_timer(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                VkCommandPool command_pool,
+                VkQueue queue,
+                uint32_t queue_family_index,
+                uint32_t frame_count,
+                bool use_calibrated_timestamps,
+                struct GpuTimer *p_gpu_timer);
+
+void begin_gpu_timer_frame(
+                struct GpuTimer *p_gpu_timer,
+                VkCommandBuffer command_buffer,
+                uint32_t frame);
+
+void begin_gpu_zone(
+                struct GpuTimer *p_gpu_timer,
+                VkCommandBuffer command_buffer,
+                uint32_t frame,
+                const char *name);
+
+void end_gpu_zone(
+                struct GpuTimer *p_gpu_timer,
+                VkCommandBuffer command_buffer,
+                uint32_t frame);
+
+void destroy_gpu_timer(
+                struct GpuTimer *p_gpu_timer);
+
+#endif
@@ -6,7 +6,11 @@
 #include <vulkan/vulkan_core.h>
 
 #include "../debug/print.h"
+#include "../debug/trace.h"
 #include "vk_graphics_pipeline.h"
+#include "vk_host_allocator.h"
+#include "vk_pipeline_cache.h"
+#include "vk_shader_cache.h"
 #include "vk_vertex_data.h"
 
 VkShaderModule create_shader_module(
@@ -19,7 +23,8 @@ VkShaderModule create_shader_module(
         createInfo.pCode = (const uint32_t *)p_filebytes->bytes;
         
         VkShaderModule shaderModule;
-        if (vkCreateShaderModule(*p_device, &createInfo, NULL, &shaderModule)
+        if (vkCreateShaderModule(*p_device, &createInfo, get_host_allocator(),
+                                &shaderModule)
                         != VK_SUCCESS) {
                 error("Failed to create shader module!");
                 exit(EXIT_FAILURE);
@@ -30,13 +35,19 @@ VkShaderModule create_shader_module(
         return shaderModule;
 }
 
-struct GraphicsPipelineDetails create_graphics_pipeline(
+struct GraphicsPipelineDetails create_graphics_pipeline_from_info(
                 VkDevice *p_device,
-                VkExtent2D *p_swap_chain_extent,
-                VkRenderPass *p_render_pass)
+                VkRenderPass *p_render_pass,
+                const struct GraphicsPipelineInfo *p_info)
 {
-        struct FileBytes *vertShaderCode = read_file("shaders/vert.spv");
-        struct FileBytes *fragShaderCode = read_file("shaders/frag.spv");
+        struct FileBytes *vertShaderCode =
+                load_shader_file(p_info->vert_shader_path);
+        struct FileBytes *fragShaderCode =
+                load_shader_file(p_info->frag_shader_path);
+        if (vertShaderCode == NULL || fragShaderCode == NULL) {
+                error("Failed to load shaders!");
+                exit(EXIT_FAILURE);
+        }
 
         VkShaderModule vertShaderModule =
                 create_shader_module(p_device, vertShaderCode);
@@ -67,40 +78,36 @@ struct GraphicsPipelineDetails create_graphics_pipeline(
         vertexInputInfo.sType =
               VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 
-        VkVertexInputBindingDescription binding_description = get_binding_description();
-        vertexInputInfo.vertexBindingDescriptionCount = 1;
-        vertexInputInfo.pVertexBindingDescriptions = &binding_description;
-
-        struct VertexAttributeDescriptionArray attr_description = get_attribute_description();
-        vertexInputInfo.vertexAttributeDescriptionCount = attr_description.size;
-        vertexInputInfo.pVertexAttributeDescriptions = attr_description.data;
+        vertexInputInfo.vertexBindingDescriptionCount = p_info->binding_count;
+        vertexInputInfo.pVertexBindingDescriptions = p_info->a_bindings;
+        vertexInputInfo.vertexAttributeDescriptionCount = p_info->attribute_count;
+        vertexInputInfo.pVertexAttributeDescriptions = p_info->a_attributes;
 
         VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
         inputAssembly.sType =
                 VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        inputAssembly.topology = p_info->topology;
         inputAssembly. primitiveRestartEnable = VK_FALSE;
 
-        VkViewport viewport = {};
-        viewport.x = 0.0f;
-        viewport.y = 0.0f;
-        viewport.width = (float) p_swap_chain_extent->width;
-        viewport.height = (float) p_swap_chain_extent->height;
-        viewport.minDepth = 0.0f;
-        viewport.maxDepth = 1.0f;
-
-        VkRect2D scissor = {};
-        VkOffset2D offset = {0, 0};
-        scissor.offset = offset;
-        scissor.extent = *p_swap_chain_extent;
-
+        // The viewport and scissor are set when recording, so the
+        // pipeline does not depend on the swap chain extent and can be
+        // created before the swap chain exists.
         VkPipelineViewportStateCreateInfo viewportState = {};
         viewportState.sType =
                 VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
         viewportState.viewportCount = 1;
-        viewportState.pViewports = &viewport;
         viewportState.scissorCount = 1;
-        viewportState.pScissors = &scissor;
+
+        VkDynamicState dynamicStates[] = {
+                VK_DYNAMIC_STATE_VIEWPORT,
+                VK_DYNAMIC_STATE_SCISSOR
+        };
+
+        VkPipelineDynamicStateCreateInfo dynamicState = {};
+        dynamicState.sType =
+                VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamicState.dynamicStateCount = ARRAY_SIZE(dynamicStates);
+        dynamicState.pDynamicStates = dynamicStates;
 
         VkPipelineRasterizationStateCreateInfo rasterizer = {};
         rasterizer.sType =
@@ -126,6 +133,19 @@ struct GraphicsPipelineDetails create_graphics_pipeline(
         multisampling.alphaToCoverageEnable = VK_FALSE; // Optional
         multisampling.alphaToOneEnable = VK_FALSE; // Optional
 
+        // The background is drawn after the objects in front of it, so
+        // its fragments behind them fail the early depth test and are
+        // never shaded.
+        VkPipelineDepthStencilStateCreateInfo depthStencil = {};
+        depthStencil.sType =
+                VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depthStencil.depthTestEnable = VK_TRUE;
+        depthStencil.depthWriteEnable =
+                p_info->depth_write ? VK_TRUE : VK_FALSE;
+        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+        depthStencil.depthBoundsTestEnable = VK_FALSE;
+        depthStencil.stencilTestEnable = VK_FALSE;
+
         VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
         colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT |
               VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT |
@@ -151,16 +171,24 @@ struct GraphicsPipelineDetails create_graphics_pipeline(
         colorBlending.blendConstants[2] = 0.0f; // Optional
         colorBlending.blendConstants[3] = 0.0f; // Optional
 
+        VkPushConstantRange pushConstantRange = {};
+        pushConstantRange.stageFlags =
+                VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = p_info->push_constant_size;
+
         VkPipelineLayout pipelineLayout;
         VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
         pipelineLayoutInfo.sType =
               VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipelineLayoutInfo.setLayoutCount = 0; // Optional
-        pipelineLayoutInfo.pSetLayouts = NULL; // Optional
-        pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-        pipelineLayoutInfo.pPushConstantRanges = NULL; // Optional
+        pipelineLayoutInfo.setLayoutCount = p_info->set_layout_count;
+        pipelineLayoutInfo.pSetLayouts = p_info->a_set_layouts;
+        pipelineLayoutInfo.pushConstantRangeCount =
+                p_info->push_constant_size > 0 ? 1 : 0;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
         
-        if (vkCreatePipelineLayout(*p_device, &pipelineLayoutInfo, NULL,
+        if (vkCreatePipelineLayout(*p_device, &pipelineLayoutInfo,
+                                get_host_allocator(),
                                 &pipelineLayout) != VK_SUCCESS) {
                 error("Failed to create pipeline layout!");
                 exit(EXIT_FAILURE);
@@ -176,20 +204,33 @@ struct GraphicsPipelineDetails create_graphics_pipeline(
         pipelineInfo.pViewportState = &viewportState;
         pipelineInfo.pRasterizationState = &rasterizer;
         pipelineInfo.pMultisampleState = &multisampling;
-        pipelineInfo.pDepthStencilState = NULL;
+        pipelineInfo.pDepthStencilState =
+                p_info->depth_format != VK_FORMAT_UNDEFINED ?
+                &depthStencil : NULL;
         pipelineInfo.pColorBlendState = &colorBlending;
-        pipelineInfo.pDynamicState = NULL;
+        pipelineInfo.pDynamicState = &dynamicState;
         
         pipelineInfo.layout = pipelineLayout;
 
+        // Without a render pass the pipeline is used with dynamic
+        // rendering and describes its attachment formats itself.
+        VkPipelineRenderingCreateInfo renderingInfo = {};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+        renderingInfo.colorAttachmentCount = 1;
+        renderingInfo.pColorAttachmentFormats = &p_info->color_format;
+        renderingInfo.depthAttachmentFormat = p_info->depth_format;
+
+        if (*p_render_pass == VK_NULL_HANDLE)
+                pipelineInfo.pNext = &renderingInfo;
+
         pipelineInfo.renderPass = *p_render_pass;
         pipelineInfo.subpass = 0;
 
         pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
         pipelineInfo.basePipelineIndex = -1; // Optional
         VkPipeline graphicsPipeline;
-        if (vkCreateGraphicsPipelines(*p_device, VK_NULL_HANDLE, 1,
-                                &pipelineInfo, NULL,
+        if (vkCreateGraphicsPipelines(*p_device, get_pipeline_cache(), 1,
+                                &pipelineInfo, get_host_allocator(),
                                 &graphicsPipeline) != VK_SUCCESS) {
                 error("Failed to create graphics pipeline!");
                 exit(EXIT_FAILURE);
@@ -198,9 +239,10 @@ struct GraphicsPipelineDetails create_graphics_pipeline(
         
 
         // ==== Cleanup ====
-        free(attr_description.data);
-        vkDestroyShaderModule(*p_device, vertShaderModule, NULL);
-        vkDestroyShaderModule(*p_device, fragShaderModule, NULL);
+        vkDestroyShaderModule(*p_device, vertShaderModule,
+                        get_host_allocator());
+        vkDestroyShaderModule(*p_device, fragShaderModule,
+                        get_host_allocator());
 
         // =================
 
@@ -211,3 +253,47 @@ struct GraphicsPipelineDetails create_graphics_pipeline(
 
         return pipelineDetails;
 }
+
+struct GraphicsPipelineDetails create_graphics_pipeline(
+                VkDevice *p_device,
+                VkRenderPass *p_render_pass,
+                VkFormat color_format,
+                VkFormat depth_format,
+                const struct VertexLayout *p_vertex_layout,
+                VkDescriptorSetLayout texture_set_layout,
+                bool bindless)
+{
+        TRACE_ZONE("create_graphics_pipeline");
+        VkVertexInputBindingDescription binding_descriptions[] = {
+                get_binding_description(p_vertex_layout),
+                get_instance_binding_description()
+        };
+        struct VertexAttributeDescriptionArray attr_description =
+                get_attribute_description(p_vertex_layout);
+
+        struct GraphicsPipelineInfo info = {};
+        info.vert_shader_path = "shaders/vert.spv";
+        // The bindless shader picks its texture from the whole table
+        // with an index pushed once per frame
+        info.frag_shader_path = bindless ?
+                "shaders/bindless_frag.spv" : "shaders/textured_frag.spv";
+        info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        info.a_bindings = binding_descriptions;
+        info.binding_count = ARRAY_SIZE(binding_descriptions);
+        info.a_attributes = attr_description.data;
+        info.attribute_count = attr_description.size;
+        info.color_format = color_format;
+        info.depth_format = depth_format;
+        info.depth_write = true;
+        info.a_set_layouts = &texture_set_layout;
+        info.set_layout_count = 1;
+        info.push_constant_size = bindless ? sizeof(uint32_t) : 0;
+
+        struct GraphicsPipelineDetails pipelineDetails =
+                create_graphics_pipeline_from_info(p_device,
+                                p_render_pass, &info);
+
+        free(attr_description.data);
+
+        return pipelineDetails;
+}
@@ -1,16 +1,57 @@
 #ifndef VK_GRAPHICS_PIPELINE_H
 #define VK_GRAPHICS_PIPELINE_H
 
+#include <stdbool.h>
 #include <vulkan/vulkan_core.h>
+#include "../utils/file.h"
+#include "vk_vertex_data.h"
 
 struct GraphicsPipelineDetails {
         VkPipeline graphics_pipeline;
         VkPipelineLayout pipeline_layout;
 };
 
+// Describes the parts of a graphics pipeline that differ between the
+// things we draw. Everything else is shared fixed function state.
+struct GraphicsPipelineInfo {
+        const char *vert_shader_path;
+        const char *frag_shader_path;
+        VkPrimitiveTopology topology;
+        const VkVertexInputBindingDescription *a_bindings;
+        uint32_t binding_count;
+        const VkVertexInputAttributeDescription *a_attributes;
+        uint32_t attribute_count;
+        // Color attachment format, only used with dynamic rendering
+        // where there is no render pass to take it from.
+        VkFormat color_format;
+        // Depth attachment format, VK_FORMAT_UNDEFINED for no depth test
+        VkFormat depth_format;
+        // Depth tested draws that do not occlude, like blended ones,
+        // leave this unset
+        bool depth_write;
+        // Descriptor set layouts of the pipeline layout, in set order
+        const VkDescriptorSetLayout *a_set_layouts;
+        uint32_t set_layout_count;
+        // Bytes of push constants visible to both stages, 0 for none
+        uint32_t push_constant_size;
+};
+
+VkShaderModule create_shader_module(
+                VkDevice *p_device,
+                struct FileBytes *p_filebytes);
+
+struct GraphicsPipelineDetails create_graphics_pipeline_from_info(
+                VkDevice *p_device,
+                VkRenderPass *p_render_pass,
+                const struct GraphicsPipelineInfo *p_info);
+
 struct GraphicsPipelineDetails create_graphics_pipeline(
                 VkDevice *p_device,
-                VkExtent2D *p_swap_chain_extent,
-                VkRenderPass *p_render_pass);
+                VkRenderPass *p_render_pass,
+                VkFormat color_format,
+                VkFormat depth_format,
+                const struct VertexLayout *p_vertex_layout,
+                VkDescriptorSetLayout texture_set_layout,
+                bool bindless);
 
 #endif
@@ -0,0 +1,368 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+
+#include "../debug/print.h"
+#include "../utils/array.h"
+#include "vk_host_allocator.h"
+
+// Every allocation is at least this aligned, which keeps the header in
+// front of it aligned too
+#define MIN_ALIGNMENT 16
+// Room reserved in front of a pooled allocation for its header
+#define POOL_HEADER_SPACE 32
+// Slots carved out of one malloc when a pool runs dry
+#define POOL_SLAB_SLOT_COUNT 64
+
+// Stored right in front of the memory handed to the driver
+struct AllocationHeader {
+        // Start of the malloc'd block or pool slot
+        void *p_block;
+        size_t size;
+        uint8_t scope;
+        // Index into the pools, or -1 when malloc'd
+        int8_t pool;
+};
+
+// Small allocations are frequent during command recording and object
+// creation. Each pool hands out fixed size slots from a free list.
+struct SmallAllocationPool {
+        size_t size;
+        pthread_mutex_t mutex;
+        void *p_free;
+        // Linked through their first pointer, freed on destroy
+        void *p_slabs;
+};
+
+struct ScopeCounters {
+        atomic_uint_fast64_t live_count;
+        atomic_uint_fast64_t live_bytes;
+        atomic_uint_fast64_t peak_bytes;
+        atomic_uint_fast64_t total_count;
+        atomic_uint_fast64_t internal_bytes;
+};
+
+static const char *SCOPE_NAMES[HOST_ALLOCATION_SCOPE_COUNT] = {
+        "command", "object", "cache", "device", "instance"
+};
+
+static struct SmallAllocationPool pools[] = {
+        {.size = 32}, {.size = 64}, {.size = 128}, {.size = 256}
+};
+
+static struct ScopeCounters counters[HOST_ALLOCATION_SCOPE_COUNT];
+static atomic_uint_fast64_t pooledCount;
+static bool usePools = false;
+static bool initialized = false;
+static VkAllocationCallbacks callbacks;
+
+// Totals at the previous report, only touched by the reporting thread
+static uint64_t reportedTotalCounts[HOST_ALLOCATION_SCOPE_COUNT];
+
+
+static struct AllocationHeader *get_header(void *p_memory)
+{
+        return (struct AllocationHeader *) ((uint8_t *) p_memory -
+                        sizeof(struct AllocationHeader));
+}
+
+static void count_allocation(VkSystemAllocationScope scope, size_t size)
+{
+        struct ScopeCounters *p_counters = &counters[scope];
+        atomic_fetch_add_explicit(&p_counters->live_count, 1,
+                        memory_order_relaxed);
+        atomic_fetch_add_explicit(&p_counters->total_count, 1,
+                        memory_order_relaxed);
+        uint64_t bytes = atomic_fetch_add_explicit(&p_counters->live_bytes,
+                        size, memory_order_relaxed) + size;
+
+        uint64_t peak = atomic_load_explicit(&p_counters->peak_bytes,
+                        memory_order_relaxed);
+        while (bytes > peak && !atomic_compare_exchange_weak_explicit(
+                                &p_counters->peak_bytes, &peak, bytes,
+                                memory_order_relaxed, memory_order_relaxed))
+                ;
+}
+
+static void count_free(VkSystemAllocationScope scope, size_t size)
+{
+        struct ScopeCounters *p_counters = &counters[scope];
+        atomic_fetch_sub_explicit(&p_counters->live_count, 1,
+                        memory_order_relaxed);
+        atomic_fetch_sub_explicit(&p_counters->live_bytes, size,
+                        memory_order_relaxed);
+}
+
+static int find_pool(size_t size, size_t alignment)
+{
+        if (!usePools || alignment > MIN_ALIGNMENT)
+                return -1;
+
+        for (size_t i = 0; i < ARRAY_SIZE(pools); i++)
+                if (size <= pools[i].size)
+                        return i;
+
+        return -1;
+}
+
+static void *take_pool_slot(struct SmallAllocationPool *p_pool)
+{
+        size_t slotSize = POOL_HEADER_SPACE + p_pool->size;
+
+        pthread_mutex_lock(&p_pool->mutex);
+        if (p_pool->p_free == NULL) {
+                uint8_t *slab = malloc(MIN_ALIGNMENT +
+                                POOL_SLAB_SLOT_COUNT * slotSize);
+                if (slab == NULL) {
+                        pthread_mutex_unlock(&p_pool->mutex);
+                        return NULL;
+                }
+
+                *(void **) slab = p_pool->p_slabs;
+                p_pool->p_slabs = slab;
+                for (size_t i = 0; i < POOL_SLAB_SLOT_COUNT; i++) {
+                        void *p_slot = slab + MIN_ALIGNMENT + i * slotSize;
+                        *(void **) p_slot = p_pool->p_free;
+                        p_pool->p_free = p_slot;
+                }
+        }
+
+        void *p_slot = p_pool->p_free;
+        p_pool->p_free = *(void **) p_slot;
+        pthread_mutex_unlock(&p_pool->mutex);
+
+        return p_slot;
+}
+
+static void give_pool_slot(struct SmallAllocationPool *p_pool, void *p_slot)
+{
+        pthread_mutex_lock(&p_pool->mutex);
+        *(void **) p_slot = p_pool->p_free;
+        p_pool->p_free = p_slot;
+        pthread_mutex_unlock(&p_pool->mutex);
+}
+
+static void *allocate(size_t size, size_t alignment,
+                VkSystemAllocationScope scope)
+{
+        if (alignment < MIN_ALIGNMENT)
+                alignment = MIN_ALIGNMENT;
+
+        void *p_block;
+        uint8_t *p_memory;
+        int pool = find_pool(size, alignment);
+        if (pool >= 0) {
+                p_block = take_pool_slot(&pools[pool]);
+                if (p_block == NULL)
+                        return NULL;
+                p_memory = (uint8_t *) p_block + POOL_HEADER_SPACE;
+                atomic_fetch_add_explicit(&pooledCount, 1,
+                                memory_order_relaxed);
+        } else {
+                p_block = malloc(sizeof(struct AllocationHeader) +
+                                alignment - 1 + size);
+                if (p_block == NULL)
+                        return NULL;
+                uintptr_t address = (uintptr_t) p_block +
+                        sizeof(struct AllocationHeader);
+                address = (address + alignment - 1) & ~(alignment - 1);
+                p_memory = (uint8_t *) address;
+        }
+
+        struct AllocationHeader *p_header = get_header(p_memory);
+        p_header->p_block = p_block;
+        p_header->size = size;
+        p_header->scope = scope;
+        p_header->pool = pool;
+
+        count_allocation(scope, size);
+        return p_memory;
+}
+
+static void release(void *p_memory)
+{
+        struct AllocationHeader *p_header = get_header(p_memory);
+        count_free(p_header->scope, p_header->size);
+
+        if (p_header->pool >= 0)
+                give_pool_slot(&pools[p_header->pool], p_header->p_block);
+        else
+                free(p_header->p_block);
+}
+
+static VKAPI_ATTR void *VKAPI_CALL allocation_callback(
+                void *p_user_data,
+                size_t size,
+                size_t alignment,
+                VkSystemAllocationScope scope)
+{
+        return allocate(size, alignment, scope);
+}
+
+static VKAPI_ATTR void *VKAPI_CALL reallocation_callback(
+                void *p_user_data,
+                void *p_original,
+                size_t size,
+                size_t alignment,
+                VkSystemAllocationScope scope)
+{
+        if (p_original == NULL)
+                return allocate(size, alignment, scope);
+
+        if (size == 0) {
+                release(p_original);
+                return NULL;
+        }
+
+        // The original stays valid when the new allocation fails
+        void *p_memory = allocate(size, alignment, scope);
+        if (p_memory == NULL)
+                return NULL;
+
+        size_t originalSize = get_header(p_original)->size;
+        memcpy(p_memory, p_original, originalSize < size ?
+                        originalSize : size);
+        release(p_original);
+
+        return p_memory;
+}
+
+static VKAPI_ATTR void VKAPI_CALL free_callback(
+                void *p_user_data,
+                void *p_memory)
+{
+        if (p_memory != NULL)
+                release(p_memory);
+}
+
+static VKAPI_ATTR void VKAPI_CALL internal_allocation_callback(
+                void *p_user_data,
+                size_t size,
+                VkInternalAllocationType type,
+                VkSystemAllocationScope scope)
+{
+        atomic_fetch_add_explicit(&counters[scope].internal_bytes, size,
+                        memory_order_relaxed);
+}
+
+static VKAPI_ATTR void VKAPI_CALL internal_free_callback(
+                void *p_user_data,
+                size_t size,
+                VkInternalAllocationType type,
+                VkSystemAllocationScope scope)
+{
+        atomic_fetch_sub_explicit(&counters[scope].internal_bytes, size,
+                        memory_order_relaxed);
+}
+
+// Must be called before the instance is created, the callbacks cannot
+// change for the lifetime of the objects created with them.
+void init_host_allocator(bool pool_small_allocations)
+{
+        usePools = pool_small_allocations;
+        for (size_t i = 0; i < ARRAY_SIZE(pools); i++)
+                pthread_mutex_init(&pools[i].mutex, NULL);
+
+        callbacks = (VkAllocationCallbacks) {};
+        callbacks.pfnAllocation = allocation_callback;
+        callbacks.pfnReallocation = reallocation_callback;
+        callbacks.pfnFree = free_callback;
+        callbacks.pfnInternalAllocation = internal_allocation_callback;
+        callbacks.pfnInternalFree = internal_free_callback;
+        initialized = true;
+}
+
+// NULL, the driver's own allocator, unless tracking is initialized
+const VkAllocationCallbacks *get_host_allocator(void)
+{
+        return initialized ? &callbacks : NULL;
+}
+
+void get_host_allocation_stats(struct HostAllocationStats *p_stats)
+{
+        for (size_t i = 0; i < HOST_ALLOCATION_SCOPE_COUNT; i++) {
+                struct ScopeCounters *p_counters = &counters[i];
+                struct HostAllocationScopeStats *p_scope =
+                        &p_stats->scopes[i];
+                p_scope->live_count = atomic_load_explicit(
+                                &p_counters->live_count,
+                                memory_order_relaxed);
+                p_scope->live_bytes = atomic_load_explicit(
+                                &p_counters->live_bytes,
+                                memory_order_relaxed);
+                p_scope->peak_bytes = atomic_load_explicit(
+                                &p_counters->peak_bytes,
+                                memory_order_relaxed);
+                p_scope->total_count = atomic_load_explicit(
+                                &p_counters->total_count,
+                                memory_order_relaxed);
+                p_scope->internal_bytes = atomic_load_explicit(
+                                &p_counters->internal_bytes,
+                                memory_order_relaxed);
+        }
+
+        p_stats->pooled_count = atomic_load_explicit(&pooledCount,
+                        memory_order_relaxed);
+}
+
+// Prints every scope along with the allocations made since the last
+// report. In steady state the command scope should not grow.
+void report_host_allocations(const char *p_label)
+{
+        if (!initialized)
+                return;
+
+        struct HostAllocationStats stats;
+        get_host_allocation_stats(&stats);
+
+        info("Host allocations (%s), %lu pooled:\n", p_label,
+                        (unsigned long) stats.pooled_count);
+        for (size_t i = 0; i < HOST_ALLOCATION_SCOPE_COUNT; i++) {
+                const struct HostAllocationScopeStats *p_scope =
+                        &stats.scopes[i];
+                info("\t%-8s %6lu live, %8lu bytes, %8lu peak, "
+                                "%6lu new, %8lu internal\n",
+                                SCOPE_NAMES[i],
+                                (unsigned long) p_scope->live_count,
+                                (unsigned long) p_scope->live_bytes,
+                                (unsigned long) p_scope->peak_bytes,
+                                (unsigned long) (p_scope->total_count -
+                                        reportedTotalCounts[i]),
+                                (unsigned long) p_scope->internal_bytes);
+                reportedTotalCounts[i] = p_scope->total_count;
+        }
+}
+
+// Only after the instance is destroyed, pooled memory is freed here
+void destroy_host_allocator(void)
+{
+        if (!initialized)
+                return;
+
+        uint64_t leaked = 0;
+        for (size_t i = 0; i < HOST_ALLOCATION_SCOPE_COUNT; i++)
+                leaked += atomic_load_explicit(&counters[i].live_count,
+                                memory_order_relaxed);
+        if (leaked > 0)
+                warning("%lu host allocations were never freed!\n",
+                                (unsigned long) leaked);
+
+        for (size_t i = 0; i < ARRAY_SIZE(pools); i++) {
+                void *p_slab = pools[i].p_slabs;
+                while (p_slab != NULL) {
+                        void *p_next = *(void **) p_slab;
+                        free(p_slab);
+                        p_slab = p_next;
+                }
+                pthread_mutex_destroy(&pools[i].mutex);
+                pools[i].p_free = NULL;
+                pools[i].p_slabs = NULL;
+        }
+
+        initialized = false;
+}
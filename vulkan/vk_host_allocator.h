@@ -0,0 +1,43 @@
+#ifndef VK_HOST_ALLOCATOR_H
+#define VK_HOST_ALLOCATOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+// Host memory the driver allocates through our callbacks, counted per
+// VkSystemAllocationScope. Every Vulkan object has to be created and
+// destroyed with get_host_allocator() so that the counts stay balanced.
+
+// Command, object, cache, device and instance
+#define HOST_ALLOCATION_SCOPE_COUNT 5
+
+struct HostAllocationScopeStats {
+        // Allocations that have not been freed yet
+        uint64_t live_count;
+        uint64_t live_bytes;
+        uint64_t peak_bytes;
+        // Every allocation ever made in the scope
+        uint64_t total_count;
+        // Memory the driver allocated itself and only told us about,
+        // e.g. executable memory for pipelines
+        uint64_t internal_bytes;
+};
+
+struct HostAllocationStats {
+        struct HostAllocationScopeStats scopes[HOST_ALLOCATION_SCOPE_COUNT];
+        // Allocations served from the small allocation pools
+        uint64_t pooled_count;
+};
+
+void init_host_allocator(bool pool_small_allocations);
+
+const VkAllocationCallbacks *get_host_allocator(void);
+
+void get_host_allocation_stats(struct HostAllocationStats *p_stats);
+
+void report_host_allocations(const char *p_label);
+
+void destroy_host_allocator(void);
+
+#endif
@@ -0,0 +1,176 @@
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+#include "vk_buffer.h"
+#include "vk_host_allocator.h"
+#include "vk_image.h"
+#include "vk_memory_budget.h"
+
+
+// Creates a device local 2D image and binds dedicated memory to it
+VkResult create_mipmapped_image(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                VkExtent2D extent,
+                VkFormat format,
+                uint32_t mip_levels,
+                VkImageUsageFlags usage,
+                VkImage *p_image,
+                VkDeviceMemory *p_image_memory)
+{
+        VkImageCreateInfo imageInfo = {};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = format;
+        imageInfo.extent.width = extent.width;
+        imageInfo.extent.height = extent.height;
+        imageInfo.extent.depth = 1;
+        imageInfo.mipLevels = mip_levels;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = usage;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        VkResult result = vkCreateImage(device, &imageInfo,
+                        get_host_allocator(), p_image);
+        if (result != VK_SUCCESS)
+                return result;
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(device, *p_image, &memRequirements);
+
+        VkMemoryAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memRequirements.size;
+        allocInfo.memoryTypeIndex = find_memory_type(physical_device,
+                        memRequirements.memoryTypeBits,
+                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        result = allocate_device_memory(device, &allocInfo, p_image_memory);
+        if (result != VK_SUCCESS) {
+                vkDestroyImage(device, *p_image, get_host_allocator());
+                return result;
+        }
+
+        return vkBindImageMemory(device, *p_image, *p_image_memory, 0);
+}
+
+// The same with a single mip level
+VkResult create_image(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                VkExtent2D extent,
+                VkFormat format,
+                VkImageUsageFlags usage,
+                VkImage *p_image,
+                VkDeviceMemory *p_image_memory)
+{
+        return create_mipmapped_image(device, physical_device, extent,
+                        format, 1, usage, p_image, p_image_memory);
+}
+
+VkResult create_mipmapped_image_view(
+                VkDevice device,
+                VkImage image,
+                VkFormat format,
+                VkImageAspectFlags aspect,
+                uint32_t mip_levels,
+                VkImageView *p_image_view)
+{
+        VkImageViewCreateInfo createInfo = {};
+        createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        createInfo.image = image;
+        createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        createInfo.format = format;
+        createInfo.subresourceRange.aspectMask = aspect;
+        createInfo.subresourceRange.baseMipLevel = 0;
+        createInfo.subresourceRange.levelCount = mip_levels;
+        createInfo.subresourceRange.baseArrayLayer = 0;
+        createInfo.subresourceRange.layerCount = 1;
+
+        return vkCreateImageView(device, &createInfo, get_host_allocator(),
+                        p_image_view);
+}
+
+VkResult create_image_view(
+                VkDevice device,
+                VkImage image,
+                VkFormat format,
+                VkImageAspectFlags aspect,
+                VkImageView *p_image_view)
+{
+        return create_mipmapped_image_view(device, image, format, aspect,
+                        1, p_image_view);
+}
+
+static void record_layout_transition(
+                VkCommandBuffer command_buffer,
+                VkImage image,
+                VkImageAspectFlags aspect,
+                uint32_t base_level,
+                uint32_t level_count,
+                VkImageLayout old_layout,
+                VkImageLayout new_layout,
+                VkPipelineStageFlags src_stage,
+                VkAccessFlags src_access,
+                VkPipelineStageFlags dst_stage,
+                VkAccessFlags dst_access)
+{
+        VkImageMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = src_access;
+        barrier.dstAccessMask = dst_access;
+        barrier.oldLayout = old_layout;
+        barrier.newLayout = new_layout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange.aspectMask = aspect;
+        barrier.subresourceRange.baseMipLevel = base_level;
+        barrier.subresourceRange.levelCount = level_count;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+
+        vkCmdPipelineBarrier(command_buffer, src_stage, dst_stage, 0,
+                        0, NULL, 0, NULL, 1, &barrier);
+}
+
+// Records a barrier that moves the first mip level of a color image from
+// one layout to another. Render passes do this implicitly, everything
+// else has to do it by hand.
+void record_image_layout_transition(
+                VkCommandBuffer command_buffer,
+                VkImage image,
+                VkImageLayout old_layout,
+                VkImageLayout new_layout,
+                VkPipelineStageFlags src_stage,
+                VkAccessFlags src_access,
+                VkPipelineStageFlags dst_stage,
+                VkAccessFlags dst_access)
+{
+        record_layout_transition(command_buffer, image,
+                        VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, old_layout,
+                        new_layout, src_stage, src_access, dst_stage,
+                        dst_access);
+}
+
+// The same for a range of mip levels of a color image
+void record_mip_layout_transition(
+                VkCommandBuffer command_buffer,
+                VkImage image,
+                uint32_t base_level,
+                uint32_t level_count,
+                VkImageLayout old_layout,
+                VkImageLayout new_layout,
+                VkPipelineStageFlags src_stage,
+                VkAccessFlags src_access,
+                VkPipelineStageFlags dst_stage,
+                VkAccessFlags dst_access)
+{
+        record_layout_transition(command_buffer, image,
+                        VK_IMAGE_ASPECT_COLOR_BIT, base_level, level_count,
+                        old_layout, new_layout, src_stage, src_access,
+                        dst_stage, dst_access);
+}
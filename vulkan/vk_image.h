@@ -0,0 +1,63 @@
+#ifndef VK_IMAGE_H
+#define VK_IMAGE_H
+
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+VkResult create_mipmapped_image(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                VkExtent2D extent,
+                VkFormat format,
+                uint32_t mip_levels,
+                VkImageUsageFlags usage,
+                VkImage *p_image,
+                VkDeviceMemory *p_image_memory);
+
+VkResult create_image(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                VkExtent2D extent,
+                VkFormat format,
+                VkImageUsageFlags usage,
+                VkImage *p_image,
+                VkDeviceMemory *p_image_memory);
+
+VkResult create_mipmapped_image_view(
+                VkDevice device,
+                VkImage image,
+                VkFormat format,
+                VkImageAspectFlags aspect,
+                uint32_t mip_levels,
+                VkImageView *p_image_view);
+
+VkResult create_image_view(
+                VkDevice device,
+                VkImage image,
+                VkFormat format,
+                VkImageAspectFlags aspect,
+                VkImageView *p_image_view);
+
+void record_image_layout_transition(
+                VkCommandBuffer command_buffer,
+                VkImage image,
+                VkImageLayout old_layout,
+                VkImageLayout new_layout,
+                VkPipelineStageFlags src_stage,
+                VkAccessFlags src_access,
+                VkPipelineStageFlags dst_stage,
+                VkAccessFlags dst_access);
+
+void record_mip_layout_transition(
+                VkCommandBuffer command_buffer,
+                VkImage image,
+                uint32_t base_level,
+                uint32_t level_count,
+                VkImageLayout old_layout,
+                VkImageLayout new_layout,
+                VkPipelineStageFlags src_stage,
+                VkAccessFlags src_access,
+                VkPipelineStageFlags dst_stage,
+                VkAccessFlags dst_access);
+
+#endif
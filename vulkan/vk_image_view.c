@@ -1,6 +1,8 @@
 #include <vulkan/vulkan_core.h>
 #include <stdlib.h>
 
+#include "vk_host_allocator.h"
+
 
 VkResult create_image_views(
                 VkDevice p_device,
@@ -33,7 +35,7 @@ VkResult create_image_views(
                 createInfo.subresourceRange.layerCount = 1;
 
                 VkResult result = vkCreateImageView(p_device, &createInfo,
-                                NULL, &a[i]);
+                                get_host_allocator(), &a[i]);
                 if (result != VK_SUCCESS)
                         return result;
         }
@@ -45,7 +47,8 @@ void destroy_image_views(VkDevice *p_device,
                 uint32_t image_view_count)
 {
         for (size_t i = 0; i < image_view_count; i++) {
-                vkDestroyImageView(*p_device, a_image_views[i], NULL);
+                vkDestroyImageView(*p_device, a_image_views[i],
+                                get_host_allocator());
         }
         free(a_image_views);
 }
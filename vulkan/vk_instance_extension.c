@@ -8,12 +8,15 @@
 
 extern const bool ENABLE_VALIDATION_LAYERS;
 
-const struct RequiredExtensions get_required_extensions()
+const struct RequiredExtensions get_required_extensions(bool window_system)
 {
+        // Without a window GLFW is not initialized and there is
+        // nothing to present to
         struct RequiredExtensions glfwExtensions = {};
-        glfwExtensions.extensions =
-                glfwGetRequiredInstanceExtensions(
-                                &glfwExtensions.extension_count);
+        if (window_system)
+                glfwExtensions.extensions =
+                        glfwGetRequiredInstanceExtensions(
+                                        &glfwExtensions.extension_count);
 
         // Enable extra extensions when validation layers are enabled
         if (ENABLE_VALIDATION_LAYERS) {
@@ -26,7 +29,8 @@ const struct RequiredExtensions get_required_extensions()
 
                 extensions.extension_count =
                         glfwExtensions.extension_count + extraExtensionsSize;
-                extensions.extensions = malloc(extensions.extension_count);             // TODO Call free somewhere
+                extensions.extensions = malloc(extensions.extension_count *
+                                sizeof(const char *));             // TODO Call free somewhere
 
                 // Merge the arrays
                 size_t i,j;
@@ -1,6 +1,7 @@
 #ifndef VK_INSTANCE_EXTENSION_H
 #define VK_INSTANCE_EXTENSION_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 struct RequiredExtensions {
@@ -8,6 +9,8 @@ struct RequiredExtensions {
         uint32_t extension_count;
 };
 
-const struct RequiredExtensions get_required_extensions();
+// The window system extensions are only included with window_system,
+// GLFW has to be initialized for those
+const struct RequiredExtensions get_required_extensions(bool window_system);
 
 #endif
@@ -1,8 +1,13 @@
+#include <stdbool.h>
 #include <stdint.h>
 #include <vulkan/vulkan_core.h>
 
+#include "vk_host_allocator.h"
+#include "vk_logical_device.h"
 #include "vk_queue_family.h"
 #include "../datastructures/list.h"
+#include "../utils/array.h"
+#include "../debug/trace.h"
 
 
 extern const bool ENABLE_VALIDATION_LAYERS;
@@ -15,34 +20,35 @@ VkResult create_logical_device(
                 uint32_t extension_count,
                 const char **a_validation_layers,
                 uint32_t validation_layer_count,
+                const struct OptionalDeviceFeatures *p_optional_features,
                 VkDevice *p_device)
 {
+        TRACE_ZONE("create_logical_device");
         struct QueueFamilyIndices indices =
                 find_queue_families(*p_physical_device, *p_surface);
 
+        // The graphics, present, compute and transfer families are often
+        // the same family, but a queue family may only be requested once.
+        uint32_t requestedFamilies[] = {
+                indices.graphics_family.value,
+                indices.present_family.value,
+                indices.compute_family.value,
+                indices.transfer_family.value
+        };
+        uint32_t uniqueQueueFamilies[ARRAY_SIZE(requestedFamilies)];
         uint32_t queueCount = 0;
-        // TODO Temporary solution to avoid duplicates
-        // since we do not have a Set data structure
-        if (indices.graphics_family.value == indices.present_family.value)
-                queueCount = 1;
-        else 
-                queueCount = 2;
-        
+        for (size_t i = 0; i < ARRAY_SIZE(requestedFamilies); i++) {
+                bool seen = false;
+                for (size_t j = 0; j < queueCount; j++)
+                        seen |= uniqueQueueFamilies[j] == requestedFamilies[i];
+                if (!seen)
+                        uniqueQueueFamilies[queueCount++] = requestedFamilies[i];
+        }
+
         // Vulkan expects pQueueCreateInfos to point at a contiguous array of
         // VkDeviceQueueCreateInfo structs, so use a plain stack array here.
         VkDeviceQueueCreateInfo queueCreateInfos[queueCount];
 
-        // TODO Implement Set data structure
-        // The index to the queue families are supposed to
-        // only be added once if they are the same, but they will
-        // be added multiple times since we are not using a Set.
-        uint32_t uniqueQueueFamilies[queueCount];
-        uniqueQueueFamilies[0] = indices.graphics_family.value;
-        // TODO Temporary solution to avoid duplicates since
-        // we do not have a Set data structure
-        if (queueCount == 2)
-                uniqueQueueFamilies[1] = indices.present_family.value;
-
         float queuePriority = 1.0f;
         for(int i = 0; i < queueCount; i++) {
                 uint32_t queueFamily = uniqueQueueFamilies[i];
@@ -56,7 +62,17 @@ VkResult create_logical_device(
         }
 
         VkPhysicalDeviceFeatures deviceFeatures = {};
-
+        if (p_optional_features->multi_draw_indirect) {
+                deviceFeatures.multiDrawIndirect = VK_TRUE;
+                deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
+        }
+        deviceFeatures.textureCompressionBC =
+                p_optional_features->texture_compression_bc;
+        deviceFeatures.textureCompressionETC2 =
+                p_optional_features->texture_compression_etc2;
+        // The bindless texture array is indexed with a push constant
+        deviceFeatures.shaderSampledImageArrayDynamicIndexing =
+                p_optional_features->descriptor_indexing;
 
         VkDeviceCreateInfo createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -64,8 +80,73 @@ VkResult create_logical_device(
         createInfo.queueCreateInfoCount = queueCount;
 
         createInfo.pEnabledFeatures = &deviceFeatures;
-        createInfo.enabledExtensionCount = extension_count;
-        createInfo.ppEnabledExtensionNames = a_device_extensions;
+
+        // Only chained when requested, the structs are invalid on
+        // devices older than their version.
+        VkPhysicalDeviceVulkan12Features features12 = {};
+        features12.sType =
+                VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        features12.timelineSemaphore =
+                p_optional_features->timeline_semaphores;
+        if (p_optional_features->descriptor_indexing) {
+                features12.runtimeDescriptorArray = VK_TRUE;
+                features12.descriptorBindingPartiallyBound = VK_TRUE;
+                features12.descriptorBindingSampledImageUpdateAfterBind =
+                        VK_TRUE;
+                features12.descriptorBindingStorageBufferUpdateAfterBind =
+                        VK_TRUE;
+        }
+
+        VkPhysicalDeviceVulkan13Features features13 = {};
+        features13.sType =
+                VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+        features13.dynamicRendering = VK_TRUE;
+
+        VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures = {};
+        presentIdFeatures.sType =
+                VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+        presentIdFeatures.presentId = VK_TRUE;
+
+        VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures = {};
+        presentWaitFeatures.sType =
+                VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+        presentWaitFeatures.presentWait = VK_TRUE;
+
+        if (p_optional_features->timeline_semaphores ||
+                        p_optional_features->descriptor_indexing) {
+                features12.pNext = (void*) createInfo.pNext;
+                createInfo.pNext = &features12;
+        }
+        if (p_optional_features->dynamic_rendering) {
+                features13.pNext = (void*) createInfo.pNext;
+                createInfo.pNext = &features13;
+        }
+
+        // Optional extensions are appended to the required ones
+        const char *extensions[extension_count + 4];
+        uint32_t enabledExtensionCount = 0;
+        for (size_t i = 0; i < extension_count; i++)
+                extensions[enabledExtensionCount++] = a_device_extensions[i];
+
+        if (p_optional_features->present_wait) {
+                extensions[enabledExtensionCount++] =
+                        VK_KHR_PRESENT_ID_EXTENSION_NAME;
+                extensions[enabledExtensionCount++] =
+                        VK_KHR_PRESENT_WAIT_EXTENSION_NAME;
+
+                presentIdFeatures.pNext = (void*) createInfo.pNext;
+                presentWaitFeatures.pNext = &presentIdFeatures;
+                createInfo.pNext = &presentWaitFeatures;
+        }
+        if (p_optional_features->memory_budget)
+                extensions[enabledExtensionCount++] =
+                        VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+        if (p_optional_features->calibrated_timestamps)
+                extensions[enabledExtensionCount++] =
+                        VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME;
+
+        createInfo.enabledExtensionCount = enabledExtensionCount;
+        createInfo.ppEnabledExtensionNames = extensions;
 
         if (ENABLE_VALIDATION_LAYERS) {
                 createInfo.enabledLayerCount = validation_layer_count;
@@ -76,7 +157,7 @@ VkResult create_logical_device(
 
 
         VkResult result = vkCreateDevice(*p_physical_device,
-                        &createInfo, NULL, p_device);
+                        &createInfo, get_host_allocator(), p_device);
         if (result != VK_SUCCESS) {
                 return result;
         }
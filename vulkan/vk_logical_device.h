@@ -1,8 +1,31 @@
 #ifndef VK_LOGICAL_DEVICE_H
 #define VK_LOGICAL_DEVICE_H
 
+#include <stdbool.h>
 #include <vulkan/vulkan_core.h>
 
+// Features enabled on top of the Vulkan 1.0 baseline when the
+// physical device supports them
+struct OptionalDeviceFeatures {
+        bool timeline_semaphores;
+        bool dynamic_rendering;
+        // VK_KHR_present_id and VK_KHR_present_wait
+        bool present_wait;
+        // multiDrawIndirect and drawIndirectFirstInstance
+        bool multi_draw_indirect;
+        // textureCompressionBC and textureCompressionETC2, needed to
+        // sample the compressed formats of each family
+        bool texture_compression_bc;
+        bool texture_compression_etc2;
+        // Runtime sized, partially bound descriptor arrays that can be
+        // updated after being bound, for the bindless table
+        bool descriptor_indexing;
+        // VK_EXT_memory_budget, per heap budgets from the driver
+        bool memory_budget;
+        // VK_EXT_calibrated_timestamps, for the GPU timer
+        bool calibrated_timestamps;
+};
+
 VkResult create_logical_device(
                 VkPhysicalDevice *p_physical_device,
                 VkSurfaceKHR *p_surface,
@@ -10,6 +33,7 @@ VkResult create_logical_device(
                 uint32_t extension_count,
                 const char **a_validation_layers,
                 uint32_t validation_layer_count,
+                const struct OptionalDeviceFeatures *p_optional_features,
                 VkDevice *p_device);
 
 #endif
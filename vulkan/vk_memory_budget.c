@@ -0,0 +1,260 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <vulkan/vulkan_core.h>
+
+#include "../debug/print.h"
+#include "vk_host_allocator.h"
+#include "vk_memory_budget.h"
+
+#define MAX_PRESSURE_HANDLERS 8
+// Share of a heap assumed to be available when the driver does not
+// report a budget. Drivers keep some of every heap for themselves.
+#define ESTIMATED_BUDGET_FRACTION 0.8
+#define MIB (1024.0 * 1024.0)
+
+struct PressureHandler {
+        MemoryPressureFunction function;
+        void *p_user_data;
+};
+
+struct TrackedAllocation {
+        VkDeviceMemory memory;
+        VkDeviceSize size;
+        uint32_t heap;
+};
+
+static VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+static VkPhysicalDeviceMemoryProperties memoryProperties;
+static bool useBudgetExtension = false;
+static float pressureThreshold = 1.0f;
+
+static struct PressureHandler handlers[MAX_PRESSURE_HANDLERS];
+static uint32_t handlerCount = 0;
+
+// Guards everything below, allocations may come from any thread
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct TrackedAllocation *allocations = NULL;
+static uint32_t allocationCount = 0;
+static uint32_t allocationCapacity = 0;
+static VkDeviceSize allocatedBytes[VK_MAX_MEMORY_HEAPS];
+static uint32_t heapAllocationCounts[VK_MAX_MEMORY_HEAPS];
+static uint32_t pressureEventCount = 0;
+
+
+// The extension needs VK_EXT_memory_budget enabled on the device and
+// vkGetPhysicalDeviceMemoryProperties2 from Vulkan 1.1.
+void init_memory_budget(
+                VkPhysicalDevice physical_device,
+                bool use_memory_budget_extension,
+                float pressure_threshold)
+{
+        physicalDevice = physical_device;
+        useBudgetExtension = use_memory_budget_extension;
+        pressureThreshold = pressure_threshold;
+        vkGetPhysicalDeviceMemoryProperties(physical_device,
+                        &memoryProperties);
+}
+
+// Handlers are asked in the order they were added until the heap is no
+// longer under pressure
+void add_memory_pressure_handler(
+                MemoryPressureFunction function,
+                void *p_user_data)
+{
+        if (handlerCount == MAX_PRESSURE_HANDLERS) {
+                error("Too many memory pressure handlers!");
+                exit(EXIT_FAILURE);
+        }
+
+        handlers[handlerCount++] = (struct PressureHandler) {
+                function, p_user_data
+        };
+}
+
+void get_memory_budget_stats(struct MemoryBudgetStats *p_stats)
+{
+        *p_stats = (struct MemoryBudgetStats) {};
+        p_stats->heap_count = memoryProperties.memoryHeapCount;
+        p_stats->driver_budget = useBudgetExtension;
+
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = {};
+        if (useBudgetExtension) {
+                budgetProperties.sType =
+                        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+                VkPhysicalDeviceMemoryProperties2 properties = {};
+                properties.sType =
+                        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+                properties.pNext = &budgetProperties;
+
+                vkGetPhysicalDeviceMemoryProperties2(physicalDevice,
+                                &properties);
+        }
+
+        pthread_mutex_lock(&mutex);
+        for (size_t i = 0; i < p_stats->heap_count; i++) {
+                const VkMemoryHeap *p_heap = &memoryProperties.memoryHeaps[i];
+                struct HeapBudget *p_budget = &p_stats->heaps[i];
+                p_budget->size = p_heap->size;
+                p_budget->device_local =
+                        p_heap->flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+                p_budget->allocated_bytes = allocatedBytes[i];
+                p_budget->allocation_count = heapAllocationCounts[i];
+
+                if (useBudgetExtension) {
+                        p_budget->budget = budgetProperties.heapBudget[i];
+                        p_budget->usage = budgetProperties.heapUsage[i];
+                } else {
+                        p_budget->budget =
+                                p_heap->size * ESTIMATED_BUDGET_FRACTION;
+                        p_budget->usage = allocatedBytes[i];
+                }
+        }
+        p_stats->pressure_event_count = pressureEventCount;
+        pthread_mutex_unlock(&mutex);
+}
+
+static bool is_heap_under_pressure(uint32_t heap, VkDeviceSize size)
+{
+        struct MemoryBudgetStats stats;
+        get_memory_budget_stats(&stats);
+
+        const struct HeapBudget *p_budget = &stats.heaps[heap];
+        return p_budget->usage + size >
+                p_budget->budget * pressureThreshold;
+}
+
+// Returns the bytes the handlers freed
+static VkDeviceSize relieve_memory_pressure(uint32_t heap, VkDeviceSize size)
+{
+        if (handlerCount == 0 || !is_heap_under_pressure(heap, size))
+                return 0;
+
+        pthread_mutex_lock(&mutex);
+        pressureEventCount++;
+        pthread_mutex_unlock(&mutex);
+
+        VkDeviceSize freed = 0;
+        for (size_t i = 0; i < handlerCount; i++) {
+                freed += handlers[i].function(handlers[i].p_user_data,
+                                heap, size);
+                if (!is_heap_under_pressure(heap, size))
+                        break;
+        }
+
+        return freed;
+}
+
+static void track_allocation(VkDeviceMemory memory, VkDeviceSize size,
+                uint32_t heap)
+{
+        pthread_mutex_lock(&mutex);
+        if (allocationCount == allocationCapacity) {
+                allocationCapacity = allocationCapacity > 0 ?
+                        allocationCapacity * 2 : 64;
+                allocations = realloc(allocations, allocationCapacity *
+                                sizeof(struct TrackedAllocation));
+        }
+
+        allocations[allocationCount++] = (struct TrackedAllocation) {
+                memory, size, heap
+        };
+        allocatedBytes[heap] += size;
+        heapAllocationCounts[heap]++;
+        pthread_mutex_unlock(&mutex);
+}
+
+// Gives the pressure handlers a chance to make room first, and once more
+// if the driver runs out of memory anyway.
+VkResult allocate_device_memory(
+                VkDevice device,
+                const VkMemoryAllocateInfo *p_allocate_info,
+                VkDeviceMemory *p_memory)
+{
+        uint32_t heap = memoryProperties.memoryTypes[
+                p_allocate_info->memoryTypeIndex].heapIndex;
+        VkDeviceSize size = p_allocate_info->allocationSize;
+
+        relieve_memory_pressure(heap, size);
+
+        VkResult result = vkAllocateMemory(device, p_allocate_info,
+                        get_host_allocator(), p_memory);
+        if (result == VK_ERROR_OUT_OF_DEVICE_MEMORY && handlerCount > 0) {
+                VkDeviceSize freed = 0;
+                for (size_t i = 0; i < handlerCount; i++)
+                        freed += handlers[i].function(
+                                        handlers[i].p_user_data, heap, size);
+                if (freed > 0)
+                        result = vkAllocateMemory(device, p_allocate_info,
+                                        get_host_allocator(), p_memory);
+        }
+
+        if (result == VK_SUCCESS)
+                track_allocation(*p_memory, size, heap);
+
+        return result;
+}
+
+void free_device_memory(
+                VkDevice device,
+                VkDeviceMemory memory)
+{
+        if (memory == VK_NULL_HANDLE)
+                return;
+
+        pthread_mutex_lock(&mutex);
+        for (size_t i = 0; i < allocationCount; i++) {
+                struct TrackedAllocation *p_allocation = &allocations[i];
+                if (p_allocation->memory != memory)
+                        continue;
+
+                allocatedBytes[p_allocation->heap] -= p_allocation->size;
+                heapAllocationCounts[p_allocation->heap]--;
+                *p_allocation = allocations[--allocationCount];
+                break;
+        }
+        pthread_mutex_unlock(&mutex);
+
+        vkFreeMemory(device, memory, get_host_allocator());
+}
+
+void report_memory_budget(void)
+{
+        struct MemoryBudgetStats stats;
+        get_memory_budget_stats(&stats);
+
+        for (size_t i = 0; i < stats.heap_count; i++) {
+                const struct HeapBudget *p_budget = &stats.heaps[i];
+                info("Heap %zu (%s): %.1f of %.1f MiB budget, "
+                                "%.1f MiB in %u allocations of ours\n",
+                                i, p_budget->device_local ?
+                                "device local" : "host",
+                                p_budget->usage / MIB,
+                                p_budget->budget / MIB,
+                                p_budget->allocated_bytes / MIB,
+                                p_budget->allocation_count);
+        }
+
+        if (!stats.driver_budget)
+                info("Heap budgets are estimated, "
+                                "VK_EXT_memory_budget is unavailable\n");
+        if (stats.pressure_event_count > 0)
+                info("Memory pressure was relieved %u times\n",
+                                stats.pressure_event_count);
+}
+
+// After the device is destroyed, every allocation has been freed by then
+void destroy_memory_budget(void)
+{
+        if (allocationCount > 0)
+                warning("%u device memory allocations were never freed!\n",
+                                allocationCount);
+
+        free(allocations);
+        allocations = NULL;
+        allocationCount = 0;
+        allocationCapacity = 0;
+        handlerCount = 0;
+}
@@ -0,0 +1,68 @@
+#ifndef VK_MEMORY_BUDGET_H
+#define VK_MEMORY_BUDGET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+// Device memory use per heap, compared against the budget the driver
+// reports through VK_EXT_memory_budget. Every device memory allocation
+// has to go through allocate_device_memory() and free_device_memory()
+// so that our own tally stays complete.
+
+// Called before an allocation that would take its heap over the
+// pressure threshold. Frees whatever memory the owner can spare, e.g.
+// evictable streaming or readback buffers, and returns the bytes freed.
+// Runs on the allocating thread and may free device memory itself.
+typedef VkDeviceSize (*MemoryPressureFunction)(
+                void *p_user_data,
+                uint32_t heap_index,
+                VkDeviceSize size);
+
+struct HeapBudget {
+        VkDeviceSize size;
+        // What the driver allows this process to use before it starts
+        // paging. Estimated from the heap size without the extension.
+        VkDeviceSize budget;
+        // Everything this process has on the heap, as seen by the driver.
+        // Equal to the allocated bytes without the extension.
+        VkDeviceSize usage;
+        // Our own tally of live allocations
+        VkDeviceSize allocated_bytes;
+        uint32_t allocation_count;
+        bool device_local;
+};
+
+struct MemoryBudgetStats {
+        uint32_t heap_count;
+        struct HeapBudget heaps[VK_MAX_MEMORY_HEAPS];
+        // Whether budget and usage come from VK_EXT_memory_budget
+        bool driver_budget;
+        uint32_t pressure_event_count;
+};
+
+void init_memory_budget(
+                VkPhysicalDevice physical_device,
+                bool use_memory_budget_extension,
+                float pressure_threshold);
+
+void add_memory_pressure_handler(
+                MemoryPressureFunction function,
+                void *p_user_data);
+
+VkResult allocate_device_memory(
+                VkDevice device,
+                const VkMemoryAllocateInfo *p_allocate_info,
+                VkDeviceMemory *p_memory);
+
+void free_device_memory(
+                VkDevice device,
+                VkDeviceMemory memory);
+
+void get_memory_budget_stats(struct MemoryBudgetStats *p_stats);
+
+void report_memory_budget(void);
+
+void destroy_memory_budget(void);
+
+#endif
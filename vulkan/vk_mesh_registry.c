@@ -0,0 +1,170 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+
+#include "../debug/print.h"
+#include "../debug/trace.h"
+#include "vk_buffer.h"
+#include "vk_host_allocator.h"
+#include "vk_memory_budget.h"
+#include "vk_mesh_registry.h"
+#include "vk_vertex_data.h"
+
+
+// Grows a host array so it can hold at least required elements
+static void *reserve(void *p_data, uint32_t *p_capacity, uint32_t required,
+                size_t element_size)
+{
+        if (required <= *p_capacity)
+                return p_data;
+
+        uint32_t capacity = *p_capacity ? *p_capacity : 16;
+        while (capacity < required)
+                capacity *= 2;
+
+        p_data = realloc(p_data, capacity * element_size);
+        if (p_data == NULL) {
+                error("Failed to grow mesh registry!");
+                exit(EXIT_FAILURE);
+        }
+
+        *p_capacity = capacity;
+        return p_data;
+}
+
+void init_mesh_registry(
+                const struct VertexLayout *p_vertex_layout,
+                struct MeshRegistry *p_mesh_registry)
+{
+        memset(p_mesh_registry, 0, sizeof(*p_mesh_registry));
+        p_mesh_registry->vertex_layout = *p_vertex_layout;
+}
+
+// Quantizes a mesh into the shared buffers and returns its id. The indices
+// are 16 bit and relative to the mesh, so a single mesh is limited to
+// 65536 vertices while the registry as a whole is not.
+uint32_t register_mesh(
+                struct MeshRegistry *p_mesh_registry,
+                const Vertex *a_vertices,
+                uint32_t vertex_count,
+                const uint16_t *a_indices,
+                uint32_t index_count)
+{
+        if (p_mesh_registry->vertex_buffer != VK_NULL_HANDLE) {
+                error("Meshes must be registered before the upload!");
+                exit(EXIT_FAILURE);
+        }
+        if (vertex_count > UINT16_MAX + 1) {
+                error("Mesh has too many vertices for 16 bit indices!");
+                exit(EXIT_FAILURE);
+        }
+
+        struct MeshRegistry *p = p_mesh_registry;
+        uint32_t stride = p->vertex_layout.stride;
+        p->vertices = reserve(p->vertices, &p->vertex_capacity,
+                        p->vertex_count + vertex_count, stride);
+        p->indices = reserve(p->indices, &p->index_capacity,
+                        p->index_count + index_count, sizeof(uint16_t));
+        p->meshes = reserve(p->meshes, &p->mesh_capacity,
+                        p->mesh_count + 1, sizeof(struct Mesh));
+
+        struct Mesh mesh = {};
+        mesh.first_index = p->index_count;
+        mesh.index_count = index_count;
+        mesh.vertex_offset = (int32_t) p->vertex_count;
+        mesh.vertex_count = vertex_count;
+
+        quantize_vertices(&p->vertex_layout, a_vertices, vertex_count,
+                        &p->vertices[p->vertex_count * stride]);
+        memcpy(&p->indices[p->index_count], a_indices,
+                        index_count * sizeof(uint16_t));
+        p->vertex_count += vertex_count;
+        p->index_count += index_count;
+
+        p->meshes[p->mesh_count] = mesh;
+        return p->mesh_count++;
+}
+
+// Creates the shared device local buffers and uploads every registered
+// mesh. The host copies of the vertices and indices are released, only
+// the mesh table is kept for building draw commands.
+void upload_mesh_registry(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                VkCommandPool command_pool,
+                VkQueue queue,
+                struct MeshRegistry *p_mesh_registry)
+{
+        TRACE_ZONE("upload_mesh_registry");
+        struct MeshRegistry *p = p_mesh_registry;
+        if (p->mesh_count == 0) {
+                error("Mesh registry is empty!");
+                exit(EXIT_FAILURE);
+        }
+
+        VkDeviceSize vertexBufferSize =
+                (VkDeviceSize) p->vertex_layout.stride * p->vertex_count;
+        VkDeviceSize indexBufferSize = sizeof(uint16_t) * p->index_count;
+
+        if (create_buffer(device, physical_device, vertexBufferSize,
+                                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                &p->vertex_buffer, &p->vertex_buffer_memory)
+                        != VK_SUCCESS) {
+                error("Failed to create vertex buffer!");
+                exit(EXIT_FAILURE);
+        }
+
+        if (create_buffer(device, physical_device, indexBufferSize,
+                                VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+                                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                &p->index_buffer, &p->index_buffer_memory)
+                        != VK_SUCCESS) {
+                error("Failed to create index buffer!");
+                exit(EXIT_FAILURE);
+        }
+
+        upload_buffer(device, physical_device, command_pool, queue,
+                        p->vertex_buffer, p->vertices, vertexBufferSize);
+        upload_buffer(device, physical_device, command_pool, queue,
+                        p->index_buffer, p->indices, indexBufferSize);
+
+        free(p->vertices);
+        free(p->indices);
+        p->vertices = NULL;
+        p->indices = NULL;
+        p->vertex_capacity = 0;
+        p->index_capacity = 0;
+}
+
+// Binds the shared buffers to vertex binding 0 and as the index buffer
+void bind_mesh_registry(
+                const struct MeshRegistry *p_mesh_registry,
+                VkCommandBuffer command_buffer)
+{
+        VkDeviceSize offsets[] = {0};
+        vkCmdBindVertexBuffers(command_buffer, 0, 1,
+                        &p_mesh_registry->vertex_buffer, offsets);
+        vkCmdBindIndexBuffer(command_buffer, p_mesh_registry->index_buffer,
+                        0, VK_INDEX_TYPE_UINT16);
+}
+
+void destroy_mesh_registry(
+                VkDevice device,
+                struct MeshRegistry *p_mesh_registry)
+{
+        vkDestroyBuffer(device, p_mesh_registry->vertex_buffer,
+                        get_host_allocator());
+        free_device_memory(device, p_mesh_registry->vertex_buffer_memory);
+        vkDestroyBuffer(device, p_mesh_registry->index_buffer,
+                        get_host_allocator());
+        free_device_memory(device, p_mesh_registry->index_buffer_memory);
+
+        free(p_mesh_registry->vertices);
+        free(p_mesh_registry->indices);
+        free(p_mesh_registry->meshes);
+        memset(p_mesh_registry, 0, sizeof(*p_mesh_registry));
+}
@@ -0,0 +1,67 @@
+#ifndef VK_MESH_REGISTRY_H
+#define VK_MESH_REGISTRY_H
+
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+#include "vk_vertex_data.h"
+
+// Location of a mesh inside the shared buffers. Indices are relative to
+// the first vertex of the mesh, which is added back through vertexOffset.
+struct Mesh {
+        uint32_t first_index;
+        uint32_t index_count;
+        int32_t vertex_offset;
+        uint32_t vertex_count;
+};
+
+// Packs every mesh into one vertex and one index buffer, so the whole
+// scene is drawn with a single bind and meshes only differ in the offsets
+// of their draw commands. Meshes are quantized into the vertex layout and
+// collected on the host with register_mesh(), then uploaded together once
+// all of them are known.
+struct MeshRegistry {
+        struct VertexLayout vertex_layout;
+        // vertex_count vertices of vertex_layout.stride bytes
+        uint8_t *vertices;
+        uint32_t vertex_count;
+        uint32_t vertex_capacity;
+        uint16_t *indices;
+        uint32_t index_count;
+        uint32_t index_capacity;
+        struct Mesh *meshes;
+        uint32_t mesh_count;
+        uint32_t mesh_capacity;
+        VkBuffer vertex_buffer;
+        VkDeviceMemory vertex_buffer_memory;
+        VkBuffer index_buffer;
+        VkDeviceMemory index_buffer_memory;
+};
+
+void init_mesh_registry(
+                const struct VertexLayout *p_vertex_layout,
+                struct MeshRegistry *p_mesh_registry);
+
+uint32_t register_mesh(
+                struct MeshRegistry *p_mesh_registry,
+                const Vertex *a_vertices,
+                uint32_t vertex_count,
+                const uint16_t *a_indices,
+                uint32_t index_count);
+
+void upload_mesh_registry(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                VkCommandPool command_pool,
+                VkQueue queue,
+                struct MeshRegistry *p_mesh_registry);
+
+void bind_mesh_registry(
+                const struct MeshRegistry *p_mesh_registry,
+                VkCommandBuffer command_buffer);
+
+void destroy_mesh_registry(
+                VkDevice device,
+                struct MeshRegistry *p_mesh_registry);
+
+#endif
@@ -0,0 +1,83 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <vulkan/vulkan_core.h>
+
+#include "../debug/print.h"
+#include "vk_host_allocator.h"
+#include "vk_image.h"
+#include "vk_image_view.h"
+#include "vk_memory_budget.h"
+#include "vk_offscreen_target.h"
+
+static const VkFormatFeatureFlags REQUIRED_FORMAT_FEATURES =
+        VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT |
+        VK_FORMAT_FEATURE_TRANSFER_SRC_BIT;
+
+
+bool supports_offscreen_target(
+                VkPhysicalDevice physical_device,
+                VkFormat format)
+{
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties(physical_device, format,
+                        &formatProperties);
+
+        return (formatProperties.optimalTilingFeatures &
+                        REQUIRED_FORMAT_FEATURES) == REQUIRED_FORMAT_FEATURES;
+}
+
+// The images are rendered to and then copied out by the frame capture
+void create_offscreen_target(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                VkFormat format,
+                VkExtent2D extent,
+                uint32_t frame_count,
+                struct OffscreenTarget *p_target)
+{
+        *p_target = (struct OffscreenTarget) {};
+        p_target->device = device;
+        p_target->format = format;
+        p_target->extent = extent;
+        p_target->frame_count = frame_count;
+
+        p_target->images = malloc(frame_count * sizeof(VkImage));
+        p_target->image_memory = malloc(frame_count * sizeof(VkDeviceMemory));
+
+        for (size_t i = 0; i < frame_count; i++) {
+                if (create_image(device, physical_device, extent, format,
+                                        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                                        VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                                        &p_target->images[i],
+                                        &p_target->image_memory[i])
+                                != VK_SUCCESS) {
+                        error("Failed to create offscreen color image!");
+                        exit(EXIT_FAILURE);
+                }
+        }
+
+        if (create_image_views(device, p_target->images, frame_count,
+                                &p_target->format, &p_target->image_views)
+                        != VK_SUCCESS) {
+                error("Failed to create offscreen image views!");
+                exit(EXIT_FAILURE);
+        }
+}
+
+void destroy_offscreen_target(
+                struct OffscreenTarget *p_target)
+{
+        VkDevice device = p_target->device;
+
+        for (size_t i = 0; i < p_target->frame_count; i++) {
+                vkDestroyImage(device, p_target->images[i],
+                                get_host_allocator());
+                free_device_memory(device, p_target->image_memory[i]);
+        }
+        destroy_image_views(&device, p_target->image_views,
+                        p_target->frame_count);
+
+        free(p_target->images);
+        free(p_target->image_memory);
+}
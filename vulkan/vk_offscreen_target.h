@@ -0,0 +1,40 @@
+#ifndef VK_OFFSCREEN_TARGET_H
+#define VK_OFFSCREEN_TARGET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+// Color images a frame is rendered to instead of a swap chain image, when
+// nothing is presented.
+//
+// There is one image for every frame in flight. A slot only comes round
+// again once its frame has finished, so the render graph can treat each
+// image like an acquired swap chain image and the next frame never waits
+// for the readback of the previous one.
+struct OffscreenTarget {
+        VkDevice device;
+        VkFormat format;
+        VkExtent2D extent;
+        uint32_t frame_count;
+        VkImage *images;
+        VkDeviceMemory *image_memory;
+        VkImageView *image_views;
+};
+
+bool supports_offscreen_target(
+                VkPhysicalDevice physical_device,
+                VkFormat format);
+
+void create_offscreen_target(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                VkFormat format,
+                VkExtent2D extent,
+                uint32_t frame_count,
+                struct OffscreenTarget *p_target);
+
+void destroy_offscreen_target(
+                struct OffscreenTarget *p_target);
+
+#endif
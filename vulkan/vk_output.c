@@ -0,0 +1,226 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <vulkan/vulkan_core.h>
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "../debug/print.h"
+#include "../debug/trace.h"
+#include "vk_host_allocator.h"
+#include "vk_image_view.h"
+#include "vk_output.h"
+#include "vk_swap_chain.h"
+
+
+void create_output_surface(
+                VkInstance instance,
+                GLFWwindow *p_window,
+                struct Output *p_output)
+{
+        *p_output = (struct Output) {};
+        p_output->p_window = p_window;
+
+        if (glfwCreateWindowSurface(instance, p_window, get_host_allocator(),
+                                &p_output->surface)
+                        != VK_SUCCESS) {
+                error("Failed to create window surface!\n");
+                exit(EXIT_FAILURE);
+        }
+}
+
+// The device is picked for the first output, every other one has to be
+// presentable from the same queue
+bool supports_output_present(
+                VkPhysicalDevice physical_device,
+                uint32_t present_queue_family,
+                const struct Output *p_output)
+{
+        VkBool32 presentSupport = VK_FALSE;
+        vkGetPhysicalDeviceSurfaceSupportKHR(physical_device,
+                        present_queue_family, p_output->surface,
+                        &presentSupport);
+
+        return presentSupport;
+}
+
+static VkSemaphore create_binary_semaphore(
+                VkDevice device)
+{
+        VkSemaphoreCreateInfo semaphoreInfo = {};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        VkSemaphore semaphore;
+        if (vkCreateSemaphore(device, &semaphoreInfo, get_host_allocator(),
+                                &semaphore)
+                        != VK_SUCCESS) {
+                error("Failed to create synchronization objects for an output!");
+                exit(EXIT_FAILURE);
+        }
+
+        return semaphore;
+}
+
+void create_output_swap_chain(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                uint32_t frame_count,
+                struct Output *p_output)
+{
+        if (create_swap_chain(p_output->p_window, device, physical_device,
+                                p_output->surface,
+                                &p_output->swap_chain_details)
+                        != VK_SUCCESS) {
+                error("Failed to create swap chain!\n");
+                exit(EXIT_FAILURE);
+        }
+
+        if (create_image_views(device,
+                                p_output->swap_chain_details.images,
+                                p_output->swap_chain_details.image_count,
+                                &p_output->swap_chain_details.image_format,
+                                &p_output->image_views)
+                        != VK_SUCCESS) {
+                error("Failed to create image views!\n");
+                exit(EXIT_FAILURE);
+        }
+
+        p_output->frame_count = frame_count;
+        p_output->image_available_semaphores =
+                malloc(frame_count * sizeof(VkSemaphore));
+        p_output->render_finished_semaphores =
+                malloc(frame_count * sizeof(VkSemaphore));
+        for (size_t i = 0; i < frame_count; i++) {
+                p_output->image_available_semaphores[i] =
+                        create_binary_semaphore(device);
+                p_output->render_finished_semaphores[i] =
+                        create_binary_semaphore(device);
+        }
+}
+
+// Waits for the device to be idle. The semaphores are kept, nothing is
+// waiting on them once the device is idle.
+void recreate_output_swap_chain(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                struct Output *p_output)
+{
+        recreate_swap_chain(p_output->p_window, device,
+                        &p_output->image_views, physical_device,
+                        p_output->surface, &p_output->swap_chain_details);
+        p_output->acquired = false;
+        p_output->resized = false;
+}
+
+bool is_output_minimized(
+                const struct Output *p_output)
+{
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(p_output->p_window, &width, &height);
+        return glfwGetWindowAttrib(p_output->p_window, GLFW_ICONIFIED) ||
+                width == 0 || height == 0;
+}
+
+// Acquires the output's next swap chain image for the current frame. The
+// output takes part in the frame only when this succeeds.
+VkResult acquire_output_image(
+                VkDevice device,
+                struct Output *p_output,
+                uint32_t current_frame)
+{
+        TRACE_ZONE("acquire");
+        VkResult result = vkAcquireNextImageKHR(device,
+                        p_output->swap_chain_details.swap_chain, UINT64_MAX,
+                        p_output->image_available_semaphores[current_frame],
+                        VK_NULL_HANDLE, &p_output->image_index);
+
+        p_output->acquired = result == VK_SUCCESS ||
+                result == VK_SUBOPTIMAL_KHR;
+        return result;
+}
+
+// Presents the image of every acquired output with one call. The result
+// of each output is written to a_results, at the index of the output.
+// present_id tags the present of the first output, 0 leaves it untagged.
+VkResult present_outputs(
+                VkQueue queue,
+                struct Output *a_outputs,
+                uint32_t output_count,
+                uint32_t current_frame,
+                uint64_t present_id,
+                VkResult *a_results)
+{
+        TRACE_ZONE("present");
+        VkSemaphore waitSemaphores[output_count];
+        VkSwapchainKHR swapChains[output_count];
+        uint32_t imageIndices[output_count];
+        uint64_t presentIds[output_count];
+        VkResult results[output_count];
+        uint32_t outputIndices[output_count];
+
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < output_count; i++) {
+                struct Output *p_output = &a_outputs[i];
+                if (!p_output->acquired)
+                        continue;
+
+                waitSemaphores[count] =
+                        p_output->render_finished_semaphores[current_frame];
+                swapChains[count] = p_output->swap_chain_details.swap_chain;
+                imageIndices[count] = p_output->image_index;
+                presentIds[count] = i == 0 ? present_id : 0;
+                outputIndices[count] = i;
+                count++;
+        }
+
+        VkPresentInfoKHR presentInfo = {};
+        presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+        presentInfo.waitSemaphoreCount = count;
+        presentInfo.pWaitSemaphores = waitSemaphores;
+        presentInfo.swapchainCount = count;
+        presentInfo.pSwapchains = swapChains;
+        presentInfo.pImageIndices = imageIndices;
+        presentInfo.pResults = results;
+
+        // Tag the present so the frame pacer can wait for it
+        VkPresentIdKHR presentIdInfo = {};
+        if (present_id != 0) {
+                presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+                presentIdInfo.swapchainCount = count;
+                presentIdInfo.pPresentIds = presentIds;
+                presentInfo.pNext = &presentIdInfo;
+        }
+
+        VkResult result = vkQueuePresentKHR(queue, &presentInfo);
+
+        for (uint32_t i = 0; i < count; i++) {
+                a_results[outputIndices[i]] = results[i];
+                a_outputs[outputIndices[i]].acquired = false;
+        }
+
+        return result;
+}
+
+void destroy_output(
+                VkInstance instance,
+                VkDevice device,
+                struct Output *p_output)
+{
+        cleanup_swap_chain(device, p_output->swap_chain_details.swap_chain,
+                        p_output->image_views,
+                        p_output->swap_chain_details.image_count);
+
+        for (size_t i = 0; i < p_output->frame_count; i++) {
+                vkDestroySemaphore(device,
+                                p_output->image_available_semaphores[i],
+                                get_host_allocator());
+                vkDestroySemaphore(device,
+                                p_output->render_finished_semaphores[i],
+                                get_host_allocator());
+        }
+        free(p_output->image_available_semaphores);
+        free(p_output->render_finished_semaphores);
+
+        vkDestroySurfaceKHR(instance, p_output->surface, get_host_allocator());
+}
@@ -0,0 +1,78 @@
+#ifndef VK_OUTPUT_H
+#define VK_OUTPUT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+#include <GLFW/glfw3.h>
+#include "vk_swap_chain.h"
+
+// A window and everything needed to present to it.
+//
+// Every output renders the same scene with the same device, pipelines and
+// resources. The frame of every output is recorded into one command
+// buffer, submitted once and presented to all swap chains with a single
+// vkQueuePresentKHR. An output whose window is minimized, or whose swap
+// chain is being recreated, sits out the frame.
+struct Output {
+        GLFWwindow *p_window;
+        VkSurfaceKHR surface;
+        struct SwapChainDetails swap_chain_details;
+        VkImageView *image_views;
+        // One of each for every frame in flight. The swap chain only
+        // works with binary semaphores.
+        uint32_t frame_count;
+        VkSemaphore *image_available_semaphores;
+        VkSemaphore *render_finished_semaphores;
+        // The swap chain image of the frame being recorded, only valid
+        // while acquired is set
+        uint32_t image_index;
+        bool acquired;
+        // Set when the window was resized, the swap chain is recreated
+        // after the next present
+        bool resized;
+};
+
+void create_output_surface(
+                VkInstance instance,
+                GLFWwindow *p_window,
+                struct Output *p_output);
+
+bool supports_output_present(
+                VkPhysicalDevice physical_device,
+                uint32_t present_queue_family,
+                const struct Output *p_output);
+
+void create_output_swap_chain(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                uint32_t frame_count,
+                struct Output *p_output);
+
+void recreate_output_swap_chain(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                struct Output *p_output);
+
+bool is_output_minimized(
+                const struct Output *p_output);
+
+VkResult acquire_output_image(
+                VkDevice device,
+                struct Output *p_output,
+                uint32_t current_frame);
+
+VkResult present_outputs(
+                VkQueue queue,
+                struct Output *a_outputs,
+                uint32_t output_count,
+                uint32_t current_frame,
+                uint64_t present_id,
+                VkResult *a_results);
+
+void destroy_output(
+                VkInstance instance,
+                VkDevice device,
+                struct Output *p_output);
+
+#endif
@@ -0,0 +1,345 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <vulkan/vulkan_core.h>
+
+#include "../debug/print.h"
+#include "../debug/trace.h"
+#include "../utils/array.h"
+#include "vk_buffer.h"
+#include "vk_compute_pipeline.h"
+#include "vk_graphics_pipeline.h"
+#include "vk_host_allocator.h"
+#include "vk_memory_budget.h"
+#include "vk_particle_system.h"
+
+// Must match local_size_x in particle_shader.comp
+#define PARTICLE_WORKGROUP_SIZE 256
+
+struct ParticlePushConstants {
+        float delta_time;
+        uint32_t particle_count;
+};
+
+
+static float random_float(float min, float max)
+{
+        return min + (max - min) * ((float) rand() / (float) RAND_MAX);
+}
+
+// Scatters the particles over a disc around the center of the screen
+// and lets them drift outwards.
+static Particle *generate_particles(uint32_t particle_count)
+{
+        Particle *particles = malloc(particle_count * sizeof(Particle));
+
+        srand(1);
+        for (size_t i = 0; i < particle_count; i++) {
+                float x, y;
+                do {
+                        x = random_float(-1.0f, 1.0f);
+                        y = random_float(-1.0f, 1.0f);
+                } while (x * x + y * y > 1.0f);
+
+                particles[i].pos[0] = x * 0.25f;
+                particles[i].pos[1] = y * 0.25f;
+                particles[i].velocity[0] = x * 0.00025f;
+                particles[i].velocity[1] = y * 0.00025f;
+                particles[i].color[0] = random_float(0.0f, 1.0f);
+                particles[i].color[1] = random_float(0.0f, 1.0f);
+                particles[i].color[2] = random_float(0.0f, 1.0f);
+                particles[i].color[3] = 1.0f;
+        }
+
+        return particles;
+}
+
+static void create_particle_descriptors(
+                VkDevice device,
+                struct ParticleSystem *p_particle_system)
+{
+        // Binding 0 holds the particles of the previous frame,
+        // binding 1 receives the particles of the current frame.
+        VkDescriptorSetLayoutBinding bindings[2] = {};
+        for (size_t i = 0; i < ARRAY_SIZE(bindings); i++) {
+                bindings[i].binding = i;
+                bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                bindings[i].descriptorCount = 1;
+                bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+                bindings[i].pImmutableSamplers = NULL;
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = ARRAY_SIZE(bindings);
+        layoutInfo.pBindings = bindings;
+
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo,
+                                get_host_allocator(),
+                                &p_particle_system->descriptor_set_layout)
+                        != VK_SUCCESS) {
+                error("Failed to create particle descriptor set layout!");
+                exit(EXIT_FAILURE);
+        }
+
+        uint32_t frameCount = p_particle_system->frame_count;
+
+        VkDescriptorPoolSize poolSize = {};
+        poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSize.descriptorCount = frameCount * ARRAY_SIZE(bindings);
+
+        VkDescriptorPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = frameCount;
+
+        if (vkCreateDescriptorPool(device, &poolInfo, get_host_allocator(),
+                                &p_particle_system->descriptor_pool)
+                        != VK_SUCCESS) {
+                error("Failed to create particle descriptor pool!");
+                exit(EXIT_FAILURE);
+        }
+
+        VkDescriptorSetLayout layouts[frameCount];
+        for (size_t i = 0; i < frameCount; i++)
+                layouts[i] = p_particle_system->descriptor_set_layout;
+
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = p_particle_system->descriptor_pool;
+        allocInfo.descriptorSetCount = frameCount;
+        allocInfo.pSetLayouts = layouts;
+
+        p_particle_system->descriptor_sets =
+                malloc(frameCount * sizeof(VkDescriptorSet));
+        if (vkAllocateDescriptorSets(device, &allocInfo,
+                                p_particle_system->descriptor_sets)
+                        != VK_SUCCESS) {
+                error("Failed to allocate particle descriptor sets!");
+                exit(EXIT_FAILURE);
+        }
+
+        VkDeviceSize bufferSize =
+                sizeof(Particle) * p_particle_system->particle_count;
+
+        for (size_t i = 0; i < frameCount; i++) {
+                VkDescriptorBufferInfo bufferInfos[2] = {};
+                bufferInfos[0].buffer = p_particle_system->buffers[
+                        (i + frameCount - 1) % frameCount];
+                bufferInfos[0].offset = 0;
+                bufferInfos[0].range = bufferSize;
+                bufferInfos[1].buffer = p_particle_system->buffers[i];
+                bufferInfos[1].offset = 0;
+                bufferInfos[1].range = bufferSize;
+
+                VkWriteDescriptorSet writes[2] = {};
+                for (size_t j = 0; j < ARRAY_SIZE(writes); j++) {
+                        writes[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                        writes[j].dstSet = p_particle_system->descriptor_sets[i];
+                        writes[j].dstBinding = j;
+                        writes[j].dstArrayElement = 0;
+                        writes[j].descriptorType =
+                                VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                        writes[j].descriptorCount = 1;
+                        writes[j].pBufferInfo = &bufferInfos[j];
+                }
+
+                vkUpdateDescriptorSets(device, ARRAY_SIZE(writes), writes,
+                                0, NULL);
+        }
+}
+
+static struct GraphicsPipelineDetails create_particle_graphics_pipeline(
+                VkDevice device,
+                VkRenderPass *p_render_pass,
+                VkFormat color_format,
+                VkFormat depth_format)
+{
+        VkVertexInputBindingDescription bindingDescription = {};
+        bindingDescription.binding = 0;
+        bindingDescription.stride = sizeof(Particle);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        VkVertexInputAttributeDescription attributeDescriptions[2] = {};
+        attributeDescriptions[0].binding = 0;
+        attributeDescriptions[0].location = 0;
+        attributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
+        attributeDescriptions[0].offset = offsetof(Particle, pos);
+
+        attributeDescriptions[1].binding = 0;
+        attributeDescriptions[1].location = 1;
+        attributeDescriptions[1].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+        attributeDescriptions[1].offset = offsetof(Particle, color);
+
+        struct GraphicsPipelineInfo info = {};
+        info.vert_shader_path = "shaders/particle_vert.spv";
+        info.frag_shader_path = "shaders/frag.spv";
+        info.topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+        info.a_bindings = &bindingDescription;
+        info.binding_count = 1;
+        info.a_attributes = attributeDescriptions;
+        info.attribute_count = ARRAY_SIZE(attributeDescriptions);
+        info.color_format = color_format;
+        // Particles are tested against the objects but do not hide
+        // each other
+        info.depth_format = depth_format;
+
+        return create_graphics_pipeline_from_info(&device, p_render_pass,
+                        &info);
+}
+
+void create_particle_system(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                VkCommandPool command_pool,
+                VkQueue queue,
+                const uint32_t *a_queue_families,
+                uint32_t queue_family_count,
+                VkRenderPass *p_render_pass,
+                VkFormat color_format,
+                VkFormat depth_format,
+                uint32_t particle_count,
+                uint32_t frame_count,
+                struct ParticleSystem *p_particle_system)
+{
+        TRACE_ZONE("create_particle_system");
+        p_particle_system->particle_count = particle_count;
+        p_particle_system->frame_count = frame_count;
+        p_particle_system->buffers = malloc(frame_count * sizeof(VkBuffer));
+        p_particle_system->buffer_memory =
+                malloc(frame_count * sizeof(VkDeviceMemory));
+
+        VkDeviceSize bufferSize = sizeof(Particle) * particle_count;
+        Particle *particles = generate_particles(particle_count);
+
+        // The buffers are written on the compute queue and read as vertex
+        // input on the graphics queue, so share them between the families
+        // instead of transferring ownership every frame.
+        for (size_t i = 0; i < frame_count; i++) {
+                if (create_buffer_concurrent(device, physical_device,
+                                        bufferSize,
+                                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                                        VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                        a_queue_families, queue_family_count,
+                                        &p_particle_system->buffers[i],
+                                        &p_particle_system->buffer_memory[i])
+                                != VK_SUCCESS) {
+                        error("Failed to create particle buffer!");
+                        exit(EXIT_FAILURE);
+                }
+
+                upload_buffer(device, physical_device, command_pool, queue,
+                                p_particle_system->buffers[i],
+                                particles, bufferSize);
+        }
+        free(particles);
+
+        create_particle_descriptors(device, p_particle_system);
+
+        p_particle_system->compute_pipeline_details =
+                create_compute_pipeline(&device, "shaders/particle_comp.spv",
+                                &p_particle_system->descriptor_set_layout,
+                                sizeof(struct ParticlePushConstants));
+
+        p_particle_system->graphics_pipeline_details =
+                create_particle_graphics_pipeline(device, p_render_pass,
+                                color_format, depth_format);
+}
+
+// Records the simulation step for the current frame. The command buffer is
+// expected to be submitted to the compute queue.
+void record_particle_update(
+                const struct ParticleSystem *p_particle_system,
+                VkCommandBuffer command_buffer,
+                uint32_t current_frame,
+                float delta_time)
+{
+        // The previous frame's dispatch wrote the buffer we read from and
+        // the dispatch before that read the buffer we are about to write.
+        // Both were submitted earlier on this queue, so a single barrier
+        // covers the read-after-write and the write-after-read hazard.
+        VkMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask =
+                VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask =
+                VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+        vkCmdPipelineBarrier(command_buffer,
+                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                        0, 1, &barrier, 0, NULL, 0, NULL);
+
+        const struct ComputePipelineDetails *p_compute =
+                &p_particle_system->compute_pipeline_details;
+
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                        p_compute->compute_pipeline);
+
+        vkCmdBindDescriptorSets(command_buffer,
+                        VK_PIPELINE_BIND_POINT_COMPUTE,
+                        p_compute->pipeline_layout, 0, 1,
+                        &p_particle_system->descriptor_sets[current_frame],
+                        0, NULL);
+
+        struct ParticlePushConstants pushConstants = {};
+        pushConstants.delta_time = delta_time;
+        pushConstants.particle_count = p_particle_system->particle_count;
+        vkCmdPushConstants(command_buffer, p_compute->pipeline_layout,
+                        VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                        sizeof(pushConstants), &pushConstants);
+
+        uint32_t groupCount = (p_particle_system->particle_count +
+                        PARTICLE_WORKGROUP_SIZE - 1) / PARTICLE_WORKGROUP_SIZE;
+        vkCmdDispatch(command_buffer, groupCount, 1, 1);
+}
+
+// Records the point draw inside an active render pass.
+void record_particle_draw(
+                const struct ParticleSystem *p_particle_system,
+                VkCommandBuffer command_buffer,
+                uint32_t current_frame)
+{
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                        p_particle_system->graphics_pipeline_details
+                        .graphics_pipeline);
+
+        VkBuffer vertexBuffers[] = {
+                p_particle_system->buffers[current_frame]
+        };
+        VkDeviceSize offsets[] = {0};
+        vkCmdBindVertexBuffers(command_buffer, 0, 1, vertexBuffers, offsets);
+
+        vkCmdDraw(command_buffer, p_particle_system->particle_count, 1, 0, 0);
+}
+
+void destroy_particle_system(
+                VkDevice device,
+                struct ParticleSystem *p_particle_system)
+{
+        vkDestroyPipeline(device, p_particle_system->graphics_pipeline_details
+                        .graphics_pipeline, get_host_allocator());
+        vkDestroyPipelineLayout(device, p_particle_system
+                        ->graphics_pipeline_details.pipeline_layout,
+                        get_host_allocator());
+        destroy_compute_pipeline(&device,
+                        &p_particle_system->compute_pipeline_details);
+
+        vkDestroyDescriptorPool(device, p_particle_system->descriptor_pool,
+                        get_host_allocator());
+        vkDestroyDescriptorSetLayout(device,
+                        p_particle_system->descriptor_set_layout,
+                        get_host_allocator());
+        free(p_particle_system->descriptor_sets);
+
+        for (size_t i = 0; i < p_particle_system->frame_count; i++) {
+                vkDestroyBuffer(device, p_particle_system->buffers[i],
+                                get_host_allocator());
+                free_device_memory(device, p_particle_system->buffer_memory[i]);
+        }
+        free(p_particle_system->buffers);
+        free(p_particle_system->buffer_memory);
+}
@@ -0,0 +1,63 @@
+#ifndef VK_PARTICLE_SYSTEM_H
+#define VK_PARTICLE_SYSTEM_H
+
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+#include <cglm/cglm.h>
+
+#include "vk_compute_pipeline.h"
+#include "vk_graphics_pipeline.h"
+
+// Matches the std430 layout of the Particle struct in particle_shader.comp
+typedef struct s_particle {
+    vec2 pos;
+    vec2 velocity;
+    vec4 color;
+} Particle;
+
+// A GPU simulated particle system. The compute shader reads the particles
+// of the previous frame and writes the particles of the current frame, so
+// there is one storage buffer per frame in flight. The buffer written for a
+// frame is then bound directly as the vertex buffer of the point pipeline.
+struct ParticleSystem {
+        uint32_t particle_count;
+        uint32_t frame_count;
+        VkBuffer *buffers;
+        VkDeviceMemory *buffer_memory;
+        VkDescriptorSetLayout descriptor_set_layout;
+        VkDescriptorPool descriptor_pool;
+        VkDescriptorSet *descriptor_sets;
+        struct ComputePipelineDetails compute_pipeline_details;
+        struct GraphicsPipelineDetails graphics_pipeline_details;
+};
+
+void create_particle_system(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                VkCommandPool command_pool,
+                VkQueue queue,
+                const uint32_t *a_queue_families,
+                uint32_t queue_family_count,
+                VkRenderPass *p_render_pass,
+                VkFormat color_format,
+                VkFormat depth_format,
+                uint32_t particle_count,
+                uint32_t frame_count,
+                struct ParticleSystem *p_particle_system);
+
+void record_particle_update(
+                const struct ParticleSystem *p_particle_system,
+                VkCommandBuffer command_buffer,
+                uint32_t current_frame,
+                float delta_time);
+
+void record_particle_draw(
+                const struct ParticleSystem *p_particle_system,
+                VkCommandBuffer command_buffer,
+                uint32_t current_frame);
+
+void destroy_particle_system(
+                VkDevice device,
+                struct ParticleSystem *p_particle_system);
+
+#endif
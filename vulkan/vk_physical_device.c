@@ -5,6 +5,7 @@
 #include <string.h>
 
 #include "../debug/print.h"
+#include "../debug/trace.h"
 #include "vk_queue_family.h"
 #include "vk_swap_chain.h"
 #include "../utils/array.h"
@@ -54,8 +55,9 @@ static bool is_device_suitable(
                                 device_extensions,
                                 extension_count);
 
-        bool swapChainAdequate = false;
-        if (extensionsSupported) {
+        // A device that renders offscreen needs no swap chain
+        bool swapChainAdequate = *p_surface == VK_NULL_HANDLE;
+        if (extensionsSupported && !swapChainAdequate) {
                 struct SwapChainSupportDetails swapChainSupport =
                         query_swap_chain_support(*p_physical_device, *p_surface);
                 swapChainAdequate = //TODO
@@ -76,6 +78,7 @@ void pick_physical_device(
                 uint32_t extension_count,
                 VkPhysicalDevice *p_physical_device)
 {
+        TRACE_ZONE("pick_physical_device");
         uint32_t deviceCount = 0;
         vkEnumeratePhysicalDevices(*p_instance, &deviceCount, NULL);
 
@@ -103,3 +106,229 @@ void pick_physical_device(
                 exit(EXIT_FAILURE);
         }
 }
+
+// Timeline semaphores are core in Vulkan 1.2, but still an optional
+// feature there. Querying it needs an instance of at least Vulkan 1.1.
+bool supports_timeline_semaphores(
+                VkPhysicalDevice physical_device,
+                uint32_t instance_api_version)
+{
+        if (instance_api_version < VK_API_VERSION_1_2)
+                return false;
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physical_device, &properties);
+        if (properties.apiVersion < VK_API_VERSION_1_2)
+                return false;
+
+        VkPhysicalDeviceVulkan12Features features12 = {};
+        features12.sType =
+                VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+        VkPhysicalDeviceFeatures2 features = {};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &features12;
+
+        vkGetPhysicalDeviceFeatures2(physical_device, &features);
+
+        return features12.timelineSemaphore == VK_TRUE;
+}
+
+// Dynamic rendering is used through the Vulkan 1.3 core entry points,
+// so both the instance and the device need to be at least 1.3.
+bool supports_dynamic_rendering(
+                VkPhysicalDevice physical_device,
+                uint32_t instance_api_version)
+{
+        if (instance_api_version < VK_API_VERSION_1_3)
+                return false;
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physical_device, &properties);
+        if (properties.apiVersion < VK_API_VERSION_1_3)
+                return false;
+
+        VkPhysicalDeviceVulkan13Features features13 = {};
+        features13.sType =
+                VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+
+        VkPhysicalDeviceFeatures2 features = {};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &features13;
+
+        vkGetPhysicalDeviceFeatures2(physical_device, &features);
+
+        return features13.dynamicRendering == VK_TRUE;
+}
+
+// Drawing many meshes from one indirect buffer needs both more than one
+// draw per call and a per-draw firstInstance. Both are core 1.0 features.
+bool supports_multi_draw_indirect(
+                VkPhysicalDevice physical_device)
+{
+        VkPhysicalDeviceFeatures features;
+        vkGetPhysicalDeviceFeatures(physical_device, &features);
+
+        return features.multiDrawIndirect == VK_TRUE &&
+                features.drawIndirectFirstInstance == VK_TRUE;
+}
+
+// Desktop GPUs usually support BC and mobile GPUs ETC2
+bool supports_texture_compression_bc(
+                VkPhysicalDevice physical_device)
+{
+        VkPhysicalDeviceFeatures features;
+        vkGetPhysicalDeviceFeatures(physical_device, &features);
+
+        return features.textureCompressionBC == VK_TRUE;
+}
+
+bool supports_texture_compression_etc2(
+                VkPhysicalDevice physical_device)
+{
+        VkPhysicalDeviceFeatures features;
+        vkGetPhysicalDeviceFeatures(physical_device, &features);
+
+        return features.textureCompressionETC2 == VK_TRUE;
+}
+
+// Descriptor indexing is core in Vulkan 1.2, where VK_EXT_descriptor_indexing
+// was promoted. Only the parts the bindless table relies on are checked.
+bool supports_descriptor_indexing(
+                VkPhysicalDevice physical_device,
+                uint32_t instance_api_version)
+{
+        if (instance_api_version < VK_API_VERSION_1_2)
+                return false;
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physical_device, &properties);
+        if (properties.apiVersion < VK_API_VERSION_1_2)
+                return false;
+
+        VkPhysicalDeviceVulkan12Features features12 = {};
+        features12.sType =
+                VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+        VkPhysicalDeviceFeatures2 features = {};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &features12;
+
+        vkGetPhysicalDeviceFeatures2(physical_device, &features);
+
+        return features.features.shaderSampledImageArrayDynamicIndexing
+                        == VK_TRUE &&
+                features12.runtimeDescriptorArray == VK_TRUE &&
+                features12.descriptorBindingPartiallyBound == VK_TRUE &&
+                features12.descriptorBindingSampledImageUpdateAfterBind
+                        == VK_TRUE &&
+                features12.descriptorBindingStorageBufferUpdateAfterBind
+                        == VK_TRUE;
+}
+
+static bool is_device_extension_available(
+                VkPhysicalDevice physical_device,
+                const char *extension_name)
+{
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(physical_device, NULL,
+                        &extensionCount, NULL);
+
+        VkExtensionProperties extensions[extensionCount];
+        vkEnumerateDeviceExtensionProperties(physical_device, NULL,
+                        &extensionCount, extensions);
+
+        for (size_t i = 0; i < extensionCount; i++) {
+                if (strcmp(extensions[i].extensionName, extension_name) == 0)
+                        return true;
+        }
+
+        return false;
+}
+
+// Present wait lets the host block until a given present has reached the
+// display, which paces frames to the actual scanout instead of the queue.
+bool supports_present_wait(
+                VkPhysicalDevice physical_device,
+                uint32_t instance_api_version)
+{
+        if (instance_api_version < VK_API_VERSION_1_1)
+                return false;
+
+        if (!is_device_extension_available(physical_device,
+                                VK_KHR_PRESENT_ID_EXTENSION_NAME) ||
+                        !is_device_extension_available(physical_device,
+                                VK_KHR_PRESENT_WAIT_EXTENSION_NAME))
+                return false;
+
+        VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures = {};
+        presentIdFeatures.sType =
+                VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+
+        VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures = {};
+        presentWaitFeatures.sType =
+                VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+        presentWaitFeatures.pNext = &presentIdFeatures;
+
+        VkPhysicalDeviceFeatures2 features = {};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &presentWaitFeatures;
+
+        vkGetPhysicalDeviceFeatures2(physical_device, &features);
+
+        return presentIdFeatures.presentId == VK_TRUE &&
+                presentWaitFeatures.presentWait == VK_TRUE;
+}
+
+// The budget is read through vkGetPhysicalDeviceMemoryProperties2, core
+// since Vulkan 1.1. Without it budgets are estimated from the heap sizes.
+bool supports_memory_budget(
+                VkPhysicalDevice physical_device,
+                uint32_t instance_api_version)
+{
+        if (instance_api_version < VK_API_VERSION_1_1)
+                return false;
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physical_device, &properties);
+        if (properties.apiVersion < VK_API_VERSION_1_1)
+                return false;
+
+        return is_device_extension_available(physical_device,
+                        VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+}
+
+// Calibrated timestamps sample the device clock together with the
+// CLOCK_MONOTONIC the trace runs on, without a submission to time. Both
+// domains have to be calibrateable.
+bool supports_calibrated_timestamps(
+                VkInstance instance,
+                VkPhysicalDevice physical_device)
+{
+        if (!is_device_extension_available(physical_device,
+                                VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME))
+                return false;
+
+        // Extension commands are not exported by the loader
+        PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT
+                getTimeDomains =
+                (PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT)
+                vkGetInstanceProcAddr(instance,
+                                "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT");
+        if (getTimeDomains == NULL)
+                return false;
+
+        uint32_t domainCount = 0;
+        getTimeDomains(physical_device, &domainCount, NULL);
+        VkTimeDomainEXT domains[domainCount + 1];
+        getTimeDomains(physical_device, &domainCount, domains);
+
+        bool device = false;
+        bool monotonic = false;
+        for (size_t i = 0; i < domainCount; i++) {
+                device |= domains[i] == VK_TIME_DOMAIN_DEVICE_EXT;
+                monotonic |= domains[i] == VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+        }
+
+        return device && monotonic;
+}
@@ -1,6 +1,8 @@
 #ifndef VK_PHYSICAL_DEVICE_H
 #define VK_PHYSICAL_DEVICE_H
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <vulkan/vulkan_core.h>
 
 void pick_physical_device(
@@ -10,4 +12,37 @@ void pick_physical_device(
                 uint32_t extension_count,
                 VkPhysicalDevice *p_physical_device);
 
+bool supports_timeline_semaphores(
+                VkPhysicalDevice physical_device,
+                uint32_t instance_api_version);
+
+bool supports_dynamic_rendering(
+                VkPhysicalDevice physical_device,
+                uint32_t instance_api_version);
+
+bool supports_present_wait(
+                VkPhysicalDevice physical_device,
+                uint32_t instance_api_version);
+
+bool supports_multi_draw_indirect(
+                VkPhysicalDevice physical_device);
+
+bool supports_texture_compression_bc(
+                VkPhysicalDevice physical_device);
+
+bool supports_texture_compression_etc2(
+                VkPhysicalDevice physical_device);
+
+bool supports_descriptor_indexing(
+                VkPhysicalDevice physical_device,
+                uint32_t instance_api_version);
+
+bool supports_memory_budget(
+                VkPhysicalDevice physical_device,
+                uint32_t instance_api_version);
+
+bool supports_calibrated_timestamps(
+                VkInstance instance,
+                VkPhysicalDevice physical_device);
+
 #endif
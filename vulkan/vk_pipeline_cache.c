@@ -0,0 +1,137 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+
+#include "../debug/print.h"
+#include "../debug/trace.h"
+#include "vk_host_allocator.h"
+#include "vk_pipeline_cache.h"
+
+static VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+static const char *cachePath;
+
+
+// Reads the cache file written by the previous run. A missing file is
+// not an error, the first run simply starts with an empty cache.
+static void *read_cache_file(
+                const char *path,
+                size_t *p_size)
+{
+        FILE *file = fopen(path, "rb");
+        if (file == NULL)
+                return NULL;
+
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        rewind(file);
+
+        void *data = size > 0 ? malloc(size) : NULL;
+        if (data != NULL && fread(data, size, 1, file) != 1) {
+                warning("Failed to read pipeline cache %s\n", path);
+                free(data);
+                data = NULL;
+        }
+        fclose(file);
+
+        *p_size = data != NULL ? size : 0;
+        return data;
+}
+
+// Drivers have to reject foreign data themselves, but not all of them
+// do it gracefully, so only data from this exact device is handed over.
+static bool is_cache_compatible(
+                VkPhysicalDevice physical_device,
+                const void *data,
+                size_t size)
+{
+        VkPipelineCacheHeaderVersionOne header;
+        if (size < sizeof(header))
+                return false;
+        memcpy(&header, data, sizeof(header));
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+        return header.headerSize >= sizeof(header) &&
+                header.headerSize <= size &&
+                header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+                header.vendorID == properties.vendorID &&
+                header.deviceID == properties.deviceID &&
+                memcmp(header.pipelineCacheUUID,
+                                properties.pipelineCacheUUID,
+                                VK_UUID_SIZE) == 0;
+}
+
+void create_pipeline_cache(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                const char *path)
+{
+        TRACE_ZONE("create_pipeline_cache");
+        size_t size = 0;
+        void *data = read_cache_file(path, &size);
+        if (data != NULL && !is_cache_compatible(physical_device, data,
+                                size)) {
+                info("Pipeline cache %s is from another device or "
+                                "driver, starting empty\n", path);
+                free(data);
+                data = NULL;
+                size = 0;
+        }
+
+        VkPipelineCacheCreateInfo cacheInfo = {};
+        cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        cacheInfo.initialDataSize = size;
+        cacheInfo.pInitialData = data;
+
+        if (vkCreatePipelineCache(device, &cacheInfo, get_host_allocator(),
+                                &pipelineCache) != VK_SUCCESS) {
+                error("Failed to create pipeline cache!\n");
+                exit(EXIT_FAILURE);
+        }
+        free(data);
+
+        cachePath = path;
+}
+
+VkPipelineCache get_pipeline_cache(void)
+{
+        return pipelineCache;
+}
+
+static void write_cache_file(
+                VkDevice device)
+{
+        size_t size = 0;
+        if (vkGetPipelineCacheData(device, pipelineCache, &size, NULL)
+                        != VK_SUCCESS || size == 0)
+                return;
+
+        void *data = malloc(size);
+        if (vkGetPipelineCacheData(device, pipelineCache, &size, data)
+                        != VK_SUCCESS) {
+                free(data);
+                return;
+        }
+
+        FILE *file = fopen(cachePath, "wb");
+        if (file == NULL || fwrite(data, size, 1, file) != 1)
+                warning("Failed to write pipeline cache %s\n", cachePath);
+        if (file != NULL)
+                fclose(file);
+        free(data);
+}
+
+void destroy_pipeline_cache(
+                VkDevice device)
+{
+        if (pipelineCache == VK_NULL_HANDLE)
+                return;
+
+        write_cache_file(device);
+
+        vkDestroyPipelineCache(device, pipelineCache, get_host_allocator());
+        pipelineCache = VK_NULL_HANDLE;
+}
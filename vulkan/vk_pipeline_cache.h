@@ -0,0 +1,25 @@
+#ifndef VK_PIPELINE_CACHE_H
+#define VK_PIPELINE_CACHE_H
+
+#include <vulkan/vulkan_core.h>
+
+// One pipeline cache for the device, shared by every pipeline we create.
+// It is seeded from a file written by the previous run, so pipelines that
+// did not change skip shader compilation in the driver. Data written by a
+// different device or driver version is ignored.
+
+void create_pipeline_cache(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                const char *path);
+
+// VK_NULL_HANDLE before create_pipeline_cache(), which disables caching.
+// The cache is internally synchronized, pipelines may be created from
+// any thread.
+VkPipelineCache get_pipeline_cache(void);
+
+// Writes the cache back to the file it was loaded from
+void destroy_pipeline_cache(
+                VkDevice device);
+
+#endif
@@ -14,7 +14,8 @@ bool is_queue_family_indices_complete(
                 struct QueueFamilyIndices *queue_family_indices)
 {
         return queue_family_indices->graphics_family.is_some &&
-                queue_family_indices->present_family.is_some;
+                queue_family_indices->present_family.is_some &&
+                queue_family_indices->compute_family.is_some;
 }
 
 struct QueueFamilyIndices find_queue_families(VkPhysicalDevice physical_device,
@@ -36,23 +37,49 @@ struct QueueFamilyIndices find_queue_families(VkPhysicalDevice physical_device,
         // that supports both in the same queue for improved performance.
         // TODO Implement Linked List data structure
         for (size_t i = 0; i < queueFamilyCount; i++) {
-                if (queueFamilies[i].queueFlags &
-                                (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_GRAPHICS_BIT)) {
+                // A transfer family without graphics or compute is usually
+                // backed by a DMA engine, which copies without taking time
+                // from the other queues.
+                if (!indices.transfer_family.is_some &&
+                                queueFamilies[i].queueFlags & VK_QUEUE_TRANSFER_BIT &&
+                                !(queueFamilies[i].queueFlags &
+                                        (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
                         set_value(indices.transfer_family, i);
                 }
 
-                if (queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+                if (!indices.graphics_family.is_some &&
+                                queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
                         set_value(indices.graphics_family, i);
                 }
 
+                // A family without the graphics bit is usually backed by
+                // dedicated async compute hardware, so it always wins over
+                // a family we picked earlier.
+                if (queueFamilies[i].queueFlags & VK_QUEUE_COMPUTE_BIT) {
+                        if (!(queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) ||
+                                        !indices.compute_family.is_some) {
+                                set_value(indices.compute_family, i);
+                        }
+                }
+
+                // Nothing is presented without a surface, the graphics
+                // family stands in so the indices are still complete
                 VkBool32 presentSupport = false;
-                vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, i,
-                                surface, &presentSupport);
-                if (presentSupport) {
+                if (surface != VK_NULL_HANDLE)
+                        vkGetPhysicalDeviceSurfaceSupportKHR(physical_device,
+                                        i, surface, &presentSupport);
+                else
+                        presentSupport = queueFamilies[i].queueFlags &
+                                VK_QUEUE_GRAPHICS_BIT;
+                if (!indices.present_family.is_some && presentSupport) {
                         set_value(indices.present_family, i);
                 }
+        }
 
-                if (is_queue_family_indices_complete(&indices)) break;
+        // Graphics families always support transfers as well
+        if (!indices.transfer_family.is_some && indices.graphics_family.is_some) {
+                set_value(indices.transfer_family,
+                                indices.graphics_family.value);
         }
 
         return indices;
@@ -7,7 +7,13 @@
 struct QueueFamilyIndices {
         Option(uint32_t) graphics_family;
         Option(uint32_t) present_family;
+        // Prefers a transfer-only family for streaming uploads, falls
+        // back to the graphics family.
         Option(uint32_t) transfer_family;
+        // Prefers a compute-only family so compute work can run
+        // asynchronously next to the graphics queue. Falls back to a
+        // family that also supports graphics.
+        Option(uint32_t) compute_family;
 };
 
 void create_queue(VkDevice *p_device, uint32_t queue_family, VkQueue *p_queue);
@@ -0,0 +1,1291 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <vulkan/vulkan_core.h>
+
+#include "../debug/print.h"
+#include "../debug/trace.h"
+#include "vk_buffer.h"
+#include "vk_gpu_timer.h"
+#include "vk_host_allocator.h"
+#include "vk_image.h"
+#include "vk_memory_budget.h"
+#include "vk_render_graph.h"
+
+#define MIB (1024.0 * 1024.0)
+
+// Usage that lets an image live only in tile memory
+static const VkImageUsageFlags ATTACHMENT_USAGE =
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+        VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+
+// Only these have to be made available by a barrier
+static const VkAccessFlags WRITE_ACCESS =
+        VK_ACCESS_SHADER_WRITE_BIT |
+        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+        VK_ACCESS_TRANSFER_WRITE_BIT |
+        VK_ACCESS_HOST_WRITE_BIT |
+        VK_ACCESS_MEMORY_WRITE_BIT;
+
+struct UsageInfo {
+        VkPipelineStageFlags stages;
+        VkAccessFlags access;
+        // Images only
+        VkImageLayout layout;
+        VkImageUsageFlags image_usage;
+        bool write;
+};
+
+static const struct UsageInfo USAGE_INFO[] = {
+        [RENDER_GRAPH_COLOR_ATTACHMENT] = {
+                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+                        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, true
+        },
+        [RENDER_GRAPH_DEPTH_ATTACHMENT] = {
+                VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                        VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, true
+        },
+        [RENDER_GRAPH_SAMPLED] = {
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                VK_ACCESS_SHADER_READ_BIT,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                VK_IMAGE_USAGE_SAMPLED_BIT, false
+        },
+        [RENDER_GRAPH_TRANSFER_SRC] = {
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_ACCESS_TRANSFER_READ_BIT,
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                VK_IMAGE_USAGE_TRANSFER_SRC_BIT, false
+        },
+        [RENDER_GRAPH_TRANSFER_DST] = {
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_ACCESS_TRANSFER_WRITE_BIT,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                VK_IMAGE_USAGE_TRANSFER_DST_BIT, true
+        },
+        [RENDER_GRAPH_COMPUTE_READ] = {
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_ACCESS_SHADER_READ_BIT,
+                VK_IMAGE_LAYOUT_GENERAL,
+                VK_IMAGE_USAGE_STORAGE_BIT, false
+        },
+        [RENDER_GRAPH_COMPUTE_WRITE] = {
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                VK_IMAGE_LAYOUT_GENERAL,
+                VK_IMAGE_USAGE_STORAGE_BIT, true
+        },
+        [RENDER_GRAPH_INDIRECT_READ] = {
+                VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+                VK_IMAGE_LAYOUT_UNDEFINED, 0, false
+        },
+        [RENDER_GRAPH_VERTEX_READ] = {
+                VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+                VK_IMAGE_LAYOUT_UNDEFINED, 0, false
+        }
+};
+
+// The barriers in front of a pass, recorded as one vkCmdPipelineBarrier
+struct BarrierBatch {
+        VkImageMemoryBarrier image_barriers[RENDER_GRAPH_MAX_RESOURCES];
+        uint32_t image_barrier_count;
+        VkBufferMemoryBarrier buffer_barriers[RENDER_GRAPH_MAX_RESOURCES];
+        uint32_t buffer_barrier_count;
+        VkPipelineStageFlags src_stages;
+        VkPipelineStageFlags dst_stages;
+};
+
+// What a pass with attachments renders to, gathered before its barriers
+// change the layouts the load operations depend on
+struct PassAttachments {
+        uint32_t colors[RENDER_GRAPH_MAX_COLOR_ATTACHMENTS];
+        VkAttachmentLoadOp color_load_ops[RENDER_GRAPH_MAX_COLOR_ATTACHMENTS];
+        VkAttachmentStoreOp color_store_ops[RENDER_GRAPH_MAX_COLOR_ATTACHMENTS];
+        VkClearValue color_clear_values[RENDER_GRAPH_MAX_COLOR_ATTACHMENTS];
+        uint32_t color_count;
+        bool has_depth;
+        uint32_t depth;
+        VkAttachmentLoadOp depth_load_op;
+        VkAttachmentStoreOp depth_store_op;
+        VkClearValue depth_clear_value;
+};
+
+
+static VkImageAspectFlags get_format_aspect(VkFormat format)
+{
+        switch (format) {
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_X8_D24_UNORM_PACK32:
+        case VK_FORMAT_D32_SFLOAT:
+                return VK_IMAGE_ASPECT_DEPTH_BIT;
+        case VK_FORMAT_D16_UNORM_S8_UINT:
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+                return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+        case VK_FORMAT_S8_UINT:
+                return VK_IMAGE_ASPECT_STENCIL_BIT;
+        default:
+                return VK_IMAGE_ASPECT_COLOR_BIT;
+        }
+}
+
+// Whether the use depends on what earlier passes left in the resource
+static bool reads_contents(const struct RenderGraphUse *p_use)
+{
+        switch (p_use->usage) {
+        case RENDER_GRAPH_COLOR_ATTACHMENT:
+        case RENDER_GRAPH_DEPTH_ATTACHMENT:
+                return !p_use->clear;
+        case RENDER_GRAPH_TRANSFER_DST:
+                return false;
+        default:
+                return true;
+        }
+}
+
+static bool is_attachment(enum RenderGraphUsage usage)
+{
+        return usage == RENDER_GRAPH_COLOR_ATTACHMENT ||
+                usage == RENDER_GRAPH_DEPTH_ATTACHMENT;
+}
+
+void create_render_graph(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                bool dynamic_rendering,
+                struct RenderGraph *p_render_graph)
+{
+        *p_render_graph = (struct RenderGraph) {};
+        p_render_graph->device = device;
+        p_render_graph->physical_device = physical_device;
+        p_render_graph->dynamic_rendering = dynamic_rendering;
+
+        // Usually only on tiled GPUs
+        VkPhysicalDeviceMemoryProperties properties;
+        vkGetPhysicalDeviceMemoryProperties(physical_device, &properties);
+        for (size_t i = 0; i < properties.memoryTypeCount; i++) {
+                if (properties.memoryTypes[i].propertyFlags &
+                                VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)
+                        p_render_graph->lazy_memory = true;
+        }
+}
+
+// Starts declaring the next frame, the passes and resources of the
+// previous one are forgotten
+void begin_render_graph(
+                struct RenderGraph *p_render_graph)
+{
+        p_render_graph->pass_count = 0;
+        p_render_graph->resource_count = 0;
+}
+
+static uint32_t add_resource(
+                struct RenderGraph *p_render_graph,
+                enum RenderGraphResourceType type)
+{
+        if (p_render_graph->resource_count == RENDER_GRAPH_MAX_RESOURCES) {
+                error("Too many render graph resources!");
+                exit(EXIT_FAILURE);
+        }
+
+        uint32_t index = p_render_graph->resource_count++;
+        struct RenderGraphResource *p_resource =
+                &p_render_graph->resources[index];
+        *p_resource = (struct RenderGraphResource) {};
+        p_resource->type = type;
+        p_resource->first_pass = UINT32_MAX;
+        p_resource->last_pass = UINT32_MAX;
+
+        return index;
+}
+
+// The image has to be in initial_layout by the time wait_stage runs, e.g.
+// the stage that waits on the semaphore of a swap chain image. Use the
+// top of pipe stage when there is nothing to wait for.
+uint32_t import_render_graph_image(
+                struct RenderGraph *p_render_graph,
+                VkImage image,
+                VkImageView image_view,
+                VkFormat format,
+                VkExtent2D extent,
+                VkImageLayout initial_layout,
+                VkPipelineStageFlags wait_stage,
+                VkImageLayout final_layout)
+{
+        uint32_t index = add_resource(p_render_graph,
+                        RENDER_GRAPH_IMPORTED_IMAGE);
+        struct RenderGraphResource *p_resource =
+                &p_render_graph->resources[index];
+        p_resource->image = image;
+        p_resource->image_view = image_view;
+        p_resource->format = format;
+        p_resource->aspect = get_format_aspect(format);
+        p_resource->extent = extent;
+        p_resource->final_layout = final_layout;
+        p_resource->state.layout = initial_layout;
+        if (wait_stage != VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT)
+                p_resource->state.write_stages = wait_stage;
+
+        return index;
+}
+
+uint32_t import_render_graph_buffer(
+                struct RenderGraph *p_render_graph,
+                VkBuffer buffer)
+{
+        uint32_t index = add_resource(p_render_graph,
+                        RENDER_GRAPH_IMPORTED_BUFFER);
+        p_render_graph->resources[index].buffer = buffer;
+
+        return index;
+}
+
+// The usage of the image follows from the passes that use it
+uint32_t add_render_graph_transient(
+                struct RenderGraph *p_render_graph,
+                VkFormat format,
+                VkExtent2D extent)
+{
+        uint32_t index = add_resource(p_render_graph,
+                        RENDER_GRAPH_TRANSIENT_IMAGE);
+        struct RenderGraphResource *p_resource =
+                &p_render_graph->resources[index];
+        p_resource->format = format;
+        p_resource->aspect = get_format_aspect(format);
+        p_resource->extent = extent;
+
+        return index;
+}
+
+uint32_t add_render_graph_pass(
+                struct RenderGraph *p_render_graph,
+                const char *name,
+                VkExtent2D render_area,
+                bool side_effects,
+                RenderGraphRecordFunction record,
+                void *p_user_data)
+{
+        if (p_render_graph->pass_count == RENDER_GRAPH_MAX_PASSES) {
+                error("Too many render graph passes!");
+                exit(EXIT_FAILURE);
+        }
+
+        uint32_t index = p_render_graph->pass_count++;
+        struct RenderGraphPass *p_pass = &p_render_graph->passes[index];
+        *p_pass = (struct RenderGraphPass) {};
+        p_pass->name = name;
+        p_pass->record = record;
+        p_pass->p_user_data = p_user_data;
+        p_pass->render_area = render_area;
+        p_pass->side_effects = side_effects;
+
+        return index;
+}
+
+static struct RenderGraphUse *add_use(
+                struct RenderGraph *p_render_graph,
+                uint32_t pass,
+                uint32_t resource,
+                enum RenderGraphUsage usage)
+{
+        struct RenderGraphPass *p_pass = &p_render_graph->passes[pass];
+        if (p_pass->use_count == RENDER_GRAPH_MAX_PASS_USES) {
+                error("Render graph pass %s uses too many resources!",
+                                p_pass->name);
+                exit(EXIT_FAILURE);
+        }
+
+        // A barrier cannot put one image in two layouts at once
+        for (size_t i = 0; i < p_pass->use_count; i++) {
+                if (p_pass->uses[i].resource == resource) {
+                        error("Render graph pass %s uses a resource twice!",
+                                        p_pass->name);
+                        exit(EXIT_FAILURE);
+                }
+        }
+
+        struct RenderGraphUse *p_use = &p_pass->uses[p_pass->use_count++];
+        *p_use = (struct RenderGraphUse) {};
+        p_use->resource = resource;
+        p_use->usage = usage;
+
+        return p_use;
+}
+
+// Declares that the pass uses the resource. Attachments keep what the
+// resource held before unless cleared with clear_render_graph_attachment().
+void use_render_graph_resource(
+                struct RenderGraph *p_render_graph,
+                uint32_t pass,
+                uint32_t resource,
+                enum RenderGraphUsage usage)
+{
+        add_use(p_render_graph, pass, resource, usage);
+}
+
+// Renders the pass to the resource after clearing it, as a color or depth
+// attachment depending on its format
+void clear_render_graph_attachment(
+                struct RenderGraph *p_render_graph,
+                uint32_t pass,
+                uint32_t resource,
+                VkClearValue clear_value)
+{
+        VkImageAspectFlags aspect = p_render_graph->resources[resource].aspect;
+        struct RenderGraphUse *p_use = add_use(p_render_graph, pass, resource,
+                        aspect & VK_IMAGE_ASPECT_COLOR_BIT ?
+                        RENDER_GRAPH_COLOR_ATTACHMENT :
+                        RENDER_GRAPH_DEPTH_ATTACHMENT);
+        p_use->clear = true;
+        p_use->clear_value = clear_value;
+}
+
+// Walks the passes from the last one and keeps those that write imported
+// resources, have side effects, or write what a kept pass reads
+static void cull_passes(
+                struct RenderGraph *p_render_graph)
+{
+        bool needed[RENDER_GRAPH_MAX_RESOURCES] = {};
+
+        for (uint32_t i = p_render_graph->pass_count; i-- > 0;) {
+                struct RenderGraphPass *p_pass = &p_render_graph->passes[i];
+
+                bool keep = p_pass->side_effects;
+                for (size_t j = 0; j < p_pass->use_count; j++) {
+                        const struct RenderGraphUse *p_use = &p_pass->uses[j];
+                        const struct RenderGraphResource *p_resource =
+                                &p_render_graph->resources[p_use->resource];
+                        if (USAGE_INFO[p_use->usage].write &&
+                                        (p_resource->type !=
+                                         RENDER_GRAPH_TRANSIENT_IMAGE ||
+                                         needed[p_use->resource]))
+                                keep = true;
+                }
+
+                p_pass->culled = !keep;
+                if (!keep)
+                        continue;
+
+                for (size_t j = 0; j < p_pass->use_count; j++) {
+                        const struct RenderGraphUse *p_use = &p_pass->uses[j];
+                        if (reads_contents(p_use))
+                                needed[p_use->resource] = true;
+                }
+        }
+}
+
+static void find_lifetimes(
+                struct RenderGraph *p_render_graph)
+{
+        for (uint32_t i = 0; i < p_render_graph->pass_count; i++) {
+                const struct RenderGraphPass *p_pass =
+                        &p_render_graph->passes[i];
+                if (p_pass->culled)
+                        continue;
+
+                for (size_t j = 0; j < p_pass->use_count; j++) {
+                        const struct RenderGraphUse *p_use = &p_pass->uses[j];
+                        struct RenderGraphResource *p_resource =
+                                &p_render_graph->resources[p_use->resource];
+                        if (p_resource->first_pass == UINT32_MAX)
+                                p_resource->first_pass = i;
+                        p_resource->last_pass = i;
+                        p_resource->usage |=
+                                USAGE_INFO[p_use->usage].image_usage;
+                }
+        }
+}
+
+static void destroy_transients(
+                struct RenderGraph *p_render_graph)
+{
+        VkDevice device = p_render_graph->device;
+
+        for (size_t i = 0; i < p_render_graph->transient_count; i++) {
+                struct TransientImage *p_transient =
+                        &p_render_graph->transients[i];
+                vkDestroyImageView(device, p_transient->image_view,
+                                get_host_allocator());
+                vkDestroyImage(device, p_transient->image,
+                                get_host_allocator());
+        }
+        for (size_t i = 0; i < p_render_graph->block_count; i++)
+                free_device_memory(device, p_render_graph->blocks[i].memory);
+
+        p_render_graph->transient_count = 0;
+        p_render_graph->block_count = 0;
+}
+
+static bool lifetimes_overlap(
+                const struct TransientImage *p_a,
+                const struct TransientImage *p_b)
+{
+        return p_a->first_pass <= p_b->last_pass &&
+                p_b->first_pass <= p_a->last_pass;
+}
+
+// Puts the image in the first block whose memory type it can use and
+// whose images are all done before it starts or start after it is done.
+// Lazily allocated images only share with each other.
+static uint32_t find_block(
+                struct RenderGraph *p_render_graph,
+                uint32_t transient,
+                const VkMemoryRequirements *p_requirements)
+{
+        const struct TransientImage *p_transient =
+                &p_render_graph->transients[transient];
+
+        for (uint32_t i = 0; i < p_render_graph->block_count; i++) {
+                if (!(p_requirements->memoryTypeBits &
+                                        (1u << p_render_graph->blocks[i].memory_type)) ||
+                                p_render_graph->blocks[i].lazy !=
+                                p_transient->lazy)
+                        continue;
+
+                bool free = true;
+                for (size_t j = 0; j < transient && free; j++) {
+                        const struct TransientImage *p_other =
+                                &p_render_graph->transients[j];
+                        if (p_other->block == i &&
+                                        lifetimes_overlap(p_transient, p_other))
+                                free = false;
+                }
+                if (free)
+                        return i;
+        }
+
+        uint32_t index = p_render_graph->block_count++;
+        struct AliasedMemoryBlock *p_block = &p_render_graph->blocks[index];
+        *p_block = (struct AliasedMemoryBlock) {};
+        p_block->lazy = p_transient->lazy && try_find_memory_type(
+                        p_render_graph->physical_device,
+                        p_requirements->memoryTypeBits,
+                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+                        VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT,
+                        &p_block->memory_type);
+        if (!p_block->lazy)
+                p_block->memory_type = find_memory_type(
+                                p_render_graph->physical_device,
+                                p_requirements->memoryTypeBits,
+                                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        return index;
+}
+
+static void create_transients(
+                struct RenderGraph *p_render_graph,
+                const struct TransientImage *a_transients,
+                uint32_t transient_count)
+{
+        VkDevice device = p_render_graph->device;
+        struct RenderGraphStats *p_stats = &p_render_graph->stats;
+        p_stats->transient_bytes = 0;
+        p_stats->allocated_bytes = 0;
+        p_stats->lazy_bytes = 0;
+        p_stats->extent = (VkExtent2D) {};
+
+        for (uint32_t i = 0; i < transient_count; i++) {
+                struct TransientImage *p_transient =
+                        &p_render_graph->transients[i];
+                *p_transient = a_transients[i];
+
+                VkImageCreateInfo imageInfo = {};
+                imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+                imageInfo.imageType = VK_IMAGE_TYPE_2D;
+                imageInfo.format = p_transient->format;
+                imageInfo.extent.width = p_transient->extent.width;
+                imageInfo.extent.height = p_transient->extent.height;
+                imageInfo.extent.depth = 1;
+                imageInfo.mipLevels = 1;
+                imageInfo.arrayLayers = 1;
+                imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+                imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+                imageInfo.usage = p_transient->usage;
+                imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+                imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+                if (vkCreateImage(device, &imageInfo, get_host_allocator(),
+                                        &p_transient->image) != VK_SUCCESS) {
+                        error("Failed to create transient image!");
+                        exit(EXIT_FAILURE);
+                }
+
+                VkMemoryRequirements requirements;
+                vkGetImageMemoryRequirements(device, p_transient->image,
+                                &requirements);
+                p_transient->size = requirements.size;
+                p_transient->block = find_block(p_render_graph, i,
+                                &requirements);
+                p_render_graph->transient_count = i + 1;
+                if (p_transient->extent.width * p_transient->extent.height >
+                                p_stats->extent.width * p_stats->extent.height)
+                        p_stats->extent = p_transient->extent;
+
+                // Every image is bound at the start of its block
+                struct AliasedMemoryBlock *p_block =
+                        &p_render_graph->blocks[p_transient->block];
+                if (requirements.size > p_block->size)
+                        p_block->size = requirements.size;
+                p_stats->transient_bytes += requirements.size;
+        }
+
+        for (size_t i = 0; i < p_render_graph->block_count; i++) {
+                struct AliasedMemoryBlock *p_block = &p_render_graph->blocks[i];
+
+                VkMemoryAllocateInfo allocInfo = {};
+                allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+                allocInfo.allocationSize = p_block->size;
+                allocInfo.memoryTypeIndex = p_block->memory_type;
+
+                if (allocate_device_memory(device, &allocInfo,
+                                        &p_block->memory) != VK_SUCCESS) {
+                        error("Failed to allocate transient image memory!");
+                        exit(EXIT_FAILURE);
+                }
+                p_stats->allocated_bytes += p_block->size;
+                if (p_block->lazy)
+                        p_stats->lazy_bytes += p_block->size;
+        }
+
+        for (size_t i = 0; i < transient_count; i++) {
+                struct TransientImage *p_transient =
+                        &p_render_graph->transients[i];
+                vkBindImageMemory(device, p_transient->image,
+                                p_render_graph->blocks[p_transient->block].memory,
+                                0);
+
+                if (create_image_view(device, p_transient->image,
+                                        p_transient->format,
+                                        p_transient->aspect,
+                                        &p_transient->image_view)
+                                != VK_SUCCESS) {
+                        error("Failed to create transient image view!");
+                        exit(EXIT_FAILURE);
+                }
+        }
+
+        p_stats->transient_count = transient_count;
+}
+
+// Finds an existing image for every declared one, in a_images. An image
+// can stand in for another of the same kind as long as the images
+// sharing its memory are not used at the same time this frame. Outputs
+// that come and go, e.g. minimized windows, then keep using the images
+// they had instead of having all of them recreated.
+static bool match_transients(
+                const struct RenderGraph *p_render_graph,
+                const struct TransientImage *a_transients,
+                uint32_t transient_count,
+                uint32_t *a_images)
+{
+        bool taken[RENDER_GRAPH_MAX_RESOURCES] = {};
+
+        for (uint32_t i = 0; i < transient_count; i++) {
+                const struct TransientImage *p_a = &a_transients[i];
+
+                a_images[i] = UINT32_MAX;
+                for (uint32_t j = 0; j < p_render_graph->transient_count &&
+                                a_images[i] == UINT32_MAX; j++) {
+                        const struct TransientImage *p_b =
+                                &p_render_graph->transients[j];
+                        if (taken[j] || p_a->format != p_b->format ||
+                                        p_a->extent.width != p_b->extent.width ||
+                                        p_a->extent.height != p_b->extent.height ||
+                                        p_a->usage != p_b->usage ||
+                                        p_a->lazy != p_b->lazy)
+                                continue;
+
+                        bool aliased = false;
+                        for (uint32_t k = 0; k < i && !aliased; k++) {
+                                uint32_t other = a_images[k];
+                                if (p_render_graph->transients[other].block ==
+                                                p_b->block &&
+                                                lifetimes_overlap(p_a,
+                                                        &a_transients[k]))
+                                        aliased = true;
+                        }
+                        if (!aliased)
+                                a_images[i] = j;
+                }
+
+                if (a_images[i] == UINT32_MAX)
+                        return false;
+                taken[a_images[i]] = true;
+        }
+
+        return true;
+}
+
+// Gives every transient image used this frame its image and starting
+// state. The images are only recreated when the existing ones cannot
+// stand in for the declared ones.
+static void prepare_transients(
+                struct RenderGraph *p_render_graph)
+{
+        struct TransientImage transients[RENDER_GRAPH_MAX_RESOURCES];
+        uint32_t transientCount = 0;
+        // Index of the transient image of every declared one
+        uint32_t images[RENDER_GRAPH_MAX_RESOURCES];
+
+        for (size_t i = 0; i < p_render_graph->resource_count; i++) {
+                struct RenderGraphResource *p_resource =
+                        &p_render_graph->resources[i];
+                if (p_resource->type != RENDER_GRAPH_TRANSIENT_IMAGE ||
+                                p_resource->first_pass == UINT32_MAX)
+                        continue;
+
+                struct TransientImage *p_transient =
+                        &transients[transientCount];
+                *p_transient = (struct TransientImage) {};
+                p_transient->format = p_resource->format;
+                p_transient->extent = p_resource->extent;
+                p_transient->aspect = p_resource->aspect;
+                p_transient->usage = p_resource->usage;
+                p_transient->first_pass = p_resource->first_pass;
+                p_transient->last_pass = p_resource->last_pass;
+                p_resource->transient = transientCount++;
+
+                // Rendered to by one pass and dropped by its store
+                // operation, see collect_attachments()
+                p_transient->lazy = p_render_graph->lazy_memory &&
+                        p_transient->first_pass == p_transient->last_pass &&
+                        (p_transient->usage & ~ATTACHMENT_USAGE) == 0;
+                if (p_transient->lazy)
+                        p_transient->usage |=
+                                VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+        }
+
+        if (!match_transients(p_render_graph, transients, transientCount,
+                                images)) {
+                // Earlier frames may still be using the old images
+                if (p_render_graph->transient_count > 0)
+                        vkDeviceWaitIdle(p_render_graph->device);
+                destroy_transients(p_render_graph);
+                create_transients(p_render_graph, transients,
+                                transientCount);
+                for (uint32_t i = 0; i < transientCount; i++)
+                        images[i] = i;
+        }
+
+        // The contents are undefined at the start of every frame. The
+        // first use still has to wait for everything that last used the
+        // memory, in this frame or an earlier one.
+        for (size_t i = 0; i < p_render_graph->resource_count; i++) {
+                struct RenderGraphResource *p_resource =
+                        &p_render_graph->resources[i];
+                if (p_resource->type != RENDER_GRAPH_TRANSIENT_IMAGE ||
+                                p_resource->first_pass == UINT32_MAX)
+                        continue;
+
+                p_resource->transient = images[p_resource->transient];
+                const struct TransientImage *p_transient =
+                        &p_render_graph->transients[p_resource->transient];
+                const struct AliasedMemoryBlock *p_block =
+                        &p_render_graph->blocks[p_transient->block];
+                p_resource->image = p_transient->image;
+                p_resource->image_view = p_transient->image_view;
+                p_resource->state = (struct RenderGraphState) {};
+                p_resource->state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+                p_resource->state.write_stages = p_block->stages;
+                p_resource->state.write_access = p_block->access;
+        }
+}
+
+static void add_barrier(
+                struct BarrierBatch *p_batch,
+                const struct RenderGraphResource *p_resource,
+                VkPipelineStageFlags src_stages,
+                VkAccessFlags src_access,
+                VkPipelineStageFlags dst_stages,
+                VkAccessFlags dst_access,
+                VkImageLayout new_layout)
+{
+        p_batch->src_stages |= src_stages != 0 ? src_stages :
+                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        p_batch->dst_stages |= dst_stages;
+
+        if (p_resource->type == RENDER_GRAPH_IMPORTED_BUFFER) {
+                VkBufferMemoryBarrier *p_barrier = &p_batch->buffer_barriers[
+                        p_batch->buffer_barrier_count++];
+                *p_barrier = (VkBufferMemoryBarrier) {};
+                p_barrier->sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+                p_barrier->srcAccessMask = src_access;
+                p_barrier->dstAccessMask = dst_access;
+                p_barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                p_barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                p_barrier->buffer = p_resource->buffer;
+                p_barrier->offset = 0;
+                p_barrier->size = VK_WHOLE_SIZE;
+                return;
+        }
+
+        VkImageMemoryBarrier *p_barrier = &p_batch->image_barriers[
+                p_batch->image_barrier_count++];
+        *p_barrier = (VkImageMemoryBarrier) {};
+        p_barrier->sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        p_barrier->srcAccessMask = src_access;
+        p_barrier->dstAccessMask = dst_access;
+        p_barrier->oldLayout = p_resource->state.layout;
+        p_barrier->newLayout = new_layout;
+        p_barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        p_barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        p_barrier->image = p_resource->image;
+        p_barrier->subresourceRange.aspectMask = p_resource->aspect;
+        p_barrier->subresourceRange.baseMipLevel = 0;
+        p_barrier->subresourceRange.levelCount = 1;
+        p_barrier->subresourceRange.baseArrayLayer = 0;
+        p_barrier->subresourceRange.layerCount = 1;
+}
+
+static void record_barriers(
+                struct RenderGraph *p_render_graph,
+                VkCommandBuffer command_buffer,
+                const struct BarrierBatch *p_batch)
+{
+        uint32_t barrierCount = p_batch->image_barrier_count +
+                p_batch->buffer_barrier_count;
+        if (barrierCount == 0)
+                return;
+
+        vkCmdPipelineBarrier(command_buffer, p_batch->src_stages,
+                        p_batch->dst_stages, 0, 0, NULL,
+                        p_batch->buffer_barrier_count,
+                        p_batch->buffer_barriers,
+                        p_batch->image_barrier_count,
+                        p_batch->image_barriers);
+        p_render_graph->stats.barrier_count += barrierCount;
+}
+
+// Adds the barrier the use needs after the resource's previous uses, if
+// any, and makes the use the resource's latest
+static void sync_use(
+                struct RenderGraph *p_render_graph,
+                const struct RenderGraphUse *p_use,
+                struct BarrierBatch *p_batch)
+{
+        struct RenderGraphResource *p_resource =
+                &p_render_graph->resources[p_use->resource];
+        struct RenderGraphState *p_state = &p_resource->state;
+        const struct UsageInfo *p_info = &USAGE_INFO[p_use->usage];
+
+        bool image = p_resource->type != RENDER_GRAPH_IMPORTED_BUFFER;
+        VkImageLayout layout = image ? p_info->layout : p_state->layout;
+        bool transition = layout != p_state->layout;
+
+        // Writes and layout changes wait for every earlier use, reads only
+        // for a write they have not seen yet
+        VkPipelineStageFlags srcStages = 0;
+        if (p_info->write || transition)
+                srcStages = p_state->write_stages | p_state->read_stages;
+        else if ((p_state->visible_stages & p_info->stages) !=
+                        p_info->stages ||
+                        (p_state->visible_access & p_info->access) !=
+                        p_info->access)
+                srcStages = p_state->write_stages;
+
+        bool barrier = transition || srcStages != 0;
+        if (barrier)
+                add_barrier(p_batch, p_resource, srcStages,
+                                p_state->write_access, p_info->stages,
+                                p_info->access, layout);
+
+        if (p_info->write || transition) {
+                // A layout transition counts as a write of the image
+                p_state->write_stages = p_info->stages;
+                p_state->write_access = p_info->write ?
+                        p_info->access & WRITE_ACCESS : 0;
+                p_state->read_stages = p_info->write ? 0 : p_info->stages;
+                p_state->visible_stages = p_info->write ? 0 : p_info->stages;
+                p_state->visible_access = p_info->write ? 0 : p_info->access;
+        } else {
+                p_state->read_stages |= p_info->stages;
+                if (barrier) {
+                        p_state->visible_stages |= p_info->stages;
+                        p_state->visible_access |= p_info->access;
+                }
+        }
+        p_state->layout = layout;
+
+        if (p_resource->type == RENDER_GRAPH_TRANSIENT_IMAGE) {
+                struct AliasedMemoryBlock *p_block = &p_render_graph->blocks[
+                        p_render_graph->transients[p_resource->transient].block];
+                p_block->stages |= p_info->stages;
+                p_block->access |= p_info->access & WRITE_ACCESS;
+        }
+}
+
+static void collect_attachments(
+                const struct RenderGraph *p_render_graph,
+                uint32_t pass,
+                struct PassAttachments *p_attachments)
+{
+        const struct RenderGraphPass *p_pass = &p_render_graph->passes[pass];
+        *p_attachments = (struct PassAttachments) {};
+
+        for (size_t i = 0; i < p_pass->use_count; i++) {
+                const struct RenderGraphUse *p_use = &p_pass->uses[i];
+                if (!is_attachment(p_use->usage))
+                        continue;
+
+                // Nothing worth loading in an undefined image, and nothing
+                // worth storing after the last use of a transient one
+                const struct RenderGraphResource *p_resource =
+                        &p_render_graph->resources[p_use->resource];
+                VkAttachmentLoadOp loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+                if (p_use->clear)
+                        loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+                else if (p_resource->state.layout == VK_IMAGE_LAYOUT_UNDEFINED)
+                        loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                VkAttachmentStoreOp storeOp =
+                        p_resource->type == RENDER_GRAPH_TRANSIENT_IMAGE &&
+                        p_resource->last_pass == pass ?
+                        VK_ATTACHMENT_STORE_OP_DONT_CARE :
+                        VK_ATTACHMENT_STORE_OP_STORE;
+
+                if (p_use->usage == RENDER_GRAPH_DEPTH_ATTACHMENT) {
+                        p_attachments->has_depth = true;
+                        p_attachments->depth = p_use->resource;
+                        p_attachments->depth_load_op = loadOp;
+                        p_attachments->depth_store_op = storeOp;
+                        p_attachments->depth_clear_value = p_use->clear_value;
+                        continue;
+                }
+
+                if (p_attachments->color_count ==
+                                RENDER_GRAPH_MAX_COLOR_ATTACHMENTS) {
+                        error("Render graph pass %s has too many color "
+                                        "attachments!", p_pass->name);
+                        exit(EXIT_FAILURE);
+                }
+                uint32_t index = p_attachments->color_count++;
+                p_attachments->colors[index] = p_use->resource;
+                p_attachments->color_load_ops[index] = loadOp;
+                p_attachments->color_store_ops[index] = storeOp;
+                p_attachments->color_clear_values[index] = p_use->clear_value;
+        }
+}
+
+// The layouts never change inside the render pass, the barriers in front
+// of the pass have already done that
+static VkRenderPass get_render_pass(
+                struct RenderGraph *p_render_graph,
+                const struct PassAttachments *p_attachments)
+{
+        const struct RenderGraphResource *a_resources =
+                p_render_graph->resources;
+        struct RenderGraphRenderPass key = {};
+        key.color_count = p_attachments->color_count;
+        for (size_t i = 0; i < key.color_count; i++) {
+                key.color_formats[i] =
+                        a_resources[p_attachments->colors[i]].format;
+                key.color_load_ops[i] = p_attachments->color_load_ops[i];
+                key.color_store_ops[i] = p_attachments->color_store_ops[i];
+        }
+        key.depth_format = p_attachments->has_depth ?
+                a_resources[p_attachments->depth].format :
+                VK_FORMAT_UNDEFINED;
+        key.depth_load_op = p_attachments->depth_load_op;
+        key.depth_store_op = p_attachments->depth_store_op;
+
+        for (size_t i = 0; i < p_render_graph->render_pass_count; i++) {
+                const struct RenderGraphRenderPass *p_cached =
+                        &p_render_graph->render_passes[i];
+                bool match = p_cached->color_count == key.color_count &&
+                        p_cached->depth_format == key.depth_format &&
+                        p_cached->depth_load_op == key.depth_load_op &&
+                        p_cached->depth_store_op == key.depth_store_op;
+                for (size_t j = 0; match && j < key.color_count; j++)
+                        match = p_cached->color_formats[j] ==
+                                key.color_formats[j] &&
+                                p_cached->color_load_ops[j] ==
+                                key.color_load_ops[j] &&
+                                p_cached->color_store_ops[j] ==
+                                key.color_store_ops[j];
+                if (match)
+                        return p_cached->render_pass;
+        }
+
+        VkAttachmentDescription attachments[
+                RENDER_GRAPH_MAX_COLOR_ATTACHMENTS + 1] = {};
+        VkAttachmentReference colorRefs[RENDER_GRAPH_MAX_COLOR_ATTACHMENTS];
+        for (uint32_t i = 0; i < key.color_count; i++) {
+                attachments[i].format = key.color_formats[i];
+                attachments[i].samples = VK_SAMPLE_COUNT_1_BIT;
+                attachments[i].loadOp = key.color_load_ops[i];
+                attachments[i].storeOp = key.color_store_ops[i];
+                attachments[i].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                attachments[i].stencilStoreOp =
+                        VK_ATTACHMENT_STORE_OP_DONT_CARE;
+                attachments[i].initialLayout =
+                        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+                attachments[i].finalLayout =
+                        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+                colorRefs[i].attachment = i;
+                colorRefs[i].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        }
+
+        VkAttachmentDescription *p_depth = &attachments[key.color_count];
+        p_depth->format = key.depth_format;
+        p_depth->samples = VK_SAMPLE_COUNT_1_BIT;
+        p_depth->loadOp = key.depth_load_op;
+        p_depth->storeOp = key.depth_store_op;
+        p_depth->stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        p_depth->stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        p_depth->initialLayout =
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        p_depth->finalLayout =
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        VkAttachmentReference depthRef = {};
+        depthRef.attachment = key.color_count;
+        depthRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        VkSubpassDescription subpass = {};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = key.color_count;
+        subpass.pColorAttachments = colorRefs;
+        if (p_attachments->has_depth)
+                subpass.pDepthStencilAttachment = &depthRef;
+
+        VkRenderPassCreateInfo renderPassInfo = {};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassInfo.attachmentCount = key.color_count +
+                (p_attachments->has_depth ? 1 : 0);
+        renderPassInfo.pAttachments = attachments;
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+
+        if (vkCreateRenderPass(p_render_graph->device, &renderPassInfo,
+                                get_host_allocator(), &key.render_pass)
+                        != VK_SUCCESS) {
+                error("Failed to create render graph render pass!");
+                exit(EXIT_FAILURE);
+        }
+
+        if (p_render_graph->render_pass_count ==
+                        p_render_graph->render_pass_capacity) {
+                p_render_graph->render_pass_capacity =
+                        p_render_graph->render_pass_capacity > 0 ?
+                        p_render_graph->render_pass_capacity * 2 : 4;
+                p_render_graph->render_passes = realloc(
+                                p_render_graph->render_passes,
+                                p_render_graph->render_pass_capacity *
+                                sizeof(struct RenderGraphRenderPass));
+        }
+        p_render_graph->render_passes[p_render_graph->render_pass_count++] =
+                key;
+
+        return key.render_pass;
+}
+
+static VkFramebuffer get_framebuffer(
+                struct RenderGraph *p_render_graph,
+                VkRenderPass render_pass,
+                const struct PassAttachments *p_attachments,
+                VkExtent2D extent)
+{
+        struct RenderGraphFramebuffer key = {};
+        key.render_pass = render_pass;
+        key.extent = extent;
+        for (size_t i = 0; i < p_attachments->color_count; i++)
+                key.views[key.view_count++] = p_render_graph->resources[
+                        p_attachments->colors[i]].image_view;
+        if (p_attachments->has_depth)
+                key.views[key.view_count++] = p_render_graph->resources[
+                        p_attachments->depth].image_view;
+
+        for (size_t i = 0; i < p_render_graph->framebuffer_count; i++) {
+                const struct RenderGraphFramebuffer *p_cached =
+                        &p_render_graph->framebuffers[i];
+                bool match = p_cached->render_pass == key.render_pass &&
+                        p_cached->view_count == key.view_count &&
+                        p_cached->extent.width == key.extent.width &&
+                        p_cached->extent.height == key.extent.height;
+                for (size_t j = 0; match && j < key.view_count; j++)
+                        match = p_cached->views[j] == key.views[j];
+                if (match)
+                        return p_cached->framebuffer;
+        }
+
+        VkFramebufferCreateInfo framebufferInfo = {};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = render_pass;
+        framebufferInfo.attachmentCount = key.view_count;
+        framebufferInfo.pAttachments = key.views;
+        framebufferInfo.width = extent.width;
+        framebufferInfo.height = extent.height;
+        framebufferInfo.layers = 1;
+
+        if (vkCreateFramebuffer(p_render_graph->device, &framebufferInfo,
+                                get_host_allocator(), &key.framebuffer)
+                        != VK_SUCCESS) {
+                error("Failed to create render graph framebuffer!");
+                exit(EXIT_FAILURE);
+        }
+
+        if (p_render_graph->framebuffer_count ==
+                        p_render_graph->framebuffer_capacity) {
+                p_render_graph->framebuffer_capacity =
+                        p_render_graph->framebuffer_capacity > 0 ?
+                        p_render_graph->framebuffer_capacity * 2 : 8;
+                p_render_graph->framebuffers = realloc(
+                                p_render_graph->framebuffers,
+                                p_render_graph->framebuffer_capacity *
+                                sizeof(struct RenderGraphFramebuffer));
+        }
+        p_render_graph->framebuffers[p_render_graph->framebuffer_count++] =
+                key;
+
+        return key.framebuffer;
+}
+
+static void begin_dynamic_rendering(
+                const struct RenderGraph *p_render_graph,
+                VkCommandBuffer command_buffer,
+                const struct RenderGraphPass *p_pass,
+                const struct PassAttachments *p_attachments)
+{
+        VkRenderingAttachmentInfo colorAttachments[
+                RENDER_GRAPH_MAX_COLOR_ATTACHMENTS] = {};
+        for (size_t i = 0; i < p_attachments->color_count; i++) {
+                VkRenderingAttachmentInfo *p_attachment = &colorAttachments[i];
+                p_attachment->sType =
+                        VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+                p_attachment->imageView = p_render_graph->resources[
+                        p_attachments->colors[i]].image_view;
+                p_attachment->imageLayout =
+                        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+                p_attachment->loadOp = p_attachments->color_load_ops[i];
+                p_attachment->storeOp = p_attachments->color_store_ops[i];
+                p_attachment->clearValue = p_attachments->color_clear_values[i];
+        }
+
+        VkRenderingAttachmentInfo depthAttachment = {};
+        depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+        if (p_attachments->has_depth) {
+                depthAttachment.imageView = p_render_graph->resources[
+                        p_attachments->depth].image_view;
+                depthAttachment.imageLayout =
+                        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+                depthAttachment.loadOp = p_attachments->depth_load_op;
+                depthAttachment.storeOp = p_attachments->depth_store_op;
+                depthAttachment.clearValue = p_attachments->depth_clear_value;
+        }
+
+        VkRenderingInfo renderingInfo = {};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+        renderingInfo.renderArea.extent = p_pass->render_area;
+        renderingInfo.layerCount = 1;
+        renderingInfo.colorAttachmentCount = p_attachments->color_count;
+        renderingInfo.pColorAttachments = colorAttachments;
+        if (p_attachments->has_depth)
+                renderingInfo.pDepthAttachment = &depthAttachment;
+
+        vkCmdBeginRendering(command_buffer, &renderingInfo);
+}
+
+static void begin_render_pass(
+                struct RenderGraph *p_render_graph,
+                VkCommandBuffer command_buffer,
+                const struct RenderGraphPass *p_pass,
+                const struct PassAttachments *p_attachments)
+{
+        // Every attachment has the size of the first one
+        uint32_t first = p_attachments->color_count > 0 ?
+                p_attachments->colors[0] : p_attachments->depth;
+        VkExtent2D extent = p_render_graph->resources[first].extent;
+
+        VkRenderPass renderPass = get_render_pass(p_render_graph,
+                        p_attachments);
+        VkFramebuffer framebuffer = get_framebuffer(p_render_graph,
+                        renderPass, p_attachments, extent);
+
+        VkClearValue clearValues[RENDER_GRAPH_MAX_COLOR_ATTACHMENTS + 1];
+        for (size_t i = 0; i < p_attachments->color_count; i++)
+                clearValues[i] = p_attachments->color_clear_values[i];
+        clearValues[p_attachments->color_count] =
+                p_attachments->depth_clear_value;
+
+        VkRenderPassBeginInfo renderPassInfo = {};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = renderPass;
+        renderPassInfo.framebuffer = framebuffer;
+        renderPassInfo.renderArea.extent = p_pass->render_area;
+        renderPassInfo.clearValueCount = p_attachments->color_count +
+                (p_attachments->has_depth ? 1 : 0);
+        renderPassInfo.pClearValues = clearValues;
+
+        vkCmdBeginRenderPass(command_buffer, &renderPassInfo,
+                        VK_SUBPASS_CONTENTS_INLINE);
+}
+
+static void record_pass(
+                struct RenderGraph *p_render_graph,
+                VkCommandBuffer command_buffer,
+                uint32_t pass)
+{
+        const struct RenderGraphPass *p_pass = &p_render_graph->passes[pass];
+
+        struct PassAttachments attachments;
+        collect_attachments(p_render_graph, pass, &attachments);
+        bool rendering = attachments.color_count > 0 || attachments.has_depth;
+
+        struct BarrierBatch batch = {};
+        for (size_t i = 0; i < p_pass->use_count; i++)
+                sync_use(p_render_graph, &p_pass->uses[i], &batch);
+        record_barriers(p_render_graph, command_buffer, &batch);
+
+        if (rendering && p_render_graph->dynamic_rendering)
+                begin_dynamic_rendering(p_render_graph, command_buffer,
+                                p_pass, &attachments);
+        else if (rendering)
+                begin_render_pass(p_render_graph, command_buffer, p_pass,
+                                &attachments);
+
+        p_pass->record(command_buffer, p_pass->p_user_data);
+
+        if (rendering && p_render_graph->dynamic_rendering)
+                vkCmdEndRendering(command_buffer);
+        else if (rendering)
+                vkCmdEndRenderPass(command_buffer);
+}
+
+// Puts the imported images in their final layout. Whatever comes after
+// the graph, e.g. presentation, is synchronized by the caller.
+static void record_final_transitions(
+                struct RenderGraph *p_render_graph,
+                VkCommandBuffer command_buffer)
+{
+        struct BarrierBatch batch = {};
+
+        for (size_t i = 0; i < p_render_graph->resource_count; i++) {
+                struct RenderGraphResource *p_resource =
+                        &p_render_graph->resources[i];
+                struct RenderGraphState *p_state = &p_resource->state;
+                if (p_resource->type != RENDER_GRAPH_IMPORTED_IMAGE ||
+                                p_resource->final_layout ==
+                                VK_IMAGE_LAYOUT_UNDEFINED ||
+                                p_resource->final_layout == p_state->layout)
+                        continue;
+
+                add_barrier(&batch, p_resource,
+                                p_state->write_stages | p_state->read_stages,
+                                p_state->write_access,
+                                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                                p_resource->final_layout);
+                p_state->layout = p_resource->final_layout;
+        }
+
+        record_barriers(p_render_graph, command_buffer, &batch);
+}
+
+// Records every pass that is not culled, in the order they were added,
+// each one in a GPU zone named after it
+void execute_render_graph(
+                struct RenderGraph *p_render_graph,
+                VkCommandBuffer command_buffer,
+                struct GpuTimer *p_gpu_timer,
+                uint32_t frame)
+{
+        TRACE_ZONE("execute_render_graph");
+        cull_passes(p_render_graph);
+        find_lifetimes(p_render_graph);
+        prepare_transients(p_render_graph);
+
+        struct RenderGraphStats *p_stats = &p_render_graph->stats;
+        p_stats->pass_count = p_render_graph->pass_count;
+        p_stats->culled_pass_count = 0;
+        p_stats->barrier_count = 0;
+
+        for (uint32_t i = 0; i < p_render_graph->pass_count; i++) {
+                const struct RenderGraphPass *p_pass =
+                        &p_render_graph->passes[i];
+                if (p_pass->culled) {
+                        p_stats->culled_pass_count++;
+                        continue;
+                }
+
+                begin_gpu_zone(p_gpu_timer, command_buffer, frame,
+                                p_pass->name);
+                record_pass(p_render_graph, command_buffer, i);
+                end_gpu_zone(p_gpu_timer, command_buffer, frame);
+        }
+
+        record_final_transitions(p_render_graph, command_buffer);
+}
+
+// Logs the memory of the transient images at their current size. Lazily
+// allocated memory is only committed once the driver needs it, so this
+// means the most after some frames have been rendered at that size.
+void report_render_graph_memory(
+                const struct RenderGraph *p_render_graph)
+{
+        const struct RenderGraphStats *p_stats = &p_render_graph->stats;
+        if (p_render_graph->transient_count == 0)
+                return;
+
+        VkDeviceSize committedBytes = 0;
+        for (size_t i = 0; i < p_render_graph->block_count; i++) {
+                if (!p_render_graph->blocks[i].lazy)
+                        continue;
+
+                VkDeviceSize committed = 0;
+                vkGetDeviceMemoryCommitment(p_render_graph->device,
+                                p_render_graph->blocks[i].memory, &committed);
+                committedBytes += committed;
+        }
+
+        VkDeviceSize usedBytes = p_stats->allocated_bytes -
+                p_stats->lazy_bytes + committedBytes;
+        info("Render graph at %ux%u: %u transient images, %.1f MiB on "
+                        "their own, %.1f MiB aliased, %.1f MiB of it lazily "
+                        "allocated with %.1f MiB committed, %.1f MiB saved\n",
+                        p_stats->extent.width, p_stats->extent.height,
+                        p_stats->transient_count,
+                        p_stats->transient_bytes / MIB,
+                        p_stats->allocated_bytes / MIB,
+                        p_stats->lazy_bytes / MIB, committedBytes / MIB,
+                        (p_stats->transient_bytes - usedBytes) / MIB);
+}
+
+// Must only be called while the device is idle. Drops the framebuffers
+// and transient images, which are created again by the next execution.
+// Needed whenever imported image views are destroyed, e.g. along with
+// the swap chain.
+void reset_render_graph(
+                struct RenderGraph *p_render_graph)
+{
+        for (size_t i = 0; i < p_render_graph->framebuffer_count; i++)
+                vkDestroyFramebuffer(p_render_graph->device,
+                                p_render_graph->framebuffers[i].framebuffer,
+                                get_host_allocator());
+        p_render_graph->framebuffer_count = 0;
+
+        destroy_transients(p_render_graph);
+}
+
+void destroy_render_graph(
+                struct RenderGraph *p_render_graph)
+{
+        reset_render_graph(p_render_graph);
+
+        for (size_t i = 0; i < p_render_graph->render_pass_count; i++)
+                vkDestroyRenderPass(p_render_graph->device,
+                                p_render_graph->render_passes[i].render_pass,
+                                get_host_allocator());
+
+        free(p_render_graph->render_passes);
+        free(p_render_graph->framebuffers);
+}
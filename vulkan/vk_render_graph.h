@@ -0,0 +1,269 @@
+#ifndef VK_RENDER_GRAPH_H
+#define VK_RENDER_GRAPH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+#include "vk_gpu_timer.h"
+
+#define RENDER_GRAPH_MAX_PASSES 16
+#define RENDER_GRAPH_MAX_RESOURCES 16
+// Resources a single pass can use
+#define RENDER_GRAPH_MAX_PASS_USES 8
+#define RENDER_GRAPH_MAX_COLOR_ATTACHMENTS 4
+
+// Records the commands of a pass. Passes with attachments are recorded
+// inside the rendering the graph began for them.
+typedef void (*RenderGraphRecordFunction)(VkCommandBuffer command_buffer,
+                void *p_user_data);
+
+enum RenderGraphUsage {
+        // Written by a graphics pass, which is rendered to every
+        // attachment it uses
+        RENDER_GRAPH_COLOR_ATTACHMENT,
+        RENDER_GRAPH_DEPTH_ATTACHMENT,
+        // Read in a fragment shader
+        RENDER_GRAPH_SAMPLED,
+        RENDER_GRAPH_TRANSFER_SRC,
+        RENDER_GRAPH_TRANSFER_DST,
+        // Storage images and buffers of a compute shader
+        RENDER_GRAPH_COMPUTE_READ,
+        RENDER_GRAPH_COMPUTE_WRITE,
+        // Buffers only
+        RENDER_GRAPH_INDIRECT_READ,
+        RENDER_GRAPH_VERTEX_READ
+};
+
+enum RenderGraphResourceType {
+        // Owned by someone else, e.g. the swap chain images
+        RENDER_GRAPH_IMPORTED_IMAGE,
+        RENDER_GRAPH_IMPORTED_BUFFER,
+        // Created by the graph and only valid between the passes that use
+        // it. Its contents are undefined at the start of every frame.
+        RENDER_GRAPH_TRANSIENT_IMAGE
+};
+
+struct RenderGraphUse {
+        uint32_t resource;
+        enum RenderGraphUsage usage;
+        // Attachments only, cleared instead of loaded
+        bool clear;
+        VkClearValue clear_value;
+};
+
+struct RenderGraphPass {
+        const char *name;
+        RenderGraphRecordFunction record;
+        void *p_user_data;
+        // Rendered from the origin of the attachments, unused without any
+        VkExtent2D render_area;
+        struct RenderGraphUse uses[RENDER_GRAPH_MAX_PASS_USES];
+        uint32_t use_count;
+        // Kept even when nothing reads what it writes, e.g. a readback
+        bool side_effects;
+        bool culled;
+};
+
+// How a resource was last used, to find the barrier in front of the next
+// use. Reads since the last write are collected, a write has to wait for
+// all of them.
+struct RenderGraphState {
+        VkImageLayout layout;
+        VkPipelineStageFlags write_stages;
+        VkAccessFlags write_access;
+        VkPipelineStageFlags read_stages;
+        // Reads the last write has already been made visible to
+        VkPipelineStageFlags visible_stages;
+        VkAccessFlags visible_access;
+};
+
+struct RenderGraphResource {
+        enum RenderGraphResourceType type;
+        VkImage image;
+        VkImageView image_view;
+        VkBuffer buffer;
+        VkFormat format;
+        VkImageAspectFlags aspect;
+        VkExtent2D extent;
+        // Imported images are put in this layout after the last pass,
+        // VK_IMAGE_LAYOUT_UNDEFINED to leave them as they are
+        VkImageLayout final_layout;
+        struct RenderGraphState state;
+        // First and last pass that is not culled, UINT32_MAX if none
+        uint32_t first_pass;
+        uint32_t last_pass;
+        VkImageUsageFlags usage;
+        // Index into the transient images of the graph
+        uint32_t transient;
+};
+
+// Transient images are kept between frames for as long as they can stand
+// in for the ones the graph declares, see match_transients()
+struct TransientImage {
+        VkFormat format;
+        VkExtent2D extent;
+        VkImageAspectFlags aspect;
+        VkImageUsageFlags usage;
+        uint32_t first_pass;
+        uint32_t last_pass;
+        VkImage image;
+        VkImageView image_view;
+        VkDeviceSize size;
+        uint32_t block;
+        // Only ever an attachment of a single pass, so its contents never
+        // have to leave the tile memory of a tiled GPU
+        bool lazy;
+};
+
+// Memory shared by transient images whose passes do not overlap
+struct AliasedMemoryBlock {
+        VkDeviceMemory memory;
+        VkDeviceSize size;
+        uint32_t memory_type;
+        // Lazily allocated memory is only committed when a tiled GPU
+        // has to spill an attachment
+        bool lazy;
+        // Every stage and write that has used the images in the block,
+        // which the first use of an image in a frame has to wait for
+        VkPipelineStageFlags stages;
+        VkAccessFlags access;
+};
+
+struct RenderGraphRenderPass {
+        VkFormat color_formats[RENDER_GRAPH_MAX_COLOR_ATTACHMENTS];
+        VkAttachmentLoadOp color_load_ops[RENDER_GRAPH_MAX_COLOR_ATTACHMENTS];
+        VkAttachmentStoreOp color_store_ops[RENDER_GRAPH_MAX_COLOR_ATTACHMENTS];
+        uint32_t color_count;
+        VkFormat depth_format;
+        VkAttachmentLoadOp depth_load_op;
+        VkAttachmentStoreOp depth_store_op;
+        VkRenderPass render_pass;
+};
+
+struct RenderGraphFramebuffer {
+        VkRenderPass render_pass;
+        VkImageView views[RENDER_GRAPH_MAX_COLOR_ATTACHMENTS + 1];
+        uint32_t view_count;
+        VkExtent2D extent;
+        VkFramebuffer framebuffer;
+};
+
+struct RenderGraphStats {
+        uint32_t pass_count;
+        uint32_t culled_pass_count;
+        uint32_t barrier_count;
+        uint32_t transient_count;
+        // Memory the transient images would take on their own, and the
+        // memory they take with aliasing
+        VkDeviceSize transient_bytes;
+        VkDeviceSize allocated_bytes;
+        // Part of allocated_bytes in lazily allocated memory
+        VkDeviceSize lazy_bytes;
+        // Largest transient image, the swap chain extent for now
+        VkExtent2D extent;
+};
+
+// A frame described as passes and the resources they use.
+//
+// The graph is declared again every frame between begin_render_graph()
+// and execute_render_graph(). Passes are recorded in the order they were
+// added. Executing the graph
+//   - culls the passes whose results nothing uses,
+//   - records the barriers and layout transitions between the passes,
+//   - places transient images whose passes do not overlap in the same
+//     memory,
+//   - begins dynamic rendering or a render pass around every pass with
+//     attachments.
+// The render passes the graph creates keep every attachment in the layout
+// its barriers put it in.
+//
+// Imported resources are synchronized with whatever happened before the
+// graph by the caller, e.g. by fences and semaphores.
+struct RenderGraph {
+        VkDevice device;
+        VkPhysicalDevice physical_device;
+        bool dynamic_rendering;
+        // The device has lazily allocated memory for transient attachments
+        bool lazy_memory;
+        struct RenderGraphPass passes[RENDER_GRAPH_MAX_PASSES];
+        uint32_t pass_count;
+        struct RenderGraphResource resources[RENDER_GRAPH_MAX_RESOURCES];
+        uint32_t resource_count;
+        struct TransientImage transients[RENDER_GRAPH_MAX_RESOURCES];
+        uint32_t transient_count;
+        struct AliasedMemoryBlock blocks[RENDER_GRAPH_MAX_RESOURCES];
+        uint32_t block_count;
+        // Without dynamic rendering
+        struct RenderGraphRenderPass *render_passes;
+        uint32_t render_pass_count;
+        uint32_t render_pass_capacity;
+        struct RenderGraphFramebuffer *framebuffers;
+        uint32_t framebuffer_count;
+        uint32_t framebuffer_capacity;
+        struct RenderGraphStats stats;
+};
+
+void create_render_graph(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                bool dynamic_rendering,
+                struct RenderGraph *p_render_graph);
+
+void begin_render_graph(
+                struct RenderGraph *p_render_graph);
+
+uint32_t import_render_graph_image(
+                struct RenderGraph *p_render_graph,
+                VkImage image,
+                VkImageView image_view,
+                VkFormat format,
+                VkExtent2D extent,
+                VkImageLayout initial_layout,
+                VkPipelineStageFlags wait_stage,
+                VkImageLayout final_layout);
+
+uint32_t import_render_graph_buffer(
+                struct RenderGraph *p_render_graph,
+                VkBuffer buffer);
+
+uint32_t add_render_graph_transient(
+                struct RenderGraph *p_render_graph,
+                VkFormat format,
+                VkExtent2D extent);
+
+uint32_t add_render_graph_pass(
+                struct RenderGraph *p_render_graph,
+                const char *name,
+                VkExtent2D render_area,
+                bool side_effects,
+                RenderGraphRecordFunction record,
+                void *p_user_data);
+
+void use_render_graph_resource(
+                struct RenderGraph *p_render_graph,
+                uint32_t pass,
+                uint32_t resource,
+                enum RenderGraphUsage usage);
+
+void clear_render_graph_attachment(
+                struct RenderGraph *p_render_graph,
+                uint32_t pass,
+                uint32_t resource,
+                VkClearValue clear_value);
+
+void execute_render_graph(
+                struct RenderGraph *p_render_graph,
+                VkCommandBuffer command_buffer,
+                struct GpuTimer *p_gpu_timer,
+                uint32_t frame);
+
+void report_render_graph_memory(
+                const struct RenderGraph *p_render_graph);
+
+void reset_render_graph(
+                struct RenderGraph *p_render_graph);
+
+void destroy_render_graph(
+                struct RenderGraph *p_render_graph);
+
+#endif
@@ -5,6 +5,7 @@
 
 VkRenderPass create_render_pass(
                 VkDevice *p_device,
-                VkFormat *p_image_format);
+                VkFormat *p_image_format,
+                VkFormat depth_format);
 
 #endif
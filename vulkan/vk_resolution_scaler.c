@@ -0,0 +1,275 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <vulkan/vulkan_core.h>
+
+#include "../debug/print.h"
+#include "vk_gpu_timer.h"
+#include "vk_host_allocator.h"
+#include "vk_image.h"
+#include "vk_image_view.h"
+#include "vk_memory_budget.h"
+#include "vk_resolution_scaler.h"
+
+// Below this fraction of the budget the scale starts to go back up
+#define SCALE_UP_HEADROOM 0.85
+// How much the scale rises per frame while there is headroom
+#define SCALE_UP_STEP 0.01f
+
+static const VkFormatFeatureFlags REQUIRED_FORMAT_FEATURES =
+        VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT |
+        VK_FORMAT_FEATURE_BLIT_SRC_BIT |
+        VK_FORMAT_FEATURE_BLIT_DST_BIT |
+        VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+
+
+bool supports_resolution_scaling(
+                VkPhysicalDevice physical_device,
+                uint32_t graphics_queue_family,
+                VkFormat format,
+                VkImageUsageFlags swap_chain_usage)
+{
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties(physical_device, format,
+                        &formatProperties);
+
+        return (formatProperties.optimalTilingFeatures &
+                        REQUIRED_FORMAT_FEATURES) == REQUIRED_FORMAT_FEATURES &&
+                (swap_chain_usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT) &&
+                supports_gpu_timing(physical_device, graphics_queue_family);
+}
+
+static void create_scaler_images(
+                struct ResolutionScaler *p_scaler)
+{
+        VkDevice device = p_scaler->device;
+        uint32_t count = p_scaler->frame_count;
+
+        p_scaler->images = malloc(count * sizeof(VkImage));
+        p_scaler->image_memory = malloc(count * sizeof(VkDeviceMemory));
+
+        for (size_t i = 0; i < count; i++) {
+                if (create_image(device, p_scaler->physical_device,
+                                        p_scaler->max_extent, p_scaler->format,
+                                        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                                        VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                                        &p_scaler->images[i],
+                                        &p_scaler->image_memory[i])
+                                != VK_SUCCESS) {
+                        error("Failed to create offscreen color image!");
+                        exit(EXIT_FAILURE);
+                }
+        }
+
+        if (create_image_views(device, p_scaler->images, count,
+                                &p_scaler->format, &p_scaler->image_views)
+                        != VK_SUCCESS) {
+                error("Failed to create offscreen image views!");
+                exit(EXIT_FAILURE);
+        }
+}
+
+static void destroy_scaler_images(
+                struct ResolutionScaler *p_scaler)
+{
+        VkDevice device = p_scaler->device;
+
+        for (size_t i = 0; i < p_scaler->frame_count; i++) {
+                vkDestroyImage(device, p_scaler->images[i],
+                                get_host_allocator());
+                free_device_memory(device, p_scaler->image_memory[i]);
+        }
+        destroy_image_views(&device, p_scaler->image_views,
+                        p_scaler->frame_count);
+
+        free(p_scaler->images);
+        free(p_scaler->image_memory);
+}
+
+void create_resolution_scaler(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                VkFormat format,
+                VkExtent2D extent,
+                uint32_t queue_family_index,
+                uint32_t frame_count,
+                double budget_ms,
+                float min_scale,
+                struct ResolutionScaler *p_scaler)
+{
+        *p_scaler = (struct ResolutionScaler) {};
+        p_scaler->device = device;
+        p_scaler->physical_device = physical_device;
+        p_scaler->format = format;
+        p_scaler->frame_count = frame_count;
+        p_scaler->max_extent = extent;
+        p_scaler->scale = 1.0f;
+        p_scaler->min_scale = min_scale;
+        p_scaler->budget_ms = budget_ms;
+
+        create_scaler_images(p_scaler);
+
+        p_scaler->render_extents = calloc(frame_count, sizeof(VkExtent2D));
+        p_scaler->queries_pending = calloc(frame_count, sizeof(bool));
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physical_device, &properties);
+        p_scaler->timestamp_period = properties.limits.timestampPeriod;
+        p_scaler->timestamp_mask =
+                get_timestamp_mask(physical_device, queue_family_index);
+
+        VkQueryPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        poolInfo.queryCount = frame_count * 2;
+
+        if (vkCreateQueryPool(device, &poolInfo, get_host_allocator(),
+                                &p_scaler->query_pool)
+                        != VK_SUCCESS) {
+                error("Failed to create resolution scaler query pool!");
+                exit(EXIT_FAILURE);
+        }
+}
+
+// Must only be called while the device is idle
+void resize_resolution_scaler(
+                struct ResolutionScaler *p_scaler,
+                VkExtent2D extent)
+{
+        destroy_scaler_images(p_scaler);
+        p_scaler->max_extent = extent;
+        create_scaler_images(p_scaler);
+}
+
+static void update_scale(
+                struct ResolutionScaler *p_scaler,
+                double gpu_time_ms)
+{
+        p_scaler->gpu_time_ms = gpu_time_ms;
+
+        float scale = p_scaler->scale;
+        if (gpu_time_ms > p_scaler->budget_ms) {
+                // The cost is roughly proportional to the pixel count, so
+                // the scale should shrink by the square root of the ratio.
+                // (1 + ratio) / 2 is never below it, and gets there over
+                // a few frames without overshooting.
+                float ratio = (float) (p_scaler->budget_ms / gpu_time_ms);
+                scale *= (1.0f + ratio) / 2.0f;
+        } else if (gpu_time_ms < p_scaler->budget_ms * SCALE_UP_HEADROOM) {
+                scale += SCALE_UP_STEP;
+        }
+
+        if (scale < p_scaler->min_scale)
+                scale = p_scaler->min_scale;
+        if (scale > 1.0f)
+                scale = 1.0f;
+        p_scaler->scale = scale;
+}
+
+static uint32_t scale_dimension(uint32_t size, float scale)
+{
+        uint32_t scaled = (uint32_t) (size * scale + 0.5f);
+        return scaled > 0 ? scaled : 1;
+}
+
+// Reads back the frame that last used this slot, which has finished by
+// the time the slot is recorded again, and picks this frame's render
+// extent. Must be recorded outside of a render pass, the queries of the
+// slot are reset here.
+VkExtent2D begin_resolution_scaler_frame(
+                struct ResolutionScaler *p_scaler,
+                VkCommandBuffer command_buffer,
+                uint32_t frame)
+{
+        if (p_scaler->queries_pending[frame]) {
+                uint64_t timestamps[2];
+                if (vkGetQueryPoolResults(p_scaler->device,
+                                        p_scaler->query_pool, frame * 2, 2,
+                                        sizeof(timestamps), timestamps,
+                                        sizeof(uint64_t),
+                                        VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+                        // Masked again after subtracting in case the
+                        // counter wrapped around in between
+                        uint64_t mask = p_scaler->timestamp_mask;
+                        uint64_t ticks = ((timestamps[1] & mask) -
+                                        (timestamps[0] & mask)) & mask;
+                        update_scale(p_scaler, ticks *
+                                        p_scaler->timestamp_period / 1e6);
+                }
+        }
+
+        VkExtent2D extent = {
+                scale_dimension(p_scaler->max_extent.width, p_scaler->scale),
+                scale_dimension(p_scaler->max_extent.height, p_scaler->scale)
+        };
+        p_scaler->render_extents[frame] = extent;
+
+        vkCmdResetQueryPool(command_buffer, p_scaler->query_pool, frame * 2, 2);
+        p_scaler->queries_pending[frame] = true;
+
+        return extent;
+}
+
+// Recorded at the start of the scene's render pass. The color output
+// stage is held back by the semaphore waits of the submission, so the
+// timestamp is not written before the frame can actually render.
+void begin_resolution_scaler_timing(
+                const struct ResolutionScaler *p_scaler,
+                VkCommandBuffer command_buffer,
+                uint32_t frame)
+{
+        vkCmdWriteTimestamp(command_buffer,
+                        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                        p_scaler->query_pool, frame * 2);
+}
+
+// Recorded at the end of the scene's render pass
+void end_resolution_scaler_timing(
+                const struct ResolutionScaler *p_scaler,
+                VkCommandBuffer command_buffer,
+                uint32_t frame)
+{
+        vkCmdWriteTimestamp(command_buffer,
+                        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        p_scaler->query_pool, frame * 2 + 1);
+}
+
+// Scales the rendered part of the offscreen image up to the whole swap
+// chain image. The render graph has put them in the transfer source and
+// destination layouts.
+void record_resolution_upscale(
+                const struct ResolutionScaler *p_scaler,
+                VkCommandBuffer command_buffer,
+                uint32_t frame,
+                VkImage swap_chain_image,
+                VkExtent2D swap_chain_extent)
+{
+        VkExtent2D renderExtent = p_scaler->render_extents[frame];
+
+        VkImageBlit region = {};
+        region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.srcSubresource.layerCount = 1;
+        region.srcOffsets[1].x = renderExtent.width;
+        region.srcOffsets[1].y = renderExtent.height;
+        region.srcOffsets[1].z = 1;
+        region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.dstSubresource.layerCount = 1;
+        region.dstOffsets[1].x = swap_chain_extent.width;
+        region.dstOffsets[1].y = swap_chain_extent.height;
+        region.dstOffsets[1].z = 1;
+
+        vkCmdBlitImage(command_buffer, p_scaler->images[frame],
+                        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                        swap_chain_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                        1, &region, VK_FILTER_LINEAR);
+}
+
+void destroy_resolution_scaler(
+                struct ResolutionScaler *p_scaler)
+{
+        destroy_scaler_images(p_scaler);
+        vkDestroyQueryPool(p_scaler->device, p_scaler->query_pool,
+                        get_host_allocator());
+        free(p_scaler->render_extents);
+        free(p_scaler->queries_pending);
+}
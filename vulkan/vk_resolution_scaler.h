@@ -0,0 +1,93 @@
+#ifndef VK_RESOLUTION_SCALER_H
+#define VK_RESOLUTION_SCALER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+// Renders into an offscreen color image at a fraction of the swap chain
+// extent and blits the result up to the swap chain image.
+//
+// The GPU time of the scene is measured with a pair of timestamps around
+// its render pass and the scale is adjusted to keep it under a budget.
+// The first one is taken at the color output stage, after the waits for
+// the swap chain image and the particle simulation, so time spent waiting
+// on either does not count. Going over the budget
+// lowers the resolution right away, while spare time only raises it a
+// little per frame, so a heavy scene costs sharpness instead of frames.
+//
+// The offscreen images are allocated at the full swap chain extent and
+// only a corner of them is rendered to, so changing the scale never
+// reallocates anything. They are rendered to by the render graph along
+// with its depth image, which has the same size.
+struct ResolutionScaler {
+        VkDevice device;
+        VkPhysicalDevice physical_device;
+        VkFormat format;
+        uint32_t frame_count;
+        // Size of the offscreen images, the swap chain extent
+        VkExtent2D max_extent;
+        VkImage *images;
+        VkDeviceMemory *image_memory;
+        VkImageView *image_views;
+        // The extent each frame in flight was recorded with
+        VkExtent2D *render_extents;
+        // A begin and end timestamp for every frame in flight
+        VkQueryPool query_pool;
+        bool *queries_pending;
+        double timestamp_period;
+        uint64_t timestamp_mask;
+        float scale;
+        float min_scale;
+        double budget_ms;
+        // Latest measured GPU frame time
+        double gpu_time_ms;
+};
+
+bool supports_resolution_scaling(
+                VkPhysicalDevice physical_device,
+                uint32_t graphics_queue_family,
+                VkFormat format,
+                VkImageUsageFlags swap_chain_usage);
+
+void create_resolution_scaler(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                VkFormat format,
+                VkExtent2D extent,
+                uint32_t queue_family_index,
+                uint32_t frame_count,
+                double budget_ms,
+                float min_scale,
+                struct ResolutionScaler *p_scaler);
+
+void resize_resolution_scaler(
+                struct ResolutionScaler *p_scaler,
+                VkExtent2D extent);
+
+VkExtent2D begin_resolution_scaler_frame(
+                struct ResolutionScaler *p_scaler,
+                VkCommandBuffer command_buffer,
+                uint32_t frame);
+
+void begin_resolution_scaler_timing(
+                const struct ResolutionScaler *p_scaler,
+                VkCommandBuffer command_buffer,
+                uint32_t frame);
+
+void end_resolution_scaler_timing(
+                const struct ResolutionScaler *p_scaler,
+                VkCommandBuffer command_buffer,
+                uint32_t frame);
+
+void record_resolution_upscale(
+                const struct ResolutionScaler *p_scaler,
+                VkCommandBuffer command_buffer,
+                uint32_t frame,
+                VkImage swap_chain_image,
+                VkExtent2D swap_chain_extent);
+
+void destroy_resolution_scaler(
+                struct ResolutionScaler *p_scaler);
+
+#endif
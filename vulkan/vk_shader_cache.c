@@ -0,0 +1,93 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../debug/print.h"
+#include "../debug/trace.h"
+#include "../utils/file.h"
+#include "vk_shader_cache.h"
+
+// Owned by the preload thread until it is joined
+static const char **a_cachedPaths;
+static struct FileBytes **a_cachedFiles;
+static uint32_t cachedCount;
+
+static pthread_mutex_t preloadMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t preloadThread;
+static bool preloadRunning = false;
+
+
+static void *preload_thread_main(void *p_unused)
+{
+        TRACE_THREAD_NAME("Shader preload");
+
+        for (size_t i = 0; i < cachedCount; i++)
+                a_cachedFiles[i] = read_file(a_cachedPaths[i]);
+
+        return NULL;
+}
+
+void preload_shader_files(
+                const char **a_paths,
+                uint32_t path_count)
+{
+        a_cachedPaths = a_paths;
+        a_cachedFiles = calloc(path_count, sizeof(struct FileBytes *));
+        cachedCount = path_count;
+
+        if (pthread_create(&preloadThread, NULL, preload_thread_main, NULL)
+                        != 0) {
+                // Without the thread every file is read on first use
+                warning("Failed to start shader preload thread\n");
+                cachedCount = 0;
+                return;
+        }
+        preloadRunning = true;
+}
+
+static void wait_for_preload()
+{
+        pthread_mutex_lock(&preloadMutex);
+        if (preloadRunning) {
+                pthread_join(preloadThread, NULL);
+                preloadRunning = false;
+        }
+        pthread_mutex_unlock(&preloadMutex);
+}
+
+struct FileBytes *load_shader_file(
+                const char *path)
+{
+        wait_for_preload();
+
+        for (size_t i = 0; i < cachedCount; i++) {
+                struct FileBytes *p_cached = a_cachedFiles[i];
+                if (p_cached == NULL || strcmp(a_cachedPaths[i], path) != 0)
+                        continue;
+
+                // Pipelines free the bytes they are given, so hand out a
+                // copy and keep the cached file for any other users.
+                struct FileBytes *p_copy = malloc(sizeof(struct FileBytes));
+                p_copy->length = p_cached->length;
+                p_copy->bytes = malloc(p_cached->length);
+                memcpy(p_copy->bytes, p_cached->bytes, p_cached->length);
+                return p_copy;
+        }
+
+        return read_file(path);
+}
+
+void release_shader_files(void)
+{
+        wait_for_preload();
+
+        for (size_t i = 0; i < cachedCount; i++) {
+                if (a_cachedFiles[i] != NULL)
+                        free_filebytes(a_cachedFiles[i]);
+        }
+        free(a_cachedFiles);
+        a_cachedFiles = NULL;
+        cachedCount = 0;
+}
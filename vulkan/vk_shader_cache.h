@@ -0,0 +1,23 @@
+#ifndef VK_SHADER_CACHE_H
+#define VK_SHADER_CACHE_H
+
+#include <stdint.h>
+#include "../utils/file.h"
+
+// Reads shader files on a background thread during startup, so the file
+// IO overlaps instance and device creation instead of stalling pipeline
+// creation later on.
+//
+// load_shader_file() waits for the preload to finish and hands out a copy
+// of the cached bytes. Files that were not preloaded are read directly.
+void preload_shader_files(
+                const char **a_paths,
+                uint32_t path_count);
+
+struct FileBytes *load_shader_file(
+                const char *path);
+
+// Frees the cached files once no more pipelines are being created
+void release_shader_files(void);
+
+#endif
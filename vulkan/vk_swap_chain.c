@@ -1,13 +1,15 @@
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <vulkan/vulkan_core.h>
 
 #include "../option.h"
 #include "../debug/print.h"
-#include "vk_frame_buffer.h"
+#include "../debug/trace.h"
 #include "vk_queue_family.h"
 #include "vk_swap_chain.h"
 #include "vk_image_view.h"
+#include "vk_host_allocator.h"
 
 
 struct SwapChainSupportDetails query_swap_chain_support(
@@ -148,6 +150,16 @@ static VkSwapchainCreateInfoKHR create_swap_chain_info(
 
         createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
+        // Lets frames be copied out of the swap chain for capture
+        if (support_details.capabilities.supportedUsageFlags &
+                        VK_IMAGE_USAGE_TRANSFER_SRC_BIT)
+                createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+        // Lets frames rendered offscreen be scaled into the swap chain
+        if (support_details.capabilities.supportedUsageFlags &
+                        VK_IMAGE_USAGE_TRANSFER_DST_BIT)
+                createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
         struct QueueFamilyIndices indices =
                 find_queue_families(physical_device, surface);
 
@@ -181,10 +193,9 @@ void recreate_swap_chain(
                 VkImageView **a_image_views,
                 VkPhysicalDevice physical_device,
                 VkSurfaceKHR surface,
-                struct SwapChainDetails *p_swap_chain_details,
-                VkRenderPass *p_render_pass,
-                VkFramebuffer **a_frame_buffers)
+                struct SwapChainDetails *p_swap_chain_details)
 {
+        TRACE_ZONE("recreate_swap_chain");
         int width = 0, height = 0;
         glfwGetFramebufferSize(p_window, &width, &height);
         while (width == 0 || height == 0) {
@@ -194,9 +205,7 @@ void recreate_swap_chain(
         vkDeviceWaitIdle(device);
 
         cleanup_swap_chain(device, p_swap_chain_details->swap_chain,
-                        *a_frame_buffers, *a_image_views,
-                        p_swap_chain_details->image_count,
-                        p_swap_chain_details->image_count);
+                        *a_image_views, p_swap_chain_details->image_count);
 
         create_swap_chain(p_window, device, physical_device,
                         surface, p_swap_chain_details);
@@ -204,11 +213,25 @@ void recreate_swap_chain(
                         p_swap_chain_details->image_count,
                         &p_swap_chain_details->image_format,
                         a_image_views);
-        create_frame_buffers(device, p_swap_chain_details, *a_image_views,
-                        p_render_pass, a_frame_buffers);
 }
 
 
+// Picks the format create_swap_chain() will use, so that the render pass
+// and pipelines can be created before the swap chain itself.
+VkFormat choose_swap_chain_format(
+                VkPhysicalDevice physical_device,
+                VkSurfaceKHR surface)
+{
+        struct SwapChainSupportDetails supportDetails =
+                query_swap_chain_support(physical_device, surface);
+
+        VkFormat format = choose_surfaceformat(supportDetails.formats,
+                        supportDetails.surface_format_count).format;
+
+        destroySwapChainSupportDetails(&supportDetails);
+        return format;
+}
+
 VkResult create_swap_chain(
                 GLFWwindow *p_window,
                 VkDevice device,
@@ -216,6 +239,7 @@ VkResult create_swap_chain(
                 VkSurfaceKHR surface,
                 struct SwapChainDetails *p_swap_chain_details)
 {
+        TRACE_ZONE("create_swap_chain");
         struct SwapChainSupportDetails supportDetails =
                 query_swap_chain_support(physical_device, surface);
 
@@ -254,7 +278,7 @@ VkResult create_swap_chain(
 
         VkSwapchainKHR p_swap_chain;
         VkResult result = vkCreateSwapchainKHR(device, &createInfo,
-                        NULL, &p_swap_chain);
+                        get_host_allocator(), &p_swap_chain);
         if (result != VK_SUCCESS) {
                 return result;
         }
@@ -274,6 +298,7 @@ VkResult create_swap_chain(
         p_swap_chain_details->image_format = image_format;
         p_swap_chain_details->images = images;
         p_swap_chain_details->image_count = image_count;
+        p_swap_chain_details->image_usage = createInfo.imageUsage;
 
         return VK_SUCCESS;
 }
@@ -281,19 +306,15 @@ VkResult create_swap_chain(
 void cleanup_swap_chain(
                 VkDevice device,
                 VkSwapchainKHR swap_chain,
-                VkFramebuffer *swap_chain_framebuffers,
                 VkImageView *swap_chain_image_views,
-                uint32_t swap_chain_framebuffer_count,
                 uint32_t swap_chain_image_views_count)
 {
-        for (size_t i = 0; i < swap_chain_framebuffer_count; i++) {
-                vkDestroyFramebuffer(device, swap_chain_framebuffers[i], NULL);
-        }
         for (size_t i = 0; i < swap_chain_image_views_count; i++) {
-                vkDestroyImageView(device, swap_chain_image_views[i], NULL);
+                vkDestroyImageView(device, swap_chain_image_views[i],
+                                get_host_allocator());
         }
 
-        vkDestroySwapchainKHR(device, swap_chain, NULL);
+        vkDestroySwapchainKHR(device, swap_chain, get_host_allocator());
 }
 
 // TODO Call somewhere. Destroy on cleanup()?
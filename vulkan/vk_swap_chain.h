@@ -24,6 +24,8 @@ struct SwapChainDetails {
         VkFormat image_format;
         // Handle to the swap chain extent
         VkExtent2D extent;
+        // What the swap chain images can be used for
+        VkImageUsageFlags image_usage;
 };
 
 void recreate_swap_chain(
@@ -32,9 +34,7 @@ void recreate_swap_chain(
                 VkImageView **a_image_views,
                 VkPhysicalDevice physical_device,
                 VkSurfaceKHR surface,
-                struct SwapChainDetails *p_swap_chain_details,
-                VkRenderPass *p_render_pass,
-                VkFramebuffer **a_frame_buffers);
+                struct SwapChainDetails *p_swap_chain_details);
 
 VkResult create_swap_chain(
                 GLFWwindow *p_window,
@@ -43,15 +43,17 @@ VkResult create_swap_chain(
                 VkSurfaceKHR surface,
                 struct SwapChainDetails *p_swap_chain_details);
 
+VkFormat choose_swap_chain_format(
+                VkPhysicalDevice physical_device,
+                VkSurfaceKHR surface);
+
 struct SwapChainSupportDetails query_swap_chain_support(
                 VkPhysicalDevice device, VkSurfaceKHR surface);
 
 void cleanup_swap_chain(
                 VkDevice device,
                 VkSwapchainKHR swap_chain,
-                VkFramebuffer *swap_chain_framebuffers,
                 VkImageView *swap_chain_image_views,
-                uint32_t swap_chain_framebuffer_count,
                 uint32_t swap_chain_image_views_count
                 );
 
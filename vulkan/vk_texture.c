@@ -0,0 +1,454 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+
+#include "../debug/print.h"
+#include "../debug/trace.h"
+#include "../utils/texture_codec.h"
+#include "vk_buffer.h"
+#include "vk_host_allocator.h"
+#include "vk_image.h"
+#include "vk_logical_device.h"
+#include "vk_memory_budget.h"
+#include "vk_texture.h"
+
+// Every format without a native path is decoded to this
+#define FALLBACK_FORMAT VK_FORMAT_R8G8B8A8_UNORM
+#define FALLBACK_TEXEL_BYTES 4
+// BC1 and ETC2 RGB both pack a block of texels into 8 bytes
+#define COMPRESSED_BLOCK_BYTES 8
+
+
+enum TextureCompression {
+        TEXTURE_COMPRESSION_NONE,
+        TEXTURE_COMPRESSION_BC,
+        TEXTURE_COMPRESSION_ETC2
+};
+
+static enum TextureCompression get_texture_compression(VkFormat format)
+{
+        switch (format) {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+                return TEXTURE_COMPRESSION_BC;
+        case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+                return TEXTURE_COMPRESSION_ETC2;
+        default:
+                return TEXTURE_COMPRESSION_NONE;
+        }
+}
+
+// Compressed formats need their device feature enabled on top of the
+// format's own support
+bool is_texture_format_supported(
+                VkPhysicalDevice physical_device,
+                const struct OptionalDeviceFeatures *p_features,
+                VkFormat format)
+{
+        enum TextureCompression compression = get_texture_compression(format);
+        if ((compression == TEXTURE_COMPRESSION_BC &&
+                                !p_features->texture_compression_bc) ||
+                        (compression == TEXTURE_COMPRESSION_ETC2 &&
+                         !p_features->texture_compression_etc2))
+                return false;
+
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(physical_device, format,
+                        &properties);
+        return properties.optimalTilingFeatures &
+                VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+}
+
+static bool supports_mip_generation(
+                VkPhysicalDevice physical_device,
+                VkFormat format)
+{
+        const VkFormatFeatureFlags required = VK_FORMAT_FEATURE_BLIT_SRC_BIT |
+                VK_FORMAT_FEATURE_BLIT_DST_BIT |
+                VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(physical_device, format,
+                        &properties);
+        return (properties.optimalTilingFeatures & required) == required;
+}
+
+static void create_texture_image(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                VkExtent2D extent,
+                VkFormat format,
+                uint32_t mip_levels,
+                VkImageUsageFlags usage,
+                struct Texture *p_texture)
+{
+        p_texture->format = format;
+        p_texture->mip_levels = mip_levels;
+
+        if (create_mipmapped_image(device, physical_device, extent, format,
+                                mip_levels, usage, &p_texture->image,
+                                &p_texture->memory) != VK_SUCCESS ||
+                        create_mipmapped_image_view(device, p_texture->image,
+                                format, VK_IMAGE_ASPECT_COLOR_BIT, mip_levels,
+                                &p_texture->image_view) != VK_SUCCESS) {
+                error("Failed to create texture image!");
+                exit(EXIT_FAILURE);
+        }
+}
+
+static void create_staging_buffer(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                const void *p_data,
+                VkDeviceSize size,
+                VkBuffer *p_buffer,
+                VkDeviceMemory *p_memory)
+{
+        if (create_buffer(device, physical_device, size,
+                                VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                p_buffer, p_memory) != VK_SUCCESS) {
+                error("Failed to create texture staging buffer!");
+                exit(EXIT_FAILURE);
+        }
+
+        void *data;
+        vkMapMemory(device, *p_memory, 0, size, 0, &data);
+        memcpy(data, p_data, size);
+        vkUnmapMemory(device, *p_memory);
+}
+
+static void record_level_copy(
+                VkCommandBuffer command_buffer,
+                VkBuffer buffer,
+                VkDeviceSize offset,
+                const struct Texture *p_texture,
+                VkExtent2D extent,
+                uint32_t level)
+{
+        VkBufferImageCopy region = {};
+        region.bufferOffset = offset;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = level;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent.width = get_mip_extent(extent.width, level);
+        region.imageExtent.height = get_mip_extent(extent.height, level);
+        region.imageExtent.depth = 1;
+
+        vkCmdCopyBufferToImage(command_buffer, buffer, p_texture->image,
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+}
+
+// Copies every stored mip level of compressed data as is
+static void upload_compressed_texture(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                VkCommandPool command_pool,
+                VkQueue queue,
+                const struct TextureSource *p_source,
+                struct Texture *p_texture)
+{
+        create_texture_image(device, physical_device, p_source->extent,
+                        p_source->format, p_source->mip_levels,
+                        VK_IMAGE_USAGE_SAMPLED_BIT |
+                        VK_IMAGE_USAGE_TRANSFER_DST_BIT, p_texture);
+
+        VkDeviceSize levelOffsets[p_source->mip_levels];
+        VkDeviceSize size = 0;
+        for (size_t i = 0; i < p_source->mip_levels; i++) {
+                levelOffsets[i] = size;
+                size += get_compressed_size(
+                                get_mip_extent(p_source->extent.width, i),
+                                get_mip_extent(p_source->extent.height, i),
+                                COMPRESSED_BLOCK_BYTES);
+        }
+        p_texture->size = size;
+
+        VkBuffer stagingBuffer;
+        VkDeviceMemory stagingMemory;
+        create_staging_buffer(device, physical_device, p_source->p_data,
+                        size, &stagingBuffer, &stagingMemory);
+
+        VkCommandBuffer commandBuffer =
+                begin_single_time_commands(device, command_pool);
+        record_mip_layout_transition(commandBuffer, p_texture->image,
+                        0, p_source->mip_levels,
+                        VK_IMAGE_LAYOUT_UNDEFINED,
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_ACCESS_TRANSFER_WRITE_BIT);
+        for (size_t i = 0; i < p_source->mip_levels; i++)
+                record_level_copy(commandBuffer, stagingBuffer,
+                                levelOffsets[i], p_texture,
+                                p_source->extent, i);
+        record_mip_layout_transition(commandBuffer, p_texture->image,
+                        0, p_source->mip_levels,
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_ACCESS_TRANSFER_WRITE_BIT,
+                        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                        VK_ACCESS_SHADER_READ_BIT);
+        end_single_time_commands(device, command_pool, queue, commandBuffer);
+
+        vkDestroyBuffer(device, stagingBuffer, get_host_allocator());
+        free_device_memory(device, stagingMemory);
+}
+
+// Fills every level below the first by blitting the one above it, which
+// the blit filters down linearly. Expects every level in the transfer
+// destination layout and leaves them ready for sampling.
+static void record_mip_generation(
+                VkCommandBuffer command_buffer,
+                const struct Texture *p_texture,
+                VkExtent2D extent)
+{
+        uint32_t mipLevels = p_texture->mip_levels;
+
+        for (uint32_t level = 1; level < mipLevels; level++) {
+                record_mip_layout_transition(command_buffer,
+                                p_texture->image, level - 1, 1,
+                                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                VK_ACCESS_TRANSFER_WRITE_BIT,
+                                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                VK_ACCESS_TRANSFER_READ_BIT);
+
+                VkImageBlit blit = {};
+                blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+                blit.srcSubresource.mipLevel = level - 1;
+                blit.srcSubresource.layerCount = 1;
+                blit.srcOffsets[1].x = get_mip_extent(extent.width, level - 1);
+                blit.srcOffsets[1].y = get_mip_extent(extent.height, level - 1);
+                blit.srcOffsets[1].z = 1;
+                blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+                blit.dstSubresource.mipLevel = level;
+                blit.dstSubresource.layerCount = 1;
+                blit.dstOffsets[1].x = get_mip_extent(extent.width, level);
+                blit.dstOffsets[1].y = get_mip_extent(extent.height, level);
+                blit.dstOffsets[1].z = 1;
+
+                vkCmdBlitImage(command_buffer,
+                                p_texture->image,
+                                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                p_texture->image,
+                                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                1, &blit, VK_FILTER_LINEAR);
+        }
+
+        // Every level but the last was a blit source
+        if (mipLevels > 1)
+                record_mip_layout_transition(command_buffer,
+                                p_texture->image, 0, mipLevels - 1,
+                                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                VK_ACCESS_TRANSFER_READ_BIT,
+                                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                                VK_ACCESS_SHADER_READ_BIT);
+        record_mip_layout_transition(command_buffer, p_texture->image,
+                        mipLevels - 1, 1,
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_ACCESS_TRANSFER_WRITE_BIT,
+                        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                        VK_ACCESS_SHADER_READ_BIT);
+}
+
+// Uploads the first level and generates the rest on the GPU, when the
+// format can be blitted with linear filtering
+static void upload_rgba8_texture(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                VkCommandPool command_pool,
+                VkQueue queue,
+                VkExtent2D extent,
+                const uint8_t *a_texels,
+                struct Texture *p_texture)
+{
+        uint32_t mipLevels = supports_mip_generation(physical_device,
+                        FALLBACK_FORMAT) ?
+                get_mip_level_count(extent.width, extent.height) : 1;
+
+        create_texture_image(device, physical_device, extent,
+                        FALLBACK_FORMAT, mipLevels,
+                        VK_IMAGE_USAGE_SAMPLED_BIT |
+                        VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                        VK_IMAGE_USAGE_TRANSFER_DST_BIT, p_texture);
+
+        p_texture->size = 0;
+        for (size_t i = 0; i < mipLevels; i++)
+                p_texture->size += (VkDeviceSize)
+                        get_mip_extent(extent.width, i) *
+                        get_mip_extent(extent.height, i) *
+                        FALLBACK_TEXEL_BYTES;
+
+        VkBuffer stagingBuffer;
+        VkDeviceMemory stagingMemory;
+        create_staging_buffer(device, physical_device, a_texels,
+                        (VkDeviceSize) extent.width * extent.height *
+                        FALLBACK_TEXEL_BYTES,
+                        &stagingBuffer, &stagingMemory);
+
+        VkCommandBuffer commandBuffer =
+                begin_single_time_commands(device, command_pool);
+        record_mip_layout_transition(commandBuffer, p_texture->image,
+                        0, mipLevels,
+                        VK_IMAGE_LAYOUT_UNDEFINED,
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_ACCESS_TRANSFER_WRITE_BIT);
+        record_level_copy(commandBuffer, stagingBuffer, 0, p_texture,
+                        extent, 0);
+        record_mip_generation(commandBuffer, p_texture, extent);
+        end_single_time_commands(device, command_pool, queue, commandBuffer);
+
+        vkDestroyBuffer(device, stagingBuffer, get_host_allocator());
+        free_device_memory(device, stagingMemory);
+}
+
+// Creates a sampled texture from the source. Compressed data is uploaded
+// as is when the device can sample it, otherwise its first level is
+// decoded to RGBA8 on the CPU. The queue has to support graphics for the
+// mip generation blits.
+void create_texture(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                VkCommandPool command_pool,
+                VkQueue queue,
+                const struct OptionalDeviceFeatures *p_features,
+                const struct TextureSource *p_source,
+                struct Texture *p_texture)
+{
+        TRACE_ZONE("create_texture");
+        *p_texture = (struct Texture) {};
+
+        enum TextureCompression compression =
+                get_texture_compression(p_source->format);
+        if (compression == TEXTURE_COMPRESSION_NONE &&
+                        p_source->format != FALLBACK_FORMAT) {
+                error("Unsupported texture format %d!", p_source->format);
+                exit(EXIT_FAILURE);
+        }
+
+        if (compression != TEXTURE_COMPRESSION_NONE &&
+                        is_texture_format_supported(physical_device,
+                                p_features, p_source->format)) {
+                upload_compressed_texture(device, physical_device,
+                                command_pool, queue, p_source, p_texture);
+                return;
+        }
+
+        if (compression == TEXTURE_COMPRESSION_NONE) {
+                upload_rgba8_texture(device, physical_device, command_pool,
+                                queue, p_source->extent, p_source->p_data,
+                                p_texture);
+                return;
+        }
+
+        VkExtent2D extent = p_source->extent;
+        uint8_t *texels = malloc((size_t) extent.width * extent.height *
+                        FALLBACK_TEXEL_BYTES);
+        if (compression == TEXTURE_COMPRESSION_BC)
+                decode_bc1(p_source->p_data, extent.width, extent.height,
+                                texels);
+        else
+                decode_etc2_rgb(p_source->p_data, extent.width, extent.height,
+                                texels);
+
+        upload_rgba8_texture(device, physical_device, command_pool, queue,
+                        extent, texels, p_texture);
+        free(texels);
+}
+
+void destroy_texture(
+                VkDevice device,
+                struct Texture *p_texture)
+{
+        vkDestroyImageView(device, p_texture->image_view, get_host_allocator());
+        vkDestroyImage(device, p_texture->image, get_host_allocator());
+        free_device_memory(device, p_texture->memory);
+}
+
+// The set layout is needed for the graphics pipeline, which may be
+// created before any texture exists.
+void create_texture_descriptors(
+                VkDevice device,
+                struct TextureDescriptors *p_descriptors)
+{
+        VkSamplerCreateInfo samplerInfo = {};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_LINEAR;
+        samplerInfo.minFilter = VK_FILTER_LINEAR;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.minLod = 0.0f;
+        samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+        if (vkCreateSampler(device, &samplerInfo, get_host_allocator(),
+                                &p_descriptors->sampler) != VK_SUCCESS) {
+                error("Failed to create texture sampler!");
+                exit(EXIT_FAILURE);
+        }
+
+        VkDescriptorSetLayoutBinding binding = {};
+        binding.binding = 0;
+        binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        binding.descriptorCount = 1;
+        binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = 1;
+        layoutInfo.pBindings = &binding;
+
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo,
+                                get_host_allocator(),
+                                &p_descriptors->set_layout) != VK_SUCCESS) {
+                error("Failed to create texture descriptor set layout!");
+                exit(EXIT_FAILURE);
+        }
+}
+
+// Points the set at the texture. The set must not be in use by the GPU.
+void write_texture_descriptor(
+                VkDevice device,
+                const struct TextureDescriptors *p_descriptors,
+                VkDescriptorSet set,
+                const struct Texture *p_texture)
+{
+        VkDescriptorImageInfo imageInfo = {};
+        imageInfo.sampler = p_descriptors->sampler;
+        imageInfo.imageView = p_texture->image_view;
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        VkWriteDescriptorSet write = {};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = set;
+        write.dstBinding = 0;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write.descriptorCount = 1;
+        write.pImageInfo = &imageInfo;
+
+        vkUpdateDescriptorSets(device, 1, &write, 0, NULL);
+}
+
+void destroy_texture_descriptors(
+                VkDevice device,
+                struct TextureDescriptors *p_descriptors)
+{
+        vkDestroyDescriptorSetLayout(device, p_descriptors->set_layout,
+                        get_host_allocator());
+        vkDestroySampler(device, p_descriptors->sampler, get_host_allocator());
+}
@@ -0,0 +1,72 @@
+#ifndef VK_TEXTURE_H
+#define VK_TEXTURE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+#include "vk_logical_device.h"
+
+// Texel data the way it is stored. Block compressed data holds every mip
+// level, largest first and tightly packed, since compressed images cannot
+// be blitted. RGBA8 data only holds the first level, the others are
+// generated on the GPU.
+struct TextureSource {
+        VkFormat format;
+        VkExtent2D extent;
+        uint32_t mip_levels;
+        const uint8_t *p_data;
+};
+
+// A sampled image with its whole mip chain
+struct Texture {
+        VkImage image;
+        VkDeviceMemory memory;
+        VkImageView image_view;
+        VkFormat format;
+        uint32_t mip_levels;
+        // Bytes of texel data, for comparing formats
+        VkDeviceSize size;
+};
+
+// The sampler shared by every texture and the layout of a set that binds
+// one texture to the fragment shader through a combined image sampler at
+// binding 0. The sets themselves are allocated per frame.
+struct TextureDescriptors {
+        VkSampler sampler;
+        VkDescriptorSetLayout set_layout;
+};
+
+bool is_texture_format_supported(
+                VkPhysicalDevice physical_device,
+                const struct OptionalDeviceFeatures *p_features,
+                VkFormat format);
+
+void create_texture(
+                VkDevice device,
+                VkPhysicalDevice physical_device,
+                VkCommandPool command_pool,
+                VkQueue queue,
+                const struct OptionalDeviceFeatures *p_features,
+                const struct TextureSource *p_source,
+                struct Texture *p_texture);
+
+void destroy_texture(
+                VkDevice device,
+                struct Texture *p_texture);
+
+void create_texture_descriptors(
+                VkDevice device,
+                struct TextureDescriptors *p_descriptors);
+
+void write_texture_descriptor(
+                VkDevice device,
+                const struct TextureDescriptors *p_descriptors,
+                VkDescriptorSet set,
+                const struct Texture *p_texture);
+
+void destroy_texture_descriptors(
+                VkDevice device,
+                struct TextureDescriptors *p_descriptors);
+
+#endif
@@ -1,35 +1,208 @@
 #include <vulkan/vulkan_core.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "../debug/print.h"
 #include "vk_vertex_data.h"
 
 
-VkVertexInputBindingDescription get_binding_description() 
+static VkFormat position_vk_format(enum VertexPositionFormat format)
+{
+    switch (format) {
+    case VERTEX_POSITION_FLOAT16:
+        return VK_FORMAT_R16G16_SFLOAT;
+    case VERTEX_POSITION_SNORM16:
+        return VK_FORMAT_R16G16_SNORM;
+    default:
+        return VK_FORMAT_R32G32_SFLOAT;
+    }
+}
+
+static uint32_t position_size(enum VertexPositionFormat format)
+{
+    return format == VERTEX_POSITION_FLOAT32 ?
+        sizeof(vec2) : 2 * sizeof(uint16_t);
+}
+
+static VkFormat color_vk_format(enum VertexColorFormat format)
+{
+    return format == VERTEX_COLOR_UNORM8 ?
+        VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_R32G32B32_SFLOAT;
+}
+
+static uint32_t color_size(enum VertexColorFormat format)
+{
+    return format == VERTEX_COLOR_UNORM8 ?
+        4 * sizeof(uint8_t) : sizeof(vec3);
+}
+
+struct VertexLayout create_vertex_layout(
+                enum VertexPositionFormat position_format,
+                enum VertexColorFormat color_format)
+{
+    struct VertexLayout layout = {};
+    layout.position_format = position_format;
+    layout.color_format = color_format;
+    layout.color_offset = position_size(position_format);
+    layout.stride = layout.color_offset + color_size(color_format);
+    return layout;
+}
+
+// Round to nearest even, with overflow to infinity and gradual underflow
+static uint16_t float_to_half(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint16_t sign = (bits >> 16) & 0x8000;
+    uint32_t float_exponent = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    if (float_exponent == 0xff)
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+
+    int32_t exponent = (int32_t) float_exponent - 127 + 15;
+    if (exponent >= 31)
+        return sign | 0x7c00;
+
+    uint32_t shift = 13;
+    if (exponent <= 0) {
+        if (exponent < -10)
+            return sign;
+        // Subnormal, shift the implicit leading one into the mantissa
+        mantissa |= 0x800000;
+        shift = 14 - exponent;
+        exponent = 0;
+    }
+
+    uint32_t half = ((uint32_t) exponent << 10) | (mantissa >> shift);
+    uint32_t remainder = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    // A carry out of the mantissa correctly bumps the exponent
+    if (remainder > halfway || (remainder == halfway && (half & 1)))
+        half++;
+
+    return sign | (uint16_t) half;
+}
+
+static int16_t float_to_snorm16(float value)
+{
+    if (value < -1.0f || value > 1.0f) {
+        error("Vertex position outside of the snorm16 range!");
+        exit(EXIT_FAILURE);
+    }
+    float scaled = value * 32767.0f;
+    return (int16_t) (scaled + (scaled < 0.0f ? -0.5f : 0.5f));
+}
+
+static uint8_t float_to_unorm8(float value)
+{
+    if (value < 0.0f)
+        value = 0.0f;
+    if (value > 1.0f)
+        value = 1.0f;
+    return (uint8_t) (value * 255.0f + 0.5f);
+}
+
+// Converts authored vertices into the layout read by the GPU. p_dst must
+// hold vertex_count * p_layout->stride bytes.
+void quantize_vertices(
+                const struct VertexLayout *p_layout,
+                const Vertex *a_vertices,
+                uint32_t vertex_count,
+                void *p_dst)
+{
+    uint8_t *dst = p_dst;
+    for (size_t i = 0; i < vertex_count; i++, dst += p_layout->stride) {
+        const Vertex *p_vertex = &a_vertices[i];
+
+        switch (p_layout->position_format) {
+        case VERTEX_POSITION_FLOAT32:
+            memcpy(dst, p_vertex->pos, sizeof(vec2));
+            break;
+        case VERTEX_POSITION_FLOAT16: {
+            uint16_t position[2] = {
+                float_to_half(p_vertex->pos[0]),
+                float_to_half(p_vertex->pos[1])
+            };
+            memcpy(dst, position, sizeof(position));
+            break;
+        }
+        case VERTEX_POSITION_SNORM16: {
+            int16_t position[2] = {
+                float_to_snorm16(p_vertex->pos[0]),
+                float_to_snorm16(p_vertex->pos[1])
+            };
+            memcpy(dst, position, sizeof(position));
+            break;
+        }
+        }
+
+        uint8_t *color = dst + p_layout->color_offset;
+        if (p_layout->color_format == VERTEX_COLOR_UNORM8) {
+            color[0] = float_to_unorm8(p_vertex->color[0]);
+            color[1] = float_to_unorm8(p_vertex->color[1]);
+            color[2] = float_to_unorm8(p_vertex->color[2]);
+            color[3] = UINT8_MAX;
+        } else {
+            memcpy(color, p_vertex->color, sizeof(vec3));
+        }
+    }
+}
+
+VkVertexInputBindingDescription get_binding_description(
+                const struct VertexLayout *p_layout)
 {
     VkVertexInputBindingDescription binding_description = {};
     binding_description.binding = 0;
-    binding_description.stride = sizeof(Vertex);
+    binding_description.stride = p_layout->stride;
     binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX; // Could be VK_VERTEX_INPUT_RATE_INSTANCE
     return binding_description;
 }
 
-struct VertexAttributeDescriptionArray get_attribute_description() 
+VkVertexInputBindingDescription get_instance_binding_description() 
+{
+    VkVertexInputBindingDescription binding_description = {};
+    binding_description.binding = 1;
+    binding_description.stride = sizeof(Instance);
+    binding_description.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+    return binding_description;
+}
+
+struct VertexAttributeDescriptionArray get_attribute_description(
+                const struct VertexLayout *p_layout)
 {
     struct VertexAttributeDescriptionArray attribute_descriptions = {
-        .size = 2,
-        .data = malloc(sizeof(VkVertexInputAttributeDescription) * 2)};
+        .size = 4,
+        .data = malloc(sizeof(VkVertexInputAttributeDescription) * 4)};
 
     // Position attribute
     attribute_descriptions.data[0].binding = 0;
     attribute_descriptions.data[0].location = 0;
-    attribute_descriptions.data[0].format = VK_FORMAT_R32G32_SFLOAT;
-    attribute_descriptions.data[0].offset = offsetof(Vertex, pos);
+    attribute_descriptions.data[0].format =
+        position_vk_format(p_layout->position_format);
+    attribute_descriptions.data[0].offset = 0;
 
     // Color attribute
     attribute_descriptions.data[1].binding = 0;
     attribute_descriptions.data[1].location = 1;
-    attribute_descriptions.data[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-    attribute_descriptions.data[1].offset = offsetof(Vertex, color);
+    attribute_descriptions.data[1].format =
+        color_vk_format(p_layout->color_format);
+    attribute_descriptions.data[1].offset = p_layout->color_offset;
+
+    // Instance attribute, center, radius and scale as one vec4
+    attribute_descriptions.data[2].binding = 1;
+    attribute_descriptions.data[2].location = 2;
+    attribute_descriptions.data[2].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+    attribute_descriptions.data[2].offset = offsetof(Instance, center);
+
+    // Instance depth
+    attribute_descriptions.data[3].binding = 1;
+    attribute_descriptions.data[3].location = 3;
+    attribute_descriptions.data[3].format = VK_FORMAT_R32_SFLOAT;
+    attribute_descriptions.data[3].offset = offsetof(Instance, depth);
 
     return attribute_descriptions;
 }
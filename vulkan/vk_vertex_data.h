@@ -1,21 +1,77 @@
 #ifndef VK_VERTEX_DATA_H
 #define VK_VERTEX_DATA_H
 
+#include <stdint.h>
 #include <vulkan/vulkan_core.h>
 #include <cglm/cglm.h>
 
+// Source vertex as authored. It is quantized into a VertexLayout when
+// the mesh is loaded, so this is never the format the GPU reads.
 typedef struct s_vertex {
     vec2 pos;
     vec3 color;
 } Vertex;
 
+enum VertexPositionFormat {
+    // R32G32_SFLOAT, 8 bytes
+    VERTEX_POSITION_FLOAT32,
+    // R16G16_SFLOAT, 4 bytes
+    VERTEX_POSITION_FLOAT16,
+    // R16G16_SNORM, 4 bytes. Positions must lie within [-1, 1].
+    VERTEX_POSITION_SNORM16
+};
+
+enum VertexColorFormat {
+    // R32G32B32_SFLOAT, 12 bytes
+    VERTEX_COLOR_FLOAT32,
+    // R8G8B8A8_UNORM, 4 bytes. Alpha is unused.
+    VERTEX_COLOR_UNORM8
+};
+
+// Layout of the per-vertex binding. Every format is expanded to floats by
+// the vertex fetch, so the same vertex shader reads all of them.
+struct VertexLayout {
+    enum VertexPositionFormat position_format;
+    enum VertexColorFormat color_format;
+    uint32_t color_offset;
+    uint32_t stride;
+};
+
+// Per-object data. It is fed to the vertex shader as an instance rate
+// attribute and doubles as the bounding circle used for culling.
+// Matches the std430 layout of the Instance struct in cull_shader.comp
+typedef struct s_instance {
+    vec2 center;
+    float radius;
+    float scale;
+    // 0 is nearest, 1 is farthest
+    float depth;
+    // Index into the mesh registry. Also pads the struct to the
+    // 8 byte alignment of vec2 in std430.
+    uint32_t mesh;
+} Instance;
+
 struct VertexAttributeDescriptionArray {
     VkVertexInputAttributeDescription *data;
     uint32_t size;
 };
 
-VkVertexInputBindingDescription get_binding_description();
+struct VertexLayout create_vertex_layout(
+                enum VertexPositionFormat position_format,
+                enum VertexColorFormat color_format);
+
+void quantize_vertices(
+                const struct VertexLayout *p_layout,
+                const Vertex *a_vertices,
+                uint32_t vertex_count,
+                void *p_dst);
+
+VkVertexInputBindingDescription get_binding_description(
+                const struct VertexLayout *p_layout);
+
+VkVertexInputBindingDescription get_instance_binding_description();
 
-struct VertexAttributeDescriptionArray get_attribute_description();
+struct VertexAttributeDescriptionArray get_attribute_description(
+                const struct VertexLayout *p_layout);
 
-#endif
\ No newline at end of file
+#endif